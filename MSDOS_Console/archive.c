@@ -0,0 +1,668 @@
+// archive.c - Browse zip and tar archives as directories without extracting (Windows, C)
+//
+// Zip: only the end-of-central-directory records are read with ReadFile and the central
+// directory itself is walked through a mapped view, so listing cost depends on the number
+// of members, not the archive size. Tar: headers are walked once sequentially through a
+// large buffer, skipping member data. Members are extracted one at a time on demand.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+
+#define ARC_IO_BUF (1024 * 1024)
+
+static WORD rd16(const BYTE *p) { return (WORD)(p[0] | (p[1] << 8)); }
+static DWORD rd32(const BYTE *p) { return (DWORD)p[0] | ((DWORD)p[1] << 8) | ((DWORD)p[2] << 16) | ((DWORD)p[3] << 24); }
+static unsigned long long rd64(const BYTE *p) { return (unsigned long long)rd32(p) | ((unsigned long long)rd32(p + 4) << 32); }
+
+static BOOL read_at(HANDLE h, unsigned long long off, void *buf, DWORD len) {
+    LARGE_INTEGER li; li.QuadPart = (LONGLONG)off;
+    if (!SetFilePointerEx(h, li, NULL, FILE_BEGIN)) return FALSE;
+    DWORD got = 0;
+    return ReadFile(h, buf, len, &got, NULL) && got == len;
+}
+
+int archive_is_archive_name(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot) return 0;
+    return _stricmp(dot, ".zip") == 0 || _stricmp(dot, ".jar") == 0 || _stricmp(dot, ".tar") == 0;
+}
+
+/* ---- index building ---- */
+
+static ArcEntry *add_entry(Archive *a, int *cap) {
+    if (a->count >= *cap) {
+        int ncap = *cap ? *cap * 2 : 256;
+        ArcEntry *n = (ArcEntry*)realloc(a->entries, sizeof(ArcEntry) * ncap);
+        if (!n) return NULL;
+        a->entries = n; *cap = ncap;
+    }
+    ArcEntry *e = &a->entries[a->count++];
+    ZeroMemory(e, sizeof(*e));
+    return e;
+}
+
+/* Normalizes a member name into the pool: backslashes become '/', leading "./" and "/"
+   are dropped and a trailing '/' marks a directory. Returns FALSE for empty names. */
+static BOOL pool_name(Archive *a, ArcEntry *e, const char *name, size_t len) {
+    while (len > 0 && (name[0] == '/' || name[0] == '\\')) { name++; len--; }
+    while (len >= 2 && name[0] == '.' && (name[1] == '/' || name[1] == '\\')) { name += 2; len -= 2; }
+    if (len > 0 && (name[len-1] == '/' || name[len-1] == '\\')) { e->is_dir = TRUE; len--; }
+    if (len == 0) return FALSE;
+    if (a->names_len + len + 1 > a->names_cap) {
+        if (len + 1 > (size_t)-1 / 4 - a->names_len) return FALSE;
+        size_t ncap = a->names_cap ? a->names_cap * 2 : 64 * 1024;
+        while (ncap < a->names_len + len + 1) ncap *= 2;
+        char *n = (char*)realloc(a->names, ncap);
+        if (!n) return FALSE;
+        a->names = n; a->names_cap = ncap;
+    }
+    char *dst = a->names + a->names_len;
+    for (size_t i = 0; i < len; ++i) dst[i] = (name[i] == '\\') ? '/' : name[i];
+    dst[len] = 0;
+    e->name_off = a->names_len;
+    a->names_len += len + 1;
+    return TRUE;
+}
+
+static int cmp_entry(const void *pa, const void *pb) {
+    const ArcEntry *x = (const ArcEntry*)pa, *y = (const ArcEntry*)pb;
+    int c = strcmp(x->path, y->path);
+    if (c) return c;
+    /* later members win when a path repeats (tar appends) */
+    return (x->offset < y->offset) ? -1 : (x->offset > y->offset);
+}
+
+static void finish_index(Archive *a) {
+    for (int i = 0; i < a->count; ++i) a->entries[i].path = a->names + a->entries[i].name_off;
+    qsort(a->entries, a->count, sizeof(ArcEntry), cmp_entry);
+    int out = 0;
+    for (int i = 0; i < a->count; ++i) {
+        if (i + 1 < a->count && strcmp(a->entries[i].path, a->entries[i+1].path) == 0) continue;
+        a->entries[out++] = a->entries[i];
+    }
+    a->count = out;
+}
+
+static void unix_to_filetime(long long t, FILETIME *ft) {
+    unsigned long long v = (unsigned long long)(t + 11644473600LL) * 10000000ULL;
+    ft->dwLowDateTime = (DWORD)v;
+    ft->dwHighDateTime = (DWORD)(v >> 32);
+}
+
+/* ---- zip ---- */
+
+static BOOL zip_index(Archive *a, HANDLE h, unsigned long long fsize) {
+    /* end of central directory: 22 bytes plus up to 64K of comment */
+    DWORD tail = (DWORD)((fsize < 22 + 65535) ? fsize : 22 + 65535);
+    if (tail < 22) return FALSE;
+    BYTE *tbuf = (BYTE*)malloc(tail);
+    if (!tbuf) return FALSE;
+    if (!read_at(h, fsize - tail, tbuf, tail)) { free(tbuf); return FALSE; }
+    long eocd = -1;
+    for (long i = (long)tail - 22; i >= 0; --i) {
+        if (rd32(tbuf + i) == 0x06054b50) { eocd = i; break; }
+    }
+    if (eocd < 0) { free(tbuf); return FALSE; }
+    unsigned long long total = rd16(tbuf + eocd + 10);
+    unsigned long long cd_size = rd32(tbuf + eocd + 12);
+    unsigned long long cd_off = rd32(tbuf + eocd + 16);
+    unsigned long long eocd_pos = fsize - tail + eocd;
+    free(tbuf);
+
+    if (total == 0xFFFF || cd_size == 0xFFFFFFFF || cd_off == 0xFFFFFFFF) {
+        BYTE loc[20], rec[56];
+        if (eocd_pos < 20 || !read_at(h, eocd_pos - 20, loc, 20) || rd32(loc) != 0x07064b50) return FALSE;
+        if (!read_at(h, rd64(loc + 8), rec, 56) || rd32(rec) != 0x06064b50) return FALSE;
+        total = rd64(rec + 32);
+        cd_size = rd64(rec + 40);
+        cd_off = rd64(rec + 48);
+    }
+    if (cd_off + cd_size > fsize) return FALSE;
+    if (cd_size == 0) return TRUE;
+
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    unsigned long long view_off = cd_off - (cd_off % si.dwAllocationGranularity);
+    SIZE_T delta = (SIZE_T)(cd_off - view_off);
+    HANDLE map = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!map) return FALSE;
+    const BYTE *view = (const BYTE*)MapViewOfFile(map, FILE_MAP_READ, (DWORD)(view_off >> 32), (DWORD)view_off, delta + (SIZE_T)cd_size);
+    if (!view) { CloseHandle(map); return FALSE; }
+
+    int cap = 0;
+    if (total > 0 && total < 0x7FFFFFFF) {
+        a->entries = (ArcEntry*)malloc(sizeof(ArcEntry) * (size_t)total);
+        if (a->entries) cap = (int)total;
+    }
+    /* names never exceed the central directory size */
+    a->names = (char*)malloc((size_t)cd_size + 1);
+    a->names_cap = a->names ? (size_t)cd_size + 1 : 0;
+
+    const BYTE *p = view + delta, *end = p + cd_size;
+    BOOL ok = TRUE;
+    while (p + 46 <= end && rd32(p) == 0x02014b50) {
+        WORD flags = rd16(p + 8), method = rd16(p + 10);
+        WORD dtime = rd16(p + 12), ddate = rd16(p + 14);
+        WORD nlen = rd16(p + 28), xlen = rd16(p + 30), clen = rd16(p + 32);
+        if (p + 46 + nlen + xlen + clen > end) break;
+        ArcEntry *e = add_entry(a, &cap);
+        if (!e) { ok = FALSE; break; }
+        e->method = method;
+        e->crc = rd32(p + 16);
+        e->csize = rd32(p + 20);
+        e->size = rd32(p + 24);
+        e->offset = rd32(p + 42);
+        if (flags & 1) e->method = 0xFFFF; /* encrypted: listed but not extractable */
+        FILETIME lft;
+        if (DosDateTimeToFileTime(ddate, dtime, &lft)) LocalFileTimeToFileTime(&lft, &e->mtime);
+        /* extra fields: zip64 sizes/offset and the UTC extended timestamp */
+        const BYTE *x = p + 46 + nlen, *xend = x + xlen;
+        while (x + 4 <= xend) {
+            WORD id = rd16(x), sz = rd16(x + 2);
+            const BYTE *d = x + 4, *dend = d + sz;
+            if (dend > xend) break;
+            if (id == 0x0001) {
+                if (e->size == 0xFFFFFFFF && d + 8 <= dend) { e->size = rd64(d); d += 8; }
+                if (e->csize == 0xFFFFFFFF && d + 8 <= dend) { e->csize = rd64(d); d += 8; }
+                if (e->offset == 0xFFFFFFFF && d + 8 <= dend) { e->offset = rd64(d); d += 8; }
+            } else if (id == 0x5455 && sz >= 5 && (d[0] & 1)) {
+                unix_to_filetime((long long)(int)rd32(d + 1), &e->mtime);
+            }
+            x = dend;
+        }
+        if (!pool_name(a, e, (const char*)(p + 46), nlen)) a->count--;
+        p += 46 + nlen + xlen + clen;
+    }
+
+    UnmapViewOfFile(view);
+    CloseHandle(map);
+    return ok;
+}
+
+/* ---- tar ---- */
+
+typedef struct {
+    HANDLE h;
+    BYTE *buf;
+    DWORD pos, len;
+    unsigned long long file_pos; /* file offset of buf[0] */
+} TarScan;
+
+/* Returns a pointer to the next 512-byte block or NULL at end of file. */
+static const BYTE *tar_block(TarScan *s) {
+    if (s->len - s->pos < 512) {
+        DWORD keep = s->len - s->pos;
+        memmove(s->buf, s->buf + s->pos, keep);
+        s->file_pos += s->pos;
+        s->pos = 0; s->len = keep;
+        DWORD got = 0;
+        if (!ReadFile(s->h, s->buf + keep, ARC_IO_BUF - keep, &got, NULL)) got = 0;
+        s->len += got;
+        if (s->len < 512) return NULL;
+    }
+    const BYTE *b = s->buf + s->pos;
+    s->pos += 512;
+    return b;
+}
+
+/* Skips member data: inside the buffer we just advance, beyond it we seek. */
+static BOOL tar_skip(TarScan *s, unsigned long long n) {
+    if (n <= (unsigned long long)(s->len - s->pos)) { s->pos += (DWORD)n; return TRUE; }
+    unsigned long long target = s->file_pos + s->pos + n;
+    LARGE_INTEGER li; li.QuadPart = (LONGLONG)target;
+    if (!SetFilePointerEx(s->h, li, NULL, FILE_BEGIN)) return FALSE;
+    s->file_pos = target; s->pos = 0; s->len = 0;
+    return TRUE;
+}
+
+static unsigned long long tar_num(const BYTE *p, int len) {
+    unsigned long long v = 0;
+    if (p[0] & 0x80) { /* GNU base-256 */
+        v = p[0] & 0x7F;
+        for (int i = 1; i < len; ++i) v = (v << 8) | p[i];
+        return v;
+    }
+    int i = 0;
+    while (i < len && (p[i] == ' ' || p[i] == 0)) i++;
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; ++i) v = (v << 3) | (unsigned long long)(p[i] - '0');
+    return v;
+}
+
+static BOOL tar_checksum_ok(const BYTE *b) {
+    unsigned long sum = 0;
+    for (int i = 0; i < 512; ++i) sum += (i >= 148 && i < 156) ? ' ' : b[i];
+    return sum == (unsigned long)tar_num(b + 148, 8);
+}
+
+/* Reads the data of a GNU long-name or pax header member (bounded). */
+static char *tar_read_small(TarScan *s, unsigned long long size) {
+    if (size > 1024 * 1024) return NULL;
+    char *out = (char*)malloc((size_t)size + 1);
+    if (!out) return NULL;
+    size_t done = 0;
+    while (done < size) {
+        const BYTE *b = tar_block(s);
+        if (!b) { free(out); return NULL; }
+        size_t n = (size - done < 512) ? (size_t)(size - done) : 512;
+        memcpy(out + done, b, n);
+        done += n;
+    }
+    out[size] = 0;
+    return out;
+}
+
+/* Looks key up in the "<length> key=value\n" records of a pax header. A record whose
+   length runs past the data, or is too short to hold its key and value, ends the scan. */
+static const char *pax_find(const char *pax, const char *key, size_t *vlen) {
+    size_t klen = strlen(key);
+    const char *p = pax, *end = pax + strlen(pax);
+    while (p < end) {
+        long rec = strtol(p, NULL, 10);
+        if (rec <= 0 || rec > end - p) break;
+        const char *rend = p + rec;
+        const char *sp = (const char*)memchr(p, ' ', (size_t)rec);
+        if (!sp) break;
+        const char *kv = sp + 1;
+        if (rend <= kv) break;
+        if (strncmp(kv, key, klen) == 0 && kv[klen] == '=') {
+            if (rend <= kv + klen + 1) break;
+            *vlen = (size_t)(rend - (kv + klen + 1) - 1); /* drop trailing newline */
+            return kv + klen + 1;
+        }
+        p = rend;
+    }
+    return NULL;
+}
+
+static BOOL tar_index(Archive *a, HANDLE h) {
+    TarScan s = { h, (BYTE*)malloc(ARC_IO_BUF), 0, 0, 0 };
+    if (!s.buf) return FALSE;
+    int cap = 0;
+    char *long_name = NULL, *pax = NULL;
+    BOOL first = TRUE, ok = TRUE;
+    const BYTE *b;
+    while ((b = tar_block(&s)) != NULL) {
+        if (b[0] == 0) break; /* end-of-archive marker */
+        if (!tar_checksum_ok(b)) { ok = !first; break; }
+        first = FALSE;
+        unsigned long long size = tar_num(b + 124, 12);
+        char type = (char)b[156];
+        if (type == 'L' || type == 'x') {
+            char *data = tar_read_small(&s, size);
+            if (!data) { ok = FALSE; break; }
+            if (type == 'L') { free(long_name); long_name = data; }
+            else { free(pax); pax = data; }
+            continue;
+        }
+        unsigned long long data_off = s.file_pos + s.pos;
+        if (type == '0' || type == 0 || type == '7' || type == '5' || type == '1' || type == '2') {
+            ArcEntry *e = add_entry(a, &cap);
+            if (!e) { ok = FALSE; break; }
+            long long mt = (long long)tar_num(b + 136, 12);
+            const char *name; size_t nlen;
+            char hdr_name[256 + 2];
+            size_t vlen;
+            const char *v;
+            if (pax && (v = pax_find(pax, "path", &vlen)) != NULL) { name = v; nlen = vlen; }
+            else if (long_name) { name = long_name; nlen = strnlen(long_name, (size_t)size); }
+            else {
+                /* ustar splits long paths into prefix + name */
+                size_t plen = (memcmp(b + 257, "ustar", 5) == 0) ? strnlen((const char*)b + 345, 155) : 0;
+                size_t blen = strnlen((const char*)b, 100);
+                nlen = 0;
+                if (plen) { memcpy(hdr_name, b + 345, plen); hdr_name[plen] = '/'; nlen = plen + 1; }
+                memcpy(hdr_name + nlen, b, blen); nlen += blen;
+                name = hdr_name;
+            }
+            if (pax && (v = pax_find(pax, "size", &vlen)) != NULL) size = _strtoui64(v, NULL, 10);
+            if (pax && (v = pax_find(pax, "mtime", &vlen)) != NULL) mt = _strtoi64(v, NULL, 10);
+            e->is_dir = (type == '5');
+            e->size = (type == '1' || type == '2' || type == '5') ? 0 : size;
+            e->csize = e->size;
+            e->offset = data_off;
+            unix_to_filetime(mt, &e->mtime);
+            if (!pool_name(a, e, name, nlen)) a->count--;
+        }
+        free(long_name); long_name = NULL;
+        free(pax); pax = NULL;
+        if (type == '1' || type == '2' || type == '5') size = 0;
+        if (!tar_skip(&s, (size + 511) / 512 * 512)) { ok = FALSE; break; }
+    }
+    free(long_name);
+    free(pax);
+    free(s.buf);
+    return ok;
+}
+
+/* ---- public ---- */
+
+Archive *archive_open(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (!dot) return NULL;
+    ArcKind kind = (_stricmp(dot, ".tar") == 0) ? ARC_TAR : ARC_ZIP;
+
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                           (kind == ARC_TAR) ? FILE_FLAG_SEQUENTIAL_SCAN : 0, NULL);
+    if (h == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER fsz;
+    if (!GetFileSizeEx(h, &fsz)) { CloseHandle(h); return NULL; }
+
+    Archive *a = (Archive*)calloc(1, sizeof(Archive));
+    if (!a) { CloseHandle(h); return NULL; }
+    a->kind = kind;
+    strncpy_s(a->path, MAX_PATH, path, _TRUNCATE);
+    BOOL ok = (kind == ARC_ZIP) ? zip_index(a, h, (unsigned long long)fsz.QuadPart) : tar_index(a, h);
+    CloseHandle(h);
+    if (!ok) { archive_close(a); return NULL; }
+    finish_index(a);
+    return a;
+}
+
+void archive_close(Archive *a) {
+    if (!a) return;
+    free(a->entries);
+    free(a->names);
+    free(a);
+}
+
+static int lower_bound(const Archive *a, const char *key) {
+    int lo = 0, hi = a->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(a->entries[mid].path, key) < 0) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+int archive_find(const Archive *a, const char *member) {
+    int i = lower_bound(a, member);
+    return (i < a->count && strcmp(a->entries[i].path, member) == 0) ? i : -1;
+}
+
+void archive_list(const Archive *a, const char *prefix, ArcListFn fn, void *ctx) {
+    size_t plen = strlen(prefix);
+    char key[MAX_PATH * 2];
+    int i = lower_bound(a, prefix);
+    while (i < a->count && strncmp(a->entries[i].path, prefix, plen) == 0) {
+        const ArcEntry *e = &a->entries[i];
+        const char *rest = e->path + plen;
+        const char *slash = strchr(rest, '/');
+        size_t clen = slash ? (size_t)(slash - rest) : strlen(rest);
+        if (clen == 0 || plen + clen + 2 > sizeof(key)) { i++; continue; }
+        memcpy(key, e->path, plen + clen);
+        key[plen + clen] = '/'; key[plen + clen + 1] = 0;
+        if (!slash) {
+            /* an explicit directory with members is reported once, by its first member below */
+            if (e->is_dir) {
+                int j = lower_bound(a, key);
+                if (j < a->count && strncmp(a->entries[j].path, key, plen + clen + 1) == 0) { i++; continue; }
+            }
+            fn(ctx, rest, e->is_dir, i);
+            i++;
+        } else {
+            char name[MAX_PATH];
+            if (clen >= sizeof(name)) clen = sizeof(name) - 1;
+            memcpy(name, rest, clen); name[clen] = 0;
+            fn(ctx, name, TRUE, -1);
+            /* jump past the whole "prefix/name/" block: '0' sorts right after '/' */
+            key[plen + clen] = '0';
+            i = lower_bound(a, key);
+        }
+    }
+}
+
+/* ---- extraction ---- */
+
+static DWORD crc_table[256];
+static BOOL crc_ready = FALSE;
+
+static DWORD crc32_update(DWORD crc, const BYTE *p, size_t n) {
+    if (!crc_ready) {
+        for (DWORD i = 0; i < 256; ++i) {
+            DWORD c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            crc_table[i] = c;
+        }
+        crc_ready = TRUE;
+    }
+    crc = ~crc;
+    while (n--) crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+#define WSIZE 32768
+
+/* Streaming raw-deflate decoder: pulls compressed bytes from a buffered handle and pushes
+   output through a 32K window that is flushed to the destination as it fills. */
+typedef struct {
+    HANDLE in; BYTE *ibuf; DWORD ipos, ilen; unsigned long long iremain;
+    DWORD bitbuf; int bitcnt;
+    HANDLE out; BYTE *win; DWORD wpos; BOOL wfull; unsigned long long total; DWORD crc;
+    int err;
+} Inflate;
+
+typedef struct { short count[16]; short symbol[288]; } Huff;
+
+static int inf_byte(Inflate *s) {
+    if (s->ipos == s->ilen) {
+        if (s->iremain == 0) { s->err = 1; return 0; }
+        DWORD want = (s->iremain < ARC_IO_BUF) ? (DWORD)s->iremain : ARC_IO_BUF, got = 0;
+        if (!ReadFile(s->in, s->ibuf, want, &got, NULL) || got == 0) { s->err = 1; return 0; }
+        s->iremain -= got; s->ipos = 0; s->ilen = got;
+    }
+    return s->ibuf[s->ipos++];
+}
+
+static int inf_bits(Inflate *s, int need) {
+    DWORD val = s->bitbuf;
+    while (s->bitcnt < need) {
+        val |= (DWORD)inf_byte(s) << s->bitcnt;
+        s->bitcnt += 8;
+    }
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+    return (int)(val & ((1UL << need) - 1));
+}
+
+static void inf_flush(Inflate *s) {
+    if (s->wpos == 0) return;
+    DWORD wr = 0;
+    s->crc = crc32_update(s->crc, s->win, s->wpos);
+    if (!WriteFile(s->out, s->win, s->wpos, &wr, NULL) || wr != s->wpos) s->err = 2;
+    s->total += s->wpos;
+}
+
+static void inf_put(Inflate *s, BYTE b) {
+    s->win[s->wpos++] = b;
+    if (s->wpos == WSIZE) { inf_flush(s); s->wpos = 0; s->wfull = TRUE; }
+}
+
+static int huff_build(Huff *h, const short *len, int n) {
+    short offs[16];
+    for (int i = 0; i < 16; ++i) h->count[i] = 0;
+    for (int i = 0; i < n; ++i) h->count[len[i]]++;
+    if (h->count[0] == n) return 0;
+    int left = 1;
+    for (int i = 1; i < 16; ++i) { left <<= 1; left -= h->count[i]; if (left < 0) return -1; }
+    offs[1] = 0;
+    for (int i = 1; i < 15; ++i) offs[i+1] = (short)(offs[i] + h->count[i]);
+    for (int i = 0; i < n; ++i) if (len[i]) h->symbol[offs[len[i]]++] = (short)i;
+    return left;
+}
+
+static int huff_decode(Inflate *s, const Huff *h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; ++len) {
+        code |= inf_bits(s, 1);
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count; first += count;
+        first <<= 1; code <<= 1;
+        if (s->err) break;
+    }
+    s->err = 3;
+    return -1;
+}
+
+static const short len_base[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const short len_extra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const short dist_base[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const short dist_extra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+static void inf_codes(Inflate *s, const Huff *lencode, const Huff *distcode) {
+    for (;;) {
+        int sym = huff_decode(s, lencode);
+        if (s->err) return;
+        if (sym < 256) { inf_put(s, (BYTE)sym); continue; }
+        if (sym == 256) return;
+        sym -= 257;
+        if (sym >= 29) { s->err = 3; return; }
+        int len = len_base[sym] + inf_bits(s, len_extra[sym]);
+        int dsym = huff_decode(s, distcode);
+        if (s->err || dsym < 0 || dsym >= 30) { s->err = 3; return; }
+        DWORD dist = (DWORD)(dist_base[dsym] + inf_bits(s, dist_extra[dsym]));
+        if (dist > WSIZE || (!s->wfull && dist > s->wpos)) { s->err = 3; return; }
+        while (len--) inf_put(s, s->win[(s->wpos + WSIZE - dist) % WSIZE]);
+    }
+}
+
+static void inf_stored(Inflate *s) {
+    s->bitbuf = 0; s->bitcnt = 0;
+    int len = inf_byte(s); len |= inf_byte(s) << 8;
+    int nlen = inf_byte(s); nlen |= inf_byte(s) << 8;
+    if (s->err || len != (~nlen & 0xFFFF)) { s->err = 3; return; }
+    while (len-- && !s->err) inf_put(s, (BYTE)inf_byte(s));
+}
+
+static void inf_fixed(Inflate *s) {
+    static Huff lencode, distcode;
+    static BOOL built = FALSE;
+    if (!built) {
+        short lengths[288];
+        int i = 0;
+        for (; i < 144; ++i) lengths[i] = 8;
+        for (; i < 256; ++i) lengths[i] = 9;
+        for (; i < 280; ++i) lengths[i] = 7;
+        for (; i < 288; ++i) lengths[i] = 8;
+        huff_build(&lencode, lengths, 288);
+        for (i = 0; i < 30; ++i) lengths[i] = 5;
+        huff_build(&distcode, lengths, 30);
+        built = TRUE;
+    }
+    inf_codes(s, &lencode, &distcode);
+}
+
+static void inf_dynamic(Inflate *s) {
+    static const short order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+    short lengths[320];
+    Huff lencode, distcode;
+    int nlen = inf_bits(s, 5) + 257, ndist = inf_bits(s, 5) + 1, ncode = inf_bits(s, 4) + 4;
+    if (nlen > 286 || ndist > 30) { s->err = 3; return; }
+    int i = 0;
+    for (; i < ncode; ++i) lengths[order[i]] = (short)inf_bits(s, 3);
+    for (; i < 19; ++i) lengths[order[i]] = 0;
+    if (huff_build(&lencode, lengths, 19) != 0) { s->err = 3; return; }
+    i = 0;
+    while (i < nlen + ndist && !s->err) {
+        int sym = huff_decode(s, &lencode), rep = 0;
+        short len = 0;
+        if (sym < 0) return;
+        if (sym < 16) { lengths[i++] = (short)sym; continue; }
+        if (sym == 16) { if (i == 0) { s->err = 3; return; } len = lengths[i-1]; rep = 3 + inf_bits(s, 2); }
+        else if (sym == 17) rep = 3 + inf_bits(s, 3);
+        else rep = 11 + inf_bits(s, 7);
+        if (i + rep > nlen + ndist) { s->err = 3; return; }
+        while (rep--) lengths[i++] = len;
+    }
+    if (s->err || lengths[256] == 0) { s->err = 3; return; }
+    int err = huff_build(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1)) { s->err = 3; return; }
+    err = huff_build(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1)) { s->err = 3; return; }
+    inf_codes(s, &lencode, &distcode);
+}
+
+static BOOL inflate_stream(HANDLE in, unsigned long long csize, HANDLE out, DWORD *crc, unsigned long long *total) {
+    Inflate s;
+    ZeroMemory(&s, sizeof(s));
+    s.in = in; s.out = out; s.iremain = csize;
+    s.ibuf = (BYTE*)malloc(ARC_IO_BUF);
+    s.win = (BYTE*)malloc(WSIZE);
+    if (!s.ibuf || !s.win) { free(s.ibuf); free(s.win); return FALSE; }
+    int last;
+    do {
+        last = inf_bits(&s, 1);
+        int type = inf_bits(&s, 2);
+        if (type == 0) inf_stored(&s);
+        else if (type == 1) inf_fixed(&s);
+        else if (type == 2) inf_dynamic(&s);
+        else s.err = 3;
+    } while (!last && !s.err);
+    if (!s.err) inf_flush(&s);
+    *crc = s.crc; *total = s.total;
+    free(s.ibuf); free(s.win);
+    return s.err == 0;
+}
+
+static BOOL copy_stream(HANDLE in, unsigned long long n, HANDLE out, DWORD *crc) {
+    BYTE *buf = (BYTE*)malloc(ARC_IO_BUF);
+    if (!buf) return FALSE;
+    BOOL ok = TRUE;
+    *crc = 0;
+    while (n > 0) {
+        DWORD want = (n < ARC_IO_BUF) ? (DWORD)n : ARC_IO_BUF, got = 0, wr = 0;
+        if (!ReadFile(in, buf, want, &got, NULL) || got == 0) { ok = FALSE; break; }
+        *crc = crc32_update(*crc, buf, got);
+        if (!WriteFile(out, buf, got, &wr, NULL) || wr != got) { ok = FALSE; break; }
+        n -= got;
+    }
+    free(buf);
+    return ok;
+}
+
+BOOL archive_extract(const Archive *a, int index, const char *dest_path, char *err, size_t errlen) {
+    if (index < 0 || index >= a->count || a->entries[index].is_dir) {
+        snprintf(err, errlen, "Not a file");
+        return FALSE;
+    }
+    const ArcEntry *e = &a->entries[index];
+    if (a->kind == ARC_ZIP && e->method != 0 && e->method != 8) {
+        snprintf(err, errlen, (e->method == 0xFFFF) ? "Encrypted member" : "Unsupported compression method %u", e->method);
+        return FALSE;
+    }
+    HANDLE in = CreateFileA(a->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (in == INVALID_HANDLE_VALUE) { snprintf(err, errlen, "Cannot open archive"); return FALSE; }
+
+    unsigned long long data_off = e->offset;
+    if (a->kind == ARC_ZIP) {
+        BYTE lh[30];
+        if (!read_at(in, e->offset, lh, 30) || rd32(lh) != 0x04034b50) {
+            CloseHandle(in); snprintf(err, errlen, "Bad local header"); return FALSE;
+        }
+        data_off = e->offset + 30 + rd16(lh + 26) + rd16(lh + 28);
+    }
+    LARGE_INTEGER li; li.QuadPart = (LONGLONG)data_off;
+    SetFilePointerEx(in, li, NULL, FILE_BEGIN);
+
+    HANDLE out = CreateFileA(dest_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (out == INVALID_HANDLE_VALUE) { CloseHandle(in); snprintf(err, errlen, "Cannot create %s", dest_path); return FALSE; }
+
+    DWORD crc = 0;
+    unsigned long long total = e->size;
+    BOOL ok;
+    if (a->kind == ARC_ZIP && e->method == 8) ok = inflate_stream(in, e->csize, out, &crc, &total);
+    else ok = copy_stream(in, (a->kind == ARC_ZIP) ? e->csize : e->size, out, &crc);
+    if (ok && a->kind == ARC_ZIP && (crc != e->crc || total != e->size)) {
+        ok = FALSE; snprintf(err, errlen, "CRC mismatch");
+    } else if (!ok) {
+        snprintf(err, errlen, "Read/decompress error");
+    }
+    if (ok) SetFileTime(out, NULL, NULL, &e->mtime);
+    CloseHandle(out);
+    CloseHandle(in);
+    if (!ok) DeleteFileA(dest_path);
+    return ok;
+}
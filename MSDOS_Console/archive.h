@@ -0,0 +1,51 @@
+// archive.h - Read-only access to zip and tar archives for the file manager
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <windows.h>
+
+typedef enum { ARC_NONE = 0, ARC_ZIP = 1, ARC_TAR = 2 } ArcKind;
+
+typedef struct {
+    const char *path;          /* member path inside the archive, '/' separated, no trailing slash */
+    BOOL is_dir;
+    unsigned long long size;   /* uncompressed size */
+    unsigned long long csize;  /* stored size (zip) */
+    unsigned long long offset; /* zip: local header offset, tar: start of data */
+    FILETIME mtime;            /* UTC */
+    WORD method;               /* zip: 0 = stored, 8 = deflate */
+    DWORD crc;
+    size_t name_off;           /* offset of path in the name pool while indexing */
+} ArcEntry;
+
+typedef struct {
+    ArcKind kind;
+    char path[MAX_PATH];       /* archive file on disk */
+    ArcEntry *entries;         /* sorted by path */
+    int count;
+    char *names;               /* pool holding every entry path */
+    size_t names_len, names_cap;
+} Archive;
+
+/* Callback for archive_list: name is the child component, is_dir tells whether it is a
+   directory (explicit or implied by deeper members), index is the entry or -1 if implied. */
+typedef void (*ArcListFn)(void *ctx, const char *name, BOOL is_dir, int index);
+
+/* Returns nonzero when the file name has an archive extension we can browse. */
+int archive_is_archive_name(const char *name);
+
+/* Opens an archive and builds its member index. Zip reads only the central directory
+   through a mapped view; tar walks the headers once without reading member data. */
+Archive *archive_open(const char *path);
+void archive_close(Archive *a);
+
+/* Enumerates the direct children of prefix ("" for the root, otherwise "dir/sub/"). */
+void archive_list(const Archive *a, const char *prefix, ArcListFn fn, void *ctx);
+
+/* Returns the entry index for a member path or -1. */
+int archive_find(const Archive *a, const char *member);
+
+/* Extracts a single member to dest_path. Returns FALSE on failure (status in err). */
+BOOL archive_extract(const Archive *a, int index, const char *dest_path, char *err, size_t errlen);
+
+#endif
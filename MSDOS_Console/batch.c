@@ -0,0 +1,330 @@
+// batch.c - Pattern marking helpers and parallel batch file operations (Windows, C)
+//
+// A batch is a fixed list of names and one operation. Worker threads claim the next
+// index from a shared counter, so many deletes/renames are in flight at once and the
+// file system sees a deep queue instead of one request at a time. A failing item is
+// recorded with its error code and the workers move on to the next one.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+#define BATCH_MAX_THREADS 64 /* also the WaitForMultipleObjects limit */
+#define BATCH_PER_CORE    4  /* file system calls mostly wait on I/O */
+
+struct Batch {
+    BatchSpec spec;
+    const char *const *names;
+    int count;
+    volatile LONG next;        /* next unclaimed index */
+    volatile LONG done;
+    volatile LONG cancel;
+    CRITICAL_SECTION lock;     /* guards failures */
+    BatchFailure *failures;
+    int nfail, fail_cap;
+    HANDLE threads[BATCH_MAX_THREADS];
+    int nthreads;
+};
+
+static char lower_ch(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static int glob_core(const char *pattern, const char *name) {
+    const char *star = NULL, *resume = NULL;
+    while (*name) {
+        if (*pattern == '*') { star = ++pattern; resume = name; continue; }
+        if (*pattern == '?' || (*pattern && lower_ch(*pattern) == lower_ch(*name))) { pattern++; name++; continue; }
+        if (!star) return 0;
+        /* mismatch after a star: let the star swallow one more character */
+        pattern = star;
+        name = ++resume;
+    }
+    while (*pattern == '*') pattern++;
+    return *pattern == 0;
+}
+
+int glob_match(const char *pattern, const char *name) {
+    if (glob_core(pattern, name)) return 1;
+    /* as in DOS, "name.*" and "*.*" also match names without an extension */
+    size_t l = strlen(pattern);
+    if (l >= 2 && pattern[l-2] == '.' && pattern[l-1] == '*' && !strchr(name, '.') && l < MAX_PATH) {
+        char base[MAX_PATH];
+        memcpy(base, pattern, l - 2);
+        base[l-2] = 0;
+        return glob_core(base, name);
+    }
+    return 0;
+}
+
+/* Regex subset: an atom is a literal, '.', '\x' escape or '[...]' class */
+static int re_atom_len(const char *re) {
+    if (re[0] == '\\' && re[1]) return 2;
+    if (re[0] == '[') {
+        int n = 1;
+        if (re[n] == '^') n++;
+        if (re[n] == ']') n++;
+        while (re[n] && re[n] != ']') n++;
+        return re[n] ? n + 1 : n;
+    }
+    return 1;
+}
+
+static int re_class_match(const char *re, int len, char c) {
+    int i = 1, neg = 0, hit = 0;
+    if (re[i] == '^') { neg = 1; i++; }
+    for (; i < len - 1; ++i) {
+        if (re[i+1] == '-' && i + 2 < len - 1) {
+            if (c >= lower_ch(re[i]) && c <= lower_ch(re[i+2])) hit = 1;
+            i += 2;
+        } else if (lower_ch(re[i]) == c) hit = 1;
+    }
+    return hit != neg;
+}
+
+static int re_atom_match(const char *re, int len, char c) {
+    c = lower_ch(c);
+    if (re[0] == '.') return 1;
+    if (re[0] == '[') return re_class_match(re, len, c);
+    if (re[0] == '\\') {
+        switch (re[1]) {
+        case 'd': return c >= '0' && c <= '9';
+        case 'w': return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+        case 's': return c == ' ' || c == '\t';
+        default:  return lower_ch(re[1]) == c;
+        }
+    }
+    return lower_ch(re[0]) == c;
+}
+
+static int re_match_here(const char *re, const char *text);
+
+/* atom* followed by rest: take as many as possible, then back off */
+static int re_match_star(const char *atom, int len, const char *rest, const char *text) {
+    const char *t = text;
+    while (*t && re_atom_match(atom, len, *t)) t++;
+    do {
+        if (re_match_here(rest, t)) return 1;
+    } while (t-- > text);
+    return 0;
+}
+
+static int re_match_here(const char *re, const char *text) {
+    if (re[0] == 0) return 1;
+    if (re[0] == '$' && re[1] == 0) return *text == 0;
+    int n = re_atom_len(re);
+    char q = re[n];
+    if (q == '*') return re_match_star(re, n, re + n + 1, text);
+    if (q == '+') return *text && re_atom_match(re, n, *text) && re_match_star(re, n, re + n + 1, text + 1);
+    if (q == '?') return (*text && re_atom_match(re, n, *text) && re_match_here(re + n + 1, text + 1)) || re_match_here(re + n + 1, text);
+    if (*text && re_atom_match(re, n, *text)) return re_match_here(re + n, text + 1);
+    return 0;
+}
+
+int regex_match(const char *re, const char *text) {
+    if (re[0] == '^') return re_match_here(re + 1, text);
+    do {
+        if (re_match_here(re, text)) return 1;
+    } while (*text++);
+    return 0;
+}
+
+BOOL dos_rename_target(const char *pattern, const char *name, char *out, size_t len) {
+    size_t o = 0;
+    const char *s = name;
+    for (const char *p = pattern; *p && o + 1 < len; ++p) {
+        if (*p == '*') {
+            /* copy the source up to the point the next pattern literal takes over */
+            const char *stop;
+            if (p[1] == 0) stop = s + strlen(s);
+            else if (p[1] == '.') { stop = strrchr(s, '.'); if (!stop) stop = s + strlen(s); }
+            else { stop = strchr(s, p[1]); if (!stop) stop = s + strlen(s); }
+            while (s < stop && o + 1 < len) out[o++] = *s++;
+            s = stop;
+        } else if (*p == '?') {
+            if (*s && *s != '.') out[o++] = *s++;
+        } else {
+            out[o++] = *p;
+            if (*p == '.') { const char *dot = strchr(s, '.'); s = dot ? dot + 1 : s + strlen(s); }
+            else if (*s && *s != '.') s++;
+        }
+    }
+    /* a trailing dot means "no extension" */
+    while (o > 0 && out[o-1] == '.') o--;
+    out[o] = 0;
+    return o > 0;
+}
+
+BOOL parse_attrib_change(const char *text, DWORD *set, DWORD *clear) {
+    *set = 0; *clear = 0;
+    for (const char *p = text; *p; ++p) {
+        if (*p == ' ' || *p == ',') continue;
+        if ((*p != '+' && *p != '-') || !p[1]) return FALSE;
+        DWORD bit;
+        switch (lower_ch(p[1])) {
+        case 'r': bit = FILE_ATTRIBUTE_READONLY; break;
+        case 'h': bit = FILE_ATTRIBUTE_HIDDEN; break;
+        case 's': bit = FILE_ATTRIBUTE_SYSTEM; break;
+        case 'a': bit = FILE_ATTRIBUTE_ARCHIVE; break;
+        default: return FALSE;
+        }
+        if (*p == '+') *set |= bit; else *clear |= bit;
+        p++;
+    }
+    return (*set | *clear) != 0;
+}
+
+static void full_path(const Batch *b, const char *name, char *out) {
+    if (b->spec.dir[0]) snprintf(out, MAX_PATH, "%s\\%s", b->spec.dir, name);
+    else strncpy_s(out, MAX_PATH, name, _TRUNCATE);
+}
+
+/* Creates every missing folder on the way to path (which itself is not created) */
+static void make_parent_dirs(const char *path) {
+    char dir[MAX_PATH];
+    strncpy_s(dir, MAX_PATH, path, _TRUNCATE);
+    /* start after "C:\" or "\\server\share\" so only real folders are attempted */
+    char *p = dir;
+    if (p[0] == '\\' && p[1] == '\\') { p = strchr(p + 2, '\\'); if (p) p = strchr(p + 1, '\\'); }
+    else if (p[0] && p[1] == ':') p += 2;
+    for (p = p ? strchr(p + 1, '\\') : NULL; p; p = strchr(p + 1, '\\')) {
+        *p = 0;
+        CreateDirectoryA(dir, NULL);
+        *p = '\\';
+    }
+}
+
+/* Performs the operation on one item; returns 0 or the Win32 error */
+static DWORD batch_one(const Batch *b, const char *name) {
+    char src[MAX_PATH], dst[MAX_PATH];
+    full_path(b, name, src);
+    const char *base = strrchr(name, '\\');
+    base = base ? base + 1 : name;
+    BOOL ok = FALSE;
+    switch (b->spec.op) {
+    case BATCH_DELETE: {
+        DWORD a = GetFileAttributesA(src);
+        if (a != INVALID_FILE_ATTRIBUTES && (a & FILE_ATTRIBUTE_DIRECTORY)) ok = RemoveDirectoryA(src);
+        else ok = DeleteFileA(src);
+        break;
+    }
+    case BATCH_MOVE:
+        snprintf(dst, sizeof(dst), "%s\\%s", b->spec.dest, base);
+        ok = MoveFileExA(src, dst, MOVEFILE_COPY_ALLOWED);
+        break;
+    case BATCH_RENAME: {
+        char target[MAX_PATH];
+        if (!dos_rename_target(b->spec.pattern, base, target, sizeof(target))) return ERROR_INVALID_NAME;
+        strncpy_s(dst, MAX_PATH, src, _TRUNCATE);
+        char *slash = strrchr(dst, '\\');
+        if (slash) slash[1] = 0; else dst[0] = 0;
+        strncat_s(dst, MAX_PATH, target, _TRUNCATE);
+        if (_stricmp(src, dst) == 0) return 0;
+        ok = MoveFileExA(src, dst, 0);
+        break;
+    }
+    case BATCH_COPY: {
+        /* a relative name keeps its folders under dest; full paths (no dir) copy flat */
+        snprintf(dst, sizeof(dst), "%s\\%s", b->spec.dest, b->spec.dir[0] ? name : base);
+        make_parent_dirs(dst);
+        DWORD a = GetFileAttributesA(src);
+        if (a != INVALID_FILE_ATTRIBUTES && (a & FILE_ATTRIBUTE_DIRECTORY)) {
+            ok = CreateDirectoryA(dst, NULL);
+            if (!ok) { DWORD d = GetFileAttributesA(dst); ok = d != INVALID_FILE_ATTRIBUTES && (d & FILE_ATTRIBUTE_DIRECTORY); }
+        }
+        else ok = CopyFileA(src, dst, FALSE);
+        break;
+    }
+    case BATCH_ATTRIB: {
+        DWORD a = GetFileAttributesA(src);
+        if (a == INVALID_FILE_ATTRIBUTES) break;
+        a = (a | b->spec.attr_set) & ~b->spec.attr_clear;
+        a &= FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_NOT_CONTENT_INDEXED;
+        ok = SetFileAttributesA(src, a ? a : FILE_ATTRIBUTE_NORMAL);
+        break;
+    }
+    }
+    if (ok) return 0;
+    DWORD err = GetLastError();
+    return err ? err : ERROR_GEN_FAILURE;
+}
+
+static DWORD WINAPI batch_worker(LPVOID param) {
+    Batch *b = (Batch*)param;
+    while (!b->cancel) {
+        LONG i = InterlockedIncrement(&b->next) - 1;
+        if (i >= b->count) break;
+        DWORD err = batch_one(b, b->names[i]);
+        if (err) {
+            EnterCriticalSection(&b->lock);
+            if (b->nfail == b->fail_cap) {
+                int ncap = b->fail_cap ? b->fail_cap * 2 : 64;
+                BatchFailure *nf = (BatchFailure*)realloc(b->failures, sizeof(BatchFailure) * ncap);
+                if (nf) { b->failures = nf; b->fail_cap = ncap; }
+            }
+            if (b->nfail < b->fail_cap) {
+                b->failures[b->nfail].index = i;
+                b->failures[b->nfail].error = err;
+                b->nfail++;
+            }
+            LeaveCriticalSection(&b->lock);
+        }
+        InterlockedIncrement(&b->done);
+    }
+    return 0;
+}
+
+Batch *batch_start(const BatchSpec *spec, const char *const *names, int count) {
+    Batch *b = (Batch*)calloc(1, sizeof(Batch));
+    if (!b) return NULL;
+    b->spec = *spec;
+    b->names = names;
+    b->count = count;
+    InitializeCriticalSection(&b->lock);
+
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    int want = (int)si.dwNumberOfProcessors * BATCH_PER_CORE;
+    if (want > BATCH_MAX_THREADS) want = BATCH_MAX_THREADS;
+    if (want > count) want = count;
+    if (want < 1) want = 1;
+    for (int t = 0; t < want; ++t) {
+        HANDLE h = CreateThread(NULL, 0, batch_worker, b, 0, NULL);
+        if (h) b->threads[b->nthreads++] = h;
+    }
+    if (b->nthreads == 0) batch_worker(b); /* no threads available: run inline */
+    return b;
+}
+
+int batch_wait(Batch *b, DWORD ms) {
+    if (b->nthreads == 0) return 1;
+    return WaitForMultipleObjects((DWORD)b->nthreads, b->threads, TRUE, ms) != WAIT_TIMEOUT;
+}
+
+void batch_progress(Batch *b, int *done, int *failed) {
+    *done = (int)b->done;
+    EnterCriticalSection(&b->lock);
+    *failed = b->nfail;
+    LeaveCriticalSection(&b->lock);
+}
+
+void batch_cancel(Batch *b) {
+    InterlockedExchange(&b->cancel, 1);
+}
+
+int batch_failures(Batch *b, const BatchFailure **out) {
+    *out = b->failures;
+    return b->nfail;
+}
+
+void batch_free(Batch *b) {
+    if (!b) return;
+    batch_cancel(b);
+    batch_wait(b, INFINITE);
+    for (int t = 0; t < b->nthreads; ++t) CloseHandle(b->threads[t]);
+    DeleteCriticalSection(&b->lock);
+    free(b->failures);
+    free(b);
+}
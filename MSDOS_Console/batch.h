@@ -0,0 +1,54 @@
+// batch.h - Pattern marking helpers and parallel batch file operations for the file manager
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <windows.h>
+
+typedef enum { BATCH_DELETE = 0, BATCH_MOVE = 1, BATCH_RENAME = 2, BATCH_ATTRIB = 3, BATCH_COPY = 4 } BatchOp;
+
+typedef struct {
+    BatchOp op;
+    char dir[MAX_PATH];        /* folder holding the items, "" when names are full paths */
+    char dest[MAX_PATH];       /* BATCH_MOVE: target folder; BATCH_COPY: target root (flat for full paths) */
+    char pattern[MAX_PATH];    /* BATCH_RENAME: DOS style target such as "*.bak" */
+    DWORD attr_set;            /* BATCH_ATTRIB: attributes to add */
+    DWORD attr_clear;          /* BATCH_ATTRIB: attributes to remove */
+} BatchSpec;
+
+typedef struct {
+    int index;                 /* position in the names array given to batch_start */
+    DWORD error;               /* GetLastError() of the failing call */
+} BatchFailure;
+
+typedef struct Batch Batch;
+
+/* Case-insensitive DOS wildcard match ('*' and '?') of a whole name. */
+int glob_match(const char *pattern, const char *name);
+
+/* Case-insensitive search for a small regex subset: . [] [^] * + ? ^ $ and \d \w \s escapes. */
+int regex_match(const char *re, const char *text);
+
+/* Applies a DOS style rename pattern ("*.old", "x??.txt") to name. FALSE if the result is empty. */
+BOOL dos_rename_target(const char *pattern, const char *name, char *out, size_t len);
+
+/* Parses an ATTRIB style change such as "+R -H +A" into set/clear masks. */
+BOOL parse_attrib_change(const char *text, DWORD *set, DWORD *clear);
+
+/* Runs spec over names[0..count) on a pool of worker threads. names must stay valid until
+   batch_free; one item failing is recorded and the rest carry on. */
+Batch *batch_start(const BatchSpec *spec, const char *const *names, int count);
+
+/* Waits up to ms milliseconds; nonzero once every worker has finished. */
+int batch_wait(Batch *b, DWORD ms);
+
+void batch_progress(Batch *b, int *done, int *failed);
+
+/* Asks the workers to stop picking up new items; items already started still complete. */
+void batch_cancel(Batch *b);
+
+/* Failures recorded so far, in completion order. Valid until batch_free. */
+int batch_failures(Batch *b, const BatchFailure **out);
+
+void batch_free(Batch *b);
+
+#endif
@@ -0,0 +1,332 @@
+// dircmp.c - Directory tree comparison for the compare mode (Windows, C)
+//
+// Both trees are enumerated at the same time (one thread per side) using only the data
+// FindFirstFileEx returns, so classifying by size and last write time never opens a file.
+// The two sorted lists are merge-joined by relative path. Only files of equal size whose
+// times differ can still be identical; with verification on, just those pairs are mapped
+// and compared with memcmp on a small thread pool, so the cost follows the number of
+// changed files rather than the size of the trees.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dircmp.h"
+
+#define CMP_TIME_SLACK   (2ULL * 10000000) /* FAT and some network shares round to 2 s */
+#define CMP_VIEW_BYTES   (64u * 1024 * 1024)
+#define CMP_MAX_THREADS  64
+
+typedef struct {
+    size_t path_off;           /* offset in the side's pool while walking */
+    const char *path;
+    BOOL is_dir;
+    unsigned long long size;
+    FILETIME mtime;
+} WalkEntry;
+
+typedef struct {
+    struct DirCompare *dc;
+    char root[MAX_PATH];
+    WalkEntry *entries;
+    int count, cap;
+    char *pool;
+    size_t pool_len, pool_cap;
+    BOOL failed;
+} Side;
+
+struct DirCompare {
+    Side left, right;
+    BOOL verify;
+    volatile LONG cancel;
+    volatile LONG scanned;
+    volatile LONG verified;
+    HANDLE thread;
+    CmpEntry *entries;
+    int count, cap;
+    int *cands;                /* entries awaiting a content check */
+    int ncands;
+    volatile LONG next_cand;
+    CmpSummary sum;
+};
+
+static BOOL side_add(Side *s, const char *rel, const WIN32_FIND_DATAA *fd) {
+    size_t l = strlen(rel) + 1;
+    if (s->count == s->cap) {
+        int ncap = s->cap ? s->cap * 2 : 1024;
+        WalkEntry *ne = (WalkEntry*)realloc(s->entries, sizeof(WalkEntry) * ncap);
+        if (!ne) return FALSE;
+        s->entries = ne; s->cap = ncap;
+    }
+    if (s->pool_len + l > s->pool_cap) {
+        size_t ncap = s->pool_cap ? s->pool_cap * 2 : 64 * 1024;
+        while (ncap < s->pool_len + l) ncap *= 2;
+        char *np = (char*)realloc(s->pool, ncap);
+        if (!np) return FALSE;
+        s->pool = np; s->pool_cap = ncap;
+    }
+    WalkEntry *e = &s->entries[s->count++];
+    e->path_off = s->pool_len;
+    e->path = NULL;
+    e->is_dir = (fd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    e->size = e->is_dir ? 0 : (((unsigned long long)fd->nFileSizeHigh << 32) | fd->nFileSizeLow);
+    e->mtime = fd->ftLastWriteTime;
+    memcpy(s->pool + s->pool_len, rel, l);
+    s->pool_len += l;
+    return TRUE;
+}
+
+static void walk_dir(Side *s, const char *rel) {
+    char search[MAX_PATH];
+    if (rel[0]) snprintf(search, sizeof(search), "%s\\%s\\*", s->root, rel);
+    else snprintf(search, sizeof(search), "%s\\*", s->root);
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileExA(search, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE) {
+        if (rel[0] || GetLastError() != ERROR_FILE_NOT_FOUND) s->failed = TRUE;
+        return;
+    }
+    do {
+        if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+        char child[MAX_PATH];
+        if (rel[0]) snprintf(child, sizeof(child), "%s\\%s", rel, fd.cFileName);
+        else strncpy_s(child, MAX_PATH, fd.cFileName, _TRUNCATE);
+        if (strlen(s->root) + strlen(child) + 3 >= MAX_PATH) { s->failed = TRUE; continue; }
+        if (!side_add(s, child, &fd)) { s->failed = TRUE; break; }
+        InterlockedIncrement(&s->dc->scanned);
+        /* junctions and symlinked dirs are compared as entries but not followed */
+        if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && !(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+            walk_dir(s, child);
+    } while (!s->dc->cancel && FindNextFileA(h, &fd));
+    FindClose(h);
+}
+
+static int cmp_walk(const void *a, const void *b) {
+    return _stricmp(((const WalkEntry*)a)->path, ((const WalkEntry*)b)->path);
+}
+
+static DWORD WINAPI walk_thread(LPVOID param) {
+    Side *s = (Side*)param;
+    walk_dir(s, "");
+    for (int i = 0; i < s->count; ++i) s->entries[i].path = s->pool + s->entries[i].path_off;
+    qsort(s->entries, s->count, sizeof(WalkEntry), cmp_walk);
+    return 0;
+}
+
+static long long filetime_diff(const FILETIME *a, const FILETIME *b) {
+    unsigned long long ta = ((unsigned long long)a->dwHighDateTime << 32) | a->dwLowDateTime;
+    unsigned long long tb = ((unsigned long long)b->dwHighDateTime << 32) | b->dwLowDateTime;
+    return (long long)(ta - tb);
+}
+
+static CmpEntry *add_entry(DirCompare *dc) {
+    if (dc->count == dc->cap) {
+        int ncap = dc->cap ? dc->cap * 2 : 256;
+        CmpEntry *ne = (CmpEntry*)realloc(dc->entries, sizeof(CmpEntry) * ncap);
+        if (!ne) return NULL;
+        dc->entries = ne; dc->cap = ncap;
+    }
+    CmpEntry *e = &dc->entries[dc->count++];
+    ZeroMemory(e, sizeof(*e));
+    return e;
+}
+
+static BOOL add_candidate(DirCompare *dc, int index) {
+    if ((dc->ncands & (dc->ncands - 1)) == 0) {
+        int *nc = (int*)realloc(dc->cands, sizeof(int) * (dc->ncands ? dc->ncands * 2 : 64));
+        if (!nc) return FALSE;
+        dc->cands = nc;
+    }
+    dc->cands[dc->ncands++] = index;
+    return TRUE;
+}
+
+/* Merge-join the sorted sides into the differing entries */
+static void merge_sides(DirCompare *dc) {
+    const Side *l = &dc->left, *r = &dc->right;
+    int i = 0, j = 0;
+    while (i < l->count || j < r->count) {
+        int c = (i >= l->count) ? 1 : (j >= r->count) ? -1 : _stricmp(l->entries[i].path, r->entries[j].path);
+        const WalkEntry *a = (c <= 0) ? &l->entries[i] : NULL;
+        const WalkEntry *b = (c >= 0) ? &r->entries[j] : NULL;
+        if (a) i++;
+        if (b) j++;
+        CmpState state;
+        BOOL check = FALSE;
+        if (!b) state = CMP_ONLY_LEFT;
+        else if (!a) state = CMP_ONLY_RIGHT;
+        else if (a->is_dir != b->is_dir) state = CMP_DIFFERENT;
+        else if (a->is_dir) state = CMP_SAME;
+        else {
+            long long dt = filetime_diff(&a->mtime, &b->mtime);
+            BOOL same_time = (dt < 0 ? -dt : dt) <= (long long)CMP_TIME_SLACK;
+            if (a->size == b->size && same_time) state = CMP_SAME;
+            else {
+                state = same_time ? CMP_DIFFERENT : (dt > 0) ? CMP_NEWER_LEFT : CMP_NEWER_RIGHT;
+                check = dc->verify && a->size == b->size;
+            }
+        }
+        if (state == CMP_SAME) { dc->sum.same++; continue; }
+        CmpEntry *e = add_entry(dc);
+        if (!e) { dc->left.failed = TRUE; return; }
+        e->path = a ? a->path : b->path;
+        e->is_dir = a ? a->is_dir : b->is_dir;
+        e->state = state;
+        if (a) { e->lsize = a->size; e->lmtime = a->mtime; }
+        if (b) { e->rsize = b->size; e->rmtime = b->mtime; }
+        if (check && !add_candidate(dc, dc->count - 1)) dc->left.failed = TRUE;
+    }
+}
+
+/* Byte comparison through mapped views; any error counts as different */
+static int files_equal(DirCompare *dc, const char *pa, const char *pb, unsigned long long size) {
+    if (size == 0) return 1;
+    int equal = 0;
+    HANDLE fa = CreateFileA(pa, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    HANDLE fb = CreateFileA(pb, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    HANDLE ma = NULL, mb = NULL;
+    if (fa == INVALID_HANDLE_VALUE || fb == INVALID_HANDLE_VALUE) goto done;
+    ma = CreateFileMappingA(fa, NULL, PAGE_READONLY, 0, 0, NULL);
+    mb = CreateFileMappingA(fb, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!ma || !mb) goto done;
+    equal = 1;
+    for (unsigned long long off = 0; off < size && equal && !dc->cancel; off += CMP_VIEW_BYTES) {
+        SIZE_T n = (SIZE_T)((size - off < CMP_VIEW_BYTES) ? (size - off) : CMP_VIEW_BYTES);
+        const void *va = MapViewOfFile(ma, FILE_MAP_READ, (DWORD)(off >> 32), (DWORD)off, n);
+        const void *vb = MapViewOfFile(mb, FILE_MAP_READ, (DWORD)(off >> 32), (DWORD)off, n);
+        if (!va || !vb || memcmp(va, vb, n) != 0) equal = 0;
+        if (va) UnmapViewOfFile(va);
+        if (vb) UnmapViewOfFile(vb);
+    }
+    if (dc->cancel) equal = 0;
+done:
+    if (ma) CloseHandle(ma);
+    if (mb) CloseHandle(mb);
+    if (fa != INVALID_HANDLE_VALUE) CloseHandle(fa);
+    if (fb != INVALID_HANDLE_VALUE) CloseHandle(fb);
+    return equal;
+}
+
+static DWORD WINAPI verify_worker(LPVOID param) {
+    DirCompare *dc = (DirCompare*)param;
+    while (!dc->cancel) {
+        LONG k = InterlockedIncrement(&dc->next_cand) - 1;
+        if (k >= dc->ncands) break;
+        CmpEntry *e = &dc->entries[dc->cands[k]];
+        char pa[MAX_PATH], pb[MAX_PATH];
+        snprintf(pa, sizeof(pa), "%s\\%s", dc->left.root, e->path);
+        snprintf(pb, sizeof(pb), "%s\\%s", dc->right.root, e->path);
+        /* each candidate belongs to one worker, so the state can be written directly */
+        if (files_equal(dc, pa, pb, e->lsize)) e->state = CMP_SAME;
+        InterlockedIncrement(&dc->verified);
+    }
+    return 0;
+}
+
+static void verify_candidates(DirCompare *dc) {
+    if (dc->ncands == 0) return;
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    int want = (int)si.dwNumberOfProcessors * 2;
+    if (want > CMP_MAX_THREADS) want = CMP_MAX_THREADS;
+    if (want > dc->ncands) want = dc->ncands;
+    HANDLE threads[CMP_MAX_THREADS];
+    int started = 0;
+    for (int t = 0; t < want; ++t) {
+        threads[started] = CreateThread(NULL, 0, verify_worker, dc, 0, NULL);
+        if (threads[started]) started++;
+    }
+    if (started == 0) verify_worker(dc);
+    else WaitForMultipleObjects((DWORD)started, threads, TRUE, INFINITE);
+    for (int t = 0; t < started; ++t) CloseHandle(threads[t]);
+    dc->sum.verified = (int)dc->verified;
+}
+
+static DWORD WINAPI compare_thread(LPVOID param) {
+    DirCompare *dc = (DirCompare*)param;
+    HANDLE other = CreateThread(NULL, 0, walk_thread, &dc->right, 0, NULL);
+    walk_thread(&dc->left);
+    if (other) { WaitForSingleObject(other, INFINITE); CloseHandle(other); }
+    else walk_thread(&dc->right);
+    if (dc->cancel) return 0;
+
+    merge_sides(dc);
+    verify_candidates(dc);
+
+    /* drop the pairs verification proved identical and count the rest */
+    int k = 0;
+    for (int i = 0; i < dc->count; ++i) {
+        CmpEntry *e = &dc->entries[i];
+        switch (e->state) {
+        case CMP_SAME: dc->sum.same++; continue;
+        case CMP_ONLY_LEFT: dc->sum.only_left++; break;
+        case CMP_ONLY_RIGHT: dc->sum.only_right++; break;
+        case CMP_NEWER_LEFT: dc->sum.newer_left++; break;
+        case CMP_NEWER_RIGHT: dc->sum.newer_right++; break;
+        case CMP_DIFFERENT: dc->sum.different++; break;
+        }
+        dc->entries[k++] = *e;
+    }
+    dc->count = k;
+    return 0;
+}
+
+/* roots are joined with '\\', so drop a trailing one ("C:\\" -> "C:") */
+static void strip_trailing_slash(char *path) {
+    size_t l = strlen(path);
+    if (l > 0 && path[l-1] == '\\') path[l-1] = 0;
+}
+
+DirCompare *dircmp_start(const char *left, const char *right, BOOL verify) {
+    DirCompare *dc = (DirCompare*)calloc(1, sizeof(DirCompare));
+    if (!dc) return NULL;
+    dc->verify = verify;
+    dc->left.dc = dc;
+    dc->right.dc = dc;
+    strncpy_s(dc->left.root, MAX_PATH, left, _TRUNCATE);
+    strncpy_s(dc->right.root, MAX_PATH, right, _TRUNCATE);
+    strip_trailing_slash(dc->left.root);
+    strip_trailing_slash(dc->right.root);
+    dc->thread = CreateThread(NULL, 0, compare_thread, dc, 0, NULL);
+    if (!dc->thread) compare_thread(dc);
+    return dc;
+}
+
+int dircmp_wait(DirCompare *dc, DWORD ms) {
+    if (!dc->thread) return 1;
+    return WaitForSingleObject(dc->thread, ms) != WAIT_TIMEOUT;
+}
+
+void dircmp_progress(DirCompare *dc, int *scanned, int *verified) {
+    *scanned = (int)dc->scanned;
+    *verified = (int)dc->verified;
+}
+
+void dircmp_cancel(DirCompare *dc) {
+    InterlockedExchange(&dc->cancel, 1);
+}
+
+int dircmp_entries(DirCompare *dc, const CmpEntry **out) {
+    *out = dc->entries;
+    return dc->count;
+}
+
+void dircmp_summary(DirCompare *dc, CmpSummary *sum) {
+    *sum = dc->sum;
+}
+
+int dircmp_incomplete(DirCompare *dc) {
+    return dc->cancel || dc->left.failed || dc->right.failed;
+}
+
+void dircmp_free(DirCompare *dc) {
+    if (!dc) return;
+    dircmp_cancel(dc);
+    dircmp_wait(dc, INFINITE);
+    if (dc->thread) CloseHandle(dc->thread);
+    free(dc->left.entries); free(dc->left.pool);
+    free(dc->right.entries); free(dc->right.pool);
+    free(dc->entries);
+    free(dc->cands);
+    free(dc);
+}
@@ -0,0 +1,54 @@
+// dircmp.h - Compare two directory trees for the file manager's compare mode
+#ifndef DIRCMP_H
+#define DIRCMP_H
+
+#include <windows.h>
+
+typedef enum {
+    CMP_SAME = 0,
+    CMP_ONLY_LEFT = 1,
+    CMP_ONLY_RIGHT = 2,
+    CMP_NEWER_LEFT = 3,
+    CMP_NEWER_RIGHT = 4,
+    CMP_DIFFERENT = 5      /* same age but other size or content, or file vs folder */
+} CmpState;
+
+typedef struct {
+    const char *path;          /* relative to both roots, '\' separated */
+    BOOL is_dir;
+    CmpState state;
+    unsigned long long lsize, rsize;
+    FILETIME lmtime, rmtime;   /* UTC, zero when missing on that side */
+} CmpEntry;
+
+typedef struct {
+    int only_left, only_right;
+    int newer_left, newer_right;
+    int different;
+    int same;                  /* identical entries (not listed) */
+    int verified;              /* file pairs whose contents were compared */
+} CmpSummary;
+
+typedef struct DirCompare DirCompare;
+
+/* Walks both trees in the background and classifies every entry by size and mtime. With
+   verify set, files of equal size whose times differ are compared byte for byte on a pool
+   of threads and dropped when identical. */
+DirCompare *dircmp_start(const char *left, const char *right, BOOL verify);
+
+/* Waits up to ms milliseconds; nonzero once the comparison has finished. */
+int dircmp_wait(DirCompare *dc, DWORD ms);
+
+void dircmp_progress(DirCompare *dc, int *scanned, int *verified);
+void dircmp_cancel(DirCompare *dc);
+
+/* Entries that differ, sorted by path. Valid after dircmp_wait and until dircmp_free. */
+int dircmp_entries(DirCompare *dc, const CmpEntry **out);
+void dircmp_summary(DirCompare *dc, CmpSummary *sum);
+
+/* Nonzero when the comparison was cancelled or a tree could not be read completely. */
+int dircmp_incomplete(DirCompare *dc);
+
+void dircmp_free(DirCompare *dc);
+
+#endif
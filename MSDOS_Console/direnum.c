@@ -0,0 +1,25 @@
+// direnum.c - Directory enumeration shared by the file pane and the command interpreter (Windows, C)
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "direnum.h"
+
+void dir_join(char *out, size_t len, const char *dir, const char *name) {
+    size_t l = strlen(dir);
+    snprintf(out, len, "%s%s%s", dir, (l && (dir[l-1] == '\\' || dir[l-1] == '/')) ? "" : "\\", name);
+}
+
+BOOL dir_enum(const char *dir, DirEnumFn fn, void *ctx) {
+    char search[MAX_PATH];
+    WIN32_FIND_DATAA fd;
+    dir_join(search, sizeof(search), dir, "*");
+    HANDLE h = FindFirstFileExA(search, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+    do {
+        if (!fn(ctx, &fd)) break;
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+    return TRUE;
+}
@@ -0,0 +1,17 @@
+// direnum.h - Directory enumeration shared by the file pane and the command interpreter
+#ifndef DIRENUM_H
+#define DIRENUM_H
+
+#include <windows.h>
+
+/* Called for every entry, "." and ".." included; return FALSE to stop early. */
+typedef BOOL (*DirEnumFn)(void *ctx, const WIN32_FIND_DATAA *fd);
+
+/* Lists dir with large fetches and without short-name lookups. FALSE, with GetLastError()
+   set, when the folder cannot be read; an empty folder is not an error. */
+BOOL dir_enum(const char *dir, DirEnumFn fn, void *ctx);
+
+/* Joins dir and name with one backslash. */
+void dir_join(char *out, size_t len, const char *dir, const char *name);
+
+#endif
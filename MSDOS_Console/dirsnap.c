@@ -0,0 +1,281 @@
+// dirsnap.c - Immutable, reference-counted folder listings shared by file panes and jobs (Windows, C)
+//
+// Two panes on the same folder, or a pane and a batch job working on its files, hold the
+// same snapshot: one enumeration, one copy of the names. The live snapshots are kept in a
+// small table keyed by path; dirsnap_open hands out another reference when the snapshot was
+// taken moments ago and the folder's last write time still matches. Older ones are not
+// shared: appending to or rewriting a file leaves the folder's time alone, so only a fresh
+// listing has current sizes and times. The last reference frees the snapshot and drops it
+// from the table.
+//
+// Folder listings take size and mtime straight from the find data, so listing a folder
+// costs one enumeration and no lookup per entry. Listings built without metadata (search
+// hits) get it on demand: the pane passes the rows it shows to dirsnap_fetch and a few
+// worker threads look them up, so the cost follows the screen height, not the list length.
+
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirsnap.h"
+#include "direnum.h"
+
+/* Names live in fixed-size blocks so FileItem.name stays valid while a snapshot grows */
+#define NAME_BLOCK_SIZE (64 * 1024)
+struct DirNameBlock {
+    struct DirNameBlock *next;
+    size_t used;
+    char data[NAME_BLOCK_SIZE];
+};
+
+#define SHARE_MS 2000           /* how long a listing is new enough to hand to another pane */
+#define FETCH_THREADS 4
+#define FETCH_QUEUE_MAX 1024
+
+typedef struct {
+    DirSnapshot *snap;
+    int index;
+} FetchEntry;
+
+static SRWLOCK live_lock = SRWLOCK_INIT;
+static DirSnapshot **live;       /* snapshots dirsnap_open can share */
+static int nlive, caplive;
+
+/* Fetch workers, started on first use; the queue and DirSnapshot.fetching are only
+   touched under fetch_lock */
+static CRITICAL_SECTION fetch_lock;
+static CONDITION_VARIABLE fetch_cv;
+static FetchEntry fetch_queue[FETCH_QUEUE_MAX];
+static int fetch_count;
+static int fetch_stopping;
+static HANDLE fetch_threads[FETCH_THREADS];
+static HANDLE fetch_done;
+
+DirSnapshot *dirsnap_new(void) {
+    DirSnapshot *s = (DirSnapshot*)calloc(1, sizeof(DirSnapshot));
+    if (s) s->refs = 1;
+    return s;
+}
+
+FileItem *dirsnap_add(DirSnapshot *s, const char *name, BOOL is_dir) {
+    if (s->count == s->cap) {
+        int ncap = s->cap ? s->cap * 2 : 256;
+        FileItem *ni = (FileItem*)realloc(s->items, sizeof(FileItem) * ncap);
+        if (!ni) return NULL;
+        s->items = ni; s->cap = ncap;
+    }
+    size_t l = strlen(name) + 1;
+    if (l > NAME_BLOCK_SIZE) return NULL;
+    if (!s->names || s->names->used + l > NAME_BLOCK_SIZE) {
+        DirNameBlock *b = (DirNameBlock*)malloc(sizeof(DirNameBlock));
+        if (!b) return NULL;
+        b->next = s->names; b->used = 0; s->names = b;
+    }
+    char *dst = s->names->data + s->names->used;
+    memcpy(dst, name, l);
+    s->names->used += l;
+    FileItem *it = &s->items[s->count++];
+    ZeroMemory(it, sizeof(*it));
+    it->name = dst;
+    it->is_dir = is_dir;
+    return it;
+}
+
+static void snapshot_free(DirSnapshot *s) {
+    DirNameBlock *b = s->names;
+    while (b) { DirNameBlock *next = b->next; free(b); b = next; }
+    free(s->items);
+    free(s);
+}
+
+DirSnapshot *dirsnap_retain(DirSnapshot *s) {
+    if (s) InterlockedIncrement(&s->refs);
+    return s;
+}
+
+/* Drops a shared snapshot from the table; caller holds live_lock exclusively */
+static void unshare(DirSnapshot *s) {
+    for (int i = 0; i < nlive; ++i) {
+        if (live[i] == s) { live[i] = live[--nlive]; break; }
+    }
+    s->shared = 0;
+}
+
+void dirsnap_release(DirSnapshot *s) {
+    if (!s) return;
+    /* the count only reaches zero under the lock, so a lookup never revives a dying snapshot */
+    AcquireSRWLockExclusive(&live_lock);
+    int last = InterlockedDecrement(&s->refs) == 0;
+    if (last && s->shared) unshare(s);
+    ReleaseSRWLockExclusive(&live_lock);
+    if (last) snapshot_free(s);
+}
+
+static BOOL add_directory_item(void *ctx, const WIN32_FIND_DATAA *fd) {
+    DirSnapshot *s = (DirSnapshot*)ctx;
+    if (strcmp(fd->cFileName, ".") == 0) return TRUE;
+    FileItem *it = dirsnap_add(s, fd->cFileName, (fd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+    if (!it) return FALSE;
+    /* the find data already carries size and last write time; local time is the pane's job */
+    it->size = ((unsigned long long)fd->nFileSizeHigh << 32) | fd->nFileSizeLow;
+    it->mtime = fd->ftLastWriteTime;
+    it->meta = META_READY;
+    return TRUE;
+}
+
+static void folder_time(const char *path, FILETIME *out) {
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    out->dwLowDateTime = out->dwHighDateTime = 0;
+    if (GetFileAttributesExA(path, GetFileExInfoStandard, &fad)) *out = fad.ftLastWriteTime;
+}
+
+DirSnapshot *dirsnap_open(const char *path, BOOL fresh) {
+    FILETIME dir_time;
+    folder_time(path, &dir_time);
+
+    if (!fresh) {
+        DirSnapshot *hit = NULL;
+        ULONGLONG now = GetTickCount64();
+        AcquireSRWLockShared(&live_lock);
+        for (int i = 0; i < nlive && !hit; ++i) {
+            DirSnapshot *s = live[i];
+            if (_stricmp(s->path, path) == 0 && now - s->taken < SHARE_MS &&
+                CompareFileTime(&s->dir_time, &dir_time) == 0) hit = dirsnap_retain(s);
+        }
+        ReleaseSRWLockShared(&live_lock);
+        if (hit) return hit;
+    }
+
+    DirSnapshot *s = dirsnap_new();
+    if (!s) return NULL;
+    strncpy_s(s->path, MAX_PATH, path, _TRUNCATE);
+    s->dir_time = dir_time;
+    s->taken = GetTickCount64();
+    if (!dir_enum(path, add_directory_item, s)) return s;   /* unreadable: not worth sharing */
+
+    AcquireSRWLockExclusive(&live_lock);
+    for (int i = 0; i < nlive; ++i) {
+        if (_stricmp(live[i]->path, path) == 0) { unshare(live[i]); break; }
+    }
+    if (nlive == caplive) {
+        int ncap = caplive ? caplive * 2 : 8;
+        DirSnapshot **n = (DirSnapshot**)realloc(live, sizeof(DirSnapshot*) * ncap);
+        if (n) { live = n; caplive = ncap; }
+    }
+    if (nlive < caplive) { live[nlive++] = s; s->shared = 1; }
+    ReleaseSRWLockExclusive(&live_lock);
+    return s;
+}
+
+BOOL dirsnap_current(DirSnapshot *s) {
+    FILETIME dir_time;
+    folder_time(s->path, &dir_time);
+    AcquireSRWLockShared(&live_lock);
+    BOOL current = s->shared && CompareFileTime(&s->dir_time, &dir_time) == 0;
+    ReleaseSRWLockShared(&live_lock);
+    return current;
+}
+
+/* The path an item's metadata is looked up by; FALSE if it has none (archive members) */
+static BOOL item_path(const DirSnapshot *s, const FileItem *it, char *out) {
+    if (s->path[0]) { dir_join(out, MAX_PATH, s->path, it->name); return TRUE; }
+    if (it->name[0] && (it->name[1] == ':' || (it->name[0] == '\\' && it->name[1] == '\\'))) {
+        strncpy_s(out, MAX_PATH, it->name, _TRUNCATE);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static DWORD WINAPI fetch_worker(LPVOID arg) {
+    (void)arg;
+    for (;;) {
+        EnterCriticalSection(&fetch_lock);
+        while (!fetch_count && !fetch_stopping) SleepConditionVariableCS(&fetch_cv, &fetch_lock, INFINITE);
+        if (fetch_stopping) { LeaveCriticalSection(&fetch_lock); return 0; }
+        FetchEntry e = fetch_queue[0];
+        memmove(fetch_queue, fetch_queue + 1, sizeof(FetchEntry) * --fetch_count);
+        LeaveCriticalSection(&fetch_lock);
+
+        FileItem *it = &e.snap->items[e.index];
+        char full[MAX_PATH];
+        WIN32_FILE_ATTRIBUTE_DATA fad;
+        if (e.snap->refs == 1) {
+            /* only the queue holds it: nobody shows this listing any more */
+            it->meta = META_MISSING;
+        } else if (item_path(e.snap, it, full) && GetFileAttributesExA(full, GetFileExInfoStandard, &fad)) {
+            it->size = ((unsigned long long)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+            it->mtime = fad.ftLastWriteTime;
+            InterlockedExchange(&it->meta, META_READY);
+            SetEvent(fetch_done);
+        } else {
+            InterlockedExchange(&it->meta, META_UNAVAILABLE);
+        }
+        EnterCriticalSection(&fetch_lock);
+        int last = --e.snap->fetching == 0;
+        LeaveCriticalSection(&fetch_lock);
+        if (last) dirsnap_release(e.snap);
+    }
+}
+
+/* Called on the UI thread only, like dirsnap_fetch */
+static void fetch_init(void) {
+    if (fetch_done) return;
+    InitializeCriticalSection(&fetch_lock);
+    InitializeConditionVariable(&fetch_cv);
+    fetch_done = CreateEventA(NULL, FALSE, FALSE, NULL);
+}
+
+HANDLE dirsnap_fetch_event(void) {
+    fetch_init();
+    return fetch_done;
+}
+
+void dirsnap_fetch(DirSnapshot *s, const int *idx, int n) {
+    if (!s) return;
+    fetch_init();
+    if (!fetch_threads[0]) {
+        for (int i = 0; i < FETCH_THREADS; ++i) fetch_threads[i] = CreateThread(NULL, 0, fetch_worker, NULL, 0, NULL);
+    }
+    int added = 0;
+    EnterCriticalSection(&fetch_lock);
+    /* rows that scrolled out of view since the last call are not worth a lookup any more */
+    int kept = 0;
+    for (int i = 0; i < fetch_count; ++i) {
+        FetchEntry e = fetch_queue[i];
+        if (e.snap == s) {
+            s->items[e.index].meta = META_MISSING;
+            if (--s->fetching == 0) dirsnap_release(s);   /* the caller still holds s */
+        } else fetch_queue[kept++] = e;
+    }
+    fetch_count = kept;
+    for (int i = 0; i < n && fetch_count < FETCH_QUEUE_MAX; ++i) {
+        FileItem *it = &s->items[idx[i]];
+        if (it->meta != META_MISSING) continue;
+        it->meta = META_QUEUED;
+        if (s->fetching++ == 0) dirsnap_retain(s);
+        fetch_queue[fetch_count].snap = s;
+        fetch_queue[fetch_count].index = idx[i];
+        fetch_count++;
+        added++;
+    }
+    LeaveCriticalSection(&fetch_lock);
+    if (added) WakeAllConditionVariable(&fetch_cv);
+}
+
+void dirsnap_fetch_stop(void) {
+    if (!fetch_done) return;
+    EnterCriticalSection(&fetch_lock);
+    fetch_stopping = 1;
+    LeaveCriticalSection(&fetch_lock);
+    WakeAllConditionVariable(&fetch_cv);
+    for (int i = 0; i < FETCH_THREADS && fetch_threads[i]; ++i) {
+        WaitForSingleObject(fetch_threads[i], INFINITE);
+        CloseHandle(fetch_threads[i]);
+        fetch_threads[i] = NULL;
+    }
+    for (int i = 0; i < fetch_count; ++i) {
+        DirSnapshot *q = fetch_queue[i].snap;
+        if (--q->fetching == 0) dirsnap_release(q);
+    }
+    fetch_count = 0;
+}
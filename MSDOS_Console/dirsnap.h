@@ -0,0 +1,76 @@
+// dirsnap.h - Immutable, reference-counted folder listings shared by file panes and jobs
+#ifndef DIRSNAP_H
+#define DIRSNAP_H
+
+#include <windows.h>
+
+/* Whether an item's size and mtime are known */
+enum {
+    META_MISSING = 0,            /* not listed with the item; dirsnap_fetch can look it up */
+    META_QUEUED,                 /* waiting for a fetch worker */
+    META_READY,
+    META_UNAVAILABLE             /* the lookup failed or the item has no path on disk */
+};
+
+typedef struct {
+    const char *name;            /* points into the snapshot's name blocks */
+    BOOL is_dir;
+    volatile LONG meta;          /* META_*; size and mtime are valid once it reads META_READY */
+    unsigned long long size;
+    FILETIME mtime;              /* UTC */
+} FileItem;
+
+typedef struct DirNameBlock DirNameBlock;
+
+/* Items in enumeration order. The items of a snapshot handed out by dirsnap_open never
+   change, so any number of panes and background jobs can read it without locks; each holder
+   keeps a reference. The one exception is metadata a fetch worker fills in later, which is
+   published through FileItem.meta. Snapshots from dirsnap_new are private until their
+   builder is done adding. */
+typedef struct {
+    char path[MAX_PATH];         /* folder listed; "" for built listings (archives, search hits) */
+    FileItem *items;
+    int count;
+    /* internal */
+    int cap;
+    DirNameBlock *names;
+    volatile LONG refs;
+    FILETIME dir_time;           /* folder's last write time when it was listed */
+    ULONGLONG taken;             /* GetTickCount64 when it was listed */
+    int shared;                  /* reachable through dirsnap_open */
+    int fetching;                /* items queued or being looked up; the queue holds one reference */
+} DirSnapshot;
+
+/* The listing of a folder on disk ("." excluded, ".." included), with size and mtime taken
+   from the enumeration itself rather than a lookup per entry. A live snapshot of the
+   same folder taken in the last couple of seconds is shared when the folder has not changed
+   since (the second pane of a pair, a job handed the pane's files); fresh always enumerates
+   again. A folder that cannot be read gives an empty listing. NULL only when out of memory. */
+DirSnapshot *dirsnap_open(const char *path, BOOL fresh);
+
+/* Whether s is still the newest listing of its folder and the folder's last write time is
+   unchanged: entries were neither added, removed nor renamed since. Says nothing about
+   the sizes and times of files written in place. */
+BOOL dirsnap_current(DirSnapshot *s);
+
+/* An empty private snapshot to fill with dirsnap_add (archive members, search hits). */
+DirSnapshot *dirsnap_new(void);
+FileItem *dirsnap_add(DirSnapshot *s, const char *name, BOOL is_dir);
+
+DirSnapshot *dirsnap_retain(DirSnapshot *s);
+void dirsnap_release(DirSnapshot *s);
+
+/* Queues the listed items of s whose metadata is missing for lookup on a small pool of
+   worker threads. Meant for the rows in or near a pane's viewport: items of s still queued
+   from an earlier call but not listed again are dropped, so scrolling never leaves a backlog.
+   Items are looked up by path: the name joined to s->path, or the name itself when it is a
+   full path (search hits). */
+void dirsnap_fetch(DirSnapshot *s, const int *idx, int n);
+
+/* Signalled whenever a fetch worker has filled in an item; the UI waits on it to redraw. */
+HANDLE dirsnap_fetch_event(void);
+
+/* Stops the fetch workers and drops what is still queued. */
+void dirsnap_fetch_stop(void);
+
+#endif
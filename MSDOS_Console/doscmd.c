@@ -0,0 +1,1019 @@
+// doscmd.c - In-process DOS command interpreter with threaded pipelines (Windows, C)
+//
+// Every stage of "DIR /S | FIND "log" | SORT" runs on its own thread. Stages hand each other
+// 64 KB chunks through bounded queues: a chunk is filled once and then only its pointer
+// moves, FIND compacts the lines it keeps inside the chunk it received, and TYPE and MORE
+// forward chunks untouched. Chunks always end at a line break (only lines longer than a
+// chunk are split), so no stage has to reassemble lines. Queues hold at most a few chunks
+// and spent chunks go back to a free list, so TYPE of a huge file through FIND runs in
+// constant memory; only SORT keeps its whole input. The calling thread drains the last
+// queue to the screen or the redirection file, handles MORE paging and Esc.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#include "doscmd.h"
+#include "direnum.h"
+#include "batch.h"
+
+#define DOS_CHUNK       (64 * 1024)
+#define DOS_PIPE_DEPTH  4        /* chunks queued between two stages */
+#define DOS_FREE_CHUNKS 16       /* spare chunks kept for reuse */
+#define DOS_MAX_STAGES  16
+#define DOS_MAX_ARGS    32
+#define DOS_MAX_LINE    8192
+
+typedef struct Chunk {
+    struct Chunk *next;
+    int len;
+    char data[DOS_CHUNK];
+} Chunk;
+
+typedef struct {
+    Chunk *head, *tail;
+    int count;
+    int closed;                /* the writer has finished */
+    int abandoned;             /* the reader has finished; writes are dropped */
+} Pipe;
+
+typedef struct Pipeline Pipeline;
+
+typedef struct {
+    Pipeline *pl;
+    int index;
+    const char *verb;
+    char *argv[DOS_MAX_ARGS];
+    int argc;
+    const char *raw;           /* text after the verb, for ECHO */
+    Pipe *in, *out;            /* in is NULL for the first stage */
+    Chunk *cur;                /* output being filled */
+    int stopped;               /* downstream is gone or the pipeline was cancelled */
+    void *state;               /* per-command data for chunk callbacks */
+    char err[256];
+    HANDLE thread;
+} Stage;
+
+struct Pipeline {
+    CRITICAL_SECTION lock;     /* guards the pipes and the free list */
+    CONDITION_VARIABLE cv;
+    Pipe pipes[DOS_MAX_STAGES];
+    Stage stages[DOS_MAX_STAGES];
+    int nstages;
+    Chunk *free_list;
+    int nfree;
+    volatile LONG cancel;
+    volatile LONG paged;       /* the last stage is MORE */
+};
+
+typedef void (*CmdFn)(Stage *st);
+
+/* ---- chunks and pipes ---- */
+
+static Chunk *chunk_get(Pipeline *pl) {
+    Chunk *c = NULL;
+    EnterCriticalSection(&pl->lock);
+    if (pl->free_list) { c = pl->free_list; pl->free_list = c->next; pl->nfree--; }
+    LeaveCriticalSection(&pl->lock);
+    if (!c) c = (Chunk*)malloc(sizeof(Chunk));
+    if (c) { c->next = NULL; c->len = 0; }
+    return c;
+}
+
+static void chunk_put(Pipeline *pl, Chunk *c) {
+    if (!c) return;
+    EnterCriticalSection(&pl->lock);
+    if (pl->nfree < DOS_FREE_CHUNKS) { c->next = pl->free_list; pl->free_list = c; pl->nfree++; c = NULL; }
+    LeaveCriticalSection(&pl->lock);
+    free(c);
+}
+
+static void free_chunks(Chunk *c) {
+    while (c) { Chunk *next = c->next; free(c); c = next; }
+}
+
+/* Queues c on the stage's output; FALSE (and c released) when nobody will read it */
+static BOOL pipe_push(Stage *st, Chunk *c) {
+    Pipeline *pl = st->pl;
+    Pipe *p = st->out;
+    EnterCriticalSection(&pl->lock);
+    while (p->count >= DOS_PIPE_DEPTH && !p->abandoned && !pl->cancel) SleepConditionVariableCS(&pl->cv, &pl->lock, INFINITE);
+    BOOL ok = !p->abandoned && !pl->cancel;
+    if (ok) {
+        c->next = NULL;
+        if (p->tail) p->tail->next = c; else p->head = c;
+        p->tail = c;
+        p->count++;
+        WakeAllConditionVariable(&pl->cv);
+    }
+    LeaveCriticalSection(&pl->lock);
+    if (!ok) { chunk_put(pl, c); st->stopped = 1; }
+    return ok;
+}
+
+/* Next chunk of p; NULL at end of input, on cancel, or when ms ran out (*timed_out set) */
+static Chunk *pipe_pop(Pipeline *pl, Pipe *p, DWORD ms, int *timed_out) {
+    Chunk *c = NULL;
+    EnterCriticalSection(&pl->lock);
+    while (!p->head && !p->closed && !pl->cancel) {
+        if (!SleepConditionVariableCS(&pl->cv, &pl->lock, ms) && ms != INFINITE) { *timed_out = 1; break; }
+    }
+    if (p->head && !pl->cancel) {
+        c = p->head;
+        p->head = c->next;
+        if (!p->head) p->tail = NULL;
+        p->count--;
+        WakeAllConditionVariable(&pl->cv);
+    }
+    LeaveCriticalSection(&pl->lock);
+    return c;
+}
+
+static void pipe_close(Pipeline *pl, Pipe *p) {
+    EnterCriticalSection(&pl->lock);
+    p->closed = 1;
+    WakeAllConditionVariable(&pl->cv);
+    LeaveCriticalSection(&pl->lock);
+}
+
+/* The reader is done: queued chunks are dropped and the writer stops at its next push */
+static void pipe_abandon(Pipeline *pl, Pipe *p) {
+    EnterCriticalSection(&pl->lock);
+    p->abandoned = 1;
+    Chunk *c = p->head;
+    p->head = p->tail = NULL;
+    p->count = 0;
+    WakeAllConditionVariable(&pl->cv);
+    LeaveCriticalSection(&pl->lock);
+    free_chunks(c);
+}
+
+static void pipeline_cancel(Pipeline *pl) {
+    EnterCriticalSection(&pl->lock);
+    InterlockedExchange(&pl->cancel, 1);
+    WakeAllConditionVariable(&pl->cv);
+    LeaveCriticalSection(&pl->lock);
+}
+
+/* ---- stage output ---- */
+
+static BOOL out_flush(Stage *st) {
+    Chunk *c = st->cur;
+    st->cur = NULL;
+    if (!c) return !st->stopped;
+    if (c->len == 0 || st->stopped) { chunk_put(st->pl, c); return !st->stopped; }
+    return pipe_push(st, c);
+}
+
+/* Writes pre followed by text, keeping both in one chunk so chunks end at line breaks */
+static BOOL out_line(Stage *st, const char *pre, int plen, const char *text, int len) {
+    if (st->stopped) return FALSE;
+    if (st->cur && st->cur->len + plen + len > DOS_CHUNK && !out_flush(st)) return FALSE;
+    while (plen + len > 0) {
+        if (!st->cur && (st->cur = chunk_get(st->pl)) == NULL) {
+            strncpy_s(st->err, sizeof(st->err), "Not enough memory", _TRUNCATE);
+            st->stopped = 1;
+            return FALSE;
+        }
+        Chunk *c = st->cur;
+        int k = plen < DOS_CHUNK - c->len ? plen : DOS_CHUNK - c->len;
+        memcpy(c->data + c->len, pre, k);
+        c->len += k; pre += k; plen -= k;
+        k = len < DOS_CHUNK - c->len ? len : DOS_CHUNK - c->len;
+        memcpy(c->data + c->len, text, k);
+        c->len += k; text += k; len -= k;
+        if (c->len == DOS_CHUNK && !out_flush(st)) return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOL out_printf(Stage *st, const char *fmt, ...) {
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) return FALSE;
+    if (n >= (int)sizeof(buf)) n = (int)sizeof(buf) - 1;
+    return out_line(st, NULL, 0, buf, n);
+}
+
+/* Passes a whole chunk on without copying it */
+static BOOL out_chunk(Stage *st, Chunk *c) {
+    if (!out_flush(st)) { chunk_put(st->pl, c); return FALSE; }
+    return pipe_push(st, c);
+}
+
+static void stage_error(Stage *st, const char *fmt, ...) {
+    va_list ap;
+    if (st->err[0]) return;
+    va_start(ap, fmt);
+    vsnprintf(st->err, sizeof(st->err), fmt, ap);
+    va_end(ap);
+}
+
+/* ---- stage input ---- */
+
+typedef BOOL (*ChunkFn)(Stage *st, Chunk *c);
+
+/* Streams a file as chunks that end at line breaks; the last line gets one if it lacks it */
+static BOOL read_file_chunks(Stage *st, const char *path, ChunkFn fn) {
+    Pipeline *pl = st->pl;
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+        stage_error(st, GetLastError() == ERROR_PATH_NOT_FOUND ? "The system cannot find the path specified - %s" : "File not found - %s", path);
+        return FALSE;
+    }
+    Chunk *c = NULL;
+    BOOL ok = TRUE;
+    for (;;) {
+        if (pl->cancel) { ok = FALSE; break; }
+        if (!c && (c = chunk_get(pl)) == NULL) { stage_error(st, "Not enough memory"); ok = FALSE; break; }
+        DWORD got = 0;
+        if (!ReadFile(h, c->data + c->len, (DWORD)(DOS_CHUNK - c->len), &got, NULL) || got == 0) break;
+        c->len += (int)got;
+        if (c->len < DOS_CHUNK) continue;
+        /* full: the partial last line moves to the next chunk */
+        Chunk *next = chunk_get(pl);
+        if (!next) { stage_error(st, "Not enough memory"); ok = FALSE; break; }
+        char *end = c->data + c->len, *nl = end;
+        while (nl > c->data && nl[-1] != '\n') nl--;
+        if (nl > c->data && nl < end) {
+            next->len = (int)(end - nl);
+            memcpy(next->data, nl, next->len);
+            c->len -= next->len;
+        }
+        Chunk *full = c;
+        c = next;
+        if (!fn(st, full)) { ok = FALSE; break; }
+    }
+    CloseHandle(h);
+    if (ok && c && c->len > 0) {
+        if (c->data[c->len - 1] != '\n') {
+            if (c->len + 2 > DOS_CHUNK) { Chunk *full = c; c = NULL; if (!fn(st, full)) return FALSE; if ((c = chunk_get(pl)) == NULL) return FALSE; }
+            c->data[c->len++] = '\r';
+            c->data[c->len++] = '\n';
+        }
+        Chunk *last = c;
+        c = NULL;
+        ok = fn(st, last);
+    }
+    chunk_put(pl, c);
+    return ok;
+}
+
+/* Feeds the named files, or the piped input when there are none, to fn */
+static void each_input(Stage *st, char **files, int nfiles, ChunkFn fn) {
+    if (nfiles > 0) {
+        for (int i = 0; i < nfiles && !st->stopped && !st->pl->cancel; ++i) read_file_chunks(st, files[i], fn);
+        return;
+    }
+    if (!st->in) return;
+    int unused = 0;
+    Chunk *c;
+    while ((c = pipe_pop(st->pl, st->in, INFINITE, &unused)) != NULL) {
+        if (!fn(st, c)) break;
+    }
+}
+
+/* ---- helpers ---- */
+
+static char lower_ch(char c) { return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c; }
+
+static int has_wildcards(const char *s) { return strpbrk(s, "*?") != NULL; }
+
+/* Splits the switches ("/S", "/b/a") off the arguments; returns the remaining count */
+static int split_switches(Stage *st, char **args, char *switches, size_t swlen) {
+    int n = 0;
+    size_t k = 0;
+    for (int i = 0; i < st->argc; ++i) {
+        const char *a = st->argv[i];
+        if (a[0] == '/' && a[1]) {
+            for (++a; *a; ++a) if (*a != '/' && k + 1 < swlen) switches[k++] = (char)toupper((unsigned char)*a);
+        } else args[n++] = st->argv[i];
+    }
+    switches[k] = 0;
+    return n;
+}
+
+static void fmt_thousands(unsigned long long v, char *out, size_t len) {
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%llu", v), k = 0;
+    char buf[40];
+    for (int i = 0; i < n; ++i) {
+        if (i > 0 && (n - i) % 3 == 0) buf[k++] = ',';
+        buf[k++] = tmp[i];
+    }
+    buf[k] = 0;
+    strncpy_s(out, len, buf, _TRUNCATE);
+}
+
+/* ---- DIR ---- */
+
+typedef struct {
+    Stage *st;
+    const char *dir;
+    const char *mask;
+    int bare, all, recurse;
+    int header_done;
+    unsigned long long files, dirs, bytes;
+    char **subdirs;
+    int nsub, capsub;
+} DirScan;
+
+typedef struct {
+    unsigned long long files, dirs, bytes;
+    int found;
+} DirTotals;
+
+static BOOL dir_entry(void *ctx, const WIN32_FIND_DATAA *fd) {
+    DirScan *d = (DirScan*)ctx;
+    Stage *st = d->st;
+    BOOL is_dir = (fd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    if (st->pl->cancel || st->stopped) return FALSE;
+    if (d->recurse && is_dir && strcmp(fd->cFileName, ".") != 0 && strcmp(fd->cFileName, "..") != 0 &&
+        !(fd->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+        if (d->nsub == d->capsub) {
+            int cap = d->capsub ? d->capsub * 2 : 16;
+            char **n = (char**)realloc(d->subdirs, sizeof(char*) * cap);
+            if (!n) return FALSE;
+            d->subdirs = n;
+            d->capsub = cap;
+        }
+        if ((d->subdirs[d->nsub] = _strdup(fd->cFileName)) != NULL) d->nsub++;
+    }
+    if (!d->all && (fd->dwFileAttributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) return TRUE;
+    if (!glob_match(d->mask, fd->cFileName)) return TRUE;
+    if (d->bare) {
+        if (strcmp(fd->cFileName, ".") == 0 || strcmp(fd->cFileName, "..") == 0) return TRUE;
+        if (is_dir) d->dirs++; else d->files++;
+        if (d->recurse) {
+            char full[MAX_PATH];
+            dir_join(full, sizeof(full), d->dir, fd->cFileName);
+            return out_printf(st, "%s\r\n", full);
+        }
+        return out_printf(st, "%s\r\n", fd->cFileName);
+    }
+    if (!d->header_done) {
+        d->header_done = 1;
+        if (!out_printf(st, "\r\n Directory of %s\r\n\r\n", d->dir)) return FALSE;
+    }
+    FILETIME lft;
+    SYSTEMTIME t;
+    FileTimeToLocalFileTime(&fd->ftLastWriteTime, &lft);
+    FileTimeToSystemTime(&lft, &t);
+    int hour12 = t.wHour % 12;
+    char size[32];
+    if (is_dir) {
+        d->dirs++;
+        strcpy_s(size, sizeof(size), "<DIR>         ");
+    } else {
+        unsigned long long sz = ((unsigned long long)fd->nFileSizeHigh << 32) | fd->nFileSizeLow;
+        d->files++;
+        d->bytes += sz;
+        char num[32];
+        fmt_thousands(sz, num, sizeof(num));
+        snprintf(size, sizeof(size), "%14s", num);
+    }
+    return out_printf(st, "%02d/%02d/%04d  %02d:%02d %s    %s %s\r\n", t.wMonth, t.wDay, t.wYear,
+                      hour12 ? hour12 : 12, t.wMinute, t.wHour >= 12 ? "PM" : "AM", size, fd->cFileName);
+}
+
+static void dir_scan(Stage *st, const char *dir, const char *mask, int bare, int all, int recurse, DirTotals *tot) {
+    DirScan d;
+    ZeroMemory(&d, sizeof(d));
+    d.st = st; d.dir = dir; d.mask = mask; d.bare = bare; d.all = all; d.recurse = recurse;
+    if (!dir_enum(dir, dir_entry, &d) && !recurse) stage_error(st, "The system cannot find the path specified - %s", dir);
+    if (d.files + d.dirs > 0) {
+        tot->found = 1;
+        tot->files += d.files; tot->dirs += d.dirs; tot->bytes += d.bytes;
+        if (!bare) {
+            char num[32];
+            fmt_thousands(d.bytes, num, sizeof(num));
+            out_printf(st, "%16llu File(s) %14s bytes\r\n", d.files, num);
+            if (!recurse) out_printf(st, "%16llu Dir(s)\r\n", d.dirs);
+        }
+    }
+    for (int i = 0; i < d.nsub; ++i) {
+        if (!st->stopped && !st->pl->cancel) {
+            char sub[MAX_PATH];
+            dir_join(sub, sizeof(sub), dir, d.subdirs[i]);
+            dir_scan(st, sub, mask, bare, all, recurse, tot);
+        }
+        free(d.subdirs[i]);
+    }
+    free(d.subdirs);
+}
+
+static void cmd_dir(Stage *st) {
+    char *args[DOS_MAX_ARGS], sw[32], full[MAX_PATH], dir[MAX_PATH];
+    int n = split_switches(st, args, sw, sizeof(sw));
+    int bare = strchr(sw, 'B') != NULL, all = strchr(sw, 'A') != NULL, recurse = strchr(sw, 'S') != NULL;
+    const char *spec = n > 0 ? args[0] : ".";
+    const char *mask = "*";
+    char *fname = NULL;
+    if (!GetFullPathNameA(spec, MAX_PATH, full, &fname)) { stage_error(st, "The filename, directory name, or volume label syntax is incorrect"); return; }
+    DWORD attr = has_wildcards(spec) ? INVALID_FILE_ATTRIBUTES : GetFileAttributesA(full);
+    if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY)) strncpy_s(dir, MAX_PATH, full, _TRUNCATE);
+    else if (fname) {
+        mask = spec + (strlen(spec) - strlen(fname));
+        if (mask < spec) mask = fname;
+        size_t dl = (size_t)(fname - full);
+        memcpy(dir, full, dl);
+        dir[dl] = 0;
+        if (dl > 3 && dir[dl - 1] == '\\') dir[dl - 1] = 0;
+    } else strncpy_s(dir, MAX_PATH, full, _TRUNCATE);
+
+    DirTotals tot;
+    ZeroMemory(&tot, sizeof(tot));
+    dir_scan(st, dir, mask, bare, all, recurse, &tot);
+    if (!tot.found && !st->err[0] && !st->pl->cancel) stage_error(st, "File Not Found");
+    else if (recurse && !bare && tot.found) {
+        char num[32];
+        fmt_thousands(tot.bytes, num, sizeof(num));
+        out_printf(st, "\r\n     Total Files Listed:\r\n%16llu File(s) %14s bytes\r\n%16llu Dir(s)\r\n", tot.files, num, tot.dirs);
+    }
+}
+
+/* ---- TYPE, MORE ---- */
+
+static void cmd_type(Stage *st) {
+    char *args[DOS_MAX_ARGS], sw[16];
+    int n = split_switches(st, args, sw, sizeof(sw));
+    if (n == 0) { stage_error(st, "The syntax of the command is incorrect"); return; }
+    each_input(st, args, n, out_chunk);
+}
+
+static void cmd_more(Stage *st) {
+    char *args[DOS_MAX_ARGS], sw[16];
+    int n = split_switches(st, args, sw, sizeof(sw));
+    if (st->index == st->pl->nstages - 1) InterlockedExchange(&st->pl->paged, 1);
+    each_input(st, args, n, out_chunk);
+}
+
+/* ---- FIND ---- */
+
+typedef struct {
+    const char *needle;
+    int nlen;
+    int icase, invert, count, number;
+    unsigned long long lineno, matches;
+} FindState;
+
+static int line_contains(const char *s, int len, const FindState *f) {
+    if (f->nlen == 0) return 1;
+    if (!f->icase) {
+        const char *end = s + len - f->nlen, *p = s;
+        while (p <= end && (p = (const char*)memchr(p, f->needle[0], (size_t)(end - p) + 1)) != NULL) {
+            if (memcmp(p, f->needle, f->nlen) == 0) return 1;
+            p++;
+        }
+        return 0;
+    }
+    char first = lower_ch(f->needle[0]);
+    for (int i = 0; i + f->nlen <= len; ++i) {
+        if (lower_ch(s[i]) != first) continue;
+        int k = 1;
+        while (k < f->nlen && lower_ch(s[i + k]) == lower_ch(f->needle[k])) k++;
+        if (k == f->nlen) return 1;
+    }
+    return 0;
+}
+
+/* Keeps the matching lines of c by compacting them inside c, then forwards it */
+static BOOL find_chunk(Stage *st, Chunk *c) {
+    FindState *f = (FindState*)st->state;
+    char *p = c->data, *end = c->data + c->len, *w = c->data;
+    while (p < end) {
+        char *nl = (char*)memchr(p, '\n', (size_t)(end - p));
+        char *le = nl ? nl + 1 : end;
+        int body = (int)(le - p);
+        while (body > 0 && (p[body - 1] == '\n' || p[body - 1] == '\r')) body--;
+        f->lineno++;
+        if (line_contains(p, body, f) != f->invert) {
+            f->matches++;
+            if (f->number) {
+                char pre[32];
+                int plen = snprintf(pre, sizeof(pre), "[%llu]", f->lineno);
+                if (!out_line(st, pre, plen, p, (int)(le - p))) { chunk_put(st->pl, c); return FALSE; }
+            } else if (!f->count) {
+                if (w != p) memmove(w, p, (size_t)(le - p));
+                w += le - p;
+            }
+        }
+        p = le;
+    }
+    if (f->count || f->number || w == c->data) {
+        chunk_put(st->pl, c);
+        return !st->stopped && !st->pl->cancel;
+    }
+    c->len = (int)(w - c->data);
+    return out_chunk(st, c);
+}
+
+static void cmd_find(Stage *st) {
+    char *args[DOS_MAX_ARGS], sw[16];
+    int n = split_switches(st, args, sw, sizeof(sw));
+    if (n == 0) { stage_error(st, "FIND: Parameter format not correct"); return; }
+    FindState f;
+    ZeroMemory(&f, sizeof(f));
+    f.needle = args[0];
+    f.nlen = (int)strlen(args[0]);
+    f.icase = strchr(sw, 'I') != NULL;
+    f.invert = strchr(sw, 'V') != NULL;
+    f.count = strchr(sw, 'C') != NULL;
+    f.number = strchr(sw, 'N') != NULL;
+    st->state = &f;
+    if (n == 1) {
+        each_input(st, NULL, 0, find_chunk);
+        if (f.count) out_printf(st, "%llu\r\n", f.matches);
+        return;
+    }
+    for (int i = 1; i < n && !st->stopped && !st->pl->cancel; ++i) {
+        char upper[MAX_PATH];
+        strncpy_s(upper, MAX_PATH, args[i], _TRUNCATE);
+        _strupr_s(upper, MAX_PATH);
+        f.lineno = f.matches = 0;
+        if (!f.count) out_printf(st, "\r\n---------- %s\r\n", upper);
+        read_file_chunks(st, args[i], find_chunk);
+        if (f.count) out_printf(st, "---------- %s: %llu\r\n", upper, f.matches);
+    }
+}
+
+/* ---- SORT ---- */
+
+typedef struct {
+    const char *p;
+    int len;                   /* without the line break */
+    int full;                  /* with it */
+} LineRef;
+
+typedef struct {
+    Chunk *kept;               /* chunks the lines point into */
+    LineRef *lines;
+    size_t n, cap;
+    int column;                /* /+n, 0-based */
+    int reverse;
+    int oom;
+} SortState;
+
+/* qsort has no context argument: the key settings are globals, held under sort_lock */
+static SRWLOCK sort_lock = SRWLOCK_INIT;
+static int sort_column;
+static int sort_reverse;
+
+static int cmp_lines(const void *a, const void *b) {
+    const LineRef *x = (const LineRef*)a, *y = (const LineRef*)b;
+    int xo = x->len > sort_column ? sort_column : x->len, yo = y->len > sort_column ? sort_column : y->len;
+    int xl = x->len - xo, yl = y->len - yo, n = xl < yl ? xl : yl;
+    int r = _strnicmp(x->p + xo, y->p + yo, (size_t)n);
+    if (r == 0) r = (xl > yl) - (xl < yl);
+    return sort_reverse ? -r : r;
+}
+
+static BOOL sort_chunk(Stage *st, Chunk *c) {
+    SortState *s = (SortState*)st->state;
+    c->next = s->kept;
+    s->kept = c;
+    char *p = c->data, *end = c->data + c->len;
+    while (p < end) {
+        char *nl = (char*)memchr(p, '\n', (size_t)(end - p));
+        char *le = nl ? nl + 1 : end;
+        if (s->n == s->cap) {
+            size_t cap = s->cap ? s->cap * 2 : 4096;
+            LineRef *nlines = (LineRef*)realloc(s->lines, cap * sizeof(LineRef));
+            if (!nlines) { s->oom = 1; return FALSE; }
+            s->lines = nlines;
+            s->cap = cap;
+        }
+        LineRef *r = &s->lines[s->n++];
+        r->p = p;
+        r->full = (int)(le - p);
+        r->len = r->full;
+        while (r->len > 0 && (p[r->len - 1] == '\n' || p[r->len - 1] == '\r')) r->len--;
+        p = le;
+    }
+    return !st->pl->cancel;
+}
+
+static void cmd_sort(Stage *st) {
+    char *args[DOS_MAX_ARGS], sw[16];
+    int n = split_switches(st, args, sw, sizeof(sw));
+    SortState s;
+    ZeroMemory(&s, sizeof(s));
+    s.reverse = strchr(sw, 'R') != NULL;
+    for (int i = 0; i < st->argc; ++i) if (st->argv[i][0] == '/' && st->argv[i][1] == '+') s.column = atoi(st->argv[i] + 2) - 1;
+    if (s.column < 0) s.column = 0;
+    st->state = &s;
+    each_input(st, args, n, sort_chunk);
+    if (s.oom) stage_error(st, "Not enough memory to sort");
+    else if (!st->pl->cancel) {
+        AcquireSRWLockExclusive(&sort_lock);
+        sort_column = s.column;
+        sort_reverse = s.reverse;
+        qsort(s.lines, s.n, sizeof(LineRef), cmp_lines);
+        ReleaseSRWLockExclusive(&sort_lock);
+        for (size_t i = 0; i < s.n && !st->stopped; ++i) {
+            const LineRef *r = &s.lines[i];
+            if (r->full > r->len) out_line(st, NULL, 0, r->p, r->full);
+            else out_line(st, r->p, r->len, "\r\n", 2);
+        }
+    }
+    free(s.lines);
+    while (s.kept) { Chunk *next = s.kept->next; chunk_put(st->pl, s.kept); s.kept = next; }
+}
+
+/* ---- COPY ---- */
+
+typedef struct {
+    const char *mask;
+    char **names;
+    int n, cap;
+} CopyScan;
+
+static BOOL copy_entry(void *ctx, const WIN32_FIND_DATAA *fd) {
+    CopyScan *c = (CopyScan*)ctx;
+    if ((fd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !glob_match(c->mask, fd->cFileName)) return TRUE;
+    if (c->n == c->cap) {
+        int cap = c->cap ? c->cap * 2 : 64;
+        char **n = (char**)realloc(c->names, sizeof(char*) * cap);
+        if (!n) return FALSE;
+        c->names = n;
+        c->cap = cap;
+    }
+    if ((c->names[c->n] = _strdup(fd->cFileName)) != NULL) c->n++;
+    return TRUE;
+}
+
+static void cmd_copy(Stage *st) {
+    char *args[DOS_MAX_ARGS], sw[16], src[MAX_PATH], dst[MAX_PATH];
+    char *fname = NULL;
+    int n = split_switches(st, args, sw, sizeof(sw));
+    if (n < 1 || n > 2) { stage_error(st, "The syntax of the command is incorrect"); return; }
+    if (!GetFullPathNameA(args[0], MAX_PATH, src, &fname) || !fname ||
+        !GetFullPathNameA(n > 1 ? args[1] : ".", MAX_PATH, dst, NULL)) {
+        stage_error(st, "The filename, directory name, or volume label syntax is incorrect");
+        return;
+    }
+    DWORD da = GetFileAttributesA(dst);
+    int to_dir = da != INVALID_FILE_ATTRIBUTES && (da & FILE_ATTRIBUTE_DIRECTORY);
+
+    if (!has_wildcards(fname)) {
+        char target[MAX_PATH];
+        if (to_dir) dir_join(target, sizeof(target), dst, fname);
+        else strncpy_s(target, MAX_PATH, dst, _TRUNCATE);
+        if (_stricmp(src, target) == 0) { stage_error(st, "The file cannot be copied onto itself"); return; }
+        if (!CopyFileA(src, target, FALSE)) {
+            stage_error(st, GetLastError() == ERROR_FILE_NOT_FOUND ? "The system cannot find the file specified" : "Cannot copy %s", args[0]);
+            out_printf(st, "        0 file(s) copied.\r\n");
+            return;
+        }
+        out_printf(st, "        1 file(s) copied.\r\n");
+        return;
+    }
+
+    /* wildcards: the matching files are copied on the batch engine's worker pool */
+    if (!to_dir) { stage_error(st, "The system cannot find the path specified"); return; }
+    CopyScan scan;
+    ZeroMemory(&scan, sizeof(scan));
+    scan.mask = fname;
+    BatchSpec spec;
+    ZeroMemory(&spec, sizeof(spec));
+    spec.op = BATCH_COPY;
+    size_t dl = (size_t)(fname - src);
+    memcpy(spec.dir, src, dl);
+    spec.dir[dl] = 0;
+    if (dl > 3 && spec.dir[dl - 1] == '\\') spec.dir[dl - 1] = 0;
+    strncpy_s(spec.dest, MAX_PATH, dst, _TRUNCATE);
+    dir_enum(spec.dir, copy_entry, &scan);
+    int copied = 0;
+    if (scan.n == 0) stage_error(st, "The system cannot find the file specified");
+    else {
+        Batch *b = batch_start(&spec, (const char *const *)scan.names, scan.n);
+        if (!b) stage_error(st, "Not enough memory");
+        else {
+            while (!batch_wait(b, 100)) if (st->pl->cancel) batch_cancel(b);
+            int done = 0, failed = 0;
+            batch_progress(b, &done, &failed);
+            const BatchFailure *fl;
+            if (batch_failures(b, &fl) > 0) stage_error(st, "Cannot copy %s", scan.names[fl[0].index]);
+            copied = done - failed;
+            batch_free(b);
+        }
+    }
+    out_printf(st, "%9d file(s) copied.\r\n", copied);
+    for (int i = 0; i < scan.n; ++i) free(scan.names[i]);
+    free(scan.names);
+}
+
+/* ---- small commands ---- */
+
+static void cmd_cd(Stage *st) {
+    char *args[DOS_MAX_ARGS], sw[16], cur[MAX_PATH];
+    int n = split_switches(st, args, sw, sizeof(sw));
+    if (n == 0) {
+        GetCurrentDirectoryA(MAX_PATH, cur);
+        out_printf(st, "%s\r\n", cur);
+    } else if (!SetCurrentDirectoryA(args[0])) stage_error(st, "The system cannot find the path specified");
+}
+
+static void cmd_echo(Stage *st) {
+    const char *t = st->raw;
+    if (*t == '.' || *t == ' ' || *t == '\t') t++;
+    else if (!*t) t = "ECHO is on.";
+    out_line(st, t, (int)strlen(t), "\r\n", 2);
+}
+
+static void cmd_ver(Stage *st) {
+    out_printf(st, "\r\nWC-DOS-Like Shell command interpreter\r\n\r\n");
+}
+
+static const struct { const char *name; CmdFn fn; } commands[] = {
+    { "DIR", cmd_dir }, { "TYPE", cmd_type }, { "FIND", cmd_find }, { "SORT", cmd_sort },
+    { "MORE", cmd_more }, { "COPY", cmd_copy }, { "CD", cmd_cd }, { "CHDIR", cmd_cd },
+    { "ECHO", cmd_echo }, { "VER", cmd_ver },
+};
+
+static CmdFn find_command(const char *verb) {
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i)
+        if (_stricmp(commands[i].name, verb) == 0) return commands[i].fn;
+    return NULL;
+}
+
+static DWORD WINAPI stage_thread(LPVOID param) {
+    Stage *st = (Stage*)param;
+    find_command(st->verb)(st);
+    out_flush(st);
+    pipe_close(st->pl, st->out);
+    if (st->in) pipe_abandon(st->pl, st->in);
+    return 0;
+}
+
+/* ---- parsing ---- */
+
+typedef struct {
+    char verb[16];
+    char *raw;                 /* text after the verb, for ECHO */
+    char *argv[DOS_MAX_ARGS];
+    int argc;
+    char *in_file, *out_file;
+    int append;
+} Segment;
+
+/* Splits a segment into verb and unquoted arguments; the arguments are copied into arena
+   (*used bytes of it taken so far) and s is left as typed. "dir/s" and "cd.." work as in
+   COMMAND.COM: the verb ends at the first character that cannot be part of a name, and a
+   switch glued to an argument starts a new one. Returns 0 on a syntax error. */
+static int parse_segment(char *s, Segment *seg, char *arena, size_t *used, size_t cap) {
+    ZeroMemory(seg, sizeof(*seg));
+    while (*s == ' ' || *s == '\t') s++;
+    size_t vl = 0;
+    while (*s && (isalnum((unsigned char)*s) || *s == '_' || *s == '-' || *s == '$' || *s == '~')) {
+        if (vl + 1 >= sizeof(seg->verb)) return 0;
+        seg->verb[vl++] = *s++;
+    }
+    seg->raw = s;
+    if (vl == 0) return *s == 0;
+
+    char *p = s;
+    char **target = NULL;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        if (*p == '<' || *p == '>') {
+            if (target) return 0;
+            if (*p == '>') { seg->append = p[1] == '>'; p += seg->append ? 2 : 1; target = &seg->out_file; }
+            else { p++; target = &seg->in_file; }
+            continue;
+        }
+        char *tok = arena + *used;
+        size_t k = *used;
+        int quoted = 0;
+        while (*p && (quoted || (*p != ' ' && *p != '\t' && *p != '<' && *p != '>'))) {
+            if (*p == '"') { quoted = !quoted; p++; continue; }
+            if (!quoted && *p == '/' && k > *used && !target) break;
+            if (k + 1 >= cap) return 0;
+            arena[k++] = *p++;
+        }
+        arena[k++] = 0;
+        *used = k;
+        if (target) { *target = tok; target = NULL; continue; }
+        if (seg->argc == DOS_MAX_ARGS) return 0;
+        seg->argv[seg->argc++] = tok;
+    }
+    return target == NULL;
+}
+
+/* Cuts ECHO's text at the first redirection outside quotes */
+static void trim_raw(char *raw) {
+    int quoted = 0;
+    for (char *p = raw; *p; ++p) {
+        if (*p == '"') quoted = !quoted;
+        else if (!quoted && (*p == '<' || *p == '>')) { *p = 0; break; }
+    }
+    size_t l = strlen(raw);
+    while (l > 0 && (raw[l - 1] == ' ' || raw[l - 1] == '\t')) raw[--l] = 0;
+}
+
+/* Splits line at '|' outside quotes; returns the segment count, 0 for a syntax error */
+static int split_pipeline(char *line, char **parts) {
+    int n = 0, quoted = 0;
+    parts[n++] = line;
+    for (char *p = line; *p; ++p) {
+        if (*p == '"') quoted = !quoted;
+        else if (*p == '|' && !quoted) {
+            if (n == DOS_MAX_STAGES - 1) return 0;    /* room for a '<' stage */
+            *p = 0;
+            parts[n++] = p + 1;
+        }
+    }
+    return n;
+}
+
+static void host_text(const DosHost *host, const char *text) {
+    host->write(host->ctx, text, (int)strlen(text));
+}
+
+/* Commands this interpreter does not know run in the real command processor */
+static DosResult run_external(const char *line, const DosHost *host) {
+    char comspec[MAX_PATH], cmd[DOS_MAX_LINE + MAX_PATH + 8];
+    if (!GetEnvironmentVariableA("COMSPEC", comspec, MAX_PATH)) strcpy_s(comspec, MAX_PATH, "cmd.exe");
+    snprintf(cmd, sizeof(cmd), "\"%s\" /c %s", comspec, line);
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    /* Ctrl+C belongs to the child while it runs */
+    HANDLE in = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD mode = 0;
+    GetConsoleMode(in, &mode);
+    SetConsoleMode(in, ENABLE_PROCESSED_INPUT | ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT | ENABLE_EXTENDED_FLAGS);
+    SetConsoleCtrlHandler(NULL, TRUE);
+    BOOL ok = CreateProcessA(NULL, cmd, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi);
+    DWORD code = 1;
+    if (ok) {
+        WaitForSingleObject(pi.hProcess, INFINITE);
+        GetExitCodeProcess(pi.hProcess, &code);
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+    }
+    SetConsoleCtrlHandler(NULL, FALSE);
+    SetConsoleMode(in, mode);
+    if (!ok) { host_text(host, "Bad command or file name\n"); return DOS_FAILED; }
+    return code == 0 ? DOS_OK : DOS_FAILED;
+}
+
+/* ---- output sink (calling thread) ---- */
+
+/* Writes a chunk to the screen, pausing every screenful when MORE asked for it */
+static BOOL sink_screen(Pipeline *pl, const DosHost *host, const char *p, int len, int *lines) {
+    int rows = host->rows > 2 ? host->rows - 1 : 24;
+    if (!pl->paged || !host->more) { host->write(host->ctx, p, len); return TRUE; }
+    const char *end = p + len;
+    while (p < end) {
+        const char *q = p;
+        while (q < end && *lines < rows) {
+            const char *nl = (const char*)memchr(q, '\n', (size_t)(end - q));
+            if (!nl) { q = end; break; }
+            q = nl + 1;
+            (*lines)++;
+        }
+        host->write(host->ctx, p, (int)(q - p));
+        p = q;
+        if (*lines >= rows) {
+            *lines = 0;
+            if (!host->more(host->ctx)) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+DosResult dos_execute(const char *line, const DosHost *host) {
+    char buf[DOS_MAX_LINE];
+    char arena[DOS_MAX_LINE + DOS_MAX_STAGES * DOS_MAX_ARGS];
+    char *parts[DOS_MAX_STAGES];
+    Segment segs[DOS_MAX_STAGES];
+    size_t used = 0;
+    strncpy_s(buf, sizeof(buf), line, _TRUNCATE);
+    char *s = buf;
+    while (*s == ' ' || *s == '\t' || *s == '@') s++;
+    if (!*s) return DOS_OK;
+
+    /* "D:" changes the drive */
+    if (isalpha((unsigned char)s[0]) && s[1] == ':' && (s[2] == 0 || s[2] == ' ')) {
+        char drive[3] = { s[0], ':', 0 };
+        if (!SetCurrentDirectoryA(drive)) { host_text(host, "The system cannot find the drive specified.\n"); return DOS_FAILED; }
+        return DOS_OK;
+    }
+
+    int n = split_pipeline(s, parts);
+    int ok = n > 0;
+    for (int i = 0; ok && i < n; ++i) {
+        ok = parse_segment(parts[i], &segs[i], arena, &used, sizeof(arena)) && segs[i].verb[0];
+        if (ok && segs[i].in_file && i > 0) ok = 0;
+        if (ok && segs[i].out_file && i < n - 1) ok = 0;
+    }
+    if (!ok) { host_text(host, "The syntax of the command is incorrect.\n"); return DOS_FAILED; }
+
+    if (n == 1 && segs[0].argc == 0 && _stricmp(segs[0].verb, "EXIT") == 0) return DOS_EXIT;
+    if (n == 1 && segs[0].argc == 0 && _stricmp(segs[0].verb, "CLS") == 0) {
+        if (host->clear) host->clear(host->ctx);
+        return DOS_OK;
+    }
+    for (int i = 0; i < n; ++i) if (!find_command(segs[i].verb)) return run_external(line, host);
+
+    /* the output file is opened before anything runs, as COMMAND.COM does */
+    HANDLE out_h = INVALID_HANDLE_VALUE;
+    const Segment *last = &segs[n - 1];
+    if (last->out_file) {
+        out_h = CreateFileA(last->out_file, GENERIC_WRITE, FILE_SHARE_READ, NULL, last->append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (out_h == INVALID_HANDLE_VALUE) { host_text(host, "The system cannot find the path specified.\n"); return DOS_FAILED; }
+        if (last->append) { LARGE_INTEGER zero; zero.QuadPart = 0; SetFilePointerEx(out_h, zero, NULL, FILE_END); }
+    }
+
+    Pipeline *pl = (Pipeline*)calloc(1, sizeof(Pipeline));
+    if (!pl) {
+        if (out_h != INVALID_HANDLE_VALUE) CloseHandle(out_h);
+        host_text(host, "Not enough memory.\n");
+        return DOS_FAILED;
+    }
+    InitializeCriticalSection(&pl->lock);
+    InitializeConditionVariable(&pl->cv);
+
+    /* "cmd < file" gets a TYPE stage in front */
+    if (segs[0].in_file) {
+        memmove(&segs[1], &segs[0], sizeof(Segment) * n);
+        ZeroMemory(&segs[0], sizeof(Segment));
+        strcpy_s(segs[0].verb, sizeof(segs[0].verb), "TYPE");
+        segs[0].argv[0] = segs[1].in_file;
+        segs[0].argc = 1;
+        n++;
+    }
+    pl->nstages = n;
+    for (int i = 0; i < n; ++i) {
+        Stage *st = &pl->stages[i];
+        st->pl = pl;
+        st->index = i;
+        st->verb = segs[i].verb;
+        st->raw = segs[i].raw ? segs[i].raw : "";
+        if (segs[i].raw) trim_raw(segs[i].raw);
+        memcpy(st->argv, segs[i].argv, sizeof(st->argv));
+        st->argc = segs[i].argc;
+        st->in = i > 0 ? &pl->pipes[i - 1] : NULL;
+        st->out = &pl->pipes[i];
+    }
+    int started = 0;
+    for (; started < n; ++started) {
+        Stage *st = &pl->stages[started];
+        if ((st->thread = CreateThread(NULL, 0, stage_thread, st, 0, NULL)) == NULL) break;
+    }
+    if (started < n) {
+        /* stages that never ran still have to look finished to their neighbours */
+        pipeline_cancel(pl);
+        for (int i = started; i < n; ++i) pipe_close(pl, &pl->pipes[i]);
+    }
+
+    /* drain the last pipe here, on the thread that owns the screen */
+    Pipe *tail = &pl->pipes[n - 1];
+    int lines = 0, failed_write = 0;
+    for (;;) {
+        int timed_out = 0;
+        Chunk *c = pipe_pop(pl, tail, 100, &timed_out);
+        if (!c) {
+            if (!timed_out) break;
+            if (host->interrupted && host->interrupted(host->ctx)) { pipeline_cancel(pl); host_text(host, "^C\n"); }
+            continue;
+        }
+        if (out_h != INVALID_HANDLE_VALUE) {
+            DWORD wrote = 0;
+            if (!WriteFile(out_h, c->data, (DWORD)c->len, &wrote, NULL) || (int)wrote != c->len) { failed_write = 1; pipeline_cancel(pl); }
+        } else if (!sink_screen(pl, host, c->data, c->len, &lines)) pipeline_cancel(pl);
+        chunk_put(pl, c);
+        if (host->interrupted && host->interrupted(host->ctx)) { pipeline_cancel(pl); host_text(host, "^C\n"); }
+    }
+    pipe_abandon(pl, tail);
+
+    for (int i = 0; i < started; ++i) {
+        WaitForSingleObject(pl->stages[i].thread, INFINITE);
+        CloseHandle(pl->stages[i].thread);
+    }
+    if (out_h != INVALID_HANDLE_VALUE) CloseHandle(out_h);
+
+    DosResult result = DOS_OK;
+    if (started < n) { host_text(host, "Not enough memory.\n"); result = DOS_FAILED; }
+    if (failed_write) { host_text(host, "There is not enough space on the disk.\n"); result = DOS_FAILED; }
+    for (int i = 0; i < n; ++i) {
+        Stage *st = &pl->stages[i];
+        if (st->err[0]) { host_text(host, st->err); host_text(host, "\n"); result = DOS_FAILED; }
+        chunk_put(pl, st->cur);
+    }
+    for (int i = 0; i < n; ++i) free_chunks(pl->pipes[i].head);
+    free_chunks(pl->free_list);
+    DeleteCriticalSection(&pl->lock);
+    free(pl);
+    return result;
+}
@@ -0,0 +1,28 @@
+// doscmd.h - In-process DOS command interpreter with threaded pipelines for "Command Prompt"
+#ifndef DOSCMD_H
+#define DOSCMD_H
+
+#include <windows.h>
+
+typedef struct {
+    void *ctx;
+    /* Console output (CP437 text, '\n' ends a line) */
+    void (*write)(void *ctx, const char *text, int len);
+    /* Polled while a command runs; nonzero cancels it. May be NULL. */
+    int (*interrupted)(void *ctx);
+    /* MORE: a screenful has been shown; return 0 to stop the output. May be NULL. */
+    int (*more)(void *ctx);
+    /* CLS. May be NULL. */
+    void (*clear)(void *ctx);
+    int rows;                  /* screen height for MORE */
+} DosHost;
+
+typedef enum { DOS_OK = 0, DOS_FAILED = 1, DOS_EXIT = 2 } DosResult;
+
+/* Runs one command line. DIR, TYPE, FIND, SORT, MORE, COPY, CD, ECHO, CLS, VER and EXIT run
+   in process: the stages of a pipeline ('|') run on their own threads, and '<', '>' and '>>'
+   redirect the first stage's input and the last stage's output. A line naming any other
+   command is handed to %COMSPEC% /c. Messages go to host->write. */
+DosResult dos_execute(const char *line, const DosHost *host);
+
+#endif
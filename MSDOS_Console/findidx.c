@@ -0,0 +1,926 @@
+// findidx.c - Trigram filename index for the "Find file" mode (Windows, C)
+//
+// The index is one file that is mapped read-only for queries:
+//   header | entries (parent, name) | name pool | postings | bucket offsets
+// Every name is split into lowercase trigrams hashed into 2^20 buckets; each bucket holds
+// the ascending entry ids containing it, delta + varint encoded. A query intersects the
+// posting lists of its own trigrams and verifies the few survivors against the names.
+// The index is built by a pool of crawler threads and kept fresh by a directory watcher
+// that records changes in a small overlay until the next background rebuild.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "findidx.h"
+
+#define FIDX_MAGIC       "WCFIDX1"
+#define FIDX_VERSION     1
+#define FIDX_BUCKET_BITS 20
+#define FIDX_BUCKETS     (1u << FIDX_BUCKET_BITS)
+#define FIDX_SHARD_IDS   (32u * 1024 * 1024) /* postings decoded in memory per build pass */
+#define FIDX_OVERLAY_MAX 20000               /* pending changes before a rebuild is forced */
+#define FIDX_NO_PARENT   0xFFFFFFFFu
+#define FIDX_F_DIR       1
+#define FIDX_MAX_DEPTH   128
+#define FIDX_STALE_AFTER (60ULL * 60 * 10000000) /* index age (100ns units) that earns a catch-up */
+#define FIDX_CATCHUP_MS  30000                   /* the catch-up waits for startup to settle */
+
+typedef struct {
+    char magic[8];
+    DWORD version, nbuckets;
+    DWORD count, reserved;
+    unsigned long long entries_off, names_off, names_len;
+    unsigned long long postings_off, postings_len, buckets_off;
+    char root[MAX_PATH];
+} FidxHeader;
+
+typedef struct {
+    DWORD parent;
+    DWORD name_off;
+    WORD name_len;
+    WORD flags;
+} FidxEntry;
+
+typedef struct {
+    char *rel;         /* path relative to root */
+    unsigned long long hash;     /* path_hash of rel */
+    BYTE removed;
+    BYTE is_dir;
+    LONG seq;
+} OverlayItem;
+
+struct FindIndex {
+    char root[MAX_PATH];
+    char index_path[MAX_PATH];
+
+    SRWLOCK lock;      /* guards the mapping below */
+    HANDLE file, map;
+    const BYTE *base;
+    const FidxHeader *hdr;
+    const FidxEntry *entries;
+    const char *names;
+    const BYTE *postings;
+    const unsigned long long *buckets;
+    unsigned long long *path_hashes;   /* path_hash of every entry's relative path */
+
+    CRITICAL_SECTION ov_lock;
+    OverlayItem *ov;
+    int ov_count, ov_cap;
+    int *ov_slots;     /* open addressing on hash: index + 1 into ov, 0 when free */
+    int ov_slot_cap;
+    volatile LONG seq;
+
+    HANDLE stop_event, rebuild_event;
+    HANDLE watch_thread, maint_thread;
+    volatile LONG building, progress, cancel;
+    volatile LONG stale;   /* the mapped index predates this run by FIDX_STALE_AFTER */
+};
+
+static unsigned char lc(unsigned char c) { return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : c; }
+
+static DWORD tri_hash(const char *p) {
+    DWORD v = lc((unsigned char)p[0]) | ((DWORD)lc((unsigned char)p[1]) << 8) | ((DWORD)lc((unsigned char)p[2]) << 16);
+    return (v * 2654435761u) >> (32 - FIDX_BUCKET_BITS);
+}
+
+/* Distinct, ascending bucket ids of a name's trigrams */
+static int name_buckets(const char *name, int len, DWORD *out) {
+    int n = 0;
+    for (int i = 0; i + 3 <= len; ++i) {
+        DWORD h = tri_hash(name + i);
+        int j = n;
+        while (j > 0 && out[j-1] > h) { out[j] = out[j-1]; j--; }
+        if (j > 0 && out[j-1] == h) { memmove(out + j, out + j + 1, sizeof(DWORD) * (n - j)); continue; }
+        out[j] = h; n++;
+    }
+    return n;
+}
+
+/* Case-insensitive FNV-1a over a relative path; entries chain it from their parent */
+#define PATH_HASH_SEED 14695981039346656037ull
+
+static unsigned long long path_fold(unsigned long long h, const char *s, size_t len) {
+    for (size_t i = 0; i < len; ++i) { h ^= lc((unsigned char)s[i]); h *= 1099511628211ull; }
+    return h;
+}
+
+static unsigned long long path_hash(const char *rel) {
+    return path_fold(PATH_HASH_SEED, rel, strlen(rel));
+}
+
+static void join_path(char *dst, size_t len, const char *dir, const char *name) {
+    size_t l = strlen(dir);
+    snprintf(dst, len, (l > 0 && dir[l-1] == '\\') ? "%s%s" : "%s\\%s", dir, name);
+}
+
+/* ---- crawler ---- */
+
+typedef struct CrawlDir {
+    struct CrawlDir *next;
+    DWORD id;
+    char path[MAX_PATH];
+} CrawlDir;
+
+typedef struct {
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE cv;
+    CrawlDir *queue;
+    int pending;              /* queued + being enumerated */
+    FidxEntry *entries;
+    DWORD count, cap;
+    char *names;
+    size_t names_len, names_cap;
+    BOOL failed;
+    volatile LONG *progress, *cancel;
+    BOOL background;          /* low CPU and I/O priority for the workers */
+} Crawl;
+
+typedef struct {
+    char name[MAX_PATH];
+    BOOL is_dir, descend;
+} CrawlItem;
+
+static BOOL crawl_append(Crawl *c, DWORD parent, const char *name, WORD flags, DWORD *id) {
+    size_t nlen = strlen(name);
+    if (c->count == c->cap) {
+        DWORD ncap = c->cap ? c->cap * 2 : 65536;
+        FidxEntry *n = (FidxEntry*)realloc(c->entries, sizeof(FidxEntry) * ncap);
+        if (!n) return FALSE;
+        c->entries = n; c->cap = ncap;
+    }
+    if (c->names_len + nlen > c->names_cap) {
+        size_t ncap = c->names_cap ? c->names_cap * 2 : 1024 * 1024;
+        char *n = (char*)realloc(c->names, ncap);
+        if (!n) return FALSE;
+        c->names = n; c->names_cap = ncap;
+    }
+    if (c->names_len + nlen > 0xFFFFFFFFu) return FALSE;
+    FidxEntry *e = &c->entries[c->count];
+    e->parent = parent;
+    e->name_off = (DWORD)c->names_len;
+    e->name_len = (WORD)nlen;
+    e->flags = flags;
+    memcpy(c->names + c->names_len, name, nlen);
+    c->names_len += nlen;
+    *id = c->count++;
+    return TRUE;
+}
+
+static DWORD WINAPI crawl_worker(LPVOID param) {
+    Crawl *c = (Crawl*)param;
+    int bcap = 256, bcount;
+    if (c->background) SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    CrawlItem *batch = (CrawlItem*)malloc(sizeof(CrawlItem) * bcap);
+    if (!batch) {
+        EnterCriticalSection(&c->lock); c->failed = TRUE; LeaveCriticalSection(&c->lock);
+        return 0;
+    }
+    for (;;) {
+        EnterCriticalSection(&c->lock);
+        while (!c->queue && c->pending > 0) SleepConditionVariableCS(&c->cv, &c->lock, INFINITE);
+        CrawlDir *d = c->queue;
+        if (d) c->queue = d->next;
+        LeaveCriticalSection(&c->lock);
+        if (!d) break;
+
+        /* enumerate outside the lock, then publish the whole directory at once */
+        bcount = 0;
+        if (!*c->cancel && !c->failed) {
+            char search[MAX_PATH];
+            WIN32_FIND_DATAA fd;
+            join_path(search, sizeof(search), d->path, "*");
+            HANDLE h = FindFirstFileExA(search, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+            if (h != INVALID_HANDLE_VALUE) {
+                do {
+                    if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+                    if (bcount == bcap) {
+                        CrawlItem *n = (CrawlItem*)realloc(batch, sizeof(CrawlItem) * bcap * 2);
+                        if (!n) break;
+                        batch = n; bcap *= 2;
+                    }
+                    CrawlItem *it = &batch[bcount++];
+                    strncpy_s(it->name, MAX_PATH, fd.cFileName, _TRUNCATE);
+                    it->is_dir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+                    /* junctions and symlinked dirs are listed but not followed */
+                    it->descend = it->is_dir && !(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT);
+                } while (FindNextFileA(h, &fd));
+                FindClose(h);
+            }
+        }
+
+        EnterCriticalSection(&c->lock);
+        for (int i = 0; i < bcount && !c->failed; ++i) {
+            DWORD id;
+            if (!crawl_append(c, d->id, batch[i].name, batch[i].is_dir ? FIDX_F_DIR : 0, &id)) { c->failed = TRUE; break; }
+            if (!batch[i].descend || strlen(d->path) + strlen(batch[i].name) + 3 >= MAX_PATH) continue;
+            CrawlDir *sub = (CrawlDir*)malloc(sizeof(CrawlDir));
+            if (!sub) { c->failed = TRUE; break; }
+            sub->id = id;
+            join_path(sub->path, MAX_PATH, d->path, batch[i].name);
+            sub->next = c->queue;
+            c->queue = sub;
+            c->pending++;
+        }
+        c->pending--;
+        InterlockedExchange(c->progress, (LONG)c->count);
+        WakeAllConditionVariable(&c->cv);
+        LeaveCriticalSection(&c->lock);
+        free(d);
+    }
+    free(batch);
+    return 0;
+}
+
+static BOOL crawl_run(Crawl *c, const char *root) {
+    DWORD root_id;
+    CrawlDir *d = (CrawlDir*)malloc(sizeof(CrawlDir));
+    if (!d || !crawl_append(c, FIDX_NO_PARENT, "", FIDX_F_DIR, &root_id)) { free(d); return FALSE; }
+    d->next = NULL;
+    d->id = root_id;
+    strncpy_s(d->path, MAX_PATH, root, _TRUNCATE);
+    c->queue = d;
+    c->pending = 1;
+
+    /* directory enumeration is latency bound, so run more threads than cores */
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    int nthreads = (int)si.dwNumberOfProcessors * 2;
+    if (nthreads < 2) nthreads = 2;
+    if (nthreads > 32) nthreads = 32;
+    HANDLE threads[32];
+    int started = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        threads[started] = CreateThread(NULL, 0, crawl_worker, c, 0, NULL);
+        if (threads[started]) started++;
+    }
+    if (started == 0) crawl_worker(c);
+    else WaitForMultipleObjects((DWORD)started, threads, TRUE, INFINITE);
+    for (int i = 0; i < started; ++i) CloseHandle(threads[i]);
+    while (c->queue) { CrawlDir *n = c->queue->next; free(c->queue); c->queue = n; }
+    return !c->failed && !*c->cancel;
+}
+
+/* ---- index writer ---- */
+
+typedef struct {
+    HANDLE h;
+    BYTE *buf;
+    DWORD len;
+    unsigned long long pos;
+    BOOL err;
+} Writer;
+
+#define WRITER_BUF (4 * 1024 * 1024)
+
+static void w_flush(Writer *w) {
+    DWORD wr = 0;
+    if (w->len && (!WriteFile(w->h, w->buf, w->len, &wr, NULL) || wr != w->len)) w->err = TRUE;
+    w->len = 0;
+}
+
+static void w_put(Writer *w, const void *data, size_t n) {
+    const BYTE *p = (const BYTE*)data;
+    w->pos += n;
+    while (n > 0) {
+        DWORD room = WRITER_BUF - w->len;
+        DWORD k = (n < room) ? (DWORD)n : room;
+        memcpy(w->buf + w->len, p, k);
+        w->len += k; p += k; n -= k;
+        if (w->len == WRITER_BUF) w_flush(w);
+    }
+}
+
+static void w_varint(Writer *w, DWORD v) {
+    BYTE b[5];
+    int n = 0;
+    while (v >= 0x80) { b[n++] = (BYTE)(v | 0x80); v >>= 7; }
+    b[n++] = (BYTE)v;
+    w_put(w, b, n);
+}
+
+static void w_align(Writer *w) {
+    static const BYTE zero[8] = { 0 };
+    if (w->pos % 8) w_put(w, zero, (size_t)(8 - w->pos % 8));
+}
+
+static BOOL write_index(const Crawl *c, const char *root, const char *path) {
+    DWORD *counts = (DWORD*)calloc(FIDX_BUCKETS, sizeof(DWORD));
+    DWORD *cursor = (DWORD*)malloc(sizeof(DWORD) * FIDX_BUCKETS);
+    unsigned long long *boff = (unsigned long long*)malloc(sizeof(unsigned long long) * (FIDX_BUCKETS + 1));
+    Writer w = { INVALID_HANDLE_VALUE, (BYTE*)malloc(WRITER_BUF), 0, 0, FALSE };
+    DWORD tri[MAX_PATH];
+    BOOL ok = FALSE;
+    if (!counts || !cursor || !boff || !w.buf) goto done;
+
+    w.h = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (w.h == INVALID_HANDLE_VALUE) goto done;
+
+    FidxHeader hdr;
+    ZeroMemory(&hdr, sizeof(hdr));
+    memcpy(hdr.magic, FIDX_MAGIC, sizeof(FIDX_MAGIC));
+    hdr.version = FIDX_VERSION;
+    hdr.nbuckets = FIDX_BUCKETS;
+    hdr.count = c->count;
+    strncpy_s(hdr.root, MAX_PATH, root, _TRUNCATE);
+    w_put(&w, &hdr, sizeof(hdr));
+    w_align(&w);
+    hdr.entries_off = w.pos;
+    w_put(&w, c->entries, sizeof(FidxEntry) * (size_t)c->count);
+    hdr.names_off = w.pos;
+    hdr.names_len = c->names_len;
+    w_put(&w, c->names, c->names_len);
+
+    for (DWORD id = 0; id < c->count; ++id) {
+        const FidxEntry *e = &c->entries[id];
+        int n = name_buckets(c->names + e->name_off, e->name_len, tri);
+        for (int k = 0; k < n; ++k) counts[tri[k]]++;
+    }
+
+    /* postings are produced bucket range by bucket range so memory stays bounded */
+    hdr.postings_off = w.pos;
+    DWORD b = 0;
+    while (b < FIDX_BUCKETS) {
+        unsigned long long sum = 0;
+        DWORD e = b;
+        while (e < FIDX_BUCKETS && (e == b || sum + counts[e] <= FIDX_SHARD_IDS)) sum += counts[e++];
+        DWORD *ids = (DWORD*)malloc(sizeof(DWORD) * (size_t)(sum ? sum : 1));
+        if (!ids) goto done;
+        DWORD at = 0;
+        for (DWORD k = b; k < e; ++k) { cursor[k] = at; at += counts[k]; }
+        for (DWORD id = 0; id < c->count; ++id) {
+            const FidxEntry *en = &c->entries[id];
+            int n = name_buckets(c->names + en->name_off, en->name_len, tri);
+            for (int k = 0; k < n; ++k) if (tri[k] >= b && tri[k] < e) ids[cursor[tri[k]]++] = id;
+        }
+        at = 0;
+        for (DWORD k = b; k < e; ++k) {
+            boff[k] = w.pos - hdr.postings_off;
+            DWORD prev = 0;
+            for (DWORD i = 0; i < counts[k]; ++i, ++at) { w_varint(&w, ids[at] - prev); prev = ids[at]; }
+        }
+        free(ids);
+        b = e;
+    }
+    boff[FIDX_BUCKETS] = w.pos - hdr.postings_off;
+    hdr.postings_len = boff[FIDX_BUCKETS];
+    w_align(&w);
+    hdr.buckets_off = w.pos;
+    w_put(&w, boff, sizeof(unsigned long long) * (FIDX_BUCKETS + 1));
+    w_flush(&w);
+
+    LARGE_INTEGER zero; zero.QuadPart = 0;
+    DWORD wr = 0;
+    ok = !w.err && SetFilePointerEx(w.h, zero, NULL, FILE_BEGIN) && WriteFile(w.h, &hdr, sizeof(hdr), &wr, NULL) && wr == sizeof(hdr);
+
+done:
+    if (w.h != INVALID_HANDLE_VALUE) CloseHandle(w.h);
+    if (!ok) DeleteFileA(path);
+    free(w.buf); free(boff); free(cursor); free(counts);
+    return ok;
+}
+
+static BOOL build_index(FindIndex *ix, const char *tmp_path, BOOL background) {
+    Crawl c;
+    ZeroMemory(&c, sizeof(c));
+    InitializeCriticalSection(&c.lock);
+    InitializeConditionVariable(&c.cv);
+    c.progress = &ix->progress;
+    c.cancel = &ix->cancel;
+    c.background = background;
+    BOOL ok = crawl_run(&c, ix->root);
+    if (ok && background) SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    ok = ok && write_index(&c, ix->root, tmp_path);
+    if (background) SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+    DeleteCriticalSection(&c.lock);
+    free(c.entries);
+    free(c.names);
+    return ok;
+}
+
+/* ---- mapping ---- */
+
+static void unmap_index(FindIndex *ix) {
+    if (ix->base) UnmapViewOfFile(ix->base);
+    if (ix->map) CloseHandle(ix->map);
+    if (ix->file && ix->file != INVALID_HANDLE_VALUE) CloseHandle(ix->file);
+    free(ix->path_hashes);
+    ix->base = NULL; ix->map = NULL; ix->file = NULL; ix->hdr = NULL; ix->path_hashes = NULL;
+}
+
+static BOOL map_index(FindIndex *ix) {
+    ix->file = CreateFileA(ix->index_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (ix->file == INVALID_HANDLE_VALUE) { ix->file = NULL; return FALSE; }
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(ix->file, &sz) || sz.QuadPart < (LONGLONG)sizeof(FidxHeader)) { unmap_index(ix); return FALSE; }
+    ix->map = CreateFileMappingA(ix->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!ix->map) { unmap_index(ix); return FALSE; }
+    ix->base = (const BYTE*)MapViewOfFile(ix->map, FILE_MAP_READ, 0, 0, 0);
+    if (!ix->base) { unmap_index(ix); return FALSE; }
+
+    const FidxHeader *h = (const FidxHeader*)ix->base;
+    unsigned long long size = (unsigned long long)sz.QuadPart;
+    if (memcmp(h->magic, FIDX_MAGIC, sizeof(FIDX_MAGIC)) != 0 || h->version != FIDX_VERSION ||
+        h->nbuckets != FIDX_BUCKETS || _stricmp(h->root, ix->root) != 0 ||
+        h->entries_off + (unsigned long long)h->count * sizeof(FidxEntry) > size ||
+        h->names_off + h->names_len > size || h->postings_off + h->postings_len > size ||
+        h->buckets_off + sizeof(unsigned long long) * (FIDX_BUCKETS + 1) > size) {
+        unmap_index(ix);
+        return FALSE;
+    }
+    ix->entries = (const FidxEntry*)(ix->base + h->entries_off);
+    ix->names = (const char*)(ix->base + h->names_off);
+    ix->postings = ix->base + h->postings_off;
+    ix->buckets = (const unsigned long long*)(ix->base + h->buckets_off);
+
+    /* the crawler appends a directory before its contents, so one pass in id order
+       hashes every path from its parent's */
+    ix->path_hashes = (unsigned long long*)malloc(sizeof(unsigned long long) * ((size_t)h->count + 1));
+    if (!ix->path_hashes) { unmap_index(ix); return FALSE; }
+    for (DWORD id = 0; id < h->count; ++id) {
+        const FidxEntry *e = &ix->entries[id];
+        unsigned long long ph = PATH_HASH_SEED;
+        if (e->name_off + (unsigned long long)e->name_len > h->names_len) { ix->path_hashes[id] = ph; continue; }
+        if (e->parent < id && ix->entries[e->parent].name_len) ph = path_fold(ix->path_hashes[e->parent], "\\", 1);
+        ix->path_hashes[id] = path_fold(ph, ix->names + e->name_off, e->name_len);
+    }
+    ix->hdr = h;
+    return TRUE;
+}
+
+/* ---- overlay of changes seen since the last build ---- */
+
+/* Item for the path with this hash, or NULL. Caller holds ov_lock. */
+static OverlayItem *overlay_find(const FindIndex *ix, unsigned long long hash, const char *rel) {
+    if (!ix->ov_slot_cap) return NULL;
+    for (int s = (int)(hash & (ix->ov_slot_cap - 1)); ix->ov_slots[s]; s = (s + 1) & (ix->ov_slot_cap - 1)) {
+        OverlayItem *it = &ix->ov[ix->ov_slots[s] - 1];
+        if (it->hash == hash && (!rel || _stricmp(it->rel, rel) == 0)) return it;
+    }
+    return NULL;
+}
+
+/* Refills the slots from ov, growing them to keep the load under one half */
+static void overlay_rehash(FindIndex *ix) {
+    int cap = ix->ov_slot_cap ? ix->ov_slot_cap : 128;
+    while (cap < (ix->ov_count + 1) * 2) cap *= 2;
+    if (cap != ix->ov_slot_cap) {
+        int *n = (int*)malloc(sizeof(int) * cap);
+        if (!n) return;
+        free(ix->ov_slots);
+        ix->ov_slots = n;
+        ix->ov_slot_cap = cap;
+    }
+    ZeroMemory(ix->ov_slots, sizeof(int) * cap);
+    for (int i = 0; i < ix->ov_count; ++i) {
+        int s = (int)(ix->ov[i].hash & (cap - 1));
+        while (ix->ov_slots[s]) s = (s + 1) & (cap - 1);
+        ix->ov_slots[s] = i + 1;
+    }
+}
+
+/* Adds or replaces the item for rel; returns the number of pending items */
+static int overlay_add(FindIndex *ix, const char *rel, BOOL removed, BOOL is_dir) {
+    unsigned long long hash = path_hash(rel);
+    EnterCriticalSection(&ix->ov_lock);
+    /* one item per path: the latest action wins */
+    OverlayItem *it = overlay_find(ix, hash, rel);
+    if (it) {
+        it->removed = (BYTE)removed;
+        it->is_dir = (BYTE)is_dir;
+        it->seq = InterlockedIncrement(&ix->seq);
+        int n = ix->ov_count;
+        LeaveCriticalSection(&ix->ov_lock);
+        return n;
+    }
+    if ((ix->ov_count + 1) * 2 > ix->ov_slot_cap) overlay_rehash(ix);
+    if ((ix->ov_count + 1) * 2 > ix->ov_slot_cap) {
+        LeaveCriticalSection(&ix->ov_lock);
+        return FIDX_OVERLAY_MAX + 1;        /* out of memory: let a rebuild catch up */
+    }
+    if (ix->ov_count == ix->ov_cap) {
+        int ncap = ix->ov_cap ? ix->ov_cap * 2 : 64;
+        OverlayItem *n = (OverlayItem*)realloc(ix->ov, sizeof(OverlayItem) * ncap);
+        if (n) { ix->ov = n; ix->ov_cap = ncap; }
+    }
+    if (ix->ov_count < ix->ov_cap) {
+        it = &ix->ov[ix->ov_count];
+        it->rel = _strdup(rel);
+        if (it->rel) {
+            it->hash = hash;
+            it->removed = (BYTE)removed;
+            it->is_dir = (BYTE)is_dir;
+            it->seq = InterlockedIncrement(&ix->seq);
+            int s = (int)(hash & (ix->ov_slot_cap - 1));
+            while (ix->ov_slots[s]) s = (s + 1) & (ix->ov_slot_cap - 1);
+            ix->ov_slots[s] = ++ix->ov_count;
+        }
+    }
+    int n = ix->ov_count;
+    LeaveCriticalSection(&ix->ov_lock);
+    return n;
+}
+
+typedef struct OverlayDir {
+    struct OverlayDir *next;
+    char rel[MAX_PATH];
+} OverlayDir;
+
+/* Lists a subtree moved in under the root into the overlay; the watcher only reports its top.
+   Stops once the overlay is big enough to force a rebuild anyway. Returns the pending count. */
+static int overlay_crawl(FindIndex *ix, const char *top) {
+    int n = 0;
+    OverlayDir *stack = (OverlayDir*)malloc(sizeof(OverlayDir));
+    if (!stack) return FIDX_OVERLAY_MAX + 1;
+    stack->next = NULL;
+    strncpy_s(stack->rel, MAX_PATH, top, _TRUNCATE);
+    while (stack && n <= FIDX_OVERLAY_MAX && !ix->cancel) {
+        OverlayDir *d = stack;
+        stack = d->next;
+        char search[MAX_PATH], full[MAX_PATH];
+        WIN32_FIND_DATAA fd;
+        join_path(full, sizeof(full), ix->root, d->rel);
+        join_path(search, sizeof(search), full, "*");
+        HANDLE h = FindFirstFileExA(search, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+        if (h != INVALID_HANDLE_VALUE) {
+            do {
+                if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+                char rel[MAX_PATH];
+                join_path(rel, sizeof(rel), d->rel, fd.cFileName);
+                BOOL is_dir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+                n = overlay_add(ix, rel, FALSE, is_dir);
+                /* like the crawler: junctions and symlinked dirs are listed but not followed */
+                if (is_dir && !(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                    OverlayDir *sub = (OverlayDir*)malloc(sizeof(OverlayDir));
+                    if (!sub) { n = FIDX_OVERLAY_MAX + 1; break; }
+                    strncpy_s(sub->rel, MAX_PATH, rel, _TRUNCATE);
+                    sub->next = stack;
+                    stack = sub;
+                }
+            } while (n <= FIDX_OVERLAY_MAX && FindNextFileA(h, &fd));
+            FindClose(h);
+        }
+        free(d);
+    }
+    while (stack) { OverlayDir *next = stack->next; free(stack); stack = next; }
+    return n;
+}
+
+static void overlay_record(FindIndex *ix, const char *rel, DWORD action) {
+    BOOL removed = (action == FILE_ACTION_REMOVED || action == FILE_ACTION_RENAMED_OLD_NAME);
+    char full[MAX_PATH];
+    join_path(full, sizeof(full), ix->root, rel);
+    DWORD attr = removed ? INVALID_FILE_ATTRIBUTES : GetFileAttributesA(full);
+    BOOL is_dir = (attr != INVALID_FILE_ATTRIBUTES) && (attr & FILE_ATTRIBUTE_DIRECTORY);
+    int n = overlay_add(ix, rel, removed, is_dir);
+
+    /* a new directory is empty and its contents are reported one by one, but a directory
+       moved in brings a whole subtree at once */
+    if (is_dir && action == FILE_ACTION_RENAMED_NEW_NAME && !(attr & FILE_ATTRIBUTE_REPARSE_POINT)) n = overlay_crawl(ix, rel);
+    if (n > FIDX_OVERLAY_MAX) SetEvent(ix->rebuild_event);
+}
+
+static void overlay_drop_through(FindIndex *ix, LONG seq) {
+    EnterCriticalSection(&ix->ov_lock);
+    int out = 0;
+    for (int i = 0; i < ix->ov_count; ++i) {
+        if (ix->ov[i].seq <= seq) free(ix->ov[i].rel);
+        else ix->ov[out++] = ix->ov[i];
+    }
+    ix->ov_count = out;
+    overlay_rehash(ix);
+    LeaveCriticalSection(&ix->ov_lock);
+}
+
+static DWORD WINAPI watch_thread(LPVOID param) {
+    FindIndex *ix = (FindIndex*)param;
+    HANDLE dir = CreateFileA(ix->root, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (dir == INVALID_HANDLE_VALUE) return 0;
+    DWORD *buf = (DWORD*)malloc(64 * 1024);
+    OVERLAPPED ov;
+    ZeroMemory(&ov, sizeof(ov));
+    ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (!buf || !ov.hEvent) { free(buf); if (ov.hEvent) CloseHandle(ov.hEvent); CloseHandle(dir); return 0; }
+
+    for (;;) {
+        ResetEvent(ov.hEvent);
+        if (!ReadDirectoryChangesW(dir, buf, 64 * 1024, TRUE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME,
+                                   NULL, &ov, NULL)) break;
+        HANDLE waits[2] = { ix->stop_event, ov.hEvent };
+        if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) == WAIT_OBJECT_0) {
+            CancelIoEx(dir, &ov);
+            DWORD ignored;
+            GetOverlappedResult(dir, &ov, &ignored, TRUE);
+            break;
+        }
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(dir, &ov, &bytes, FALSE)) break;
+        if (bytes == 0) { SetEvent(ix->rebuild_event); continue; } /* notification buffer overflowed */
+
+        const BYTE *p = (const BYTE*)buf;
+        for (;;) {
+            const FILE_NOTIFY_INFORMATION *fni = (const FILE_NOTIFY_INFORMATION*)p;
+            char rel[MAX_PATH];
+            int n = WideCharToMultiByte(CP_ACP, 0, fni->FileName, (int)(fni->FileNameLength / sizeof(WCHAR)), rel, MAX_PATH - 1, NULL, NULL);
+            if (n > 0) {
+                rel[n] = 0;
+                overlay_record(ix, rel, fni->Action);
+            }
+            if (fni->NextEntryOffset == 0) break;
+            p += fni->NextEntryOffset;
+        }
+    }
+    CloseHandle(ov.hEvent);
+    free(buf);
+    CloseHandle(dir);
+    return 0;
+}
+
+static DWORD WINAPI maint_thread(LPVOID param) {
+    FindIndex *ix = (FindIndex*)param;
+    HANDLE waits[2] = { ix->stop_event, ix->rebuild_event };
+    char tmp[MAX_PATH];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", ix->index_path);
+    for (;;) {
+        if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) == WAIT_OBJECT_0) break;
+        /* let bursts of changes settle before recrawling, unless there is no index at all;
+           catching up on an old index yields to startup and to the user */
+        BOOL catch_up = ix->stale != 0;
+        if (ix->hdr && WaitForSingleObject(ix->stop_event, catch_up ? FIDX_CATCHUP_MS : 2000) == WAIT_OBJECT_0) break;
+
+        LONG seq = ix->seq;
+        InterlockedExchange(&ix->progress, 0);
+        InterlockedExchange(&ix->building, 1);
+        BOOL ok = build_index(ix, tmp, catch_up && ix->hdr);
+        if (ok) {
+            AcquireSRWLockExclusive(&ix->lock);
+            unmap_index(ix);
+            MoveFileExA(tmp, ix->index_path, MOVEFILE_REPLACE_EXISTING);
+            map_index(ix);
+            ReleaseSRWLockExclusive(&ix->lock);
+            overlay_drop_through(ix, seq);
+            InterlockedExchange(&ix->stale, 0);
+        }
+        InterlockedExchange(&ix->building, 0);
+    }
+    return 0;
+}
+
+/* ---- public ---- */
+
+FindIndex *findidx_start(const char *root, const char *index_path) {
+    FindIndex *ix = (FindIndex*)calloc(1, sizeof(FindIndex));
+    if (!ix) return NULL;
+    strncpy_s(ix->root, MAX_PATH, root, _TRUNCATE);
+    strncpy_s(ix->index_path, MAX_PATH, index_path, _TRUNCATE);
+    InitializeSRWLock(&ix->lock);
+    InitializeCriticalSection(&ix->ov_lock);
+    ix->stop_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    ix->rebuild_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!ix->stop_event || !ix->rebuild_event) { findidx_stop(ix); return NULL; }
+
+    /* an existing index is served right away. A missing one is crawled at once; an old
+       one is caught up later in the background, for changes made while we were not running */
+    BOOL missing = !map_index(ix);
+    if (!missing) {
+        FILETIME written, now;
+        GetSystemTimeAsFileTime(&now);
+        if (GetFileTime(ix->file, NULL, NULL, &written)) {
+            unsigned long long w = ((unsigned long long)written.dwHighDateTime << 32) | written.dwLowDateTime;
+            unsigned long long n = ((unsigned long long)now.dwHighDateTime << 32) | now.dwLowDateTime;
+            ix->stale = (n > w) && (n - w > FIDX_STALE_AFTER);
+        }
+    }
+    ix->watch_thread = CreateThread(NULL, 0, watch_thread, ix, 0, NULL);
+    ix->maint_thread = CreateThread(NULL, 0, maint_thread, ix, 0, NULL);
+    if (missing || ix->stale) SetEvent(ix->rebuild_event);
+    return ix;
+}
+
+void findidx_refresh(FindIndex *ix) {
+    if (ix) SetEvent(ix->rebuild_event);
+}
+
+void findidx_stop(FindIndex *ix) {
+    if (!ix) return;
+    InterlockedExchange(&ix->cancel, 1);
+    if (ix->stop_event) SetEvent(ix->stop_event);
+    if (ix->watch_thread) { WaitForSingleObject(ix->watch_thread, INFINITE); CloseHandle(ix->watch_thread); }
+    if (ix->maint_thread) { WaitForSingleObject(ix->maint_thread, INFINITE); CloseHandle(ix->maint_thread); }
+    unmap_index(ix);
+    for (int i = 0; i < ix->ov_count; ++i) free(ix->ov[i].rel);
+    free(ix->ov);
+    free(ix->ov_slots);
+    DeleteCriticalSection(&ix->ov_lock);
+    if (ix->stop_event) CloseHandle(ix->stop_event);
+    if (ix->rebuild_event) CloseHandle(ix->rebuild_event);
+    free(ix);
+}
+
+int findidx_busy(FindIndex *ix) {
+    return ix && ix->building;
+}
+
+void findidx_status(FindIndex *ix, char *buf, size_t len) {
+    if (!ix) { snprintf(buf, len, "no index"); return; }
+    if (ix->building && !ix->hdr) { snprintf(buf, len, "indexing %ld paths...", (long)ix->progress); return; }
+    AcquireSRWLockShared(&ix->lock);
+    DWORD count = ix->hdr ? ix->hdr->count : 0;
+    ReleaseSRWLockShared(&ix->lock);
+    snprintf(buf, len, "%lu paths%s", (unsigned long)count,
+             ix->building ? (ix->stale ? ", catching up" : ", refreshing") : (ix->stale ? ", may be stale" : ""));
+}
+
+/* Lower is better: exact name, then prefix, then word start, then any substring;
+   shorter names first within a class. Returns -1 when the name does not match. */
+static long match_score(const char *name, int nlen, const char *q, int qlen) {
+    int cls = -1;
+    for (int i = 0; i + qlen <= nlen; ++i) {
+        int k = 0;
+        while (k < qlen && lc((unsigned char)name[i + k]) == (unsigned char)q[k]) k++;
+        if (k < qlen) continue;
+        int c;
+        if (i == 0) c = (nlen == qlen) ? 0 : 1;
+        else {
+            unsigned char prev = (unsigned char)name[i - 1];
+            c = ((prev >= 'a' && prev <= 'z') || (prev >= 'A' && prev <= 'Z') || (prev >= '0' && prev <= '9')) ? 3 : 2;
+        }
+        if (cls < 0 || c < cls) cls = c;
+        if (cls <= 1) break;
+    }
+    if (cls < 0) return -1;
+    return ((long)cls << 16) | (nlen < 0xFFFF ? nlen : 0xFFFF);
+}
+
+/* Relative path of an entry ("dir\\sub\\name") */
+static void entry_rel(const FindIndex *ix, DWORD id, char *out, size_t len) {
+    DWORD chain[FIDX_MAX_DEPTH];
+    int depth = 0;
+    while (id != FIDX_NO_PARENT && id < ix->hdr->count && depth < FIDX_MAX_DEPTH) {
+        if (ix->entries[id].name_len) chain[depth++] = id;
+        id = ix->entries[id].parent;
+    }
+    size_t at = 0;
+    out[0] = 0;
+    for (int i = depth - 1; i >= 0; --i) {
+        const FidxEntry *e = &ix->entries[chain[i]];
+        if (at + e->name_len + 2 > len) break;
+        if (at) out[at++] = '\\';
+        memcpy(out + at, ix->names + e->name_off, e->name_len);
+        at += e->name_len;
+        out[at] = 0;
+    }
+}
+
+/* Whether the overlay supersedes an entry: its own path has a newer item (removed, or
+   recreated and listed from the overlay), or a folder above it was removed */
+static BOOL overlay_hides(const FindIndex *ix, DWORD id) {
+    char rel[MAX_PATH];
+    BOOL self = TRUE;
+    for (int depth = 0; id < ix->hdr->count && ix->entries[id].name_len && depth < FIDX_MAX_DEPTH; ++depth) {
+        const OverlayItem *it = overlay_find(ix, ix->path_hashes[id], NULL);
+        if (it && (self || it->removed)) {
+            /* a hash match is rare enough to confirm with the full path */
+            entry_rel(ix, id, rel, sizeof(rel));
+            it = overlay_find(ix, ix->path_hashes[id], rel);
+            if (it && (self || it->removed)) return TRUE;
+        }
+        self = FALSE;
+        id = ix->entries[id].parent;
+    }
+    return FALSE;
+}
+
+typedef struct { long score; DWORD id; } Cand; /* id with the top bit set refers to an overlay item */
+
+/* Max-heap on score that keeps the best `max` candidates */
+static void heap_push(Cand *heap, int *n, int max, long score, DWORD id) {
+    int i;
+    if (*n < max) {
+        i = (*n)++;
+        while (i > 0 && heap[(i - 1) / 2].score < score) { heap[i] = heap[(i - 1) / 2]; i = (i - 1) / 2; }
+    } else if (score < heap[0].score) {
+        i = 0;
+        for (;;) {
+            int l = 2 * i + 1, r = l + 1, m = l;
+            if (l >= *n) break;
+            if (r < *n && heap[r].score > heap[l].score) m = r;
+            if (heap[m].score <= score) break;
+            heap[i] = heap[m];
+            i = m;
+        }
+    } else return;
+    heap[i].score = score;
+    heap[i].id = id;
+}
+
+static int cmp_cand(const void *a, const void *b) {
+    const Cand *x = (const Cand*)a, *y = (const Cand*)b;
+    if (x->score != y->score) return (x->score < y->score) ? -1 : 1;
+    return (x->id < y->id) ? -1 : (x->id > y->id);
+}
+
+static const BYTE *decode_varint(const BYTE *p, const BYTE *end, DWORD *v) {
+    DWORD r = 0;
+    int shift = 0;
+    while (p < end) {
+        BYTE b = *p++;
+        r |= (DWORD)(b & 0x7F) << shift;
+        if (!(b & 0x80)) { *v = r; return p; }
+        shift += 7;
+    }
+    return NULL;
+}
+
+int findidx_query(FindIndex *ix, const char *query, FindHit *hits, int max) {
+    char q[MAX_PATH];
+    int qlen = 0;
+    while (*query == ' ') query++;
+    for (; query[qlen] && qlen < MAX_PATH - 1; ++qlen) q[qlen] = (char)lc((unsigned char)query[qlen]);
+    while (qlen > 0 && q[qlen-1] == ' ') qlen--;
+    q[qlen] = 0;
+    if (!ix || qlen == 0 || max <= 0) return 0;
+
+    Cand *heap = (Cand*)malloc(sizeof(Cand) * max);
+    if (!heap) return 0;
+    int n = 0;
+    char rel[MAX_PATH];
+
+    AcquireSRWLockShared(&ix->lock);
+    EnterCriticalSection(&ix->ov_lock);
+
+    if (ix->hdr) {
+        DWORD *cand = NULL;
+        DWORD ncand = 0;
+        BOOL scan_all = (qlen < 3);
+        if (!scan_all) {
+            DWORD tri[MAX_PATH];
+            int nt = name_buckets(q, qlen, tri);
+            /* intersect the shortest posting lists first */
+            for (int i = 1; i < nt; ++i) {
+                DWORD t = tri[i];
+                unsigned long long tl = ix->buckets[t + 1] - ix->buckets[t];
+                int j = i;
+                while (j > 0 && ix->buckets[tri[j-1] + 1] - ix->buckets[tri[j-1]] > tl) { tri[j] = tri[j-1]; j--; }
+                tri[j] = t;
+            }
+            for (int t = 0; t < nt; ++t) {
+                const BYTE *p = ix->postings + ix->buckets[tri[t]];
+                const BYTE *end = ix->postings + ix->buckets[tri[t] + 1];
+                DWORD id = 0, delta;
+                if (t == 0) {
+                    cand = (DWORD*)malloc(sizeof(DWORD) * (size_t)(end - p + 1));
+                    if (!cand) break;
+                    while (p && p < end && (p = decode_varint(p, end, &delta)) != NULL) { id += delta; cand[ncand++] = id; }
+                } else {
+                    DWORD out = 0, i = 0;
+                    while (i < ncand && p && p < end && (p = decode_varint(p, end, &delta)) != NULL) {
+                        id += delta;
+                        while (i < ncand && cand[i] < id) i++;
+                        if (i < ncand && cand[i] == id) cand[out++] = cand[i++];
+                    }
+                    ncand = out;
+                }
+                if (ncand == 0) break;
+            }
+        }
+        DWORD total = scan_all ? ix->hdr->count : ncand;
+        for (DWORD k = 0; k < total; ++k) {
+            DWORD id = scan_all ? k : cand[k];
+            const FidxEntry *e = &ix->entries[id];
+            long score = match_score(ix->names + e->name_off, e->name_len, q, qlen);
+            if (score < 0) continue;
+            if (ix->ov_count && overlay_hides(ix, id)) continue;
+            heap_push(heap, &n, max, score, id);
+        }
+        free(cand);
+    }
+
+    for (int i = 0; i < ix->ov_count; ++i) {
+        const OverlayItem *it = &ix->ov[i];
+        if (it->removed) continue;
+        const char *base = strrchr(it->rel, '\\');
+        base = base ? base + 1 : it->rel;
+        long score = match_score(base, (int)strlen(base), q, qlen);
+        if (score >= 0) heap_push(heap, &n, max, score, 0x80000000u | (DWORD)i);
+    }
+
+    qsort(heap, n, sizeof(Cand), cmp_cand);
+    for (int i = 0; i < n; ++i) {
+        DWORD id = heap[i].id;
+        if (id & 0x80000000u) {
+            const OverlayItem *it = &ix->ov[id & 0x7FFFFFFFu];
+            join_path(hits[i].path, MAX_PATH, ix->root, it->rel);
+            hits[i].is_dir = it->is_dir;
+        } else {
+            entry_rel(ix, id, rel, sizeof(rel));
+            join_path(hits[i].path, MAX_PATH, ix->root, rel);
+            hits[i].is_dir = (ix->entries[id].flags & FIDX_F_DIR) != 0;
+        }
+    }
+    LeaveCriticalSection(&ix->ov_lock);
+    ReleaseSRWLockShared(&ix->lock);
+    free(heap);
+    return n;
+}
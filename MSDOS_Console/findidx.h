@@ -0,0 +1,35 @@
+// findidx.h - Instant filename search over a whole volume backed by a trigram index
+#ifndef FINDIDX_H
+#define FINDIDX_H
+
+#include <windows.h>
+
+typedef struct FindIndex FindIndex;
+
+typedef struct {
+    char path[MAX_PATH];   /* full path */
+    BOOL is_dir;
+} FindHit;
+
+/* Maps the index file for root if one exists, starts watching root for changes and
+   schedules a background build when there is no index yet, or when the watcher falls
+   behind. An existing index is served at once; one written over an hour ago is caught up
+   by a low priority rebuild once startup has settled. */
+FindIndex *findidx_start(const char *root, const char *index_path);
+void findidx_stop(FindIndex *ix);
+
+/* Rebuilds the index in the background, e.g. to pick up changes made while it was not
+   being watched. */
+void findidx_refresh(FindIndex *ix);
+
+/* Case-insensitive name search; fills up to max hits, best matches first. */
+int findidx_query(FindIndex *ix, const char *query, FindHit *hits, int max);
+
+/* Short human readable state ("12345678 paths", "indexing 1234 paths...", with ", may be
+   stale" or ", catching up" while an old index waits for its catch-up) */
+void findidx_status(FindIndex *ix, char *buf, size_t len);
+
+/* Nonzero while a background crawl is running */
+int findidx_busy(FindIndex *ix);
+
+#endif
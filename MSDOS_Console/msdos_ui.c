@@ -1,32 +1,70 @@
 ﻿// msdos_ui.c - Minimal MS-DOS style terminal file manager (Windows console, C)
-// Compile in Visual Studio as a C file (set /TC) or use: cl /W4 /TC msdos_ui.c
+// Compile in Visual Studio as a C file (set /TC) or use: cl /W4 /TC msdos_ui.c archive.c findidx.c batch.c vtout.c dircmp.c qbasic.c direnum.c doscmd.c dirsnap.c tailf.c
 
 #include <windows.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <conio.h>
+#include <shellapi.h>
+
+#include "archive.h"
+#include "findidx.h"
+#include "batch.h"
+#include "vtout.h"
+#include "dircmp.h"
+#include "qbasic.h"
+#include "direnum.h"
+#include "doscmd.h"
+#include "dirsnap.h"
+#include "tailf.h"
 
 #define MAX_ITEMS 1024
 #define MAX_NAME  260
-
-typedef struct {
-    char name[MAX_NAME];
-    BOOL is_dir;
-    unsigned long long size;
-    SYSTEMTIME mtime;
-} FileItem;
+#define FETCH_ROWS_MAX 512      /* rows asked for metadata per pane and frame */
 
 static HANDLE hConsole;
 static HANDLE hInput;
 static DWORD prevInputMode;
+/* VT output backend; NULL renders through WriteConsoleOutputA (WCDOS_OUTPUT=console) */
+static VtOut *vt_out = NULL;
+
+typedef enum { SORT_NONE = 0, SORT_NAME = 1, SORT_EXT = 2, SORT_TIME = 3, SORT_SIZE = 4 } SortKey;
+
+/* A pane's view of a snapshot: the directory and file rows it shows, in its own order and
+   through its own filter, and the marked files as a bitset over snapshot item indices */
+typedef struct {
+    DirSnapshot *snap;
+    FileItem *items;             /* snap->items */
+    int count;                   /* snap->count */
+    int *dir_idx, *file_idx;
+    int dcount, fcount;
+    int idx_cap;                 /* capacity of dir_idx/file_idx/marks in items */
+    unsigned long long *marks;
+    int marked;
+    SortKey sort;
+    char filter[64];             /* wildcard the files must match; "" shows all */
+} Listing;
+
+/* One file panel: its folder, its view of that folder and its cursors. While archive is
+   set the panel lists the members under arc_prefix ("" or "dir/sub/") and cwd shows the
+   virtual path "<archive>\\<prefix>". */
+typedef struct {
+    char cwd[MAX_PATH];
+    Listing ls;
+    int dir_sel, file_sel;
+    int dir_offset, file_offset;
+    Archive *archive;
+    char arc_prefix[MAX_PATH];
+} Panel;
+
+/* Dual pane mode shows both panels side by side; otherwise only the active one. The active
+   panel's folder on disk is the process's current directory. */
+static Panel panels[2];
+static int active_panel = 0;
+static int dual_pane = 0;
 
-/* forward declare selection globals so restore/save functions can reference them
-   even if the globals are defined later in the file */
-extern int dir_sel;
-extern int file_sel;
-extern int dir_offset;
-extern int file_offset;
+static Panel *other_panel(const Panel *p) { return p == &panels[0] ? &panels[1] : &panels[0]; }
 
 // Remember selection per-directory so selection is restored when returning
 #define MAX_SEL_STATES 128
@@ -38,65 +76,72 @@ typedef struct {
 static SelState sel_states[MAX_SEL_STATES];
 static int sel_state_count = 0;
 
-static void save_selection_for_path(const char *path, int dsel, int fsel, int doff, int foff) {
-    if (!path) return;
-    for (int i = 0; i < sel_state_count; ++i) {
-        if (_stricmp(sel_states[i].path, path) == 0) {
-            sel_states[i].dir_sel = dsel;
-            sel_states[i].file_sel = fsel;
-            sel_states[i].dir_offset = doff;
-            sel_states[i].file_offset = foff;
-            return;
-        }
+static void save_selection(const Panel *p) {
+    int i = 0;
+    while (i < sel_state_count && _stricmp(sel_states[i].path, p->cwd) != 0) i++;
+    if (i == sel_state_count) {
+        if (sel_state_count >= MAX_SEL_STATES) return;
+        strncpy_s(sel_states[i].path, MAX_PATH, p->cwd, _TRUNCATE);
+        sel_state_count++;
     }
-    if (sel_state_count >= MAX_SEL_STATES) return;
-    strncpy_s(sel_states[sel_state_count].path, MAX_PATH, path, _TRUNCATE);
-    sel_states[sel_state_count].dir_sel = dsel;
-    sel_states[sel_state_count].file_sel = fsel;
-    sel_states[sel_state_count].dir_offset = doff;
-    sel_states[sel_state_count].file_offset = foff;
-    sel_state_count++;
+    sel_states[i].dir_sel = p->dir_sel;
+    sel_states[i].file_sel = p->file_sel;
+    sel_states[i].dir_offset = p->dir_offset;
+    sel_states[i].file_offset = p->file_offset;
 }
 
-static void restore_selection_for_path(const char *path, int dcount, int fcount) {
-    if (!path) return;
+static void restore_selection(Panel *p) {
+    int dcount = p->ls.dcount, fcount = p->ls.fcount;
     for (int i = 0; i < sel_state_count; ++i) {
-        if (_stricmp(sel_states[i].path, path) == 0) {
-            dir_sel = sel_states[i].dir_sel;
-            file_sel = sel_states[i].file_sel;
-            dir_offset = sel_states[i].dir_offset;
-            file_offset = sel_states[i].file_offset;
-            if (dcount == 0) { dir_sel = 0; dir_offset = 0; }
-            else if (dir_sel >= dcount) dir_sel = dcount - 1;
-            if (fcount == 0) { file_sel = 0; file_offset = 0; }
-            else if (file_sel >= fcount) file_sel = fcount - 1;
+        if (_stricmp(sel_states[i].path, p->cwd) == 0) {
+            p->dir_sel = sel_states[i].dir_sel;
+            p->file_sel = sel_states[i].file_sel;
+            p->dir_offset = sel_states[i].dir_offset;
+            p->file_offset = sel_states[i].file_offset;
+            if (dcount == 0) { p->dir_sel = 0; p->dir_offset = 0; }
+            else if (p->dir_sel >= dcount) p->dir_sel = dcount - 1;
+            if (fcount == 0) { p->file_sel = 0; p->file_offset = 0; }
+            else if (p->file_sel >= fcount) p->file_sel = fcount - 1;
             return;
         }
     }
     // not found -> reset
-    dir_sel = 0; file_sel = 0; dir_offset = 0; file_offset = 0;
+    p->dir_sel = 0; p->file_sel = 0; p->dir_offset = 0; p->file_offset = 0;
 }
 
 // Pane focus and selections
 typedef enum { PANE_DIR = 0, PANE_FILES = 1, PANE_MAIN = 2, PANE_TASKS = 3 } Pane;
 static Pane cur_pane = PANE_DIR;
-static int dir_sel = 0;
-static int file_sel = 0;
 static int main_sel = 0;
 static int task_sel = 0;
-static int dir_offset = 0;
-static int file_offset = 0;
 static int menu_active = 0; /* 0 = none, 1 = active */
 static int menu_id = 0; /* 0=file,1=options */
 static int menu_sel = 0;
 static int show_sizes = 1;
 static char status_msg[256] = "";
 
+/* "Find file" and compare modes belong to the active panel, which keeps the focus until
+   they end; the other panel goes on showing its folder */
+
+/* "Find file" mode: results of a name search over find_root replace the pane listings */
+static FindIndex *find_index = NULL;
+static int find_active = 0;
+static char find_query[MAX_PATH] = "";
+static char find_root[MAX_PATH] = "";
+
+/* Compare mode: the Files pane lists how cmp_right differs from cmp_left (the folder the
+   compare started in); listing item i is compare entry i */
+static DirCompare *cmp_result = NULL;
+static int cmp_active = 0;
+static int cmp_verify = 0;
+static char cmp_left[MAX_PATH] = "";
+static char cmp_right[MAX_PATH] = "";
+
 /* Menu definitions */
-static const char *file_menu_items[] = { "Refresh", "Exit" };
-static const int file_menu_count = 2;
-static const char *options_menu_items[] = { "Show Sizes", "About" };
-static const int options_menu_count = 2;
+static const char *file_menu_items[] = { "Refresh", "Find File", "Compare Folders", "Exit" };
+static const int file_menu_count = 4;
+static const char *options_menu_items[] = { "Show Sizes", "Verify Contents", "Dual Pane", "About" };
+static const int options_menu_count = 4;
 
 // Console color helpers
 enum {
@@ -111,6 +156,9 @@ enum {
     ATTR_MENU_BAR = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE,
     /* Black text on bright yellow background for selection (classic DOS highlight) */
     ATTR_HILITE = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_INTENSITY,
+    /* Marked files: bright yellow text, red on the highlight bar */
+    ATTR_MARKED = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY,
+    ATTR_HILITE_MARKED = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_INTENSITY | FOREGROUND_RED,
     /* Grey/white background for pane headers (black text on bright background) */
     ATTR_HDR = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE | BACKGROUND_INTENSITY
     ,
@@ -129,6 +177,7 @@ static COORD get_console_size() {
 }
 
 static void put_text(int x, int y, const char* text, WORD attr) {
+    if (vt_out) { vt_text(vt_out, x, y, text, attr); return; }
     SetConsoleCursorPosition(hConsole, (COORD){ (SHORT)x, (SHORT)y });
     SetConsoleTextAttribute(hConsole, attr);
     DWORD written;
@@ -144,50 +193,1064 @@ static void fill_line(int y, WORD attr, int width) {
     free(buf);
 }
 
-static void load_directory(const char* path, FileItem* items, int* count) {
-    char search[MAX_PATH];
-    WIN32_FIND_DATAA fd;
-    HANDLE hFind;
-
-    snprintf(search, sizeof(search), "%s\\*", path);
-    *count = 0;
-    hFind = FindFirstFileA(search, &fd);
-    if (hFind == INVALID_HANDLE_VALUE) return;
-
-    do {
-        if (strcmp(fd.cFileName, ".") == 0) continue;
-        FileItem *it = &items[(*count)++];
-        strncpy_s(it->name, MAX_NAME, fd.cFileName, MAX_NAME-1);
-        it->name[MAX_NAME-1] = 0;
-        it->is_dir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-        it->size = 0;
-        ZeroMemory(&it->mtime, sizeof(it->mtime));
-
-        /* Get size and last write time */
-        char full[MAX_PATH];
-        snprintf(full, sizeof(full), "%s\\%s", path, fd.cFileName);
-        WIN32_FILE_ATTRIBUTE_DATA fad;
-        if (GetFileAttributesExA(full, GetFileExInfoStandard, &fad)) {
-            it->size = ((unsigned long long)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
-            FILETIME localFt;
-            FileTimeToLocalFileTime(&fad.ftLastWriteTime, &localFt);
-            FileTimeToSystemTime(&localFt, &it->mtime);
+#define MARK_WORDS(n) (((n) + 63) / 64)
+#define IS_MARKED(ls, i) ((((ls)->marks[(i) >> 6]) >> ((i) & 63)) & 1)
+
+/* Find results hold full paths; patterns and batch messages use the last component */
+static const char *item_base_name(const char *name) {
+    const char *slash = strrchr(name, '\\');
+    return slash ? slash + 1 : name;
+}
+
+/* Points the view at snap, taking over the caller's reference */
+static void listing_bind(Listing *ls, DirSnapshot *snap) {
+    dirsnap_release(ls->snap);
+    ls->snap = snap;
+    ls->items = snap ? snap->items : NULL;
+    ls->count = snap ? snap->count : 0;
+    ls->dcount = 0; ls->fcount = 0; ls->marked = 0;
+}
+
+/* Starts a listing that is not a folder on disk (archive members, search hits) */
+static void listing_clear(Listing *ls) {
+    listing_bind(ls, dirsnap_new());
+}
+
+static FileItem *listing_add(Listing *ls, const char *name, BOOL is_dir) {
+    if (!ls->snap) return NULL;
+    FileItem *it = dirsnap_add(ls->snap, name, is_dir);
+    ls->items = ls->snap->items;
+    ls->count = ls->snap->count;
+    return it;
+}
+
+/* qsort has no context argument; views are only sorted on the UI thread */
+static const FileItem *sort_items;
+static SortKey sort_key;
+
+static unsigned long long time_key(const FILETIME *t) {
+    return ((unsigned long long)t->dwHighDateTime << 32) | t->dwLowDateTime;
+}
+
+static int cmp_view(const void *a, const void *b) {
+    int ia = *(const int*)a, ib = *(const int*)b;
+    const FileItem *x = &sort_items[ia], *y = &sort_items[ib];
+    /* ".." stays on top */
+    if (strcmp(x->name, "..") == 0) return -1;
+    if (strcmp(y->name, "..") == 0) return 1;
+    const char *nx = item_base_name(x->name), *ny = item_base_name(y->name);
+    int r = 0;
+    if (sort_key == SORT_EXT) {
+        const char *ex = strrchr(nx, '.'), *ey = strrchr(ny, '.');
+        r = _stricmp(ex ? ex : "", ey ? ey : "");
+    } else if (sort_key == SORT_TIME) {
+        unsigned long long tx = time_key(&x->mtime), ty = time_key(&y->mtime);
+        r = (tx < ty) - (tx > ty);         /* newest first */
+    } else if (sort_key == SORT_SIZE) {
+        r = (x->size < y->size) - (x->size > y->size);   /* largest first */
+    }
+    if (r == 0) r = _stricmp(nx, ny);
+    if (r == 0) r = (ia > ib) - (ia < ib);
+    return r;
+}
+
+/* Builds the pane views from the snapshot through the filter and in the sort order */
+static void listing_build_views(Listing *ls) {
+    if (ls->idx_cap < ls->count) {
+        int ncap = ls->snap->cap;
+        int *d = (int*)realloc(ls->dir_idx, sizeof(int) * ncap);
+        if (d) ls->dir_idx = d;
+        int *f = (int*)realloc(ls->file_idx, sizeof(int) * ncap);
+        if (f) ls->file_idx = f;
+        unsigned long long *m = (unsigned long long*)realloc(ls->marks, sizeof(unsigned long long) * MARK_WORDS(ncap));
+        if (m) ls->marks = m;
+        if (d && f && m) ls->idx_cap = ncap;
+        else ls->count = ls->idx_cap; /* out of memory: show what fits */
+    }
+    ls->dcount = 0; ls->fcount = 0;
+    for (int i = 0; i < ls->count; ++i) {
+        if (ls->items[i].is_dir) ls->dir_idx[ls->dcount++] = i;
+        else if (!ls->filter[0] || glob_match(ls->filter, item_base_name(ls->items[i].name))) ls->file_idx[ls->fcount++] = i;
+    }
+    if (ls->sort != SORT_NONE) {
+        sort_items = ls->items;
+        sort_key = ls->sort;
+        qsort(ls->dir_idx, ls->dcount, sizeof(int), cmp_view);
+        qsort(ls->file_idx, ls->fcount, sizeof(int), cmp_view);
+    }
+}
+
+/* Build the pane views once per load and clear the marks */
+static void listing_finish(Listing *ls) {
+    listing_build_views(ls);
+    ls->marked = 0;
+    if (ls->marks) memset(ls->marks, 0, sizeof(unsigned long long) * MARK_WORDS(ls->count));
+}
+
+static void listing_free(Listing *ls) {
+    dirsnap_release(ls->snap);
+    free(ls->dir_idx);
+    free(ls->file_idx);
+    free(ls->marks);
+    ZeroMemory(ls, sizeof(*ls));
+}
+
+static void listing_mark(Listing *ls, int i, int on) {
+    unsigned long long bit = 1ULL << (i & 63);
+    int was = (ls->marks[i >> 6] & bit) != 0;
+    if (on && !was) { ls->marks[i >> 6] |= bit; ls->marked++; }
+    else if (!on && was) { ls->marks[i >> 6] &= ~bit; ls->marked--; }
+}
+
+/* Shows path; fresh lists it again, otherwise a current listing of it is kept or shared */
+static void load_directory(const char *path, Listing *ls, BOOL fresh) {
+    if (!fresh && ls->snap && _stricmp(ls->snap->path, path) == 0 && dirsnap_current(ls->snap)) return;
+    DirSnapshot *s = dirsnap_open(path, fresh);
+    if (s && s == ls->snap) { dirsnap_release(s); return; }   /* unchanged: keep the view and its marks */
+    listing_bind(ls, s);
+    listing_finish(ls);
+}
+
+typedef struct {
+    const Archive *arc;
+    Listing *ls;
+} ArcListCtx;
+
+static void add_archive_item(void *ctx, const char *name, BOOL is_dir, int index) {
+    ArcListCtx *c = (ArcListCtx*)ctx;
+    FileItem *it = listing_add(c->ls, name, is_dir);
+    if (!it) return;
+    if (index >= 0) {
+        const ArcEntry *e = &c->arc->entries[index];
+        it->size = e->size;
+        it->mtime = e->mtime;
+        it->meta = META_READY;
+    } else it->meta = META_UNAVAILABLE;     /* folders implied by member paths */
+}
+
+/* List the members of the panel's archive under arc_prefix and build the virtual cwd */
+static void load_archive_dir(Panel *p) {
+    listing_clear(&p->ls);
+    listing_add(&p->ls, "..", TRUE);
+    ArcListCtx ctx = { p->archive, &p->ls };
+    archive_list(p->archive, p->arc_prefix, add_archive_item, &ctx);
+    listing_finish(&p->ls);
+
+    snprintf(p->cwd, MAX_PATH, "%s\\%s", p->archive->path, p->arc_prefix);
+    for (char *c = p->cwd; *c; ++c) if (*c == '/') *c = '\\';
+    size_t l = strlen(p->cwd);
+    if (l > 0 && p->cwd[l-1] == '\\') p->cwd[l-1] = 0;
+}
+
+/* The folder on disk behind a panel: its cwd, or the folder holding its archive */
+static void panel_disk_dir(const Panel *p, char *out) {
+    strncpy_s(out, MAX_PATH, p->archive ? p->archive->path : p->cwd, _TRUNCATE);
+    if (!p->archive) return;
+    char *slash = strrchr(out, '\\');
+    if (slash && (slash == out || slash[-1] == ':')) slash[1] = 0;
+    else if (slash) *slash = 0;
+}
+
+/* Moves the focus to panel i; the process follows it to its folder */
+static void activate_panel(int i) {
+    char dir[MAX_PATH];
+    active_panel = i;
+    panel_disk_dir(&panels[i], dir);
+    SetCurrentDirectoryA(dir);
+}
+
+static int panel_in_mode(const Panel *p) {
+    return p == &panels[active_panel] && (find_active || cmp_active);
+}
+
+/* The other panel shows its folder again if it changed; an unchanged folder keeps its
+   snapshot, view and marks. fresh reads it again regardless, for writes such as overwrites
+   that leave the folder's own time alone. */
+static void sync_other_panel(const Panel *p, BOOL fresh) {
+    Panel *o = other_panel(p);
+    if (!dual_pane || o->archive || panel_in_mode(o) || !o->cwd[0]) return;
+    save_selection(o);
+    load_directory(o->cwd, &o->ls, fresh);
+    restore_selection(o);
+}
+
+/* Reads the panel's folder (or archive folder) again */
+static void refresh_listing(Panel *p) {
+    if (p->archive) load_archive_dir(p);
+    else load_directory(p->cwd, &p->ls, TRUE);
+    sync_other_panel(p, FALSE);
+}
+
+/* Enter a directory (or "..") from the directory pane, inside an archive or on disk */
+static void change_directory(Panel *p, const char *dname) {
+    save_selection(p);
+    if (p->archive) {
+        if (strcmp(dname, "..") == 0) {
+            size_t l = strlen(p->arc_prefix);
+            if (l == 0) {
+                /* leaving the archive root returns to the folder that holds it */
+                panel_disk_dir(p, p->cwd);
+                archive_close(p->archive);
+                p->archive = NULL;
+            } else {
+                p->arc_prefix[l-1] = 0;
+                char *slash = strrchr(p->arc_prefix, '/');
+                if (slash) slash[1] = 0; else p->arc_prefix[0] = 0;
+            }
+        } else {
+            strncat_s(p->arc_prefix, MAX_PATH, dname, _TRUNCATE);
+            strncat_s(p->arc_prefix, MAX_PATH, "/", _TRUNCATE);
+        }
+        if (p->archive) load_archive_dir(p);
+        else load_directory(p->cwd, &p->ls, TRUE);
+    } else {
+        if (strcmp(dname, "..") == 0) SetCurrentDirectoryA("..");
+        else { char newpath[MAX_PATH]; snprintf(newpath, sizeof(newpath), "%s\\%s", p->cwd, dname); SetCurrentDirectoryA(newpath); }
+        GetCurrentDirectoryA(MAX_PATH, p->cwd);
+        load_directory(p->cwd, &p->ls, TRUE);
+    }
+    restore_selection(p);
+}
+
+/* Extract one archive member into dest_dir; returns FALSE and sets status_msg on failure */
+static BOOL extract_member(const Panel *p, const char *fname, const char *dest_dir, char *out_path) {
+    char member[MAX_PATH];
+    snprintf(member, sizeof(member), "%s%s", p->arc_prefix, fname);
+    int idx = archive_find(p->archive, member);
+    snprintf(out_path, MAX_PATH, "%s\\%s", dest_dir, fname);
+    char err[128];
+    if (idx < 0 || !archive_extract(p->archive, idx, out_path, err, sizeof(err))) {
+        snprintf(status_msg, sizeof(status_msg), "Extract failed: %s", (idx < 0) ? "member not found" : err);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void run_qbasic(Panel *p, const char *initial);
+
+/* Enter on a file: archives open like folders, .BAS programs run; archive members are
+   extracted to %TEMP% and opened */
+static void open_file(Panel *p, const char *fname) {
+    if (cmp_active) return;
+    if (p->archive) {
+        char dir[MAX_PATH], out[MAX_PATH];
+        GetTempPathA(MAX_PATH, dir);
+        strncat_s(dir, MAX_PATH, "wcdos", _TRUNCATE);
+        CreateDirectoryA(dir, NULL);
+        if (extract_member(p, fname, dir, out)) ShellExecuteA(NULL, "open", out, NULL, NULL, SW_SHOWNORMAL);
+        return;
+    }
+    const char *ext = strrchr(fname, '.');
+    if (ext && _stricmp(ext, ".bas") == 0) {
+        char cmd[MAX_PATH + 4];
+        snprintf(cmd, sizeof(cmd), strchr(fname, ' ') ? "\"%s\" " : "%s ", fname);
+        run_qbasic(p, cmd);
+        return;
+    }
+    if (!archive_is_archive_name(fname)) return;
+    char full[MAX_PATH];
+    snprintf(full, sizeof(full), "%s\\%s", p->cwd, fname);
+    Archive *a = archive_open(full);
+    if (!a) { snprintf(status_msg, sizeof(status_msg), "Cannot read archive %s", fname); return; }
+    save_selection(p);
+    p->archive = a;
+    p->arc_prefix[0] = 0;
+    load_archive_dir(p);
+    restore_selection(p);
+}
+
+/* Search root: WCDOS_FIND_ROOT if set, otherwise the volume holding the current directory */
+static void init_find_root(const char *cwd) {
+    if (GetEnvironmentVariableA("WCDOS_FIND_ROOT", find_root, MAX_PATH) > 0) return;
+    if (!GetVolumePathNameA(cwd, find_root, MAX_PATH)) strncpy_s(find_root, MAX_PATH, cwd, _TRUNCATE);
+}
+
+/* Index lives under %LOCALAPPDATA%\WC-DOS, one file per search root */
+static void find_index_path(char *out) {
+    char base[MAX_PATH];
+    if (!GetEnvironmentVariableA("LOCALAPPDATA", base, MAX_PATH)) GetTempPathA(MAX_PATH, base);
+    char dir[MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s\\WC-DOS", base);
+    CreateDirectoryA(dir, NULL);
+    char tag[MAX_PATH];
+    int t = 0;
+    for (const char *p = find_root; *p && t < MAX_PATH - 1; ++p) {
+        char c = *p;
+        tag[t++] = ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) ? c : '_';
+    }
+    tag[t] = 0;
+    snprintf(out, MAX_PATH, "%s\\find-%s.idx", dir, tag);
+}
+
+static void run_find_query(Panel *p) {
+    static FindHit hits[MAX_ITEMS];
+    int n = findidx_query(find_index, find_query, hits, MAX_ITEMS);
+    listing_clear(&p->ls);
+    for (int i = 0; i < n; ++i) listing_add(&p->ls, hits[i].path, hits[i].is_dir);
+    listing_finish(&p->ls);
+    p->dir_sel = 0; p->file_sel = 0; p->dir_offset = 0; p->file_offset = 0;
+}
+
+static void start_find(Panel *p) {
+    if (!find_index) {
+        char cwd[MAX_PATH], idx[MAX_PATH];
+        GetCurrentDirectoryA(MAX_PATH, cwd);
+        init_find_root(cwd);
+        find_index_path(idx);
+        find_index = findidx_start(find_root, idx);
+        if (!find_index) { snprintf(status_msg, sizeof(status_msg), "Cannot start file index"); return; }
+    }
+    save_selection(p);
+    find_active = 1;
+    find_query[0] = 0;
+    cur_pane = PANE_FILES;
+    run_find_query(p);
+}
+
+/* Leave find mode; with a hit given, open its folder and select it there */
+static void end_find(Panel *p, const char *hit) {
+    find_active = 0;
+    if (!hit) {
+        refresh_listing(p);
+        restore_selection(p);
+        return;
+    }
+    char dir[MAX_PATH], name[MAX_NAME];
+    strncpy_s(dir, MAX_PATH, hit, _TRUNCATE);
+    char *slash = strrchr(dir, '\\');
+    if (!slash) return;
+    strncpy_s(name, MAX_NAME, slash + 1, _TRUNCATE);
+    if (slash == dir || slash[-1] == ':') slash[1] = 0; else *slash = 0;
+    if (p->archive) { archive_close(p->archive); p->archive = NULL; }
+    if (!SetCurrentDirectoryA(dir)) snprintf(status_msg, sizeof(status_msg), "Cannot open %s", dir);
+    GetCurrentDirectoryA(MAX_PATH, p->cwd);
+    load_directory(p->cwd, &p->ls, TRUE);
+    p->dir_sel = 0; p->file_sel = 0; p->dir_offset = 0; p->file_offset = 0;
+    Listing *ls = &p->ls;
+    for (int d = 0; d < ls->dcount; ++d) {
+        if (_stricmp(ls->items[ls->dir_idx[d]].name, name) == 0) { p->dir_sel = d; p->dir_offset = d; cur_pane = PANE_DIR; return; }
+    }
+    for (int f = 0; f < ls->fcount; ++f) {
+        if (_stricmp(ls->items[ls->file_idx[f]].name, name) == 0) { p->file_sel = f; p->file_offset = f; cur_pane = PANE_FILES; return; }
+    }
+}
+
+/* Line input on the status row; returns FALSE when cancelled with Esc */
+static BOOL prompt_line(const char *label, char *buf, size_t len) {
+    COORD size = get_console_size();
+    int y = size.Y - 1;
+    for (;;) {
+        char line[1024];
+        snprintf(line, sizeof(line), " %s%s_", label, buf);
+        if ((int)strlen(line) > size.X - 1) line[size.X - 1] = 0;
+        fill_line(y, ATTR_STATUS, size.X - 1);
+        put_text(0, y, line, ATTR_STATUS);
+        INPUT_RECORD ir;
+        DWORD read = 0;
+        if (!ReadConsoleInput(hInput, &ir, 1, &read)) return FALSE;
+        if (ir.EventType != KEY_EVENT || !ir.Event.KeyEvent.bKeyDown) continue;
+        WORD vk = ir.Event.KeyEvent.wVirtualKeyCode;
+        CHAR ch = ir.Event.KeyEvent.uChar.AsciiChar;
+        size_t l = strlen(buf);
+        if (vk == VK_RETURN) return TRUE;
+        if (vk == VK_ESCAPE) return FALSE;
+        if (vk == VK_BACK) { if (l > 0) buf[l-1] = 0; }
+        else if ((unsigned char)ch >= 32 && l + 1 < len) { buf[l] = ch; buf[l+1] = 0; }
+    }
+}
+
+/* Mark or unmark the files matching a DOS wildcard ("*.log") or a regex written as /re/ */
+static int mark_matching(Listing *ls, const char *pattern, int on) {
+    char re[MAX_PATH];
+    int use_re = 0;
+    size_t l = strlen(pattern);
+    if (l >= 2 && pattern[0] == '/' && pattern[l-1] == '/') {
+        memcpy(re, pattern + 1, l - 2);
+        re[l-2] = 0;
+        use_re = 1;
+    }
+    int n = 0;
+    for (int f = 0; f < ls->fcount; ++f) {
+        int i = ls->file_idx[f];
+        const char *name = item_base_name(ls->items[i].name);
+        if (use_re ? regex_match(re, name) : glob_match(pattern, name)) { listing_mark(ls, i, on); n++; }
+    }
+    return n;
+}
+
+static int cmp_name_ptr(const void *a, const void *b) {
+    return _stricmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Progress text on the status row while a background job runs */
+static void show_progress(const char *text) {
+    COORD size = get_console_size();
+    char line[256];
+    snprintf(line, sizeof(line), " %s   Esc: cancel", text);
+    if ((int)strlen(line) > size.X - 1) line[size.X - 1] = 0;
+    fill_line(size.Y - 1, ATTR_STATUS, size.X - 1);
+    put_text(0, size.Y - 1, line, ATTR_STATUS);
+}
+
+/* Drains pending input; nonzero if Esc was among it */
+static int escape_pressed(void) {
+    int esc = 0;
+    DWORD pending = 0;
+    while (GetNumberOfConsoleInputEvents(hInput, &pending) && pending > 0) {
+        INPUT_RECORD ir;
+        DWORD read = 0;
+        if (!ReadConsoleInput(hInput, &ir, 1, &read)) break;
+        if (ir.EventType == KEY_EVENT && ir.Event.KeyEvent.bKeyDown && ir.Event.KeyEvent.wVirtualKeyCode == VK_ESCAPE) esc = 1;
+    }
+    return esc;
+}
+
+static void run_compare(Panel *p);
+
+/* Nonzero when path is root or a folder below it */
+static int path_within(const char *path, const char *root) {
+    size_t n = strlen(root);
+    if (n == 0 || _strnicmp(path, root, n) != 0) return 0;
+    return path[n] == 0 || path[n] == '\\' || root[n-1] == '\\';
+}
+
+/* Whether a batch may have changed the files in folder: the source folder for every
+   operation, the target tree for copy and move, and any folder when the names are full paths */
+static int batch_wrote_into(const BatchSpec *spec, const char *folder) {
+    if (!spec->dir[0] || _stricmp(spec->dir, folder) == 0) return 1;
+    if (spec->op == BATCH_COPY) return path_within(folder, spec->dest);
+    return spec->op == BATCH_MOVE && _stricmp(spec->dest, folder) == 0;
+}
+
+/* Runs spec over names, which point into the panel's snapshot, with a progress line; Esc
+   cancels. The listings are reloaded afterwards and the items that failed stay marked for
+   a retry. */
+static void execute_batch(Panel *p, const BatchSpec *spec, const char *verb, const char **names, int n) {
+    Listing *ls = &p->ls;
+    Batch *b = batch_start(spec, names, n);
+    if (!b) { snprintf(status_msg, sizeof(status_msg), "Out of memory"); return; }
+    /* the job keeps the snapshot, and so its names, alive across the reload below */
+    DirSnapshot *held = dirsnap_retain(ls->snap);
+    int cancelled = 0, done = 0, failed = 0;
+    while (!batch_wait(b, 100)) {
+        batch_progress(b, &done, &failed);
+        char line[128];
+        snprintf(line, sizeof(line), "%s %d of %d, %d failed", verb, done, n, failed);
+        show_progress(line);
+        if (escape_pressed()) { batch_cancel(b); cancelled = 1; }
+    }
+    batch_progress(b, &done, &failed);
+
+    const BatchFailure *fl;
+    int nf = batch_failures(b, &fl);
+    const char **failed_names = (const char**)malloc(sizeof(char*) * (nf ? nf : 1));
+    int kept = 0;
+    for (int k = 0; failed_names && k < nf; ++k) failed_names[kept++] = names[fl[k].index];
+    char first[MAX_PATH + 160] = "";
+    if (nf > 0) {
+        char msg[128] = "";
+        FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, NULL, fl[0].error, 0, msg, sizeof(msg), NULL);
+        size_t l = strlen(msg);
+        while (l > 0 && (msg[l-1] == '\r' || msg[l-1] == '\n' || msg[l-1] == '.')) msg[--l] = 0;
+        snprintf(first, sizeof(first), ": %s: %s", item_base_name(names[fl[0].index]), msg[0] ? msg : "error");
+    }
+
+    if (find_active) run_find_query(p);
+    else if (cmp_active) run_compare(p);
+    else load_directory(p->cwd, &p->ls, TRUE);
+    sync_other_panel(p, batch_wrote_into(spec, other_panel(p)->cwd));
+    snprintf(status_msg, sizeof(status_msg), "%s %d of %d%s, %d failed%s", verb, done - failed, n, cancelled ? " (cancelled)" : "", failed, first);
+    if (kept > 0) {
+        qsort(failed_names, kept, sizeof(char*), cmp_name_ptr);
+        for (int f = 0; f < ls->fcount; ++f) {
+            int i = ls->file_idx[f];
+            const char *key = ls->items[i].name;
+            if (bsearch(&key, failed_names, kept, sizeof(char*), cmp_name_ptr)) listing_mark(ls, i, 1);
+        }
+    }
+    free(failed_names);
+    batch_free(b);
+    dirsnap_release(held);
+}
+
+/* Run a batch over the marked files, or the selected file when nothing is marked */
+static void run_batch(Panel *p, BatchSpec *spec, const char *verb) {
+    Listing *ls = &p->ls;
+    int n = ls->marked ? ls->marked : (ls->fcount > 0 ? 1 : 0);
+    if (n == 0) return;
+    const char **names = (const char**)malloc(sizeof(char*) * n);
+    if (!names) return;
+    if (ls->marked) {
+        int k = 0;
+        for (int f = 0; f < ls->fcount; ++f) { int i = ls->file_idx[f]; if (IS_MARKED(ls, i)) names[k++] = ls->items[i].name; }
+    } else names[0] = ls->items[ls->file_idx[p->file_sel]].name;
+    strncpy_s(spec->dir, MAX_PATH, find_active ? "" : p->cwd, _TRUNCATE);
+    execute_batch(p, spec, verb, names, n);
+    free(names);
+}
+
+/* Del/F8 delete, F5 copy, F6 move, F2 rename by pattern, F4 attributes - on the marked
+   files. Copy and move offer the other panel's folder in dual pane mode. */
+static void batch_command(Panel *p, WORD vk) {
+    Listing *ls = &p->ls;
+    if (p->archive) { snprintf(status_msg, sizeof(status_msg), "Archives are read-only"); return; }
+    int n = ls->marked ? ls->marked : (ls->fcount > 0 ? 1 : 0);
+    if (n == 0) return;
+    BatchSpec spec;
+    ZeroMemory(&spec, sizeof(spec));
+    char label[128], answer[MAX_PATH] = "";
+    if (vk == VK_DELETE || vk == VK_F8) {
+        snprintf(label, sizeof(label), "Delete %d file(s)? (Y/N) ", n);
+        if (!prompt_line(label, answer, sizeof(answer)) || (answer[0] != 'y' && answer[0] != 'Y')) return;
+        spec.op = BATCH_DELETE;
+        run_batch(p, &spec, "Deleted");
+    } else if (vk == VK_F5 || vk == VK_F6) {
+        const Panel *o = other_panel(p);
+        if (dual_pane && !o->archive) strncpy_s(answer, sizeof(answer), o->cwd, _TRUNCATE);
+        snprintf(label, sizeof(label), "%s %d file(s) to: ", vk == VK_F5 ? "Copy" : "Move", n);
+        if (!prompt_line(label, answer, sizeof(answer)) || !answer[0]) return;
+        DWORD attr;
+        if (!GetFullPathNameA(answer, MAX_PATH, spec.dest, NULL) ||
+            (attr = GetFileAttributesA(spec.dest)) == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
+            snprintf(status_msg, sizeof(status_msg), "Not a folder: %s", answer);
+            return;
+        }
+        spec.op = vk == VK_F5 ? BATCH_COPY : BATCH_MOVE;
+        run_batch(p, &spec, vk == VK_F5 ? "Copied" : "Moved");
+    } else if (vk == VK_F2) {
+        snprintf(label, sizeof(label), "Rename %d file(s) to pattern (e.g. *.bak): ", n);
+        if (!prompt_line(label, answer, sizeof(answer)) || !answer[0]) return;
+        if (strpbrk(answer, "\\/:")) { snprintf(status_msg, sizeof(status_msg), "Rename pattern cannot contain a path"); return; }
+        spec.op = BATCH_RENAME;
+        strncpy_s(spec.pattern, MAX_PATH, answer, _TRUNCATE);
+        run_batch(p, &spec, "Renamed");
+    } else if (vk == VK_F4) {
+        snprintf(label, sizeof(label), "Attributes for %d file(s) (e.g. +R -H): ", n);
+        if (!prompt_line(label, answer, sizeof(answer)) || !answer[0]) return;
+        if (!parse_attrib_change(answer, &spec.attr_set, &spec.attr_clear)) { snprintf(status_msg, sizeof(status_msg), "Use +R -R +H -H +S -S +A -A"); return; }
+        spec.op = BATCH_ATTRIB;
+        run_batch(p, &spec, "Updated");
+    }
+}
+
+/* Compare cmp_left with cmp_right (progress on the status row, Esc cancels) and list the
+   differences in the Files pane */
+static void run_compare(Panel *p) {
+    Listing *ls = &p->ls;
+    dircmp_free(cmp_result);
+    cmp_result = dircmp_start(cmp_left, cmp_right, cmp_verify);
+    listing_clear(ls);
+    p->dir_sel = 0; p->file_sel = 0; p->dir_offset = 0; p->file_offset = 0;
+    if (!cmp_result) { listing_finish(ls); snprintf(status_msg, sizeof(status_msg), "Out of memory"); return; }
+    int scanned = 0, verified = 0;
+    while (!dircmp_wait(cmp_result, 100)) {
+        dircmp_progress(cmp_result, &scanned, &verified);
+        char line[128];
+        snprintf(line, sizeof(line), "Comparing: %d entries scanned, %d files verified", scanned, verified);
+        show_progress(line);
+        if (escape_pressed()) dircmp_cancel(cmp_result);
+    }
+    const CmpEntry *e;
+    int n = dircmp_entries(cmp_result, &e);
+    for (int i = 0; i < n; ++i) {
+        /* folders are listed as files too so every difference shows in one pane */
+        FileItem *it = listing_add(ls, e[i].path, FALSE);
+        if (!it) break;
+        it->size = (e[i].state == CMP_ONLY_RIGHT) ? e[i].rsize : e[i].lsize;
+        it->mtime = (e[i].state == CMP_ONLY_RIGHT || e[i].state == CMP_NEWER_RIGHT) ? e[i].rmtime : e[i].lmtime;
+        it->meta = META_READY;
+    }
+    listing_finish(ls);
+    if (dircmp_incomplete(cmp_result)) snprintf(status_msg, sizeof(status_msg), "Comparison incomplete: cancelled or some folders could not be read");
+}
+
+/* In dual pane mode the other panel's folder is offered as the folder to compare with */
+static void start_compare(Panel *p) {
+    if (p->archive || find_active) { snprintf(status_msg, sizeof(status_msg), "Compare works on folders on disk"); return; }
+    char target[MAX_PATH];
+    const Panel *o = other_panel(p);
+    strncpy_s(target, MAX_PATH, (dual_pane && !o->archive) ? o->cwd : cmp_right, _TRUNCATE);
+    if (!prompt_line("Compare with folder: ", target, sizeof(target)) || !target[0]) return;
+    char full[MAX_PATH];
+    DWORD attr;
+    if (!GetFullPathNameA(target, MAX_PATH, full, NULL) ||
+        (attr = GetFileAttributesA(full)) == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
+        snprintf(status_msg, sizeof(status_msg), "Not a folder: %s", target);
+        return;
+    }
+    if (_stricmp(full, p->cwd) == 0) { snprintf(status_msg, sizeof(status_msg), "Pick a folder other than the current one"); return; }
+    save_selection(p);
+    strncpy_s(cmp_left, MAX_PATH, p->cwd, _TRUNCATE);
+    strncpy_s(cmp_right, MAX_PATH, full, _TRUNCATE);
+    cmp_active = 1;
+    cur_pane = PANE_FILES;
+    run_compare(p);
+}
+
+static void end_compare(Panel *p) {
+    cmp_active = 0;
+    dircmp_free(cmp_result);
+    cmp_result = NULL;
+    refresh_listing(p);
+    restore_selection(p);
+}
+
+/* F5 in compare mode: copy the marked differences (or all of them) from left to right so
+   the right side matches. Entries that exist only on the right are left alone, and so are
+   those newer on the right unless they are marked. */
+static void sync_compare(Panel *p) {
+    Listing *ls = &p->ls;
+    const CmpEntry *e;
+    int n = dircmp_entries(cmp_result, &e);
+    if (n > ls->count) n = ls->count;
+    const char **names = (const char**)malloc(sizeof(char*) * (n ? n : 1));
+    if (!names) return;
+    int k = 0, newer = 0, kept = 0;
+    for (int i = 0; i < n; ++i) {
+        if (e[i].state == CMP_ONLY_RIGHT) continue;
+        if (ls->marked && !IS_MARKED(ls, i)) continue;
+        if (e[i].state == CMP_NEWER_RIGHT) {
+            /* overwriting a newer file takes an explicit mark */
+            if (!IS_MARKED(ls, i)) { kept++; continue; }
+            newer++;
+        }
+        names[k++] = ls->items[i].name;     /* same text as e[i].path, held by the snapshot */
+    }
+    char label[MAX_PATH + 128], note[64] = "", answer[8] = "";
+    if (newer) snprintf(note, sizeof(note), ", %d newer on the right", newer);
+    else if (kept) snprintf(note, sizeof(note), ", %d newer on the right skipped", kept);
+    snprintf(label, sizeof(label), "Copy %d item(s)%s to %s? (Y/N) ", k, note, cmp_right);
+    if (k == 0) snprintf(status_msg, sizeof(status_msg), kept ? "Nothing to copy; %d newer on the right (mark to overwrite)" : "Nothing to copy", kept);
+    else if (prompt_line(label, answer, sizeof(answer)) && (answer[0] == 'y' || answer[0] == 'Y')) {
+        BatchSpec spec;
+        ZeroMemory(&spec, sizeof(spec));
+        spec.op = BATCH_COPY;
+        strncpy_s(spec.dir, MAX_PATH, cmp_left, _TRUNCATE);
+        strncpy_s(spec.dest, MAX_PATH, cmp_right, _TRUNCATE);
+        execute_batch(p, &spec, "Copied", names, k);
+    }
+    free(names);
+}
+
+/* ---- Command Prompt and MS-DOS QBasic: both run on the plain screen with the file manager suspended ---- */
+
+static void console_clear(void) {
+    CONSOLE_SCREEN_BUFFER_INFO sbi;
+    COORD home = { 0, 0 };
+    DWORD written;
+    if (vt_out) { vt_clear(vt_out); return; }
+    GetConsoleScreenBufferInfo(hConsole, &sbi);
+    DWORD cells = (DWORD)sbi.dwSize.X * sbi.dwSize.Y;
+    FillConsoleOutputCharacterA(hConsole, ' ', cells, home, &written);
+    FillConsoleOutputAttribute(hConsole, sbi.wAttributes, cells, home, &written);
+    SetConsoleCursorPosition(hConsole, home);
+}
+
+static void term_write(void *ctx, const char *text, int len) {
+    DWORD written;
+    (void)ctx;
+    if (vt_out) vt_write(vt_out, text, len);
+    else WriteConsoleA(hConsole, text, (DWORD)len, &written, NULL);
+}
+
+static void term_text(const char *text) { term_write(NULL, text, (int)strlen(text)); }
+
+/* Reads a cooked line: echo and editing are switched on just for the call */
+static int term_read_line(void *ctx, char *buf, int len) {
+    DWORD mode = 0, got = 0;
+    (void)ctx;
+    GetConsoleMode(hInput, &mode);
+    SetConsoleMode(hInput, ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT | ENABLE_EXTENDED_FLAGS);
+    BOOL ok = ReadConsoleA(hInput, buf, (DWORD)len - 1, &got, NULL);
+    SetConsoleMode(hInput, mode);
+    if (!ok) return 0;
+    buf[got] = 0;
+    while (got > 0 && (buf[got-1] == '\r' || buf[got-1] == '\n')) buf[--got] = 0;
+    return 1;
+}
+
+static int term_interrupted(void *ctx) { (void)ctx; return escape_pressed(); }
+static void term_clear(void *ctx) { (void)ctx; console_clear(); }
+
+/* Waits for a key press; returns its virtual key code */
+static WORD term_wait_key(void) {
+    for (;;) {
+        INPUT_RECORD ir;
+        DWORD read = 0;
+        if (!ReadConsoleInput(hInput, &ir, 1, &read)) return VK_ESCAPE;
+        if (ir.EventType == KEY_EVENT && ir.Event.KeyEvent.bKeyDown) return ir.Event.KeyEvent.wVirtualKeyCode;
+    }
+}
+
+/* MORE: Esc or Q stops the output */
+static int term_more(void *ctx) {
+    (void)ctx;
+    term_text("-- More --");
+    WORD vk = term_wait_key();
+    term_text("\r          \r");
+    return vk != VK_ESCAPE && vk != 'Q';
+}
+
+/* Hands the screen over to a program: visible cursor, default colours, cleared screen */
+static void term_suspend(CONSOLE_CURSOR_INFO *ci) {
+    GetConsoleCursorInfo(hConsole, ci);
+    ci->bVisible = TRUE;
+    SetConsoleCursorInfo(hConsole, ci);
+    if (vt_out) vt_suspend(vt_out);
+    else SetConsoleTextAttribute(hConsole, ATTR_DEFAULT);
+    console_clear();
+}
+
+static void term_resume(CONSOLE_CURSOR_INFO *ci) {
+    if (vt_out) vt_resume(vt_out);
+    else SetConsoleTextAttribute(hConsole, ATTR_WHITE_ON_BLUE);
+    ci->bVisible = FALSE;
+    SetConsoleCursorInfo(hConsole, ci);
+}
+
+/* Programs may have changed files: reload whatever the panes show */
+static void reload_listing(Panel *p) {
+    if (find_active) run_find_query(p);
+    else if (cmp_active) run_compare(p);
+    else {
+        save_selection(p);
+        refresh_listing(p);
+        restore_selection(p);
+    }
+}
+
+/* Prompts for a .BAS file (the rest of the line becomes COMMAND$), compiles it and runs it;
+   Esc stops a running program. The listing is reloaded since programs may change files. */
+static void run_qbasic(Panel *p, const char *initial) {
+    char line[MAX_PATH + 256];
+    strncpy_s(line, sizeof(line), initial ? initial : "", _TRUNCATE);
+    if (!prompt_line("Run QBasic program: ", line, sizeof(line))) return;
+    char file[MAX_PATH], full[MAX_PATH], err[256];
+    const char *q = line;
+    size_t n = 0;
+    while (*q == ' ') q++;
+    if (*q == '"') { for (++q; *q && *q != '"' && n + 1 < MAX_PATH; ) file[n++] = *q++; if (*q == '"') q++; }
+    else while (*q && *q != ' ' && n + 1 < MAX_PATH) file[n++] = *q++;
+    file[n] = 0;
+    while (*q == ' ') q++;
+    if (!file[0]) return;
+    if (!strchr(item_base_name(file), '.')) strncat_s(file, MAX_PATH, ".BAS", _TRUNCATE);
+    if (!GetFullPathNameA(file, MAX_PATH, full, NULL)) { snprintf(status_msg, sizeof(status_msg), "Bad file name: %s", file); return; }
+
+    QbProgram *prog = qb_compile_file(full, err, sizeof(err));
+    if (!prog) { snprintf(status_msg, sizeof(status_msg), "%s: %s", item_base_name(full), err); return; }
+
+    /* CHDIR in the program must not move the file manager */
+    char dir[MAX_PATH];
+    CONSOLE_CURSOR_INFO ci;
+    GetCurrentDirectoryA(MAX_PATH, dir);
+    term_suspend(&ci);
+
+    QbHost host = { NULL, term_write, term_read_line, term_interrupted, term_clear };
+    int failed = qb_run(prog, q, &host, err, sizeof(err));
+    qb_free(prog);
+
+    term_text("\nPress any key to continue");
+    term_wait_key();
+    term_resume(&ci);
+    SetCurrentDirectoryA(dir);
+
+    reload_listing(p);
+    if (failed) snprintf(status_msg, sizeof(status_msg), "%s: %s", item_base_name(full), err);
+    else snprintf(status_msg, sizeof(status_msg), "%s finished", item_base_name(full));
+}
+
+/* A DOS prompt until EXIT. Built-in commands run in process (doscmd.c), others in %COMSPEC%.
+   Leaving the prompt on disk takes the file manager to the prompt's current directory. */
+static void run_shell(Panel *p) {
+    char dir[MAX_PATH], line[1024], prompt[MAX_PATH + 8];
+    CONSOLE_CURSOR_INFO ci;
+    CONSOLE_SCREEN_BUFFER_INFO sbi;
+    GetCurrentDirectoryA(MAX_PATH, dir);
+    GetConsoleScreenBufferInfo(hConsole, &sbi);
+    term_suspend(&ci);
+
+    DosHost host = { NULL, term_write, term_interrupted, term_more, term_clear, sbi.srWindow.Bottom - sbi.srWindow.Top + 1 };
+    term_text("Type EXIT to return to the Shell.\n");
+    for (;;) {
+        GetCurrentDirectoryA(MAX_PATH, line);
+        snprintf(prompt, sizeof(prompt), "\n%s>", line);
+        term_text(prompt);
+        if (!term_read_line(NULL, line, sizeof(line))) break;
+        if (dos_execute(line, &host) == DOS_EXIT) break;
+    }
+    term_resume(&ci);
+
+    char now[MAX_PATH];
+    GetCurrentDirectoryA(MAX_PATH, now);
+    if (p->archive || find_active || cmp_active || _stricmp(now, dir) == 0) {
+        SetCurrentDirectoryA(dir);
+        reload_listing(p);
+        return;
+    }
+    save_selection(p);
+    strncpy_s(p->cwd, MAX_PATH, now, _TRUNCATE);
+    refresh_listing(p);
+    restore_selection(p);
+}
+
+/* NTFS may not report the size of a file its writer holds open until the entry is flushed,
+   so the follow view also looks at the file this often without a notification */
+#define TAIL_RECHECK_MS 1000
+
+/* F3: follows a file as it grows (tail -f). The last screenful is shown first, then only
+   the appended lines are written and the screen scrolls under them; Esc or Q returns. */
+static void run_tail(Panel *p, const char *fname) {
+    char path[MAX_PATH], line[MAX_PATH + 64], err[MAX_PATH + 32];
+    CONSOLE_CURSOR_INFO ci;
+    COORD size = get_console_size();
+    /* find results are full paths already */
+    if (strchr(fname, '\\')) strncpy_s(path, MAX_PATH, fname, _TRUNCATE);
+    else snprintf(path, sizeof(path), "%s\\%s", p->cwd, fname);
+    TailFollow *t = tail_open(path, size.Y - 1, err, sizeof(err));
+    if (!t) { snprintf(status_msg, sizeof(status_msg), "Cannot follow: %s", err); return; }
+    term_suspend(&ci);
+    snprintf(line, sizeof(line), "Following %s   Esc: return\n", path);
+    term_text(line);
+
+    HANDLE waits[2] = { hInput, tail_handle(t) };
+    long long shown = tail_first(t);
+    int partial = 0;                  /* bytes of line `shown` already on screen */
+    int ev = 0, running = 1;
+    while (running) {
+        if (shown < tail_first(t)) {
+            /* the ring moved past what is on screen */
+            if (partial) term_text("\n");
+            shown = tail_first(t);
+            partial = 0;
+        } else if ((ev & TAIL_SKIPPED) && partial) {
+            /* the line on screen was cut short by the skip; its rest is gone */
+            term_text("\n");
+            partial = 0;
+        }
+        for (int len; shown <= tail_end(t); ++shown) {
+            const char *text = tail_line(t, shown, &len);
+            if (len > partial) term_write(NULL, text + partial, len - partial);
+            if (shown == tail_end(t)) { if (len > partial) partial = len; break; }
+            term_text("\n");
+            partial = 0;
+        }
+
+        DWORD r = WaitForMultipleObjects(waits[1] ? 2 : 1, waits, FALSE, TAIL_RECHECK_MS);
+        if (r == WAIT_OBJECT_0) {
+            DWORD pending = 0;
+            while (running && GetNumberOfConsoleInputEvents(hInput, &pending) && pending > 0) {
+                INPUT_RECORD ir;
+                DWORD read = 0;
+                if (!ReadConsoleInput(hInput, &ir, 1, &read)) { running = 0; break; }
+                if (ir.EventType == KEY_EVENT && ir.Event.KeyEvent.bKeyDown) {
+                    WORD vk = ir.Event.KeyEvent.wVirtualKeyCode;
+                    if (vk == VK_ESCAPE || vk == 'Q') running = 0;
+                }
+            }
+            ev = 0;
+            continue;
+        }
+        ev = tail_update(t);
+    }
+    tail_close(t);
+    term_resume(&ci);
+}
+
+static const char *cmp_state_label(CmpState st) {
+    switch (st) {
+    case CMP_ONLY_LEFT: return "only left";
+    case CMP_ONLY_RIGHT: return "only right";
+    case CMP_NEWER_LEFT: return "newer left";
+    case CMP_NEWER_RIGHT: return "newer right";
+    case CMP_DIFFERENT: return "different";
+    default: return "same";
+    }
+}
+
+/* Where a panel's lists are on screen. A list's header row is y, its items follow on the
+   next rows; x1 is the scrollbar column. rows is 0 for a list that is not shown. */
+typedef struct {
+    int x0, x1, text_x;
+    int y, rows;
+} ListRect;
+
+typedef struct {
+    ListRect dirs[2], files[2];
+    int content_top, content_bottom;
+    int mid_x;                   /* vertical divider */
+    int mid_y;                   /* single pane: the divider above Main and the task list */
+    int bottom_h;                /* single pane: lines available for the bottom panes */
+} Layout;
+
+/* Single pane: directories in the left third and files in the rest of the top half, Main
+   and the task list below. Dual pane: each panel gets half the width, directories over
+   files, and the bottom panes make way. */
+static void compute_layout(int w, int h, Layout *L) {
+    ZeroMemory(L, sizeof(*L));
+    L->content_top = 3;
+    L->content_bottom = h - 2;
+    int content_h = L->content_bottom - L->content_top + 1;
+    if (!dual_pane) {
+        int top_h = content_h / 2;
+        L->mid_x = w / 3;
+        L->mid_y = L->content_top + top_h;
+        L->bottom_h = content_h - top_h - 1;
+        ListRect d = { 0, L->mid_x - 1, 1, L->content_top, top_h - 1 };
+        ListRect f = { L->mid_x + 1, w - 1, L->mid_x + 2, L->content_top, top_h - 1 };
+        L->dirs[active_panel] = d;
+        L->files[active_panel] = f;
+    } else {
+        int dir_rows = (content_h - 2) / 3;
+        L->mid_x = w / 2;
+        for (int i = 0; i < 2; ++i) {
+            int x0 = i ? L->mid_x + 1 : 0, x1 = i ? w - 1 : L->mid_x - 1;
+            ListRect d = { x0, x1, x0 + 1, L->content_top, dir_rows };
+            ListRect f = { x0, x1, x0 + 1, L->content_top + dir_rows + 1, content_h - dir_rows - 2 };
+            L->dirs[i] = d;
+            L->files[i] = f;
         }
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (L->dirs[i].rows < 0) L->dirs[i].rows = 0;
+        if (L->files[i].rows < 0) L->files[i].rows = 0;
+    }
+}
+
+static Layout current_layout(void) {
+    COORD size = get_console_size();
+    Layout L;
+    compute_layout(size.X, size.Y, &L);
+    return L;
+}
+
+typedef struct {
+    CHAR_INFO *buf;
+    int w, h;
+} Frame;
+
+static void frame_text(Frame *f, int x, int y, const char *s, WORD attr) {
+    for (int i = 0; s[i]; ++i) {
+        if (x + i < 0 || x + i >= f->w || y < 0 || y >= f->h) continue;
+        CHAR_INFO *c = &f->buf[y * f->w + x + i];
+        c->Char.AsciiChar = s[i];
+        c->Attributes = attr;
+    }
+}
+
+static void frame_fill(Frame *f, int x0, int x1, int y, WORD attr) {
+    for (int x = x0; x <= x1; ++x) frame_text(f, x, y, " ", attr);
+}
+
+static void draw_scrollbar(Frame *f, int col, int top, int rows, int offset, int count) {
+    if (count <= rows || rows <= 0) return;
+    for (int y = top; y < top + rows; ++y) frame_text(f, col, y, "|", ATTR_SCROLL);
+    int thumb_pos = top; if (count > 1) thumb_pos = top + (offset * (rows - 1)) / (count - 1);
+    if (thumb_pos < top) thumb_pos = top; if (thumb_pos > top + rows - 1) thumb_pos = top + rows - 1; frame_text(f, col, thumb_pos, "O", ATTR_HILITE);
+}
+
+/* Header row: title on the left (a long one keeps its end), count on the right */
+static void draw_list_header(Frame *f, const ListRect *r, const char *title, const char *count, WORD attr) {
+    frame_fill(f, r->x0, r->x1, r->y, attr);
+    int room = r->x1 - r->text_x - (int)strlen(count) - 1;
+    char t[MAX_PATH + 64];
+    int l = (int)strlen(title);
+    if (room < 4) t[0] = 0;
+    else if (l > room) snprintf(t, sizeof(t), "...%s", title + l - (room - 3));
+    else strncpy_s(t, sizeof(t), title, _TRUNCATE);
+    frame_text(f, r->text_x, r->y, t, attr);
+    int posx = r->x1 - (int)strlen(count); if (posx < r->text_x) posx = r->text_x;
+    frame_text(f, posx, r->y, count, attr);
+}
+
+static void draw_dir_list(Frame *f, Panel *p, const ListRect *r, const char *title, WORD hdr_attr, int focused) {
+    Listing *ls = &p->ls;
+    int dcount = ls->dcount;
+    if (dcount == 0) p->dir_sel = 0; else if (p->dir_sel >= dcount) p->dir_sel = dcount - 1;
+    char cntbuf[32]; int selpos = (dcount>0)?(p->dir_sel+1):0; snprintf(cntbuf,sizeof(cntbuf),"%d/%d",selpos,dcount);
+    draw_list_header(f, r, title, cntbuf, hdr_attr);
+
+    int visible_dirs = r->rows;
+    if (p->dir_offset > dcount - visible_dirs) p->dir_offset = dcount - visible_dirs; if (p->dir_offset < 0) p->dir_offset = 0;
+    for (int i = 0; i < visible_dirs && (i + p->dir_offset) < dcount; ++i) {
+        int idx = ls->dir_idx[i + p->dir_offset]; WORD attr = (focused && (i + p->dir_offset) == p->dir_sel) ? (ATTR_HILITE) : ATTR_DEFAULT;
+        char line[512]; snprintf(line,sizeof(line),"  [%c] %s", 'D', ls->items[idx].name); if ((int)strlen(line) > r->x1 - r->text_x) line[r->x1 - r->text_x] = '\0'; frame_text(f, r->text_x, r->y + 1 + i, line, attr);
+    }
+    draw_scrollbar(f, r->x1, r->y + 1, visible_dirs, p->dir_offset, dcount);
+}
+
+static const char *sort_label(SortKey k) {
+    switch (k) {
+    case SORT_NAME: return "by name";
+    case SORT_EXT: return "by extension";
+    case SORT_TIME: return "by time";
+    case SORT_SIZE: return "by size";
+    default: return "";
+    }
+}
+
+/* Modification time in local time; only done for the rows on screen */
+static int item_local_time(const FileItem *it, SYSTEMTIME *st) {
+    FILETIME local;
+    return it->meta == META_READY && FileTimeToLocalFileTime(&it->mtime, &local) && FileTimeToSystemTime(&local, st);
+}
+
+/* Asks the fetch workers for the metadata a listing came without, for the rows shown and a
+   page either side of them */
+static void fetch_metadata(Listing *ls, int offset, int rows) {
+    int want[FETCH_ROWS_MAX], n = 0;
+    int from = offset - rows, to = offset + 2 * rows;
+    if (from < 0) from = 0;
+    if (to > ls->fcount) to = ls->fcount;
+    for (int f = from; f < to && n < FETCH_ROWS_MAX; ++f) {
+        int i = ls->file_idx[f];
+        if (ls->items[i].meta == META_MISSING || ls->items[i].meta == META_QUEUED) want[n++] = i;
+    }
+    if (n) dirsnap_fetch(ls->snap, want, n);
+}
+
+static void draw_file_list(Frame *f, Panel *p, const ListRect *r, WORD hdr_attr, int focused) {
+    Listing *ls = &p->ls;
+    FileItem *items = ls->items;
+    int fcount = ls->fcount;
+    int comparing = cmp_active && cmp_result && panel_in_mode(p);
+    if (fcount == 0) p->file_sel = 0; else if (p->file_sel >= fcount) p->file_sel = fcount - 1;
+    char title[128], cntbuf[48];
+    snprintf(title, sizeof(title), "Files%s%s%s%s", ls->sort ? "  " : "", sort_label(ls->sort), ls->filter[0] ? "  " : "", ls->filter);
+    int selpos = (fcount>0)?(p->file_sel+1):0;
+    if (ls->marked > 0) snprintf(cntbuf,sizeof(cntbuf),"%d marked  %d/%d",ls->marked,selpos,fcount); else snprintf(cntbuf,sizeof(cntbuf),"%d/%d",selpos,fcount);
+    draw_list_header(f, r, title, cntbuf, hdr_attr);
 
-        if (*count >= MAX_ITEMS) break;
-    } while (FindNextFileA(hFind, &fd));
-    FindClose(hFind);
+    int visible_files = r->rows;
+    if (p->file_offset > fcount - visible_files) p->file_offset = fcount - visible_files; if (p->file_offset < 0) p->file_offset = 0;
+    fetch_metadata(ls, p->file_offset, visible_files);
+    for (int i = 0; i < visible_files && (i + p->file_offset) < fcount; ++i) {
+        int idx = ls->file_idx[i + p->file_offset]; FileItem *it = &items[idx]; int selected_row = (focused && (i + p->file_offset) == p->file_sel);
+        WORD attr = IS_MARKED(ls, idx) ? (selected_row ? ATTR_HILITE_MARKED : ATTR_MARKED) : (selected_row ? ATTR_HILITE : ATTR_DEFAULT);
+        SYSTEMTIME st; int known = item_local_time(it, &st);
+        char line[1024]; char dt[64] = ""; if (known) { int hour = st.wHour; int hour12 = hour % 12; if (hour12 == 0) hour12 = 12; const char *ampm = (hour >= 12) ? "PM" : "AM"; snprintf(dt, sizeof(dt), "%02d/%02d/%04d %02d:%02d %s", st.wMonth, st.wDay, st.wYear, hour12, st.wMinute, ampm); }
+        char sizebuf[32] = ""; if (!it->is_dir && show_sizes && known) snprintf(sizebuf, sizeof(sizebuf), "%10llu", it->size);
+        snprintf(line, sizeof(line), "%s %s %s", dt, sizebuf, it->name);
+        if (comparing) {
+            const CmpEntry *ce; int ne = dircmp_entries(cmp_result, &ce);
+            if (idx < ne) snprintf(line, sizeof(line), "%-11s %s %s %s%s", cmp_state_label(ce[idx].state), dt, ce[idx].is_dir ? "     <DIR>" : sizebuf, it->name, ce[idx].is_dir ? "\\" : "");
+        }
+        int available = r->x1 - r->text_x; if ((int)strlen(line) > available) line[available] = '\0'; frame_text(f, r->text_x, r->y + 1 + i, line, attr);
+    }
+    draw_scrollbar(f, r->x1, r->y + 1, visible_files, p->file_offset, fcount);
 }
 
-static void draw_ui(const char* cwd, FileItem* items, int count, int sel) {
+static void draw_ui(void) {
     COORD size = get_console_size();
     int w = size.X, h = size.Y;
     int total = w * h;
     CHAR_INFO *buf = (CHAR_INFO*)malloc(sizeof(CHAR_INFO) * total);
     if (!buf) return;
+    Frame fr = { buf, w, h };
+    Panel *ap = &panels[active_panel];
+    Listing *ls = &ap->ls;
 
     // fill background: use black background for panes and default text color
-    WORD blackBg = (WORD)(BACKGROUND_RED*0 | BACKGROUND_GREEN*0 | BACKGROUND_BLUE*0); /* 0 -> no background bits set -> treated as black */
     for (int y = 0; y < h; ++y) {
         for (int x = 0; x < w; ++x) {
             int idx = y * w + x;
@@ -196,35 +1259,21 @@ static void draw_ui(const char* cwd, FileItem* items, int count, int sel) {
         }
     }
 
-#define BUF_PUT_TEXT(px,py,txt,attr) do { \
-        const char *_s = (txt); \
-        for (int _i = 0; _i < (int)strlen(_s); ++_i) { \
-            int _x = (px) + _i; int _y = (py); \
-            if (_x < 0 || _x >= w || _y < 0 || _y >= h) continue; \
-            int _idx = _y * w + _x; \
-            buf[_idx].Char.AsciiChar = _s[_i]; \
-            buf[_idx].Attributes = (attr); \
-        } \
-    } while (0)
-
-    int content_top = 3;
-    int content_bottom = h - 2;
-    int content_h = content_bottom - content_top + 1;
-    int left_w = w / 3;
-    int mid_x = left_w;
-    int top_h = content_h / 2;
-    int mid_y = content_top + top_h;
-    int bottom_h = content_h - top_h - 1; // lines available for bottom panes
+#define BUF_PUT_TEXT(px,py,txt,attr) frame_text(&fr, (px), (py), (txt), (attr))
+
+    Layout L;
+    compute_layout(w, h, &L);
+    int content_top = L.content_top;
+    int content_bottom = L.content_bottom;
+    int mid_x = L.mid_x;
+    int mid_y = L.mid_y;
+    int bottom_h = L.bottom_h;
 
     // title/menu/path
     char title[256]; snprintf(title, sizeof(title), " WC-DOS-Like Shell ");
     int title_x = (w > (int)strlen(title)) ? (w/2 - (int)strlen(title)/2) : 0;
     /* fill entire title bar row with blue background and write white-on-blue title */
-    for (int x = 0; x < w; ++x) {
-        int idx = 0 * w + x;
-        buf[idx].Char.AsciiChar = ' ';
-        buf[idx].Attributes = ATTR_WHITE_ON_BLUE;
-    }
+    frame_fill(&fr, 0, w - 1, 0, ATTR_WHITE_ON_BLUE);
     BUF_PUT_TEXT(title_x, 0, title, ATTR_WHITE_ON_BLUE);
     // menu/file bar (use grey background to match menu dropdown)
     WORD menuBg = (WORD)(BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE);
@@ -232,16 +1281,21 @@ static void draw_ui(const char* cwd, FileItem* items, int count, int sel) {
     WORD menuTextAttr = (WORD)(menuBg);
     WORD pathTextAttr = (WORD)(ATTR_DEFAULT);
     // fill the menu bar line with the grey background and the path line with default background
-    for (int x = 0; x < w; ++x) {
-        int idx1 = 1 * w + x; buf[idx1].Char.AsciiChar = ' '; buf[idx1].Attributes = menuBg;
-        int idx2 = 2 * w + x; buf[idx2].Char.AsciiChar = ' '; buf[idx2].Attributes = ATTR_DEFAULT;
-    }
+    frame_fill(&fr, 0, w - 1, 1, menuBg);
+    frame_fill(&fr, 0, w - 1, 2, ATTR_DEFAULT);
     BUF_PUT_TEXT(0, 1, " File  Options  View  Help", menuTextAttr);
-    char pathbar[1024]; snprintf(pathbar, sizeof(pathbar), " %s", cwd); BUF_PUT_TEXT(0, 2, pathbar, pathTextAttr);
+    char pathbar[1024];
+    if (find_active) {
+        char fstate[128]; findidx_status(find_index, fstate, sizeof(fstate));
+        snprintf(pathbar, sizeof(pathbar), " Find: %s_   [%s: %s]", find_query, find_root, fstate);
+    } else if (cmp_active && cmp_result) {
+        CmpSummary cs; dircmp_summary(cmp_result, &cs);
+        snprintf(pathbar, sizeof(pathbar), " Compare %s -> %s   [%d only left, %d only right, %d newer left, %d newer right, %d different, %d same]",
+                 cmp_left, cmp_right, cs.only_left, cs.only_right, cs.newer_left, cs.newer_right, cs.different, cs.same);
+    } else snprintf(pathbar, sizeof(pathbar), " %s", ap->cwd);
+    BUF_PUT_TEXT(0, 2, pathbar, pathTextAttr);
 
-    // pane header attributes: use white text on blue background and fill the whole header area with blue
-    WORD attr_dir_hdr = ATTR_WHITE_ON_BLUE;
-    WORD attr_files_hdr = ATTR_WHITE_ON_BLUE;
+    // pane header attributes: white on blue; in dual pane mode the active panel's are purple
     WORD attr_main_hdr = ATTR_WHITE_ON_BLUE;
     WORD attr_tasks_hdr = ATTR_WHITE_ON_BLUE;
 
@@ -249,72 +1303,40 @@ static void draw_ui(const char* cwd, FileItem* items, int count, int sel) {
     int menu_file_x = 1;
     int menu_options_x = 7; /* matches spacing in menu bar string */
 
-    /* menu is drawn after the main content so it appears above panes */
-
     // dividers (use box-drawing characters) - draw with default foreground so no background fills
     char ver_ch[2] = { (char)179, 0 }; /* │ */
     char hor_ch[2] = { (char)196, 0 }; /* ─ */
     char cross_ch[2] = { (char)197, 0 }; /* ┼ */
     for (int y = content_top; y <= content_bottom; ++y) BUF_PUT_TEXT(mid_x, y, ver_ch, ATTR_DEFAULT);
-    for (int x = 0; x < w; ++x) {
-        if (x == mid_x) BUF_PUT_TEXT(x, mid_y, cross_ch, ATTR_DEFAULT);
-        else BUF_PUT_TEXT(x, mid_y, hor_ch, ATTR_DEFAULT);
-    }
-
-    // Build lists
-    int dir_idx[MAX_ITEMS]; int file_idx[MAX_ITEMS]; int dcount = 0, fcount = 0;
-    for (int i = 0; i < count; ++i) { if (items[i].is_dir) dir_idx[dcount++] = i; else file_idx[fcount++] = i; }
-
-    if (dcount == 0) dir_sel = 0; else if (dir_sel >= dcount) dir_sel = dcount - 1;
-    if (fcount == 0) file_sel = 0; else if (file_sel >= fcount) file_sel = fcount - 1;
-
-    // directory header and count - fill left header area with blue background then draw text
-    for (int x = 0; x < mid_x; ++x) {
-        int idx = content_top * w + x;
-        buf[idx].Char.AsciiChar = ' ';
-        buf[idx].Attributes = ATTR_WHITE_ON_BLUE;
-    }
-    BUF_PUT_TEXT(1, content_top, "Directory Tree", attr_dir_hdr);
-    char cntbuf[32]; int selpos = (dcount>0)?(dir_sel+1):0; snprintf(cntbuf,sizeof(cntbuf),"%d/%d",selpos,dcount);
-    int posx = mid_x - (int)strlen(cntbuf) - 1; if (posx < 0) posx = 0; BUF_PUT_TEXT(posx, content_top, cntbuf, ATTR_WHITE_ON_BLUE);
-
-    int dt_y = content_top + 1; int dt_max = (mid_y - 1) - dt_y + 1; int visible_dirs = dt_max; if (visible_dirs < 0) visible_dirs = 0;
-    if (dir_offset < 0) dir_offset = 0; if (dir_offset > dcount - visible_dirs) dir_offset = dcount - visible_dirs; if (dir_offset < 0) dir_offset = 0;
-    for (int i = 0; i < visible_dirs && (i + dir_offset) < dcount; ++i) {
-        int idx = dir_idx[i + dir_offset]; WORD attr = (cur_pane == PANE_DIR && (i + dir_offset) == dir_sel) ? (ATTR_HILITE) : ATTR_DEFAULT;
-        char line[512]; snprintf(line,sizeof(line),"  [%c] %s", 'D', items[idx].name); if ((int)strlen(line) > left_w-2) line[left_w-2] = '\0'; BUF_PUT_TEXT(1, dt_y + i, line, attr);
-    }
-
-    // left scrollbar
-    if (dcount > visible_dirs && visible_dirs > 0) {
-        int col = mid_x - 1; for (int y = dt_y; y < dt_y + visible_dirs; ++y) BUF_PUT_TEXT(col, y, "|", ATTR_SCROLL);
-        int thumb_pos = dt_y; if (dcount > 1) thumb_pos = dt_y + (dir_offset * (visible_dirs - 1)) / (dcount - 1);
-        if (thumb_pos < dt_y) thumb_pos = dt_y; if (thumb_pos > dt_y + visible_dirs - 1) thumb_pos = dt_y + visible_dirs - 1; BUF_PUT_TEXT(col, thumb_pos, "O", ATTR_HILITE);
-    }
-
-    // files header and list - fill right header area with blue background then draw text
-    for (int x = mid_x + 1; x < w; ++x) {
-        int idx = content_top * w + x;
-        buf[idx].Char.AsciiChar = ' ';
-        buf[idx].Attributes = ATTR_WHITE_ON_BLUE;
-    }
-    BUF_PUT_TEXT(mid_x+2, content_top, "Files", attr_files_hdr);
-    selpos = (fcount>0)?(file_sel+1):0; snprintf(cntbuf,sizeof(cntbuf),"%d/%d",selpos,fcount); posx = w - (int)strlen(cntbuf) - 1; if (posx < mid_x+2) posx = mid_x+2; BUF_PUT_TEXT(posx, content_top, cntbuf, ATTR_WHITE_ON_BLUE);
-    int fl_y = content_top + 1; int fl_max = (mid_y - 1) - fl_y + 1; int visible_files = fl_max; if (visible_files < 0) visible_files = 0;
-    if (file_offset < 0) file_offset = 0; if (file_offset > fcount - visible_files) file_offset = fcount - visible_files; if (file_offset < 0) file_offset = 0;
-    for (int i = 0; i < visible_files && (i + file_offset) < fcount; ++i) {
-        int idx = file_idx[i + file_offset]; FileItem *it = &items[idx]; WORD attr = (cur_pane == PANE_FILES && (i + file_offset) == file_sel) ? (ATTR_HILITE) : ATTR_DEFAULT;
-        char line[1024]; char dt[64] = ""; if (it->mtime.wYear != 0) { int hour = it->mtime.wHour; int hour12 = hour % 12; if (hour12 == 0) hour12 = 12; const char *ampm = (hour >= 12) ? "PM" : "AM"; snprintf(dt, sizeof(dt), "%02d/%02d/%04d %02d:%02d %s", it->mtime.wMonth, it->mtime.wDay, it->mtime.wYear, hour12, it->mtime.wMinute, ampm); }
-        char sizebuf[32] = ""; if (!it->is_dir && show_sizes) snprintf(sizebuf, sizeof(sizebuf), "%10llu", it->size);
-        snprintf(line, sizeof(line), "%s %s %s", dt, sizebuf, it->name);
-        int available = w - (mid_x + 3); if ((int)strlen(line) > available) line[available] = '\0'; BUF_PUT_TEXT(mid_x+2, fl_y + i, line, attr);
+    if (!dual_pane) {
+        for (int x = 0; x < w; ++x) {
+            if (x == mid_x) BUF_PUT_TEXT(x, mid_y, cross_ch, ATTR_DEFAULT);
+            else BUF_PUT_TEXT(x, mid_y, hor_ch, ATTR_DEFAULT);
+        }
     }
 
-    // right scrollbar
-    if (fcount > visible_files && visible_files > 0) {
-        int col = w - 1; for (int y = fl_y; y < fl_y + visible_files; ++y) BUF_PUT_TEXT(col, y, "|", ATTR_SCROLL);
-        int thumb_pos = fl_y; if (fcount > 1) thumb_pos = fl_y + (file_offset * (visible_files - 1)) / (fcount - 1);
-        if (thumb_pos < fl_y) thumb_pos = fl_y; if (thumb_pos > fl_y + visible_files - 1) thumb_pos = fl_y + visible_files - 1; BUF_PUT_TEXT(col, thumb_pos, "O", ATTR_HILITE);
+    // file lists of the panels on screen
+    for (int i = 0; i < 2; ++i) {
+        if (L.dirs[i].rows == 0 && L.files[i].rows == 0) continue;
+        Panel *p = &panels[i];
+        int active = (i == active_panel);
+        WORD hdr = (dual_pane && active) ? ATTR_WHITE_ON_PURPLE : ATTR_WHITE_ON_BLUE;
+        draw_dir_list(&fr, p, &L.dirs[i], dual_pane ? p->cwd : "Directory Tree", hdr, active && cur_pane == PANE_DIR);
+        draw_file_list(&fr, p, &L.files[i], hdr, active && cur_pane == PANE_FILES);
+    }
+
+    // bottom panes - fill bottom header areas with blue and draw headers
+    if (!dual_pane) {
+        frame_fill(&fr, 0, mid_x - 1, mid_y + 1, ATTR_WHITE_ON_BLUE);
+        frame_fill(&fr, mid_x + 1, w - 1, mid_y + 1, ATTR_WHITE_ON_BLUE);
+        BUF_PUT_TEXT(1, mid_y+1, "Main", attr_main_hdr);
+        const char *main_items[] = { "Command Prompt", "Editor", "MS-DOS QBasic", "Disk Utilities" };
+        int main_count = sizeof(main_items)/sizeof(main_items[0]);
+        for (int i = 0; i < bottom_h && i < main_count; ++i) { WORD attr = (cur_pane == PANE_MAIN && i == main_sel) ? (ATTR_HILITE) : ATTR_DEFAULT; BUF_PUT_TEXT(1, mid_y+2 + i, main_items[i], attr); }
+        BUF_PUT_TEXT(mid_x+2, mid_y+1, "Active Task List", attr_tasks_hdr);
+        const char *tasks[] = { "Command Prompt" };
+        int tcount = 1;
+        for (int i = 0; i < bottom_h && i < tcount; ++i) { WORD attr = (cur_pane == PANE_TASKS && i == task_sel) ? (ATTR_HILITE) : ATTR_DEFAULT; BUF_PUT_TEXT(mid_x+2, mid_y+2 + i, tasks[i], attr); }
     }
 
     // If menu active, draw it last so it overlays panes
@@ -328,18 +1350,10 @@ static void draw_ui(const char* cwd, FileItem* items, int count, int sel) {
         int right = mx + mw + 2;
         int top = 2; /* draw menu one line below the menu bar */
         int bottom = top + mcount + 1;
-        WORD menuBg = (WORD)(BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE); /* grey/white background */
         /* draw border with same grey background so it blends */
         WORD borderAttr = menuBg;
-        WORD itemAttr = menuBg;
         /* fill interior */
-        for (int y = top + 1; y < bottom; ++y) {
-            for (int x = left + 1; x < right; ++x) {
-                int idx = y * w + x;
-                buf[idx].Char.AsciiChar = ' ';
-                buf[idx].Attributes = menuBg;
-            }
-        }
+        for (int y = top + 1; y < bottom; ++y) frame_fill(&fr, left + 1, right - 1, y, menuBg);
         /* draw border using box-drawing characters (CP437) */
         char tl[2] = { (char)201, 0 }; /* ╔ */
         char tr[2] = { (char)187, 0 }; /* ╗ */
@@ -362,45 +1376,25 @@ static void draw_ui(const char* cwd, FileItem* items, int count, int sel) {
             /* pad to width */
             char padded[128]; strncpy_s(padded, sizeof(padded), txt, _TRUNCATE);
             int l = (int)strlen(padded);
-            for (int p = l; p < mw+1; ++p) padded[p] = ' ';
+            for (int q = l; q < mw+1; ++q) padded[q] = ' ';
             padded[mw+1] = '\0';
             BUF_PUT_TEXT(mx, y, padded, a);
         }
     }
 
-    // bottom panes - fill bottom header areas with blue and draw headers
-    for (int x = 0; x < mid_x; ++x) {
-        int idx = (mid_y+1) * w + x;
-        buf[idx].Char.AsciiChar = ' ';
-        buf[idx].Attributes = ATTR_WHITE_ON_BLUE;
-    }
-    for (int x = mid_x + 1; x < w; ++x) {
-        int idx = (mid_y+1) * w + x;
-        buf[idx].Char.AsciiChar = ' ';
-        buf[idx].Attributes = ATTR_WHITE_ON_BLUE;
-    }
-    BUF_PUT_TEXT(1, mid_y+1, "Main", attr_main_hdr);
-    const char *main_items[] = { "Command Prompt", "Editor", "MS-DOS QBasic", "Disk Utilities" };
-    int main_count = sizeof(main_items)/sizeof(main_items[0]);
-    for (int i = 0; i < bottom_h && i < main_count; ++i) { WORD attr = (cur_pane == PANE_MAIN && i == main_sel) ? (ATTR_HILITE) : ATTR_DEFAULT; BUF_PUT_TEXT(1, mid_y+2 + i, main_items[i], attr); }
-    BUF_PUT_TEXT(mid_x+2, mid_y+1, "Active Task List", attr_tasks_hdr);
-    const char *tasks[] = { "Command Prompt" };
-    int tcount = 1;
-    for (int i = 0; i < bottom_h && i < tcount; ++i) { WORD attr = (cur_pane == PANE_TASKS && i == task_sel) ? (ATTR_HILITE) : ATTR_DEFAULT; BUF_PUT_TEXT(mid_x+2, mid_y+2 + i, tasks[i], attr); }
-
     // status bar
     char status[1024];
     /* determine selected name according to focused pane */
     char selected[512] = "";
     if (cur_pane == PANE_DIR) {
-        if (dcount > 0 && dir_sel >= 0 && dir_sel < dcount) {
-            int sel_idx = dir_idx[dir_sel];
-            strncpy_s(selected, sizeof(selected), items[sel_idx].name, _TRUNCATE);
+        if (ls->dcount > 0 && ap->dir_sel >= 0 && ap->dir_sel < ls->dcount) {
+            int sel_idx = ls->dir_idx[ap->dir_sel];
+            strncpy_s(selected, sizeof(selected), ls->items[sel_idx].name, _TRUNCATE);
         }
     } else if (cur_pane == PANE_FILES) {
-        if (fcount > 0 && file_sel >= 0 && file_sel < fcount) {
-            int sel_idx = file_idx[file_sel];
-            strncpy_s(selected, sizeof(selected), items[sel_idx].name, _TRUNCATE);
+        if (ls->fcount > 0 && ap->file_sel >= 0 && ap->file_sel < ls->fcount) {
+            int sel_idx = ls->file_idx[ap->file_sel];
+            strncpy_s(selected, sizeof(selected), ls->items[sel_idx].name, _TRUNCATE);
         }
     } else if (cur_pane == PANE_MAIN) {
         const char *main_items[] = { "Command Prompt", "Editor", "MS-DOS QBasic", "Disk Utilities" };
@@ -411,18 +1405,109 @@ static void draw_ui(const char* cwd, FileItem* items, int count, int sel) {
         int tcount = 1;
         if (task_sel >= 0 && task_sel < tcount) strncpy_s(selected, sizeof(selected), tasks[task_sel], _TRUNCATE);
     }
-    snprintf(status, sizeof(status), " Enter: open   Backspace: up   PgUp/PgDn: page   Home/End: top/bottom   Q: quit    Selected: %s ", (selected[0]?selected:"") );
-    int status_y = h - 1; for (int x = 0; x < w; ++x) { int idx = status_y * w + x; buf[idx].Char.AsciiChar = ' '; buf[idx].Attributes = ATTR_STATUS; }
+    if (status_msg[0]) snprintf(status, sizeof(status), " %s ", status_msg);
+    else if (find_active) snprintf(status, sizeof(status), " Type to search   Enter: go to   Esc: leave find   Selected: %s ", (selected[0]?selected:"") );
+    else if (cmp_active) snprintf(status, sizeof(status), " Space: mark   F5: copy to right   F9: compare again   Esc: leave compare    Selected: %s ", (selected[0]?selected:"") );
+    else if (ap->archive) snprintf(status, sizeof(status), " Enter: open/view   F5: extract   Backspace: up   Q: quit    Selected: %s ", (selected[0]?selected:"") );
+    else if (cur_pane == PANE_FILES) snprintf(status, sizeof(status), " Space: mark  +/-: mark by pattern  *: invert  Del: delete  F5: copy  F6: move  F2: rename  F3: follow  F4: attrib    Selected: %s ", (selected[0]?selected:"") );
+    else if (dual_pane) snprintf(status, sizeof(status), " Tab: next list   Enter: open   Backspace: up   Ctrl+F3-F7: sort   Ctrl+F: filter   Q: quit    Selected: %s ", (selected[0]?selected:"") );
+    else snprintf(status, sizeof(status), " Enter: open   Backspace: up   PgUp/PgDn: page   Home/End: top/bottom   Q: quit    Selected: %s ", (selected[0]?selected:"") );
+    int status_y = h - 1;
+    frame_fill(&fr, 0, w - 1, status_y, ATTR_STATUS);
     BUF_PUT_TEXT(0, status_y, status, ATTR_STATUS);
+#undef BUF_PUT_TEXT
 
     // write buffer to console
-    COORD bufSize = { (SHORT)w, (SHORT)h };
-    COORD bufCoord = { 0, 0 };
-    SMALL_RECT writeRect = { 0, 0, (SHORT)(w - 1), (SHORT)(h - 1) };
-    WriteConsoleOutputA(hConsole, buf, bufSize, bufCoord, &writeRect);
+    if (vt_out) vt_present(vt_out, buf, w, h);
+    else {
+        COORD bufSize = { (SHORT)w, (SHORT)h };
+        COORD bufCoord = { 0, 0 };
+        SMALL_RECT writeRect = { 0, 0, (SHORT)(w - 1), (SHORT)(h - 1) };
+        WriteConsoleOutputA(hConsole, buf, bufSize, bufCoord, &writeRect);
+    }
 
     free(buf);
-    (void)sel; /* avoid unused param warning */
+}
+
+/* Re-sorts the panel's view; the cursor stays on the same file */
+static void set_panel_sort(Panel *p, SortKey key) {
+    Listing *ls = &p->ls;
+    int dkeep = (ls->dcount > 0) ? ls->dir_idx[p->dir_sel] : -1;
+    int fkeep = (ls->fcount > 0) ? ls->file_idx[p->file_sel] : -1;
+    ls->sort = key;
+    listing_build_views(ls);
+    for (int d = 0; d < ls->dcount; ++d) if (ls->dir_idx[d] == dkeep) p->dir_sel = d;
+    for (int f = 0; f < ls->fcount; ++f) if (ls->file_idx[f] == fkeep) p->file_sel = f;
+    snprintf(status_msg, sizeof(status_msg), "Sorted %s", key == SORT_NONE ? "in folder order" : sort_label(key));
+}
+
+/* Ctrl+F: show only the files matching a wildcard; marks are dropped with the old view */
+static void set_panel_filter(Panel *p) {
+    char pat[64];
+    strncpy_s(pat, sizeof(pat), p->ls.filter, _TRUNCATE);
+    if (!prompt_line("Show files matching (e.g. *.txt, empty for all): ", pat, sizeof(pat))) return;
+    strncpy_s(p->ls.filter, sizeof(p->ls.filter), pat, _TRUNCATE);
+    listing_finish(&p->ls);
+    p->file_sel = 0; p->file_offset = 0;
+}
+
+/* The second panel starts out on the same folder as the first, sharing its snapshot if it
+   was just listed */
+static void toggle_dual_pane(void) {
+    Panel *p = &panels[active_panel], *o = other_panel(p);
+    dual_pane = !dual_pane;
+    if (!dual_pane) return;
+    if (cur_pane == PANE_MAIN || cur_pane == PANE_TASKS) cur_pane = PANE_FILES;
+    if (!o->cwd[0]) {
+        panel_disk_dir(p, o->cwd);
+        load_directory(o->cwd, &o->ls, FALSE);
+        restore_selection(o);
+    } else sync_other_panel(p, FALSE);
+}
+
+/* Runs a File or Options menu entry; returns 0 for Exit */
+static int menu_command(int id, int sel) {
+    Panel *p = &panels[active_panel];
+    if (id == 0) {
+        if (sel == 0) {
+            // Refresh
+            if (cmp_active) run_compare(p);
+            else if (find_active) {
+                /* the index is only recrawled on request; the watcher keeps it current */
+                findidx_refresh(find_index);
+                snprintf(status_msg, sizeof(status_msg), "Rebuilding the file index");
+            } else {
+                save_selection(p);
+                refresh_listing(p);
+                restore_selection(p);
+            }
+        } else if (sel == 1) {
+            start_find(p);
+        } else if (sel == 2) {
+            start_compare(p);
+        } else if (sel == 3) {
+            return 0;
+        }
+    } else {
+        if (sel == 0) {
+            show_sizes = !show_sizes;
+        } else if (sel == 1) {
+            cmp_verify = !cmp_verify;
+            snprintf(status_msg, sizeof(status_msg), "Compare contents of changed files: %s", cmp_verify ? "on" : "off");
+        } else if (sel == 2) {
+            toggle_dual_pane();
+        } else if (sel == 3) {
+            snprintf(status_msg, sizeof(status_msg), "MS-DOS Shell demo");
+        }
+    }
+    return 1;
+}
+
+/* The row of list r under the mouse, or -1 */
+static int list_row_at(const ListRect *r, int mx, int my) {
+    if (r->rows <= 0 || mx < r->x0 || mx > r->x1) return -1;
+    if (my < r->y + 1 || my >= r->y + 1 + r->rows) return -1;
+    return my - (r->y + 1);
 }
 
 int main(void) {
@@ -451,26 +1536,39 @@ int main(void) {
     // Set initial attributes (blue background)
     SetConsoleTextAttribute(hConsole, ATTR_WHITE_ON_BLUE);
 
-    char cwd[MAX_PATH];
-    GetCurrentDirectoryA(MAX_PATH, cwd);
+    /* Prefer escape-sequence output (terminals, ConPTY, SSH); WCDOS_OUTPUT=console keeps the
+       classic WriteConsoleOutputA path */
+    char outmode[16] = "";
+    GetEnvironmentVariableA("WCDOS_OUTPUT", outmode, sizeof(outmode));
+    if (_stricmp(outmode, "console") != 0) vt_out = vt_open(hConsole, hInput);
 
-    FileItem items[MAX_ITEMS];
-    int count = 0;
-    int sel = 0;
-    load_directory(cwd, items, &count);
+    /* the second panel is opened on the first switch to dual pane mode */
+    GetCurrentDirectoryA(MAX_PATH, panels[0].cwd);
+    load_directory(panels[0].cwd, &panels[0].ls, TRUE);
     // restore any previous selection state for this path
-    {
-        int dcount = 0, fcount = 0;
-        for (int i = 0; i < count; ++i) if (items[i].is_dir) dcount++; else fcount++;
-        restore_selection_for_path(cwd, dcount, fcount);
-    }
+    restore_selection(&panels[0]);
 
-    draw_ui(cwd, items, count, sel);
+    draw_ui();
 
     int running = 1;
     while (running) {
         INPUT_RECORD ir;
         DWORD read = 0;
+        Panel *p = &panels[active_panel];
+        Listing *ls = &p->ls;
+        /* while the find index is being built, refresh results as it fills in; rows whose
+           metadata just arrived are drawn again */
+        HANDLE waits[2] = { hInput, dirsnap_fetch_event() };
+        DWORD woke = WaitForMultipleObjects(2, waits, FALSE, (find_active && findidx_busy(find_index)) ? 500 : INFINITE);
+        if (woke == WAIT_TIMEOUT) {
+            run_find_query(p);
+            draw_ui();
+            continue;
+        }
+        if (woke == WAIT_OBJECT_0 + 1) {
+            draw_ui();
+            continue;
+        }
         if (!ReadConsoleInput(hInput, &ir, 1, &read)) break;
 
         if (ir.EventType == KEY_EVENT) {
@@ -478,6 +1576,8 @@ int main(void) {
             if (!kev.bKeyDown) continue; /* only handle key down */
             WORD vk = kev.wVirtualKeyCode;
             CHAR ch = kev.uChar.AsciiChar;
+            int ctrl = (kev.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0;
+            status_msg[0] = 0;
 
             /* handle menu navigation if active */
             if (menu_active) {
@@ -492,143 +1592,205 @@ int main(void) {
                     if (menu_id == 1 && menu_sel < options_menu_count-1) menu_sel++;
                 } else if (vk == VK_RETURN) {
                     // perform menu action
-                    if (menu_id == 0) {
-                        if (menu_sel == 0) {
-                            // Refresh
-                            load_directory(cwd, items, &count);
-                            int dcount_new = 0, fcount_new = 0; for (int i = 0; i < count; ++i) if (items[i].is_dir) dcount_new++; else fcount_new++;
-                            restore_selection_for_path(cwd, dcount_new, fcount_new);
-                        } else if (menu_sel == 1) {
-                            running = 0;
-                        }
-                    } else if (menu_id == 1) {
-                        if (menu_sel == 0) {
-                            show_sizes = !show_sizes;
-                        } else if (menu_sel == 1) {
-                            snprintf(status_msg, sizeof(status_msg), "MS-DOS Shell - Demo\n");
-                        }
-                    }
                     menu_active = 0;
+                    running = menu_command(menu_id, menu_sel);
                 } else if (vk == VK_ESCAPE) {
                     menu_active = 0;
                 }
-                draw_ui(cwd, items, count, 0);
+                draw_ui();
                 continue;
             }
 
+            /* find mode: typing edits the query, Enter jumps to the selected hit */
+            if (find_active) {
+                int handled = 1;
+                if (vk == VK_ESCAPE) {
+                    end_find(p, NULL);
+                } else if (vk == VK_BACK) {
+                    size_t l = strlen(find_query);
+                    if (l > 0) { find_query[l-1] = 0; run_find_query(p); }
+                } else if (vk == VK_RETURN) {
+                    const char *hit = NULL;
+                    if (cur_pane == PANE_DIR && p->dir_sel < ls->dcount) hit = ls->items[ls->dir_idx[p->dir_sel]].name;
+                    else if (cur_pane == PANE_FILES && p->file_sel < ls->fcount) hit = ls->items[ls->file_idx[p->file_sel]].name;
+                    char target[MAX_PATH];
+                    if (hit) { strncpy_s(target, MAX_PATH, hit, _TRUNCATE); end_find(p, target); }
+                } else if ((unsigned char)ch >= 32 && !(kev.dwControlKeyState & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED | LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED))) {
+                    size_t l = strlen(find_query);
+                    if (l + 1 < sizeof(find_query)) { find_query[l] = ch; find_query[l+1] = 0; run_find_query(p); }
+                } else handled = 0;
+                if (handled) { draw_ui(); continue; }
+            }
+
+            /* compare mode: F5 copies the differences to the right side, F9 compares again */
+            if (cmp_active) {
+                int handled = 1;
+                if (vk == VK_ESCAPE) end_compare(p);
+                else if (vk == VK_F5) sync_compare(p);
+                else if (vk == VK_F9) run_compare(p);
+                else if (vk == VK_BACK || vk == VK_RETURN || vk == VK_F7) { /* would leave the compared folders */ }
+                else if (vk == VK_DELETE || vk == VK_F8 || vk == VK_F6 || vk == VK_F2 || vk == VK_F4) {
+                    /* the rows are compare-relative paths, folders and right-only entries included */
+                }
+                else handled = 0;
+                if (handled) { draw_ui(); continue; }
+            }
+
             /* compute visible rows for panes and counts */
-            COORD size = get_console_size();
-            int w = size.X, h = size.Y;
-            int content_top = 3;
-            int content_bottom = h - 2;
-            int content_h = content_bottom - content_top + 1;
-            int top_h = content_h / 2;
-            int visible_lines = top_h - 1; if (visible_lines < 0) visible_lines = 0;
-            int dcount = 0, fcount = 0;
-            for (int i = 0; i < count; ++i) { if (items[i].is_dir) dcount++; else fcount++; }
+            Layout L = current_layout();
+            int visible_lines = (cur_pane == PANE_DIR) ? L.dirs[active_panel].rows : L.files[active_panel].rows;
+            int dcount = ls->dcount, fcount = ls->fcount;
 
             if (vk == VK_UP) {
                 if (cur_pane == PANE_DIR) {
-                    if (dir_sel > 0) dir_sel--;
-                    if (dir_sel < dir_offset) dir_offset = dir_sel;
+                    if (p->dir_sel > 0) p->dir_sel--;
+                    if (p->dir_sel < p->dir_offset) p->dir_offset = p->dir_sel;
                 } else if (cur_pane == PANE_FILES) {
-                    if (file_sel > 0) file_sel--;
-                    if (file_sel < file_offset) file_offset = file_sel;
+                    if (p->file_sel > 0) p->file_sel--;
+                    if (p->file_sel < p->file_offset) p->file_offset = p->file_sel;
                 } else if (cur_pane == PANE_MAIN) { if (main_sel > 0) main_sel--; }
                 else if (cur_pane == PANE_TASKS) { if (task_sel > 0) task_sel--; }
             } else if (vk == VK_DOWN) {
                 if (cur_pane == PANE_DIR) {
-                    if (dir_sel < dcount - 1) dir_sel++;
-                    if (dir_sel >= dir_offset + visible_lines) dir_offset = dir_sel - visible_lines + 1;
+                    if (p->dir_sel < dcount - 1) p->dir_sel++;
+                    if (p->dir_sel >= p->dir_offset + visible_lines) p->dir_offset = p->dir_sel - visible_lines + 1;
                 } else if (cur_pane == PANE_FILES) {
-                    if (file_sel < fcount - 1) file_sel++;
-                    if (file_sel >= file_offset + visible_lines) file_offset = file_sel - visible_lines + 1;
+                    if (p->file_sel < fcount - 1) p->file_sel++;
+                    if (p->file_sel >= p->file_offset + visible_lines) p->file_offset = p->file_sel - visible_lines + 1;
                 } else if (cur_pane == PANE_MAIN) { if (main_sel < MAX_ITEMS-1) main_sel++; }
                 else if (cur_pane == PANE_TASKS) { if (task_sel < MAX_ITEMS-1) task_sel++; }
             } else if (vk == VK_PRIOR) { // PageUp
                 if (visible_lines <= 0) { }
                 else if (cur_pane == PANE_DIR) {
-                    dir_sel -= visible_lines; if (dir_sel < 0) dir_sel = 0;
-                    if (dir_sel < dir_offset) dir_offset = dir_sel;
+                    p->dir_sel -= visible_lines; if (p->dir_sel < 0) p->dir_sel = 0;
+                    if (p->dir_sel < p->dir_offset) p->dir_offset = p->dir_sel;
                 } else if (cur_pane == PANE_FILES) {
-                    file_sel -= visible_lines; if (file_sel < 0) file_sel = 0;
-                    if (file_sel < file_offset) file_offset = file_sel;
+                    p->file_sel -= visible_lines; if (p->file_sel < 0) p->file_sel = 0;
+                    if (p->file_sel < p->file_offset) p->file_offset = p->file_sel;
                 } else if (cur_pane == PANE_MAIN) { main_sel = 0; }
                 else if (cur_pane == PANE_TASKS) { task_sel = 0; }
             } else if (vk == VK_NEXT) { // PageDown
                 if (visible_lines <= 0) { }
                 else if (cur_pane == PANE_DIR) {
-                    if (dir_sel + visible_lines < dcount) dir_sel += visible_lines; else dir_sel = dcount - 1;
-                    if (dir_sel >= dir_offset + visible_lines) dir_offset = dir_sel - visible_lines + 1;
+                    if (p->dir_sel + visible_lines < dcount) p->dir_sel += visible_lines; else p->dir_sel = dcount - 1;
+                    if (p->dir_sel >= p->dir_offset + visible_lines) p->dir_offset = p->dir_sel - visible_lines + 1;
                 } else if (cur_pane == PANE_FILES) {
-                    if (file_sel + visible_lines < fcount) file_sel += visible_lines; else file_sel = fcount - 1;
-                    if (file_sel >= file_offset + visible_lines) file_offset = file_sel - visible_lines + 1;
+                    if (p->file_sel + visible_lines < fcount) p->file_sel += visible_lines; else p->file_sel = fcount - 1;
+                    if (p->file_sel >= p->file_offset + visible_lines) p->file_offset = p->file_sel - visible_lines + 1;
                 } else if (cur_pane == PANE_MAIN) { main_sel = main_sel + visible_lines; }
                 else if (cur_pane == PANE_TASKS) { task_sel = task_sel + visible_lines; }
             } else if (vk == VK_HOME) {
-                if (cur_pane == PANE_DIR) { dir_sel = 0; dir_offset = 0; }
-                else if (cur_pane == PANE_FILES) { file_sel = 0; file_offset = 0; }
+                if (cur_pane == PANE_DIR) { p->dir_sel = 0; p->dir_offset = 0; }
+                else if (cur_pane == PANE_FILES) { p->file_sel = 0; p->file_offset = 0; }
                 else if (cur_pane == PANE_MAIN) { main_sel = 0; }
                 else if (cur_pane == PANE_TASKS) { task_sel = 0; }
             } else if (vk == VK_END) {
-                if (cur_pane == PANE_DIR) { dir_sel = (dcount>0)?(dcount-1):0; dir_offset = (dcount>visible_lines)?(dcount-visible_lines):0; }
-                else if (cur_pane == PANE_FILES) { file_sel = (fcount>0)?(fcount-1):0; file_offset = (fcount>visible_lines)?(fcount-visible_lines):0; }
+                if (cur_pane == PANE_DIR) { p->dir_sel = (dcount>0)?(dcount-1):0; p->dir_offset = (dcount>visible_lines)?(dcount-visible_lines):0; }
+                else if (cur_pane == PANE_FILES) { p->file_sel = (fcount>0)?(fcount-1):0; p->file_offset = (fcount>visible_lines)?(fcount-visible_lines):0; }
                 else if (cur_pane == PANE_MAIN) { main_sel = 3; }
                 else if (cur_pane == PANE_TASKS) { task_sel = 0; }
             } else if (vk == VK_TAB) {
                 SHORT shiftState = GetAsyncKeyState(VK_SHIFT);
-                if (shiftState & 0x8000) cur_pane = (Pane)((cur_pane + 4 - 1) % 4);
-                else cur_pane = (Pane)((cur_pane + 1) % 4);
+                int back = (shiftState & 0x8000) != 0;
+                if (!dual_pane) {
+                    if (back) cur_pane = (Pane)((cur_pane + 4 - 1) % 4);
+                    else cur_pane = (Pane)((cur_pane + 1) % 4);
+                } else if (panel_in_mode(p)) {
+                    /* find and compare results stay in this panel */
+                    cur_pane = (cur_pane == PANE_DIR) ? PANE_FILES : PANE_DIR;
+                } else {
+                    /* both panels' lists in turn: left dirs, left files, right dirs, right files */
+                    int slot = active_panel * 2 + (cur_pane == PANE_FILES);
+                    slot = (slot + (back ? 3 : 1)) % 4;
+                    cur_pane = (slot & 1) ? PANE_FILES : PANE_DIR;
+                    if (slot / 2 != active_panel) activate_panel(slot / 2);
+                }
             } else if ((kev.dwControlKeyState & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) && (vk == 'F' || vk == 'f')) {
                 // Alt+F -> open File menu (classic)
-                menu_active = 1; menu_id = 0; menu_sel = 0; draw_ui(cwd, items, count, 0);
+                menu_active = 1; menu_id = 0; menu_sel = 0;
             } else if ((kev.dwControlKeyState & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) && (vk == 'O' || vk == 'o')) {
                 // Alt+O -> open Options menu (classic)
-                menu_active = 1; menu_id = 1; menu_sel = 0; draw_ui(cwd, items, count, 0);
+                menu_active = 1; menu_id = 1; menu_sel = 0;
+            } else if (ch == 4) {
+                // Ctrl+D -> dual pane on/off
+                toggle_dual_pane();
+            } else if (ctrl && vk >= VK_F3 && vk <= VK_F7 && !panel_in_mode(p)) {
+                // Ctrl+F3..F7 -> sort by name, extension, time, size, or folder order
+                static const SortKey keys[] = { SORT_NAME, SORT_EXT, SORT_TIME, SORT_SIZE, SORT_NONE };
+                set_panel_sort(p, keys[vk - VK_F3]);
+            } else if (ch == 6 && !panel_in_mode(p)) {
+                // Ctrl+F -> show only files matching a wildcard
+                set_panel_filter(p);
             } else if (vk == VK_RETURN) {
                 // Enter handling
                 if (cur_pane == PANE_DIR) {
-                    int dcount2 = 0; int dir_idx2[MAX_ITEMS];
-                    for (int i = 0; i < count; ++i) if (items[i].is_dir) dir_idx2[dcount2++] = i;
-                    if (dcount2 > 0 && dir_sel < dcount2) {
-                        const char *dname = items[dir_idx2[dir_sel]].name;
-                        // save current selection for cwd
-                        save_selection_for_path(cwd, dir_sel, file_sel, dir_offset, file_offset);
-                        if (strcmp(dname, "..") == 0) SetCurrentDirectoryA("..");
-                        else { char newpath[MAX_PATH]; snprintf(newpath, sizeof(newpath), "%s\\%s", cwd, dname); SetCurrentDirectoryA(newpath); }
-                        GetCurrentDirectoryA(MAX_PATH, cwd);
-                        load_directory(cwd, items, &count);
-                        // restore selection for new cwd if any
-                        int dcount_new = 0, fcount_new = 0;
-                        for (int i = 0; i < count; ++i) if (items[i].is_dir) dcount_new++; else fcount_new++;
-                        restore_selection_for_path(cwd, dcount_new, fcount_new);
+                    if (dcount > 0 && p->dir_sel < dcount) {
+                        char dname[MAX_NAME];
+                        strncpy_s(dname, MAX_NAME, ls->items[ls->dir_idx[p->dir_sel]].name, _TRUNCATE);
+                        change_directory(p, dname);
                     }
+                } else if (cur_pane == PANE_FILES) {
+                    if (fcount > 0 && p->file_sel < fcount) {
+                        char fname[MAX_NAME];
+                        strncpy_s(fname, MAX_NAME, ls->items[ls->file_idx[p->file_sel]].name, _TRUNCATE);
+                        open_file(p, fname);
+                    }
+                } else if (cur_pane == PANE_MAIN && main_sel == 0) {
+                    run_shell(p);
+                } else if (cur_pane == PANE_MAIN && main_sel == 2) {
+                    run_qbasic(p, NULL);
+                }
+            } else if (vk == VK_F3 && cur_pane == PANE_FILES && !p->archive && !cmp_active) {
+                // F3 -> follow the selected file as it grows
+                if (fcount > 0 && p->file_sel < fcount) run_tail(p, ls->items[ls->file_idx[p->file_sel]].name);
+            } else if (vk == VK_F7) {
+                start_find(p);
+            } else if (vk == VK_F9) {
+                start_compare(p);
+            } else if (vk == VK_F5 && p->archive && cur_pane == PANE_FILES) {
+                // F5 inside an archive -> extract the selected member next to the archive
+                if (fcount > 0 && p->file_sel < fcount) {
+                    char dir[MAX_PATH], out[MAX_PATH];
+                    GetCurrentDirectoryA(MAX_PATH, dir);
+                    if (extract_member(p, ls->items[ls->file_idx[p->file_sel]].name, dir, out)) snprintf(status_msg, sizeof(status_msg), "Extracted to %s", out);
+                }
+            } else if (cur_pane == PANE_FILES && (vk == VK_SPACE || vk == VK_INSERT)) {
+                // Space/Insert -> toggle the mark on the selected file and move down
+                if (fcount > 0 && p->file_sel < fcount) {
+                    int i = ls->file_idx[p->file_sel];
+                    listing_mark(ls, i, !IS_MARKED(ls, i));
+                    if (p->file_sel < fcount - 1) p->file_sel++;
+                    if (p->file_sel >= p->file_offset + visible_lines) p->file_offset = p->file_sel - visible_lines + 1;
                 }
+            } else if (cur_pane == PANE_FILES && (ch == '+' || ch == '-')) {
+                char pat[MAX_PATH] = "";
+                if (prompt_line(ch == '+' ? "Mark files matching (*.txt or /regex/): " : "Unmark files matching (*.txt or /regex/): ", pat, sizeof(pat)) && pat[0]) {
+                    int n = mark_matching(ls, pat, ch == '+');
+                    snprintf(status_msg, sizeof(status_msg), "%d file(s) %s", n, (ch == '+') ? "marked" : "unmarked");
+                }
+            } else if (cur_pane == PANE_FILES && ch == '*') {
+                for (int f = 0; f < fcount; ++f) { int i = ls->file_idx[f]; listing_mark(ls, i, !IS_MARKED(ls, i)); }
+            } else if (cur_pane == PANE_FILES && ch == 1) {
+                // Ctrl+A -> mark every file
+                for (int f = 0; f < fcount; ++f) listing_mark(ls, ls->file_idx[f], 1);
+            } else if (cur_pane == PANE_FILES && (vk == VK_DELETE || vk == VK_F8 || vk == VK_F5 || vk == VK_F6 || vk == VK_F2 || vk == VK_F4)) {
+                batch_command(p, vk);
             } else if (ch == 'q' || ch == 'Q') {
                 running = 0;
             } else if (vk == VK_BACK) {
-                SetCurrentDirectoryA(".."); GetCurrentDirectoryA(MAX_PATH, cwd); load_directory(cwd, items, &count); dir_sel = 0; file_sel = 0; dir_offset = 0; file_offset = 0;
+                if (p->archive) change_directory(p, "..");
+                else { SetCurrentDirectoryA(".."); GetCurrentDirectoryA(MAX_PATH, p->cwd); load_directory(p->cwd, ls, TRUE); p->dir_sel = 0; p->file_sel = 0; p->dir_offset = 0; p->file_offset = 0; }
             }
-            draw_ui(cwd, items, count, 0);
+            draw_ui();
         } else if (ir.EventType == MOUSE_EVENT) {
             MOUSE_EVENT_RECORD me = ir.Event.MouseEvent;
             int mx = me.dwMousePosition.X;
             int my = me.dwMousePosition.Y;
             // recompute layout
-            COORD size = get_console_size(); int w = size.X, h = size.Y;
-            int content_top = 3; int content_bottom = h - 2; int content_h = content_bottom - content_top + 1;
-            int left_w = w / 3; int mid_x = left_w; int top_h = content_h / 2;
-            int bottom_h = content_h - top_h - 1;
-            int dt_y = content_top + 1; int fl_y = content_top + 1;
-            int visible_dirs = (content_top + top_h - 1) - dt_y + 1; if (visible_dirs < 0) visible_dirs = 0;
-            int visible_files = (content_top + top_h - 1) - fl_y + 1; if (visible_files < 0) visible_files = 0;
-
-            // build dir/file index maps
-            int dir_idx_local[MAX_ITEMS]; int file_idx_local[MAX_ITEMS]; int dcount_local = 0, fcount_local = 0;
-            for (int i = 0; i < count; ++i) {
-                if (items[i].is_dir) dir_idx_local[dcount_local++] = i;
-                else file_idx_local[fcount_local++] = i;
-            }
+            Layout L = current_layout();
+            int visible_dirs = L.dirs[active_panel].rows;
+            int visible_files = L.files[active_panel].rows;
+            int dcount_local = ls->dcount, fcount_local = ls->fcount;
 
             if (me.dwEventFlags & MOUSE_WHEELED) {
                 /* mouse wheel: scroll focused pane */
@@ -638,27 +1800,27 @@ int main(void) {
                 if (step_lines != 0) {
                     if (cur_pane == PANE_DIR) {
                         /* move selection and adjust offset */
-                        dir_sel -= step_lines;
-                        if (dir_sel < 0) dir_sel = 0;
+                        p->dir_sel -= step_lines;
+                        if (p->dir_sel < 0) p->dir_sel = 0;
                         if (dcount_local > 0) {
-                            if (dir_sel >= dcount_local) dir_sel = dcount_local - 1;
+                            if (p->dir_sel >= dcount_local) p->dir_sel = dcount_local - 1;
                         }
-                        if (dir_sel < dir_offset) dir_offset = dir_sel;
-                        if (dir_sel >= dir_offset + visible_dirs) dir_offset = dir_sel - visible_dirs + 1;
+                        if (p->dir_sel < p->dir_offset) p->dir_offset = p->dir_sel;
+                        if (p->dir_sel >= p->dir_offset + visible_dirs) p->dir_offset = p->dir_sel - visible_dirs + 1;
                     } else if (cur_pane == PANE_FILES) {
-                        file_sel -= step_lines;
-                        if (file_sel < 0) file_sel = 0;
+                        p->file_sel -= step_lines;
+                        if (p->file_sel < 0) p->file_sel = 0;
                         if (fcount_local > 0) {
-                            if (file_sel >= fcount_local) file_sel = fcount_local - 1;
+                            if (p->file_sel >= fcount_local) p->file_sel = fcount_local - 1;
                         }
-                        if (file_sel < file_offset) file_offset = file_sel;
-                        if (file_sel >= file_offset + visible_files) file_offset = file_sel - visible_files + 1;
+                        if (p->file_sel < p->file_offset) p->file_offset = p->file_sel;
+                        if (p->file_sel >= p->file_offset + visible_files) p->file_offset = p->file_sel - visible_files + 1;
                     } else if (cur_pane == PANE_MAIN) {
                         main_sel -= step_lines; if (main_sel < 0) main_sel = 0; if (main_sel > MAX_ITEMS-1) main_sel = MAX_ITEMS-1;
                     } else if (cur_pane == PANE_TASKS) {
                         task_sel -= step_lines; if (task_sel < 0) task_sel = 0; if (task_sel > MAX_ITEMS-1) task_sel = MAX_ITEMS-1;
                     }
-                    draw_ui(cwd, items, count, 0);
+                    draw_ui();
                 }
             } else if (me.dwEventFlags == 0 && (me.dwButtonState & FROM_LEFT_1ST_BUTTON_PRESSED)) {
                 // handle menu bar / dropdown clicks first
@@ -667,12 +1829,12 @@ int main(void) {
                 if (my == 1) {
                     // click on menu bar
                     if (mx >= menu_file_x && mx < menu_file_x + 4) {
-                        menu_active = 1; menu_id = 0; menu_sel = 0; draw_ui(cwd, items, count, 0); continue;
+                        menu_active = 1; menu_id = 0; menu_sel = 0; draw_ui(); continue;
                     } else if (mx >= menu_options_x && mx < menu_options_x + 7) {
-                        menu_active = 1; menu_id = 1; menu_sel = 0; draw_ui(cwd, items, count, 0); continue;
+                        menu_active = 1; menu_id = 1; menu_sel = 0; draw_ui(); continue;
                     } else {
                         // clicked other menu bar area -> close menu
-                        if (menu_active) { menu_active = 0; draw_ui(cwd, items, count, 0); continue; }
+                        if (menu_active) { menu_active = 0; draw_ui(); continue; }
                     }
                 }
                 if (menu_active) {
@@ -682,93 +1844,90 @@ int main(void) {
                     int mcount = (menu_id == 0) ? file_menu_count : options_menu_count;
                     int mw = 0; for (int mi = 0; mi < mcount; ++mi) { int l = (int)strlen(mitems[mi]); if (l > mw) mw = l; }
                     int menu_top = 2; /* must match draw position */
+                    menu_active = 0;
                     if (my >= menu_top + 1 && my < menu_top + 1 + mcount && mx >= mxbase && mx < mxbase + mw + 2) {
-                        int clicked = my - (menu_top + 1);
-                        menu_sel = clicked;
-                        // perform action
-                        if (menu_id == 0) {
-                            if (menu_sel == 0) {
-                                // Refresh
-                                load_directory(cwd, items, &count);
-                                int dcount_new = 0, fcount_new = 0; for (int i = 0; i < count; ++i) if (items[i].is_dir) dcount_new++; else fcount_new++;
-                                restore_selection_for_path(cwd, dcount_new, fcount_new);
-                            } else if (menu_sel == 1) {
-                                running = 0;
-                            }
-                        } else {
-                            if (menu_sel == 0) {
-                                show_sizes = !show_sizes;
-                            } else if (menu_sel == 1) {
-                                snprintf(status_msg, sizeof(status_msg), "MS-DOS Shell demo");
-                            }
-                        }
-                        menu_active = 0; draw_ui(cwd, items, count, 0); continue;
-                    } else {
-                        // click outside dropdown closes menu
-                        menu_active = 0; draw_ui(cwd, items, count, 0); continue;
+                        menu_sel = my - (menu_top + 1);
+                        running = menu_command(menu_id, menu_sel);
                     }
+                    /* a click outside the dropdown just closes it */
+                    draw_ui(); continue;
                 }
-                // left click
-                if (my >= dt_y && my < dt_y + visible_dirs && mx < mid_x) {
-                    int clicked = dir_offset + (my - dt_y);
-                    if (clicked >= 0 && clicked < dcount_local) {
-                        dir_sel = clicked;
-                        cur_pane = PANE_DIR; /* focus pane on click */
+                // left click: either panel's lists; clicking the other panel moves the focus there
+                int row = -1;
+                for (int i = 0; i < 2 && row < 0; ++i) {
+                    Pane hit = PANE_DIR;
+                    if ((row = list_row_at(&L.dirs[i], mx, my)) < 0 && (row = list_row_at(&L.files[i], mx, my)) >= 0) hit = PANE_FILES;
+                    if (row < 0) continue;
+                    if (i != active_panel) {
+                        if (panel_in_mode(p)) break;
+                        activate_panel(i);
                     }
-                } else if (my >= fl_y && my < fl_y + visible_files && mx >= mid_x+2) {
-                    int clicked = file_offset + (my - fl_y);
-                    if (clicked >= 0 && clicked < fcount_local) {
-                        file_sel = clicked;
-                        cur_pane = PANE_FILES; /* focus pane on click */
+                    Panel *cp = &panels[i];
+                    if (hit == PANE_DIR) {
+                        int clicked = cp->dir_offset + row;
+                        if (clicked >= 0 && clicked < cp->ls.dcount) cp->dir_sel = clicked;
+                    } else {
+                        int clicked = cp->file_offset + row;
+                        if (clicked >= 0 && clicked < cp->ls.fcount) cp->file_sel = clicked;
                     }
-                } else {
+                    cur_pane = hit; /* focus pane on click */
+                }
+                if (row < 0 && !dual_pane) {
                     /* bottom panes - set focus if clicked */
-                    int mid_y_loc = content_top + top_h;
-                    if (my >= mid_y_loc + 1 && my <= content_bottom) {
-                        if (mx < mid_x) {
+                    if (my >= L.mid_y + 1 && my <= L.content_bottom) {
+                        if (mx < L.mid_x) {
                             cur_pane = PANE_MAIN;
-                            int clicked = my - (mid_y_loc + 2);
+                            int clicked = my - (L.mid_y + 2);
                             if (clicked < 0) clicked = 0;
-                            if (clicked > bottom_h-1) clicked = bottom_h-1;
+                            if (clicked > L.bottom_h-1) clicked = L.bottom_h-1;
                             /* clamp */
                             if (clicked >= 0) main_sel = clicked;
                         } else {
                             cur_pane = PANE_TASKS;
-                            int clicked = my - (mid_y_loc + 2);
+                            int clicked = my - (L.mid_y + 2);
                             if (clicked < 0) clicked = 0;
-                            if (clicked > bottom_h-1) clicked = bottom_h-1;
+                            if (clicked > L.bottom_h-1) clicked = L.bottom_h-1;
                             if (clicked >= 0) task_sel = clicked;
                         }
                     }
                 }
-                draw_ui(cwd, items, count, 0);
+                draw_ui();
             } else if ((me.dwEventFlags & DOUBLE_CLICK) && (me.dwButtonState & FROM_LEFT_1ST_BUTTON_PRESSED)) {
-                // double click -> open if dir
-                if (my >= dt_y && my < dt_y + visible_dirs && mx < mid_x) {
-                    int clicked = dir_offset + (my - dt_y);
+                // double click -> open if dir (the first click already focused the panel)
+                int row;
+                if ((row = list_row_at(&L.dirs[active_panel], mx, my)) >= 0) {
+                    int clicked = p->dir_offset + row;
                     if (clicked >= 0 && clicked < dcount_local) {
-                        int sel_idx = dir_idx_local[clicked];
-                        const char *dname = items[sel_idx].name;
-                        /* save selection for current path before changing */
-                        save_selection_for_path(cwd, dir_sel, file_sel, dir_offset, file_offset);
-                        if (strcmp(dname, "..") == 0) SetCurrentDirectoryA("..");
-                        else { char newpath[MAX_PATH]; snprintf(newpath, sizeof(newpath), "%s\\%s", cwd, dname); SetCurrentDirectoryA(newpath); }
-                        GetCurrentDirectoryA(MAX_PATH, cwd);
-                        load_directory(cwd, items, &count);
-                        /* restore selection for new cwd if any */
-                        int dcount_new = 0, fcount_new = 0;
-                        for (int i = 0; i < count; ++i) if (items[i].is_dir) dcount_new++; else fcount_new++;
-                        restore_selection_for_path(cwd, dcount_new, fcount_new);
+                        int sel_idx = ls->dir_idx[clicked];
+                        char dname[MAX_NAME];
+                        strncpy_s(dname, MAX_NAME, ls->items[sel_idx].name, _TRUNCATE);
+                        change_directory(p, dname);
+                    }
+                } else if ((row = list_row_at(&L.files[active_panel], mx, my)) >= 0) {
+                    int clicked = p->file_offset + row;
+                    if (clicked >= 0 && clicked < fcount_local) {
+                        char fname[MAX_NAME];
+                        strncpy_s(fname, MAX_NAME, ls->items[ls->file_idx[clicked]].name, _TRUNCATE);
+                        open_file(p, fname);
                     }
                 }
-                draw_ui(cwd, items, count, 0);
+                draw_ui();
             }
         } else if (ir.EventType == WINDOW_BUFFER_SIZE_EVENT) {
             // window resized - redraw
-            draw_ui(cwd, items, count, 0);
+            draw_ui();
         }
     }
 
+    for (int i = 0; i < 2; ++i) {
+        archive_close(panels[i].archive);
+        listing_free(&panels[i].ls);
+    }
+    findidx_stop(find_index);
+    dirsnap_fetch_stop();
+    dircmp_free(cmp_result);
+    vt_close(vt_out);
+
     // Restore cursor before exit
     ci.bVisible = TRUE;
     SetConsoleCursorInfo(hConsole, &ci);
@@ -777,4 +1936,4 @@ int main(void) {
     // Reset attributes
     SetConsoleTextAttribute(hConsole, FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
     return 0;
-}
\ No newline at end of file
+}
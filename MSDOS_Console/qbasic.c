@@ -0,0 +1,2811 @@
+// qbasic.c - QBasic subset compiler and bytecode interpreter (Windows, C)
+//
+// The source is tokenized once and compiled by a recursive descent parser straight into a
+// flat array of int opcodes with inline operands; no syntax tree is built. Variables are
+// resolved to slot numbers at compile time (module globals, or a frame of locals for each
+// SUB/FUNCTION call) and every expression's type is known statically, so opcodes are typed
+// and the evaluation stack holds untagged doubles and string pointers. The interpreter is a
+// single switch in a loop with pc, sp and the frame pointer kept in locals. Strings are
+// reference counted and "s$ = s$ + x$" appends in place. KILL, FILECOPY and ATTRIB with
+// wildcards run on the parallel batch engine and DIR$ enumerates with large fetches, so a
+// script looping over a big folder spends its time in the file system rather than the VM.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <math.h>
+#include <setjmp.h>
+
+#include "qbasic.h"
+#include "batch.h"
+
+#define QB_STACK       4096     /* evaluation stack slots */
+#define QB_LOCALS      65536    /* local slots shared by all active frames */
+#define QB_FRAMES      4096     /* SUB/FUNCTION nesting */
+#define QB_GOSUBS      1024
+#define QB_FILES       255
+#define QB_MAX_DIMS    8
+#define QB_MAX_PARAMS  32
+#define QB_MAX_ARGS    4        /* built-in functions */
+#define QB_NAME_LEN    40
+#define QB_EXPR_DEPTH  64
+#define QB_CTL_DEPTH   64
+#define QB_POLL        65536    /* backward jumps and calls between interrupt checks */
+#define QB_OUT_BUF     4096
+#define QB_FILE_BUF    65536
+#define QB_ZONE        14       /* PRINT comma zones */
+#define QB_MAX_STR     0x3FFFFFFF
+
+/* ---- values ---- */
+
+typedef struct QbStr {
+    int ref;
+    int len, cap;
+    struct QbStr *prev, *next; /* live list of the run; NULL for program constants */
+    char data[1];
+} QbStr;
+
+#define SLEN(s)  ((s) ? (s)->len : 0)
+#define SDATA(s) ((s) ? (s)->data : "")
+#define STR_RETAIN(s) do { if (s) (s)->ref++; } while (0)
+
+struct QbArray;
+
+typedef union {
+    double n;
+    QbStr *s;                  /* NULL is the empty string */
+    struct QbArray *a;
+} Slot;
+
+typedef struct QbArray {
+    int ndims, is_str;
+    int count;
+    int lo[QB_MAX_DIMS], ext[QB_MAX_DIMS];
+    Slot data[1];
+} QbArray;
+
+enum { K_NUM = 0, K_STR = 1, K_ARR = 2 };
+
+/* ---- bytecode ---- */
+
+enum {
+    OP_END, OP_PUSHN, OP_PUSHS,
+    OP_LDG, OP_LDGS, OP_STG, OP_STGS, OP_LDL, OP_LDLS, OP_STL, OP_STLS,
+    OP_APPG, OP_APPL,
+    OP_ALD, OP_ALDS, OP_AST, OP_ASTS, OP_DIM, OP_ERASE,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_IDIV, OP_MOD, OP_POW, OP_NEG, OP_CINT, OP_CAT,
+    OP_EQ, OP_NE, OP_LT, OP_GT, OP_LE, OP_GE,
+    OP_SEQ, OP_SNE, OP_SLT, OP_SGT, OP_SLE, OP_SGE,
+    OP_NOT, OP_AND, OP_OR, OP_XOR,
+    OP_JMP, OP_JZ, OP_JNZ,
+    OP_FORG, OP_NEXTG, OP_FORL, OP_NEXTL,
+    OP_CALL, OP_RET, OP_GOSUB, OP_RETSUB,
+    OP_BI,
+    OP_PRN, OP_PRS, OP_PRTAB, OP_PRNL, OP_PRCOL, OP_PRSPC, OP_WRN, OP_WRS, OP_WRSEP,
+    OP_OUT, OP_OUTCON,
+    OP_READ, OP_FIELDN, OP_FIELDS, OP_LINE,
+    OP_OPEN, OP_CLOSE
+};
+
+/* built-ins: functions first, then statements */
+enum {
+    BI_LEN, BI_LEFT, BI_RIGHT, BI_MID, BI_INSTR, BI_UCASE, BI_LCASE, BI_LTRIM, BI_RTRIM,
+    BI_STR, BI_VAL, BI_CHR, BI_ASC, BI_SPACE, BI_STRING, BI_STRINGS, BI_HEX,
+    BI_ABS, BI_INT, BI_FIX, BI_SGN, BI_SQR, BI_SIN, BI_COS, BI_TAN, BI_ATN, BI_EXP, BI_LOG,
+    BI_CINT, BI_CLNG, BI_RND, BI_TIMER, BI_DATE, BI_TIME, BI_ENVIRON, BI_COMMAND,
+    BI_EOF, BI_LOF, BI_FREEFILE, BI_DIR, BI_CURDIR, BI_MATCH, BI_FILELEN, BI_GETATTR,
+    BI_CLS, BI_RANDOMIZE, BI_SLEEP, BI_KILL, BI_NAME, BI_MKDIR, BI_RMDIR, BI_CHDIR,
+    BI_FILECOPY, BI_ATTRIB
+};
+
+typedef struct {
+    const char *name;
+    int id;
+    const char *args;          /* 's' string, 'n' number */
+    char ret;                  /* 's', 'n', or 0 for statements */
+} Builtin;
+
+static const Builtin builtins[] = {
+    { "LEN", BI_LEN, "s", 'n' },          { "LEFT$", BI_LEFT, "sn", 's' },
+    { "RIGHT$", BI_RIGHT, "sn", 's' },    { "MID$", BI_MID, "sn", 's' },
+    { "MID$", BI_MID, "snn", 's' },       { "INSTR", BI_INSTR, "ss", 'n' },
+    { "INSTR", BI_INSTR, "nss", 'n' },    { "UCASE$", BI_UCASE, "s", 's' },
+    { "LCASE$", BI_LCASE, "s", 's' },     { "LTRIM$", BI_LTRIM, "s", 's' },
+    { "RTRIM$", BI_RTRIM, "s", 's' },     { "STR$", BI_STR, "n", 's' },
+    { "VAL", BI_VAL, "s", 'n' },          { "CHR$", BI_CHR, "n", 's' },
+    { "ASC", BI_ASC, "s", 'n' },          { "SPACE$", BI_SPACE, "n", 's' },
+    { "STRING$", BI_STRING, "nn", 's' },  { "STRING$", BI_STRINGS, "ns", 's' },
+    { "HEX$", BI_HEX, "n", 's' },         { "ABS", BI_ABS, "n", 'n' },
+    { "INT", BI_INT, "n", 'n' },          { "FIX", BI_FIX, "n", 'n' },
+    { "SGN", BI_SGN, "n", 'n' },          { "SQR", BI_SQR, "n", 'n' },
+    { "SIN", BI_SIN, "n", 'n' },          { "COS", BI_COS, "n", 'n' },
+    { "TAN", BI_TAN, "n", 'n' },          { "ATN", BI_ATN, "n", 'n' },
+    { "EXP", BI_EXP, "n", 'n' },          { "LOG", BI_LOG, "n", 'n' },
+    { "CINT", BI_CINT, "n", 'n' },        { "CLNG", BI_CLNG, "n", 'n' },
+    { "RND", BI_RND, "", 'n' },           { "RND", BI_RND, "n", 'n' },
+    { "TIMER", BI_TIMER, "", 'n' },       { "DATE$", BI_DATE, "", 's' },
+    { "TIME$", BI_TIME, "", 's' },        { "ENVIRON$", BI_ENVIRON, "s", 's' },
+    { "COMMAND$", BI_COMMAND, "", 's' },  { "EOF", BI_EOF, "n", 'n' },
+    { "LOF", BI_LOF, "n", 'n' },          { "FREEFILE", BI_FREEFILE, "", 'n' },
+    { "DIR$", BI_DIR, "", 's' },          { "DIR$", BI_DIR, "s", 's' },
+    { "CURDIR$", BI_CURDIR, "", 's' },    { "MATCH", BI_MATCH, "ss", 'n' },
+    { "FILELEN", BI_FILELEN, "s", 'n' },  { "GETATTR", BI_GETATTR, "s", 'n' },
+    /* statements */
+    { "CLS", BI_CLS, "", 0 },             { "RANDOMIZE", BI_RANDOMIZE, "", 0 },
+    { "RANDOMIZE", BI_RANDOMIZE, "n", 0 },{ "SLEEP", BI_SLEEP, "n", 0 },
+    { "KILL", BI_KILL, "s", 0 },          { "MKDIR", BI_MKDIR, "s", 0 },
+    { "RMDIR", BI_RMDIR, "s", 0 },        { "CHDIR", BI_CHDIR, "s", 0 },
+    { "FILECOPY", BI_FILECOPY, "ss", 0 }, { "ATTRIB", BI_ATTRIB, "ss", 0 },
+};
+
+static const char *const keywords[] = {
+    "AND", "APPEND", "AS", "ATTRIB", "BASE", "CALL", "CASE", "CHDIR", "CLOSE", "CLS", "CONST",
+    "DECLARE", "DEFDBL", "DEFINT", "DEFLNG", "DEFSNG", "DEFSTR", "DIM", "DO", "DOUBLE", "ELSE",
+    "ELSEIF", "END", "ERASE", "EXIT", "FILECOPY", "FOR", "FUNCTION", "GOSUB", "GOTO", "IF",
+    "INPUT", "INTEGER", "IS", "KILL", "LET", "LINE", "LONG", "LOOP", "MKDIR", "MOD", "NAME",
+    "NEXT", "NOT", "OPEN", "OPTION", "OR", "OUTPUT", "PRINT", "RANDOMIZE", "REDIM", "RETURN",
+    "RMDIR", "SELECT", "SHARED", "SINGLE", "SLEEP", "SPC", "STATIC", "STEP", "STOP", "STRING",
+    "SUB", "SWAP", "SYSTEM", "TAB", "THEN", "TO", "UNTIL", "WEND", "WHILE", "WRITE", "XOR",
+};
+
+typedef struct {
+    char name[QB_NAME_LEN + 2];
+    unsigned char is_func, is_str, is_int;
+    int nparams;
+    unsigned char pstr[QB_MAX_PARAMS], pint[QB_MAX_PARAMS];
+    int pname[QB_MAX_PARAMS];  /* token pool offsets */
+    int entry;
+    int nlocals;
+    unsigned char *kinds;      /* K_* per local slot, released on return */
+    int start, body, end;      /* token range: header, first body token, after END SUB */
+} Proc;
+
+struct QbProgram {
+    int *code;
+    int ncode, capcode;
+    double *nums;
+    int nnums, capnums;
+    QbStr **strs;
+    int nstrs, capstrs;
+    Proc *procs;
+    int nprocs, capprocs;
+    unsigned char *gkinds;
+    int nglobals, capglobals;
+    int *linepc, *lineno;      /* statement start pc -> source line */
+    int nlines, caplines;
+    int base;                  /* OPTION BASE */
+};
+
+static void *grow(void *p, int *cap, int need, size_t elem) {
+    if (need <= *cap) return p;
+    int ncap = *cap ? *cap : 64;
+    while (ncap < need) ncap *= 2;
+    void *np = realloc(p, (size_t)ncap * elem);
+    if (np) *cap = ncap;
+    return np;
+}
+
+static QbStr *str_const_new(const char *p, int len) {
+    if (len <= 0) return NULL;
+    QbStr *s = (QbStr*)malloc(offsetof(QbStr, data) + (size_t)len + 1);
+    if (!s) return NULL;
+    s->ref = 1; s->len = s->cap = len; s->prev = s->next = NULL;
+    memcpy(s->data, p, len);
+    s->data[len] = 0;
+    return s;
+}
+
+void qb_free(QbProgram *p) {
+    if (!p) return;
+    for (int i = 0; i < p->nstrs; ++i) free(p->strs[i]);
+    for (int i = 0; i < p->nprocs; ++i) free(p->procs[i].kinds);
+    free(p->code); free(p->nums); free(p->strs); free(p->procs);
+    free(p->gkinds); free(p->linepc); free(p->lineno);
+    free(p);
+}
+
+/* ================================================================ compiler */
+
+enum { T_EOF, T_NL, T_COLON, T_NUM, T_STR, T_ID, T_LE, T_GE, T_NE, T_CH };
+enum { TY_NUM = 0, TY_STR = 1 };
+enum { SYM_VAR, SYM_ARRAY, SYM_CONST };
+enum { CTL_IF, CTL_FOR, CTL_WHILE, CTL_DO, CTL_SELECT };
+
+typedef struct {
+    unsigned char type;
+    unsigned char bol;         /* first token on its source line */
+    char ch;                   /* T_CH */
+    int line;
+    int text, len;             /* T_ID, T_STR: pool offset and length */
+    double num;
+} Tok;
+
+typedef struct {
+    char name[QB_NAME_LEN + 2];
+    unsigned char kind, is_str, is_int, local, shared, ndims;
+    int slot;                  /* SYM_CONST: index into the number or string pool */
+} Sym;
+
+typedef struct {
+    Sym *v;
+    int n, cap;
+} SymTab;
+
+typedef struct {
+    char name[QB_NAME_LEN + 2];
+    int at;                    /* label: pc; fixup: operand position */
+    int line;
+} Label;
+
+typedef struct {
+    int kind, line;
+    int a, b;                  /* IF: pending JZ operand; FOR: exit operand, body pc;
+                                  WHILE/DO: start pc, pre-test operand; SELECT: pending
+                                  next-CASE operand, inside a CASE body */
+    int var, lim, step;        /* FOR: slots, all in the loop variable's scope */
+    int local;
+    char name[QB_NAME_LEN + 2];
+    Sym sel;                   /* SELECT: hidden copy of the tested value */
+} Ctl;
+
+typedef struct {
+    QbProgram *p;
+    Tok *toks;
+    int ntok, captok, pos;
+    char *pool;
+    int pool_len, pool_cap;
+    SymTab gsyms, lsyms;
+    Proc *cur;                 /* procedure being compiled, NULL at module level */
+    unsigned char *lkinds;
+    int nlk, caplk;
+    Label *labels, *fixups;
+    int nlabels, caplabels, nfixups, capfixups;
+    Ctl ctl[QB_CTL_DEPTH];
+    int nctl;
+    int *exits, *exit_depth;   /* EXIT FOR/DO and END IF/SELECT jumps awaiting a target */
+    int nexits, capexits, capexitd;
+    int depth, hidden, next_proc;
+    int line_if;               /* inside a single-line IF: ELSE ends the statement list */
+    unsigned char deftype[26]; /* 0 number, 1 integer, 2 string */
+    int line;
+    jmp_buf fail;
+    char *err;
+    size_t errlen;
+} Comp;
+
+static void cerror(Comp *c, const char *fmt, ...) {
+    char msg[160];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    int line = (c->toks && c->pos < c->ntok) ? c->toks[c->pos].line : c->line;
+    snprintf(c->err, c->errlen, "%s in line %d", msg, line);
+    longjmp(c->fail, 1);
+}
+
+static void *cgrow(Comp *c, void *p, int *cap, int need, size_t elem) {
+    void *np = grow(p, cap, need, elem);
+    if (!np) cerror(c, "Out of memory");
+    return np;
+}
+
+/* ---- lexer ---- */
+
+static int pool_add(Comp *c, const char *s, int n) {
+    c->pool = (char*)cgrow(c, c->pool, &c->pool_cap, c->pool_len + n + 1, 1);
+    int off = c->pool_len;
+    memcpy(c->pool + off, s, n);
+    c->pool[off + n] = 0;
+    c->pool_len += n + 1;
+    return off;
+}
+
+static Tok *tok_new(Comp *c, int type, int line, int bol) {
+    c->toks = (Tok*)cgrow(c, c->toks, &c->captok, c->ntok + 1, sizeof(Tok));
+    Tok *t = &c->toks[c->ntok++];
+    ZeroMemory(t, sizeof(*t));
+    t->type = (unsigned char)type; t->line = line; t->bol = (unsigned char)bol;
+    return t;
+}
+
+static int is_alpha(char ch) { return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z'); }
+static int is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+static char up(char ch) { return (ch >= 'a' && ch <= 'z') ? (char)(ch - 32) : ch; }
+
+static void lex(Comp *c, const char *src, size_t len) {
+    int line = 1, bol = 1;
+    size_t i = 0;
+    while (i < len) {
+        char ch = src[i];
+        c->line = line;
+        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == 0x1A) { i++; continue; }
+        if (ch == '\n') { tok_new(c, T_NL, line, 0); line++; bol = 1; i++; continue; }
+        if (ch == '\'') { while (i < len && src[i] != '\n') i++; continue; }
+        if (is_digit(ch) || (ch == '.' && i + 1 < len && is_digit(src[i + 1]))) {
+            char buf[64];
+            int n = 0;
+            while (i < len && n < 62 && (is_digit(src[i]) || src[i] == '.')) buf[n++] = src[i++];
+            if (i < len && n < 60 && (up(src[i]) == 'E' || up(src[i]) == 'D') &&
+                (i + 1 < len && (is_digit(src[i + 1]) || ((src[i + 1] == '+' || src[i + 1] == '-') && i + 2 < len && is_digit(src[i + 2]))))) {
+                buf[n++] = 'E'; i++;
+                if (src[i] == '+' || src[i] == '-') buf[n++] = src[i++];
+                while (i < len && n < 62 && is_digit(src[i])) buf[n++] = src[i++];
+            }
+            buf[n] = 0;
+            if (i < len && (src[i] == '!' || src[i] == '#' || src[i] == '%' || src[i] == '&')) i++;
+            Tok *t = tok_new(c, T_NUM, line, bol);
+            t->num = strtod(buf, NULL);
+            bol = 0;
+            continue;
+        }
+        if (ch == '&' && i + 1 < len && (up(src[i + 1]) == 'H' || up(src[i + 1]) == 'O')) {
+            int base = up(src[i + 1]) == 'H' ? 16 : 8;
+            double v = 0;
+            i += 2;
+            for (; i < len; ++i) {
+                char d = up(src[i]);
+                int dv = is_digit(d) ? d - '0' : (d >= 'A' && d <= 'F') ? d - 'A' + 10 : 99;
+                if (dv >= base) break;
+                v = v * base + dv;
+            }
+            if (i < len && src[i] == '&') i++;
+            tok_new(c, T_NUM, line, bol)->num = v;
+            bol = 0;
+            continue;
+        }
+        if (is_alpha(ch)) {
+            char buf[QB_NAME_LEN + 2];
+            int n = 0;
+            while (i < len && (is_alpha(src[i]) || is_digit(src[i]) || src[i] == '.')) {
+                if (n >= QB_NAME_LEN) cerror(c, "Identifier too long");
+                buf[n++] = up(src[i++]);
+            }
+            if (i < len && (src[i] == '$' || src[i] == '%' || src[i] == '&' || src[i] == '!' || src[i] == '#')) buf[n++] = src[i++];
+            buf[n] = 0;
+            if (strcmp(buf, "REM") == 0) { while (i < len && src[i] != '\n') i++; continue; }
+            Tok *t = tok_new(c, T_ID, line, bol);
+            t->text = pool_add(c, buf, n);
+            t->len = n;
+            bol = 0;
+            continue;
+        }
+        if (ch == '"') {
+            size_t s = ++i;
+            while (i < len && src[i] != '"' && src[i] != '\n') i++;
+            int off = pool_add(c, src + s, (int)(i - s));
+            Tok *t = tok_new(c, T_STR, line, bol);
+            t->text = off; t->len = (int)(i - s);
+            if (i < len && src[i] == '"') i++;
+            bol = 0;
+            continue;
+        }
+        if (ch == '?') {
+            Tok *t = tok_new(c, T_ID, line, bol);
+            t->text = pool_add(c, "PRINT", 5); t->len = 5;
+            i++; bol = 0;
+            continue;
+        }
+        if (ch == ':') { tok_new(c, T_COLON, line, bol); i++; bol = 0; continue; }
+        if (ch == '<' && i + 1 < len && src[i + 1] == '>') { tok_new(c, T_NE, line, bol); i += 2; bol = 0; continue; }
+        if (ch == '<' && i + 1 < len && src[i + 1] == '=') { tok_new(c, T_LE, line, bol); i += 2; bol = 0; continue; }
+        if (ch == '>' && i + 1 < len && src[i + 1] == '=') { tok_new(c, T_GE, line, bol); i += 2; bol = 0; continue; }
+        if (strchr("+-*/\\^=<>(),;#", ch)) { tok_new(c, T_CH, line, bol)->ch = ch; i++; bol = 0; continue; }
+        cerror(c, "Syntax error");
+    }
+    tok_new(c, T_NL, line, 0);
+    tok_new(c, T_EOF, line, 0);
+}
+
+/* ---- token helpers ---- */
+
+#define TK(c) (&(c)->toks[(c)->pos])
+
+static const char *tid(Comp *c, const Tok *t) { return c->pool + t->text; }
+
+static int is_id(Comp *c, const char *kw) {
+    const Tok *t = TK(c);
+    return t->type == T_ID && strcmp(c->pool + t->text, kw) == 0;
+}
+
+static int accept_id(Comp *c, const char *kw) {
+    if (!is_id(c, kw)) return 0;
+    c->pos++;
+    return 1;
+}
+
+static void expect_id(Comp *c, const char *kw) {
+    if (!accept_id(c, kw)) cerror(c, "Expected %s", kw);
+}
+
+static int is_ch(Comp *c, char ch) { return TK(c)->type == T_CH && TK(c)->ch == ch; }
+
+static int accept_ch(Comp *c, char ch) {
+    if (!is_ch(c, ch)) return 0;
+    c->pos++;
+    return 1;
+}
+
+static void expect_ch(Comp *c, char ch) {
+    if (!accept_ch(c, ch)) cerror(c, "Expected %c", ch);
+}
+
+static int at_end(Comp *c) {
+    int t = TK(c)->type;
+    return t == T_NL || t == T_COLON || t == T_EOF || is_id(c, "ELSE");
+}
+
+static int is_keyword(const char *s) {
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i) if (strcmp(keywords[i], s) == 0) return 1;
+    return 0;
+}
+
+static const char *expect_name(Comp *c) {
+    const Tok *t = TK(c);
+    if (t->type != T_ID || is_keyword(tid(c, t))) cerror(c, "Expected name");
+    c->pos++;
+    return tid(c, t);
+}
+
+/* ---- emission ---- */
+
+static int emit(Comp *c, int v) {
+    QbProgram *p = c->p;
+    p->code = (int*)cgrow(c, p->code, &p->capcode, p->ncode + 1, sizeof(int));
+    p->code[p->ncode] = v;
+    return p->ncode++;
+}
+
+static void emit2(Comp *c, int op, int a) { emit(c, op); emit(c, a); }
+
+/* Emits a jump and returns the position of its target operand for patching */
+static int emit_jump(Comp *c, int op) { emit(c, op); return emit(c, -1); }
+
+static void patch(Comp *c, int at, int target) { if (at >= 0) c->p->code[at] = target; }
+
+static int num_const(Comp *c, double v) {
+    QbProgram *p = c->p;
+    for (int i = 0; i < p->nnums && i < 64; ++i) if (p->nums[i] == v) return i;
+    p->nums = (double*)cgrow(c, p->nums, &p->capnums, p->nnums + 1, sizeof(double));
+    p->nums[p->nnums] = v;
+    return p->nnums++;
+}
+
+static int str_const(Comp *c, const char *s, int len) {
+    QbProgram *p = c->p;
+    p->strs = (QbStr**)cgrow(c, p->strs, &p->capstrs, p->nstrs + 1, sizeof(QbStr*));
+    QbStr *q = str_const_new(s, len);
+    if (len > 0 && !q) cerror(c, "Out of memory");
+    p->strs[p->nstrs] = q;
+    return p->nstrs++;
+}
+
+static void mark_line(Comp *c, int line) {
+    QbProgram *p = c->p;
+    if (p->nlines && p->lineno[p->nlines - 1] == line) return;
+    int cap = p->caplines;
+    p->linepc = (int*)cgrow(c, p->linepc, &cap, p->nlines + 1, sizeof(int));
+    cap = p->caplines;
+    p->lineno = (int*)cgrow(c, p->lineno, &cap, p->nlines + 1, sizeof(int));
+    p->caplines = cap;
+    p->linepc[p->nlines] = p->ncode;
+    p->lineno[p->nlines++] = line;
+}
+
+/* ---- symbols ---- */
+
+static void name_type(Comp *c, const char *name, int *is_str, int *is_int) {
+    char last = name[strlen(name) - 1];
+    *is_str = 0; *is_int = 0;
+    if (last == '$') *is_str = 1;
+    else if (last == '%' || last == '&') *is_int = 1;
+    else if (last != '!' && last != '#') {
+        int d = c->deftype[name[0] - 'A'];
+        *is_str = d == 2; *is_int = d == 1;
+    }
+}
+
+static int new_slot(Comp *c, int local, int kind) {
+    if (local) {
+        c->lkinds = (unsigned char*)cgrow(c, c->lkinds, &c->caplk, c->nlk + 1, 1);
+        c->lkinds[c->nlk] = (unsigned char)kind;
+        return c->nlk++;
+    }
+    QbProgram *p = c->p;
+    p->gkinds = (unsigned char*)cgrow(c, p->gkinds, &p->capglobals, p->nglobals + 1, 1);
+    p->gkinds[p->nglobals] = (unsigned char)kind;
+    return p->nglobals++;
+}
+
+static Sym *sym_find(SymTab *t, const char *name, int arr) {
+    for (int i = 0; i < t->n; ++i)
+        if ((t->v[i].kind == SYM_ARRAY) == arr && strcmp(t->v[i].name, name) == 0) return &t->v[i];
+    return NULL;
+}
+
+static Sym *sym_add(Comp *c, int local, const char *name, int kind, int is_str, int is_int) {
+    SymTab *t = local ? &c->lsyms : &c->gsyms;
+    t->v = (Sym*)cgrow(c, t->v, &t->cap, t->n + 1, sizeof(Sym));
+    Sym *s = &t->v[t->n++];
+    ZeroMemory(s, sizeof(*s));
+    strncpy_s(s->name, sizeof(s->name), name, _TRUNCATE);
+    s->kind = (unsigned char)kind; s->is_str = (unsigned char)is_str; s->is_int = (unsigned char)is_int;
+    s->local = (unsigned char)local;
+    if (kind != SYM_CONST) s->slot = new_slot(c, local, kind == SYM_ARRAY ? K_ARR : is_str ? K_STR : K_NUM);
+    return s;
+}
+
+static Sym *sym_lookup(Comp *c, const char *name, int arr) {
+    Sym *s;
+    if (c->cur) {
+        if ((s = sym_find(&c->lsyms, name, arr)) != NULL) return s;
+        if ((s = sym_find(&c->gsyms, name, arr)) != NULL && (s->shared || s->kind == SYM_CONST)) return s;
+        return NULL;
+    }
+    return sym_find(&c->gsyms, name, arr);
+}
+
+/* A variable reference; the first use declares it, as in QBasic */
+static Sym *var_ref(Comp *c, const char *name, int arr) {
+    Sym *s = sym_lookup(c, name, arr);
+    if (s) return s;
+    int is_str, is_int;
+    name_type(c, name, &is_str, &is_int);
+    return sym_add(c, c->cur != NULL, name, arr ? SYM_ARRAY : SYM_VAR, is_str, is_int);
+}
+
+static Sym *array_ref(Comp *c, const char *name, int ndims) {
+    Sym *s = var_ref(c, name, 1);
+    if (s->ndims == 0) s->ndims = (unsigned char)ndims;
+    else if (s->ndims != ndims) cerror(c, "Wrong number of dimensions");
+    return s;
+}
+
+/* Hidden variable for FOR limits, SELECT CASE values and SWAP */
+static Sym hidden_var(Comp *c, int local, int is_str) {
+    Sym s;
+    ZeroMemory(&s, sizeof(s));
+    snprintf(s.name, sizeof(s.name), "#%d", c->hidden++);
+    s.kind = SYM_VAR; s.is_str = (unsigned char)is_str; s.local = (unsigned char)local;
+    s.slot = new_slot(c, local, is_str ? K_STR : K_NUM);
+    return s;
+}
+
+static Proc *proc_find(Comp *c, const char *name) {
+    for (int i = 0; i < c->p->nprocs; ++i) if (strcmp(c->p->procs[i].name, name) == 0) return &c->p->procs[i];
+    return NULL;
+}
+
+static void emit_load(Comp *c, const Sym *s) {
+    if (s->kind == SYM_CONST) emit2(c, s->is_str ? OP_PUSHS : OP_PUSHN, s->slot);
+    else if (s->local) emit2(c, s->is_str ? OP_LDLS : OP_LDL, s->slot);
+    else emit2(c, s->is_str ? OP_LDGS : OP_LDG, s->slot);
+}
+
+static int array_flags(const Sym *s, int ndims) { return s->local | (s->is_str << 1) | (ndims << 2); }
+
+typedef struct {
+    const Sym *s;
+    int ndims;                 /* array element when > 0; indices are already on the stack */
+} Lv;
+
+static void emit_store(Comp *c, const Lv *lv) {
+    const Sym *s = lv->s;
+    if (s->is_int && !s->is_str) emit(c, OP_CINT);
+    if (lv->ndims) {
+        emit(c, s->is_str ? OP_ASTS : OP_AST);
+        emit(c, s->slot);
+        emit(c, array_flags(s, lv->ndims));
+    } else if (s->local) emit2(c, s->is_str ? OP_STLS : OP_STL, s->slot);
+    else emit2(c, s->is_str ? OP_STGS : OP_STG, s->slot);
+}
+
+/* ---- expressions ---- */
+
+static int expr(Comp *c);
+
+static void need_num(Comp *c, int ty) { if (ty != TY_NUM) cerror(c, "Type mismatch"); }
+static void expr_num(Comp *c) { need_num(c, expr(c)); }
+static void expr_str(Comp *c) { if (expr(c) != TY_STR) cerror(c, "Type mismatch"); }
+
+static int parse_indices(Comp *c) {
+    int n = 0;
+    expect_ch(c, '(');
+    do {
+        if (++n > QB_MAX_DIMS) cerror(c, "Too many dimensions");
+        expr_num(c);
+    } while (accept_ch(c, ','));
+    expect_ch(c, ')');
+    return n;
+}
+
+static void call_proc(Comp *c, Proc *pr, int in_expr) {
+    int n = 0;
+    int paren = accept_ch(c, '(');
+    if (paren || (!in_expr && !at_end(c))) {
+        if (!(paren && is_ch(c, ')'))) {
+            do {
+                if (n >= pr->nparams) cerror(c, "Argument-count mismatch");
+                int ty = expr(c);
+                if (ty != pr->pstr[n]) cerror(c, "Parameter type mismatch");
+                if (pr->pint[n]) emit(c, OP_CINT);
+                n++;
+            } while (accept_ch(c, ','));
+        }
+        if (paren) expect_ch(c, ')');
+    }
+    if (n != pr->nparams) cerror(c, "Argument-count mismatch");
+    emit2(c, OP_CALL, (int)(pr - c->p->procs));
+}
+
+/* Parses the arguments of a built-in (in parentheses for functions, bare for statements)
+   and emits the call. Returns the result type, or -1 for statements. */
+static int call_builtin(Comp *c, const char *name, int stmt) {
+    char types[QB_MAX_ARGS + 1];
+    int n = 0;
+    int paren = !stmt && accept_ch(c, '(');
+    if (paren || (stmt && !at_end(c))) {
+        do {
+            if (n == QB_MAX_ARGS) cerror(c, "Argument-count mismatch");
+            types[n++] = expr(c) == TY_STR ? 's' : 'n';
+        } while (accept_ch(c, ','));
+        if (paren) expect_ch(c, ')');
+    }
+    types[n] = 0;
+    int named = 0;
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+        const Builtin *b = &builtins[i];
+        if (strcmp(b->name, name) != 0 || (b->ret == 0) != stmt) continue;
+        named = 1;
+        if (strcmp(b->args, types) != 0) continue;
+        emit(c, OP_BI); emit(c, b->id); emit(c, n);
+        return b->ret == 's' ? TY_STR : b->ret == 'n' ? TY_NUM : -1;
+    }
+    cerror(c, named ? "Type mismatch" : "Syntax error");
+    return -1;
+}
+
+static int is_builtin(const char *name, int stmt) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i)
+        if ((builtins[i].ret == 0) == stmt && strcmp(builtins[i].name, name) == 0) return 1;
+    return 0;
+}
+
+static int primary(Comp *c) {
+    Tok *t = TK(c);
+    int ty = TY_NUM;
+    if (++c->depth > QB_EXPR_DEPTH) cerror(c, "Expression too complex");
+    if (t->type == T_NUM) {
+        emit2(c, OP_PUSHN, num_const(c, t->num));
+        c->pos++;
+    } else if (t->type == T_STR) {
+        emit2(c, OP_PUSHS, str_const(c, tid(c, t), t->len));
+        c->pos++;
+        ty = TY_STR;
+    } else if (accept_ch(c, '(')) {
+        ty = expr(c);
+        expect_ch(c, ')');
+    } else if (t->type == T_ID) {
+        const char *name = tid(c, t);
+        Proc *pr;
+        c->pos++;
+        if (is_builtin(name, 0)) ty = call_builtin(c, name, 0);
+        else if ((pr = proc_find(c, name)) != NULL) {
+            if (!pr->is_func) cerror(c, "Syntax error");
+            call_proc(c, pr, 1);
+            ty = pr->is_str;
+        } else if (is_keyword(name)) {
+            c->pos--;
+            cerror(c, "Syntax error");
+        } else if (is_ch(c, '(')) {
+            int n = parse_indices(c);
+            Sym *s = array_ref(c, name, n);
+            emit(c, s->is_str ? OP_ALDS : OP_ALD); emit(c, s->slot); emit(c, array_flags(s, n));
+            ty = s->is_str;
+        } else {
+            Sym *s = var_ref(c, name, 0);
+            emit_load(c, s);
+            ty = s->is_str;
+        }
+    } else cerror(c, "Syntax error");
+    c->depth--;
+    return ty;
+}
+
+static int ex_neg(Comp *c);
+
+static int ex_pow(Comp *c) {
+    int ty = primary(c);
+    while (accept_ch(c, '^')) {
+        need_num(c, ty);
+        need_num(c, (is_ch(c, '-') || is_ch(c, '+')) ? ex_neg(c) : primary(c));
+        emit(c, OP_POW);
+    }
+    return ty;
+}
+
+static int ex_neg(Comp *c) {
+    if (accept_ch(c, '-')) { need_num(c, ex_neg(c)); emit(c, OP_NEG); return TY_NUM; }
+    if (accept_ch(c, '+')) { int ty = ex_neg(c); need_num(c, ty); return ty; }
+    return ex_pow(c);
+}
+
+static int ex_mul(Comp *c) {
+    int ty = ex_neg(c);
+    for (;;) {
+        int op = is_ch(c, '*') ? OP_MUL : is_ch(c, '/') ? OP_DIV : -1;
+        if (op < 0) return ty;
+        c->pos++;
+        need_num(c, ty); need_num(c, ex_neg(c));
+        emit(c, op);
+    }
+}
+
+static int ex_idiv(Comp *c) {
+    int ty = ex_mul(c);
+    while (accept_ch(c, '\\')) { need_num(c, ty); need_num(c, ex_mul(c)); emit(c, OP_IDIV); }
+    return ty;
+}
+
+static int ex_mod(Comp *c) {
+    int ty = ex_idiv(c);
+    while (accept_id(c, "MOD")) { need_num(c, ty); need_num(c, ex_idiv(c)); emit(c, OP_MOD); }
+    return ty;
+}
+
+static int ex_add(Comp *c) {
+    int ty = ex_mod(c);
+    for (;;) {
+        int plus = is_ch(c, '+');
+        if (!plus && !is_ch(c, '-')) return ty;
+        c->pos++;
+        int rt = ex_mod(c);
+        if (ty != rt || (ty == TY_STR && !plus)) cerror(c, "Type mismatch");
+        emit(c, ty == TY_STR ? OP_CAT : plus ? OP_ADD : OP_SUB);
+    }
+}
+
+static int relop(Comp *c) {
+    const Tok *t = TK(c);
+    if (t->type == T_LE) return OP_LE;
+    if (t->type == T_GE) return OP_GE;
+    if (t->type == T_NE) return OP_NE;
+    if (t->type == T_CH && t->ch == '=') return OP_EQ;
+    if (t->type == T_CH && t->ch == '<') return OP_LT;
+    if (t->type == T_CH && t->ch == '>') return OP_GT;
+    return -1;
+}
+
+/* string comparisons follow the numeric ones in the opcode list */
+#define STR_REL(op) ((op) - OP_EQ + OP_SEQ)
+
+static int ex_rel(Comp *c) {
+    int ty = ex_add(c);
+    for (;;) {
+        int op = relop(c);
+        if (op < 0) return ty;
+        c->pos++;
+        if (ex_add(c) != ty) cerror(c, "Type mismatch");
+        emit(c, ty == TY_STR ? STR_REL(op) : op);
+        ty = TY_NUM;
+    }
+}
+
+static int ex_not(Comp *c) {
+    if (accept_id(c, "NOT")) { need_num(c, ex_not(c)); emit(c, OP_NOT); return TY_NUM; }
+    return ex_rel(c);
+}
+
+static int ex_and(Comp *c) {
+    int ty = ex_not(c);
+    while (accept_id(c, "AND")) { need_num(c, ty); need_num(c, ex_not(c)); emit(c, OP_AND); }
+    return ty;
+}
+
+static int ex_or(Comp *c) {
+    int ty = ex_and(c);
+    while (accept_id(c, "OR")) { need_num(c, ty); need_num(c, ex_and(c)); emit(c, OP_OR); }
+    return ty;
+}
+
+static int expr(Comp *c) {
+    int ty = ex_or(c);
+    while (accept_id(c, "XOR")) { need_num(c, ty); need_num(c, ex_or(c)); emit(c, OP_XOR); }
+    return ty;
+}
+
+/* ---- lvalues ---- */
+
+static void parse_lvalue(Comp *c, Lv *lv) {
+    const char *name = expect_name(c);
+    lv->ndims = 0;
+    if (c->cur && c->cur->is_func && strcmp(name, c->cur->name) == 0 && !is_ch(c, '(')) {
+        lv->s = sym_find(&c->lsyms, name, 0);   /* the function's result */
+        return;
+    }
+    if (proc_find(c, name)) cerror(c, "Duplicate definition");
+    if (is_ch(c, '(')) {
+        lv->ndims = parse_indices(c);
+        lv->s = array_ref(c, name, lv->ndims);
+        return;
+    }
+    lv->s = var_ref(c, name, 0);
+    if (lv->s->kind == SYM_CONST) cerror(c, "Duplicate definition");
+}
+
+/* ---- labels ---- */
+
+static void label_name(Comp *c, const Tok *t, char *out) {
+    if (t->type == T_NUM) snprintf(out, QB_NAME_LEN + 2, "%.0f", t->num);
+    else if (t->type == T_ID) strncpy_s(out, QB_NAME_LEN + 2, tid(c, t), _TRUNCATE);
+    else cerror(c, "Expected label");
+}
+
+static void define_label(Comp *c, const char *name) {
+    for (int i = 0; i < c->nlabels; ++i) if (strcmp(c->labels[i].name, name) == 0) cerror(c, "Duplicate label");
+    c->labels = (Label*)cgrow(c, c->labels, &c->caplabels, c->nlabels + 1, sizeof(Label));
+    Label *l = &c->labels[c->nlabels++];
+    strncpy_s(l->name, sizeof(l->name), name, _TRUNCATE);
+    l->at = c->p->ncode;
+}
+
+static void jump_to_label(Comp *c, int op) {
+    Label *f;
+    c->fixups = (Label*)cgrow(c, c->fixups, &c->capfixups, c->nfixups + 1, sizeof(Label));
+    f = &c->fixups[c->nfixups++];
+    label_name(c, TK(c), f->name);
+    f->line = TK(c)->line;
+    c->pos++;
+    f->at = emit_jump(c, op);
+}
+
+static void resolve_labels(Comp *c) {
+    for (int i = 0; i < c->nfixups; ++i) {
+        int j;
+        for (j = 0; j < c->nlabels; ++j) if (strcmp(c->labels[j].name, c->fixups[i].name) == 0) break;
+        if (j == c->nlabels) {
+            snprintf(c->err, c->errlen, "Label not defined: %s in line %d", c->fixups[i].name, c->fixups[i].line);
+            longjmp(c->fail, 1);
+        }
+        patch(c, c->fixups[i].at, c->labels[j].at);
+    }
+    c->nlabels = c->nfixups = 0;
+}
+
+/* ---- control structures ---- */
+
+static Ctl *ctl_push(Comp *c, int kind) {
+    if (c->nctl == QB_CTL_DEPTH) cerror(c, "Block nesting too deep");
+    Ctl *k = &c->ctl[c->nctl++];
+    ZeroMemory(k, sizeof(*k));
+    k->kind = kind; k->line = TK(c)->line;
+    k->a = k->b = -1;
+    return k;
+}
+
+static Ctl *ctl_top(Comp *c, int kind, const char *err) {
+    if (c->nctl == 0 || c->ctl[c->nctl - 1].kind != kind) cerror(c, "%s", err);
+    return &c->ctl[c->nctl - 1];
+}
+
+/* Records a forward jump that is patched when the block at depth closes */
+static void add_exit(Comp *c, int depth, int at) {
+    int cap = c->capexits;
+    c->exits = (int*)cgrow(c, c->exits, &cap, c->nexits + 1, sizeof(int));
+    cap = c->capexits;
+    c->exit_depth = (int*)cgrow(c, c->exit_depth, &cap, c->nexits + 1, sizeof(int));
+    c->capexits = cap;
+    c->exits[c->nexits] = at;
+    c->exit_depth[c->nexits++] = depth;
+}
+
+static void ctl_close(Comp *c) {
+    int depth = c->nctl - 1, k = 0;
+    for (int i = 0; i < c->nexits; ++i) {
+        if (c->exit_depth[i] == depth) patch(c, c->exits[i], c->p->ncode);
+        else { c->exits[k] = c->exits[i]; c->exit_depth[k++] = c->exit_depth[i]; }
+    }
+    c->nexits = k;
+    c->nctl--;
+}
+
+static void statement(Comp *c);
+
+/* Statements of a single-line IF branch, up to ELSE or the end of the line */
+static void line_statements(Comp *c) {
+    if (TK(c)->type == T_NUM) { jump_to_label(c, OP_JMP); return; }
+    c->line_if++;
+    for (;;) {
+        statement(c);
+        if (TK(c)->type != T_COLON) break;
+        c->pos++;
+    }
+    c->line_if--;
+}
+
+static void st_if(Comp *c) {
+    expr_num(c);
+    if (accept_id(c, "GOTO")) { jump_to_label(c, OP_JNZ); return; }
+    expect_id(c, "THEN");
+    if (TK(c)->type == T_NL || TK(c)->type == T_EOF) {
+        Ctl *k = ctl_push(c, CTL_IF);
+        k->a = emit_jump(c, OP_JZ);
+        return;
+    }
+    int jz = emit_jump(c, OP_JZ);
+    line_statements(c);
+    if (accept_id(c, "ELSE")) {
+        int jend = emit_jump(c, OP_JMP);
+        patch(c, jz, c->p->ncode);
+        line_statements(c);
+        patch(c, jend, c->p->ncode);
+    } else patch(c, jz, c->p->ncode);
+}
+
+static void st_elseif(Comp *c) {
+    Ctl *k = ctl_top(c, CTL_IF, "ELSEIF without IF");
+    if (k->a < 0) cerror(c, "ELSEIF after ELSE");
+    add_exit(c, c->nctl - 1, emit_jump(c, OP_JMP));
+    patch(c, k->a, c->p->ncode);
+    expr_num(c);
+    expect_id(c, "THEN");
+    k->a = emit_jump(c, OP_JZ);
+}
+
+static void st_else(Comp *c) {
+    Ctl *k = ctl_top(c, CTL_IF, "ELSE without IF");
+    if (k->a < 0) cerror(c, "ELSE without IF");
+    add_exit(c, c->nctl - 1, emit_jump(c, OP_JMP));
+    patch(c, k->a, c->p->ncode);
+    k->a = -1;
+}
+
+static void st_for(Comp *c) {
+    Lv lv;
+    parse_lvalue(c, &lv);
+    if (lv.ndims || lv.s->is_str) cerror(c, "Type mismatch");
+    const Sym *v = lv.s;
+    expect_ch(c, '=');
+    expr_num(c);
+    emit_store(c, &lv);
+    expect_id(c, "TO");
+    Sym lim = hidden_var(c, v->local, 0), step = hidden_var(c, v->local, 0);
+    Lv ll = { &lim, 0 }, ls = { &step, 0 };
+    expr_num(c);
+    emit_store(c, &ll);
+    if (accept_id(c, "STEP")) { expr_num(c); if (v->is_int) emit(c, OP_CINT); }
+    else emit2(c, OP_PUSHN, num_const(c, 1));
+    emit_store(c, &ls);
+    Ctl *k = ctl_push(c, CTL_FOR);
+    strncpy_s(k->name, sizeof(k->name), v->name, _TRUNCATE);
+    k->local = v->local; k->var = v->slot; k->lim = lim.slot; k->step = step.slot;
+    emit(c, v->local ? OP_FORL : OP_FORG);
+    emit(c, k->var); emit(c, k->lim); emit(c, k->step);
+    k->a = emit(c, -1);
+    k->b = c->p->ncode;
+}
+
+static void st_next(Comp *c) {
+    do {
+        Ctl *k = ctl_top(c, CTL_FOR, "NEXT without FOR");
+        if (TK(c)->type == T_ID && !at_end(c)) {
+            const char *name = expect_name(c);
+            if (strcmp(name, k->name) != 0) cerror(c, "NEXT without FOR");
+        }
+        emit(c, k->local ? OP_NEXTL : OP_NEXTG);
+        emit(c, k->var); emit(c, k->lim); emit(c, k->step); emit(c, k->b);
+        patch(c, k->a, c->p->ncode);
+        ctl_close(c);
+    } while (accept_ch(c, ','));
+}
+
+static void st_do(Comp *c) {
+    Ctl *k = ctl_push(c, CTL_DO);
+    k->a = c->p->ncode;
+    if (accept_id(c, "WHILE")) { expr_num(c); k->b = emit_jump(c, OP_JZ); }
+    else if (accept_id(c, "UNTIL")) { expr_num(c); k->b = emit_jump(c, OP_JNZ); }
+}
+
+static void st_loop(Comp *c) {
+    Ctl *k = ctl_top(c, CTL_DO, "LOOP without DO");
+    if (accept_id(c, "WHILE")) { expr_num(c); emit2(c, OP_JNZ, k->a); }
+    else if (accept_id(c, "UNTIL")) { expr_num(c); emit2(c, OP_JZ, k->a); }
+    else emit2(c, OP_JMP, k->a);
+    patch(c, k->b, c->p->ncode);
+    ctl_close(c);
+}
+
+static void st_while(Comp *c) {
+    Ctl *k = ctl_push(c, CTL_WHILE);
+    k->a = c->p->ncode;
+    expr_num(c);
+    k->b = emit_jump(c, OP_JZ);
+}
+
+static void st_wend(Comp *c) {
+    Ctl *k = ctl_top(c, CTL_WHILE, "WEND without WHILE");
+    emit2(c, OP_JMP, k->a);
+    patch(c, k->b, c->p->ncode);
+    ctl_close(c);
+}
+
+static void st_exit(Comp *c) {
+    int kind;
+    if (accept_id(c, "SUB") || accept_id(c, "FUNCTION")) {
+        if (!c->cur) cerror(c, "EXIT SUB not in SUB");
+        emit(c, OP_RET);
+        return;
+    }
+    if (accept_id(c, "FOR")) kind = CTL_FOR;
+    else { expect_id(c, "DO"); kind = CTL_DO; }
+    for (int d = c->nctl - 1; d >= 0; --d) {
+        if (c->ctl[d].kind != kind) continue;
+        add_exit(c, d, emit_jump(c, OP_JMP));
+        return;
+    }
+    cerror(c, kind == CTL_FOR ? "EXIT FOR not within FOR...NEXT" : "EXIT DO not within DO...LOOP");
+}
+
+static void st_select(Comp *c) {
+    expect_id(c, "CASE");
+    int ty = expr(c);
+    Ctl *k = ctl_push(c, CTL_SELECT);
+    k->b = 0;
+    k->sel = hidden_var(c, c->cur != NULL, ty);
+    Lv lv = { &k->sel, 0 };
+    emit_store(c, &lv);
+}
+
+static void st_case(Comp *c) {
+    Ctl *k = ctl_top(c, CTL_SELECT, "CASE without SELECT");
+    int depth = c->nctl - 1;
+    if (k->b) add_exit(c, depth, emit_jump(c, OP_JMP));
+    patch(c, k->a, c->p->ncode);
+    k->a = -1;
+    k->b = 1;
+    if (accept_id(c, "ELSE")) return;
+    int body[64], nb = 0;
+    int ty = k->sel.is_str;
+    do {
+        int op = -1;
+        accept_id(c, "IS");
+        if ((op = relop(c)) >= 0) {
+            c->pos++;
+            emit_load(c, &k->sel);
+            if (expr(c) != ty) cerror(c, "Type mismatch");
+            emit(c, ty ? STR_REL(op) : op);
+        } else {
+            emit_load(c, &k->sel);
+            if (expr(c) != ty) cerror(c, "Type mismatch");
+            if (accept_id(c, "TO")) {
+                emit(c, ty ? OP_SGE : OP_GE);
+                emit_load(c, &k->sel);
+                if (expr(c) != ty) cerror(c, "Type mismatch");
+                emit(c, ty ? OP_SLE : OP_LE);
+                emit(c, OP_AND);
+            } else emit(c, ty ? OP_SEQ : OP_EQ);
+        }
+        if (nb == 64) cerror(c, "Too many CASE values");
+        body[nb++] = emit_jump(c, OP_JNZ);
+    } while (accept_ch(c, ','));
+    k->a = emit_jump(c, OP_JMP);
+    for (int i = 0; i < nb; ++i) patch(c, body[i], c->p->ncode);
+}
+
+static void st_end(Comp *c) {
+    if (accept_id(c, "IF")) {
+        Ctl *k = ctl_top(c, CTL_IF, "END IF without block IF");
+        patch(c, k->a, c->p->ncode);
+        ctl_close(c);
+    } else if (accept_id(c, "SELECT")) {
+        Ctl *k = ctl_top(c, CTL_SELECT, "END SELECT without SELECT");
+        patch(c, k->a, c->p->ncode);
+        ctl_close(c);
+    } else if (is_id(c, "SUB") || is_id(c, "FUNCTION")) {
+        cerror(c, "END SUB without SUB");
+    } else emit(c, OP_END);
+}
+
+/* ---- declarations ---- */
+
+static void as_type(Comp *c, int *is_str, int *is_int) {
+    if (accept_id(c, "STRING")) {
+        *is_str = 1; *is_int = 0;
+        if (accept_ch(c, '*')) { if (TK(c)->type != T_NUM) cerror(c, "Syntax error"); c->pos++; }
+    } else if (accept_id(c, "INTEGER") || accept_id(c, "LONG")) { *is_str = 0; *is_int = 1; }
+    else if (accept_id(c, "SINGLE") || accept_id(c, "DOUBLE")) { *is_str = 0; *is_int = 0; }
+    else cerror(c, "Expected type");
+}
+
+static void st_dim(Comp *c) {
+    int shared = accept_id(c, "SHARED");
+    if (shared && c->cur) cerror(c, "DIM SHARED not allowed in SUB");
+    do {
+        const char *name = expect_name(c);
+        int is_str, is_int;
+        name_type(c, name, &is_str, &is_int);
+        int local = c->cur != NULL;
+        if (is_ch(c, '(')) {
+            /* bounds first, then the type, so the symbol is created once */
+            int at = c->pos, n = 0;
+            expect_ch(c, '(');
+            int depth = 1;
+            while (depth > 0 && TK(c)->type != T_NL && TK(c)->type != T_EOF) {
+                if (is_ch(c, '(')) depth++;
+                else if (is_ch(c, ')')) depth--;
+                c->pos++;
+            }
+            if (accept_id(c, "AS")) as_type(c, &is_str, &is_int);
+            int after = c->pos;
+            Sym *s = sym_find(local ? &c->lsyms : &c->gsyms, name, 1);
+            if (!s) s = sym_add(c, local, name, SYM_ARRAY, is_str, is_int);
+            if (shared) s->shared = 1;
+            c->pos = at;
+            expect_ch(c, '(');
+            do {
+                if (++n > QB_MAX_DIMS) cerror(c, "Too many dimensions");
+                int bound = c->pos, code = c->p->ncode;
+                expr_num(c);
+                if (!accept_id(c, "TO")) {
+                    /* a single bound is the upper one; the lower is OPTION BASE and goes first */
+                    c->pos = bound; c->p->ncode = code;
+                    emit2(c, OP_PUSHN, num_const(c, c->p->base));
+                    expr_num(c);
+                } else expr_num(c);
+            } while (accept_ch(c, ','));
+            expect_ch(c, ')');
+            c->pos = after;
+            if (s->ndims && s->ndims != n) cerror(c, "Wrong number of dimensions");
+            s->ndims = (unsigned char)n;
+            emit(c, OP_DIM); emit(c, s->slot); emit(c, array_flags(s, n));
+        } else {
+            if (accept_id(c, "AS")) as_type(c, &is_str, &is_int);
+            Sym *s = sym_find(local ? &c->lsyms : &c->gsyms, name, 0);
+            if (s && (s->kind == SYM_CONST || s->is_str != is_str)) cerror(c, "Duplicate definition");
+            if (!s) s = sym_add(c, local, name, SYM_VAR, is_str, is_int);
+            if (shared) s->shared = 1;
+        }
+    } while (accept_ch(c, ','));
+}
+
+static void st_deftype(Comp *c, int type) {
+    do {
+        const Tok *t = TK(c);
+        if (t->type != T_ID || t->len != 1) cerror(c, "Syntax error");
+        char from = tid(c, t)[0], to = from;
+        c->pos++;
+        if (accept_ch(c, '-')) {
+            t = TK(c);
+            if (t->type != T_ID || t->len != 1) cerror(c, "Syntax error");
+            to = tid(c, t)[0];
+            c->pos++;
+        }
+        for (char ch = from; ch >= 'A' && ch <= to && ch <= 'Z'; ++ch) c->deftype[ch - 'A'] = (unsigned char)type;
+    } while (accept_ch(c, ','));
+}
+
+static void st_const(Comp *c) {
+    do {
+        const char *name = expect_name(c);
+        if (sym_lookup(c, name, 0)) cerror(c, "Duplicate definition");
+        expect_ch(c, '=');
+        int neg = accept_ch(c, '-');
+        const Tok *t = TK(c);
+        int is_str, idx;
+        if (t->type == T_NUM) { is_str = 0; idx = num_const(c, neg ? -t->num : t->num); }
+        else if (t->type == T_STR && !neg) { is_str = 1; idx = str_const(c, tid(c, t), t->len); }
+        else {
+            const Sym *o = (t->type == T_ID) ? sym_lookup(c, tid(c, t), 0) : NULL;
+            if (!o || o->kind != SYM_CONST || (neg && o->is_str)) cerror(c, "Invalid constant");
+            is_str = o->is_str;
+            idx = neg ? num_const(c, -c->p->nums[o->slot]) : o->slot;
+        }
+        c->pos++;
+        char last = name[strlen(name) - 1];
+        if ((last == '$') != is_str && (last == '$' || last == '%' || last == '&' || last == '!' || last == '#')) cerror(c, "Type mismatch");
+        Sym *s = sym_add(c, c->cur != NULL, name, SYM_CONST, is_str, 0);
+        s->slot = idx;
+    } while (accept_ch(c, ','));
+}
+
+/* SHARED inside a SUB: names refer to the module's variables */
+static void st_shared(Comp *c) {
+    if (!c->cur) cerror(c, "SHARED only allowed in SUB");
+    do {
+        const char *name = expect_name(c);
+        int arr = 0, is_str, is_int;
+        if (accept_ch(c, '(')) { expect_ch(c, ')'); arr = 1; }
+        name_type(c, name, &is_str, &is_int);
+        if (accept_id(c, "AS")) as_type(c, &is_str, &is_int);
+        const Sym *g = sym_find(&c->gsyms, name, arr);
+        if (!g) g = sym_add(c, 0, name, arr ? SYM_ARRAY : SYM_VAR, is_str, is_int);
+        if (sym_find(&c->lsyms, name, arr)) cerror(c, "Duplicate definition");
+        Sym copy = *g;
+        SymTab *t = &c->lsyms;
+        t->v = (Sym*)cgrow(c, t->v, &t->cap, t->n + 1, sizeof(Sym));
+        t->v[t->n++] = copy;
+    } while (accept_ch(c, ','));
+}
+
+static void st_print(Comp *c) {
+    int file = 0, newline = 1;
+    if (accept_ch(c, '#')) { expr_num(c); expect_ch(c, ','); emit(c, OP_OUT); file = 1; }
+    if (is_id(c, "USING")) cerror(c, "PRINT USING not supported");
+    while (!at_end(c)) {
+        newline = 1;
+        if (accept_ch(c, ';')) { newline = 0; continue; }
+        if (accept_ch(c, ',')) { emit(c, OP_PRTAB); newline = 0; continue; }
+        int tab = accept_id(c, "TAB");
+        if (tab || accept_id(c, "SPC")) {
+            expect_ch(c, '(');
+            expr_num(c);
+            expect_ch(c, ')');
+            emit(c, tab ? OP_PRCOL : OP_PRSPC);
+            continue;
+        }
+        emit(c, expr(c) == TY_STR ? OP_PRS : OP_PRN);
+    }
+    if (newline) emit(c, OP_PRNL);
+    if (file) emit(c, OP_OUTCON);
+}
+
+static void st_write(Comp *c) {
+    int file = 0, first = 1;
+    if (accept_ch(c, '#')) { expr_num(c); expect_ch(c, ','); emit(c, OP_OUT); file = 1; }
+    while (!at_end(c)) {
+        if (!first) { if (!accept_ch(c, ',')) expect_ch(c, ';'); emit(c, OP_WRSEP); }
+        emit(c, expr(c) == TY_STR ? OP_WRS : OP_WRN);
+        first = 0;
+    }
+    emit(c, OP_PRNL);
+    if (file) emit(c, OP_OUTCON);
+}
+
+static void st_input(Comp *c, int line_input) {
+    Lv lv;
+    if (accept_ch(c, '#')) {
+        expr_num(c);
+        expect_ch(c, ',');
+        emit2(c, OP_READ, 1);
+    } else {
+        int question = !line_input;
+        accept_ch(c, ';');
+        const Tok *t = TK(c);
+        if (t->type == T_STR && (c->toks[c->pos + 1].type == T_CH) && (c->toks[c->pos + 1].ch == ';' || c->toks[c->pos + 1].ch == ',')) {
+            emit2(c, OP_PUSHS, str_const(c, tid(c, t), t->len));
+            emit(c, OP_PRS);
+            c->pos++;
+            if (accept_ch(c, ',')) question = 0;
+            else c->pos++;
+        }
+        if (question) { emit2(c, OP_PUSHS, str_const(c, "? ", 2)); emit(c, OP_PRS); }
+        emit2(c, OP_READ, 0);
+    }
+    if (line_input) {
+        parse_lvalue(c, &lv);
+        if (!lv.s->is_str) cerror(c, "Type mismatch");
+        emit(c, OP_LINE);
+        emit_store(c, &lv);
+        return;
+    }
+    do {
+        parse_lvalue(c, &lv);
+        emit(c, lv.s->is_str ? OP_FIELDS : OP_FIELDN);
+        emit_store(c, &lv);
+    } while (accept_ch(c, ','));
+}
+
+static void st_open(Comp *c) {
+    int mode;
+    expr_str(c);
+    expect_id(c, "FOR");
+    if (accept_id(c, "INPUT")) mode = 0;
+    else if (accept_id(c, "OUTPUT")) mode = 1;
+    else if (accept_id(c, "APPEND")) mode = 2;
+    else cerror(c, "File mode not supported");
+    expect_id(c, "AS");
+    accept_ch(c, '#');
+    expr_num(c);
+    emit2(c, OP_OPEN, mode);
+}
+
+static void st_close(Comp *c) {
+    int n = 0;
+    if (!at_end(c)) {
+        do { accept_ch(c, '#'); expr_num(c); n++; } while (accept_ch(c, ','));
+    }
+    emit2(c, OP_CLOSE, n);
+}
+
+/* SWAP a, b as t = a: a = b: b = t, re-reading the operands' tokens for each step */
+static void st_swap(Comp *c) {
+    Lv la, lb;
+    int code = c->p->ncode, a = c->pos;
+    parse_lvalue(c, &la);
+    expect_ch(c, ',');
+    int b = c->pos;
+    parse_lvalue(c, &lb);
+    int end = c->pos;
+    if (la.s->is_str != lb.s->is_str) cerror(c, "Type mismatch");
+    c->p->ncode = code;
+    Sym t = hidden_var(c, c->cur != NULL, la.s->is_str);
+    Lv lt = { &t, 0 };
+    c->pos = a; primary(c); emit_store(c, &lt);
+    c->pos = a; parse_lvalue(c, &la); c->pos = b; primary(c); emit_store(c, &la);
+    c->pos = b; parse_lvalue(c, &lb); emit_load(c, &t); emit_store(c, &lb);
+    c->pos = end;
+}
+
+static void st_erase(Comp *c) {
+    do {
+        const char *name = expect_name(c);
+        const Sym *s = sym_lookup(c, name, 1);
+        if (!s) cerror(c, "Array not defined");
+        emit(c, OP_ERASE); emit(c, s->slot); emit(c, array_flags(s, 0));
+    } while (accept_ch(c, ','));
+}
+
+static void st_assign(Comp *c) {
+    Lv lv;
+    accept_id(c, "LET");
+    int target = c->pos;
+    parse_lvalue(c, &lv);
+    expect_ch(c, '=');
+    const Tok *t = TK(c);
+    if (!lv.ndims && lv.s->is_str && t->type == T_ID && strcmp(tid(c, t), tid(c, &c->toks[target])) == 0 &&
+        c->toks[c->pos + 1].type == T_CH && c->toks[c->pos + 1].ch == '+') {
+        /* s$ = s$ + a$ + b$ appends each part to s$ in place */
+        int save = c->pos, code = c->p->ncode, ok = 1;
+        c->pos += 2;
+        do {
+            if (ex_mod(c) != TY_STR) { ok = 0; break; }
+            emit2(c, lv.s->local ? OP_APPL : OP_APPG, lv.s->slot);
+        } while (accept_ch(c, '+'));
+        if (ok && at_end(c)) return;
+        c->pos = save; c->p->ncode = code;
+    }
+    if (expr(c) != lv.s->is_str) cerror(c, "Type mismatch");
+    emit_store(c, &lv);
+}
+
+static void statement(Comp *c) {
+    const Tok *t = TK(c);
+    if (t->type == T_NL || t->type == T_COLON || t->type == T_EOF) return;
+    if (c->line_if && is_id(c, "ELSE")) return;
+    mark_line(c, t->line);
+    if (t->type != T_ID) cerror(c, "Syntax error");
+    const char *kw = tid(c, t);
+    Proc *pr;
+    c->pos++;
+    if (!strcmp(kw, "PRINT")) st_print(c);
+    else if (!strcmp(kw, "IF")) st_if(c);
+    else if (!strcmp(kw, "ELSEIF")) st_elseif(c);
+    else if (!strcmp(kw, "ELSE")) st_else(c);
+    else if (!strcmp(kw, "END")) st_end(c);
+    else if (!strcmp(kw, "FOR")) st_for(c);
+    else if (!strcmp(kw, "NEXT")) st_next(c);
+    else if (!strcmp(kw, "DO")) st_do(c);
+    else if (!strcmp(kw, "LOOP")) st_loop(c);
+    else if (!strcmp(kw, "WHILE")) st_while(c);
+    else if (!strcmp(kw, "WEND")) st_wend(c);
+    else if (!strcmp(kw, "EXIT")) st_exit(c);
+    else if (!strcmp(kw, "SELECT")) st_select(c);
+    else if (!strcmp(kw, "CASE")) st_case(c);
+    else if (!strcmp(kw, "GOTO")) jump_to_label(c, OP_JMP);
+    else if (!strcmp(kw, "GOSUB")) jump_to_label(c, OP_GOSUB);
+    else if (!strcmp(kw, "RETURN")) emit(c, OP_RETSUB);
+    else if (!strcmp(kw, "DIM") || !strcmp(kw, "REDIM")) st_dim(c);
+    else if (!strcmp(kw, "CONST")) st_const(c);
+    else if (!strcmp(kw, "SHARED")) st_shared(c);
+    else if (!strcmp(kw, "INPUT")) st_input(c, 0);
+    else if (!strcmp(kw, "LINE")) { expect_id(c, "INPUT"); st_input(c, 1); }
+    else if (!strcmp(kw, "WRITE")) st_write(c);
+    else if (!strcmp(kw, "OPEN")) st_open(c);
+    else if (!strcmp(kw, "CLOSE")) st_close(c);
+    else if (!strcmp(kw, "SWAP")) st_swap(c);
+    else if (!strcmp(kw, "ERASE")) st_erase(c);
+    else if (!strcmp(kw, "STOP") || !strcmp(kw, "SYSTEM")) emit(c, OP_END);
+    else if (!strcmp(kw, "DEFINT") || !strcmp(kw, "DEFLNG")) st_deftype(c, 1);
+    else if (!strcmp(kw, "DEFSNG") || !strcmp(kw, "DEFDBL")) st_deftype(c, 0);
+    else if (!strcmp(kw, "DEFSTR")) st_deftype(c, 2);
+    else if (!strcmp(kw, "OPTION")) {
+        expect_id(c, "BASE");
+        if (TK(c)->type != T_NUM || (TK(c)->num != 0 && TK(c)->num != 1)) cerror(c, "Syntax error");
+        c->p->base = (int)TK(c)->num;
+        c->pos++;
+    } else if (!strcmp(kw, "NAME")) {
+        expr_str(c);
+        expect_id(c, "AS");
+        expr_str(c);
+        emit(c, OP_BI); emit(c, BI_NAME); emit(c, 2);
+    } else if (!strcmp(kw, "CALL")) {
+        const char *name = expect_name(c);
+        if (!(pr = proc_find(c, name)) || pr->is_func) cerror(c, "Subprogram not defined");
+        call_proc(c, pr, 0);
+    } else if (is_builtin(kw, 1)) call_builtin(c, kw, 1);
+    else if ((pr = proc_find(c, kw)) != NULL && !pr->is_func) call_proc(c, pr, 0);
+    else { c->pos--; st_assign(c); }
+}
+
+static void check_blocks(Comp *c) {
+    static const char *const open_msg[] = { "Block IF without END IF", "FOR without NEXT", "WHILE without WEND", "DO without LOOP", "SELECT without END SELECT" };
+    if (c->nctl == 0) return;
+    snprintf(c->err, c->errlen, "%s in line %d", open_msg[c->ctl[c->nctl - 1].kind], c->ctl[c->nctl - 1].line);
+    longjmp(c->fail, 1);
+}
+
+/* Compiles statements up to token index end, skipping SUB/FUNCTION bodies at module level */
+static void block(Comp *c, int end) {
+    while (c->pos < end) {
+        const Tok *t = TK(c);
+        if (t->type == T_EOF) break;
+        if (t->type == T_NL || t->type == T_COLON) { c->pos++; continue; }
+        if (!c->cur && c->next_proc < c->p->nprocs && c->pos == c->p->procs[c->next_proc].start) {
+            c->pos = c->p->procs[c->next_proc++].end;
+            continue;
+        }
+        if (t->bol && t->type == T_NUM) {
+            char name[QB_NAME_LEN + 2];
+            label_name(c, t, name);
+            define_label(c, name);
+            c->pos++;
+            continue;
+        }
+        if (t->bol && t->type == T_ID && c->toks[c->pos + 1].type == T_COLON && !is_keyword(tid(c, t))) {
+            define_label(c, tid(c, t));
+            c->pos += 2;
+            continue;
+        }
+        if (is_id(c, "DECLARE")) {
+            while (TK(c)->type != T_NL && TK(c)->type != T_EOF) c->pos++;
+            continue;
+        }
+        statement(c);
+        t = TK(c);
+        if (t->type != T_NL && t->type != T_COLON && t->type != T_EOF) cerror(c, "Syntax error");
+    }
+}
+
+/* Finds every SUB and FUNCTION first so calls can precede definitions */
+static void scan_procs(Comp *c) {
+    int stmt = 1;
+    for (int i = 0; i < c->ntok; ++i) {
+        const Tok *t = &c->toks[i];
+        if (t->type == T_NL || t->type == T_COLON) { stmt = 1; continue; }
+        if (!stmt || t->type != T_ID) { stmt = 0; continue; }
+        stmt = 0;
+        const char *w = tid(c, t);
+        if (!strcmp(w, "DECLARE")) {
+            while (i + 1 < c->ntok && c->toks[i + 1].type != T_NL) i++;
+            continue;
+        }
+        if (!strcmp(w, "DEFINT") || !strcmp(w, "DEFLNG") || !strcmp(w, "DEFSNG") || !strcmp(w, "DEFDBL") || !strcmp(w, "DEFSTR")) {
+            /* applied here too so FUNCTION and parameter types follow them */
+            c->pos = i + 1;
+            st_deftype(c, !strcmp(w, "DEFSTR") ? 2 : (!strcmp(w, "DEFINT") || !strcmp(w, "DEFLNG")) ? 1 : 0);
+            i = c->pos - 1;
+            continue;
+        }
+        int is_func = !strcmp(w, "FUNCTION");
+        if (!is_func && strcmp(w, "SUB")) continue;
+
+        QbProgram *p = c->p;
+        p->procs = (Proc*)cgrow(c, p->procs, &p->capprocs, p->nprocs + 1, sizeof(Proc));
+        Proc *pr = &p->procs[p->nprocs];
+        ZeroMemory(pr, sizeof(*pr));
+        pr->start = i;
+        pr->is_func = (unsigned char)is_func;
+        c->pos = i + 1;
+        const char *name = expect_name(c);
+        if (proc_find(c, name) || is_builtin(name, 0) || is_builtin(name, 1)) cerror(c, "Duplicate definition");
+        if (!is_func && name[strlen(name) - 1] == '$') cerror(c, "Syntax error");
+        strncpy_s(pr->name, sizeof(pr->name), name, _TRUNCATE);
+        int is_str, is_int;
+        name_type(c, name, &is_str, &is_int);
+        pr->is_str = (unsigned char)(is_func && is_str);
+        pr->is_int = (unsigned char)(is_func && is_int);
+        if (accept_ch(c, '(') && !accept_ch(c, ')')) {
+            do {
+                if (pr->nparams == QB_MAX_PARAMS) cerror(c, "Too many parameters");
+                const Tok *pt = TK(c);
+                const char *pn = expect_name(c);
+                if (is_ch(c, '(')) cerror(c, "Array parameters not supported");
+                name_type(c, pn, &is_str, &is_int);
+                if (accept_id(c, "AS")) as_type(c, &is_str, &is_int);
+                pr->pname[pr->nparams] = pt->text;
+                pr->pstr[pr->nparams] = (unsigned char)is_str;
+                pr->pint[pr->nparams++] = (unsigned char)is_int;
+            } while (accept_ch(c, ','));
+            expect_ch(c, ')');
+        }
+        accept_id(c, "STATIC");
+        pr->body = c->pos;
+        p->nprocs++;
+
+        /* the matching END SUB / END FUNCTION */
+        int j, at_stmt = 0;
+        for (j = c->pos; j < c->ntok; ++j) {
+            const Tok *u = &c->toks[j];
+            if (u->type == T_NL || u->type == T_COLON) { at_stmt = 1; continue; }
+            if (u->type == T_EOF) break;
+            if (at_stmt && u->type == T_ID) {
+                const char *uw = tid(c, u);
+                if (!strcmp(uw, "END") && c->toks[j + 1].type == T_ID && !strcmp(tid(c, &c->toks[j + 1]), w)) break;
+                if (!strcmp(uw, "SUB") || !strcmp(uw, "FUNCTION")) { c->pos = j; cerror(c, "SUB/FUNCTION not allowed inside %s", w); }
+            }
+            at_stmt = 0;
+        }
+        if (j >= c->ntok || c->toks[j].type == T_EOF) { c->pos = pr->start; cerror(c, "%s without END %s", w, w); }
+        p->procs[p->nprocs - 1].end = j + 2;
+        i = j + 1;
+        stmt = 0;
+    }
+}
+
+static void compile_proc(Comp *c, Proc *pr) {
+    c->cur = pr;
+    c->lsyms.n = 0;
+    c->nlk = 0;
+    pr->entry = c->p->ncode;
+    if (pr->is_func) sym_add(c, 1, pr->name, SYM_VAR, pr->is_str, pr->is_int);   /* slot 0: result */
+    for (int i = 0; i < pr->nparams; ++i) sym_add(c, 1, c->pool + pr->pname[i], SYM_VAR, pr->pstr[i], pr->pint[i]);
+    c->pos = pr->body;
+    block(c, pr->end - 2);
+    check_blocks(c);
+    c->pos = pr->end - 2;
+    mark_line(c, TK(c)->line);
+    emit(c, OP_RET);
+    resolve_labels(c);
+    pr->nlocals = c->nlk;
+    pr->kinds = (unsigned char*)malloc(c->nlk ? c->nlk : 1);
+    if (!pr->kinds) cerror(c, "Out of memory");
+    if (c->nlk) memcpy(pr->kinds, c->lkinds, c->nlk);
+    c->cur = NULL;
+}
+
+static void comp_free(Comp *c) {
+    free(c->toks); free(c->pool); free(c->gsyms.v); free(c->lsyms.v); free(c->lkinds);
+    free(c->labels); free(c->fixups); free(c->exits); free(c->exit_depth);
+    free(c);
+}
+
+QbProgram *qb_compile(const char *src, size_t len, char *err, size_t errlen) {
+    QbProgram *p = (QbProgram*)calloc(1, sizeof(QbProgram));
+    Comp *c = (Comp*)calloc(1, sizeof(Comp));
+    if (!p || !c) { free(p); free(c); snprintf(err, errlen, "Out of memory"); return NULL; }
+    c->p = p; c->err = err; c->errlen = errlen;
+    if (setjmp(c->fail)) {
+        comp_free(c);
+        qb_free(p);
+        return NULL;
+    }
+    lex(c, src, len);
+    scan_procs(c);
+    ZeroMemory(c->deftype, sizeof(c->deftype));
+    c->pos = 0;
+    block(c, c->ntok);
+    check_blocks(c);
+    emit(c, OP_END);
+    resolve_labels(c);
+    for (int i = 0; i < p->nprocs; ++i) compile_proc(c, &p->procs[i]);
+    comp_free(c);
+    return p;
+}
+
+QbProgram *qb_compile_file(const char *path, char *err, size_t errlen) {
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (h == INVALID_HANDLE_VALUE) { snprintf(err, errlen, "Cannot open %s", path); return NULL; }
+    LARGE_INTEGER size;
+    char *src = NULL;
+    DWORD got = 0;
+    if (GetFileSizeEx(h, &size) && size.QuadPart < 64 * 1024 * 1024) src = (char*)malloc((size_t)size.QuadPart + 1);
+    BOOL ok = src && ReadFile(h, src, (DWORD)size.QuadPart, &got, NULL);
+    CloseHandle(h);
+    if (!ok) { free(src); snprintf(err, errlen, "Cannot read %s", path); return NULL; }
+    QbProgram *p = qb_compile(src, got, err, errlen);
+    free(src);
+    return p;
+}
+
+/* ================================================================ runtime */
+
+typedef struct {
+    char *buf;
+    int len, pos, cap;
+    int valid;                 /* an INPUT line with fields left to read */
+} LineBuf;
+
+typedef struct {
+    HANDLE h;
+    int mode;                  /* 0 input, 1 output, 2 append */
+    char *buf;
+    int pos, len;              /* input: unread bytes buf[pos..len); output: pending buf[0..len) */
+    int col;
+    LineBuf line;
+} QbFile;
+
+typedef struct {
+    int ret;
+    Slot *caller;              /* the caller's locals */
+    Slot *base;                /* this call's locals */
+    const Proc *proc;
+} Frame;
+
+typedef struct {
+    QbProgram *p;
+    const QbHost *host;
+    const char *command;
+    Slot *globals, *locals;
+    Slot stack[QB_STACK];
+    Frame frames[QB_FRAMES];
+    int nframes;
+    int gosubs[QB_GOSUBS];
+    int ngosubs;
+    QbFile *files[QB_FILES + 1];
+    QbFile *out;               /* PRINT # target, NULL for the screen */
+    QbFile *in_file;           /* INPUT # source, NULL for the keyboard */
+    LineBuf con;               /* line typed for the current INPUT */
+    char outbuf[QB_OUT_BUF];
+    int outlen, col;
+    HANDLE dir_h;              /* DIR$ enumeration */
+    char dir_mask[MAX_PATH];
+    unsigned int seed;
+    double last_rnd;
+    int broke;
+    const char *msg;           /* runtime error */
+    QbStr live;                /* sentinel of the strings allocated by this run */
+} Vm;
+
+static QbStr *str_new(Vm *vm, int len) {
+    if (len <= 0) return NULL;
+    if (len > QB_MAX_STR) { vm->msg = "String too long"; return NULL; }
+    int cap = len < 16 ? 16 : len;
+    QbStr *s = (QbStr*)malloc(offsetof(QbStr, data) + (size_t)cap + 1);
+    if (!s) { vm->msg = "Out of string space"; return NULL; }
+    s->ref = 1; s->len = len; s->cap = cap;
+    s->data[len] = 0;
+    s->prev = &vm->live; s->next = vm->live.next;
+    vm->live.next->prev = s; vm->live.next = s;
+    return s;
+}
+
+static QbStr *str_from(Vm *vm, const char *p, int len) {
+    QbStr *s = str_new(vm, len);
+    if (s) memcpy(s->data, p, len);
+    return s;
+}
+
+static void str_release(QbStr *s) {
+    if (!s || --s->ref > 0 || !s->prev) return;
+    s->prev->next = s->next; s->next->prev = s->prev;
+    free(s);
+}
+
+/* Appends b to a, consuming both references. a grows in place when nothing else holds it,
+   so building a string piece by piece stays linear. */
+static QbStr *str_cat(Vm *vm, QbStr *a, QbStr *b) {
+    if (!b) return a;
+    if (!a) return b;
+    long long need = (long long)a->len + b->len;
+    if (need > QB_MAX_STR) { vm->msg = "String too long"; str_release(b); return a; }
+    if (a->ref == 1 && a->prev) {
+        if (need > a->cap) {
+            long long cap = (long long)a->cap * 2;
+            if (cap < need) cap = need;
+            if (cap > QB_MAX_STR) cap = QB_MAX_STR;
+            QbStr *na = (QbStr*)realloc(a, offsetof(QbStr, data) + (size_t)cap + 1);
+            if (!na) { vm->msg = "Out of string space"; str_release(b); return a; }
+            na->prev->next = na; na->next->prev = na;
+            na->cap = (int)cap;
+            a = na;
+        }
+        memcpy(a->data + a->len, b->data, b->len);
+        a->len = (int)need;
+        a->data[a->len] = 0;
+        str_release(b);
+        return a;
+    }
+    QbStr *r = str_new(vm, (int)need);
+    if (r) { memcpy(r->data, a->data, a->len); memcpy(r->data + a->len, b->data, b->len); }
+    str_release(a);
+    str_release(b);
+    return r;
+}
+
+/* A string the caller may modify: s itself when it is an unshared temporary, else a copy */
+static QbStr *str_own(Vm *vm, QbStr *s) {
+    if (!s || (s->ref == 1 && s->prev)) return s;
+    QbStr *r = str_from(vm, s->data, s->len);
+    str_release(s);
+    return r;
+}
+
+static int str_cmp(const QbStr *a, const QbStr *b) {
+    int la = SLEN(a), lb = SLEN(b);
+    int r = memcmp(SDATA(a), SDATA(b), la < lb ? la : lb);
+    return r ? r : (la > lb) - (la < lb);
+}
+
+/* CINT/CLNG rounding: halves go to the even neighbour */
+static double round_even(double x) {
+    double r = floor(x + 0.5);
+    if (r - x == 0.5 && fmod(r, 2.0) != 0) r -= 1;
+    return r;
+}
+
+static int to_int(double x) {
+    if (!(x > -2147483648.5 && x < 2147483647.5)) return x < 0 ? -2147483647 - 1 : 2147483647;
+    return (int)round_even(x);
+}
+
+/* Number text as QBasic prints it: integers in full, otherwise 7 significant digits
+   without a leading zero before the point */
+static int fmt_num(double v, char *out) {
+    int n;
+    if (v == 0) { out[0] = '0'; out[1] = 0; return 1; }
+    if (v == floor(v) && fabs(v) < 1e15) return snprintf(out, 32, "%.0f", v);
+    n = snprintf(out, 32, "%.7G", v);
+    char *z = out[0] == '-' ? out + 1 : out;
+    if (z[0] == '0' && z[1] == '.') { memmove(z, z + 1, strlen(z)); n--; }
+    return n;
+}
+
+static const char *file_error(DWORD e) {
+    switch (e) {
+    case ERROR_FILE_NOT_FOUND: return "File not found";
+    case ERROR_PATH_NOT_FOUND: case ERROR_INVALID_NAME: case ERROR_BAD_PATHNAME: return "Path not found";
+    case ERROR_ACCESS_DENIED: case ERROR_SHARING_VIOLATION: case ERROR_LOCK_VIOLATION: return "Permission denied";
+    case ERROR_FILE_EXISTS: case ERROR_ALREADY_EXISTS: return "File already exists";
+    case ERROR_DISK_FULL: case ERROR_HANDLE_DISK_FULL: return "Disk full";
+    default: return "Path/File access error";
+    }
+}
+
+/* ---- screen and files ---- */
+
+static void con_flush(Vm *vm) {
+    if (vm->outlen) vm->host->write(vm->host->ctx, vm->outbuf, vm->outlen);
+    vm->outlen = 0;
+}
+
+static int vm_interrupted(Vm *vm) {
+    con_flush(vm);
+    if (!vm->broke && vm->host->interrupted && vm->host->interrupted(vm->host->ctx)) vm->broke = 1;
+    return vm->broke;
+}
+
+static int file_flush(Vm *vm, QbFile *f) {
+    int off = 0;
+    while (off < f->len) {
+        DWORD wrote = 0;
+        if (!WriteFile(f->h, f->buf + off, (DWORD)(f->len - off), &wrote, NULL) || wrote == 0) {
+            f->len = 0;
+            vm->msg = file_error(GetLastError());
+            return 0;
+        }
+        off += (int)wrote;
+    }
+    f->len = 0;
+    return 1;
+}
+
+/* Appends text to the current PRINT target and tracks its column */
+static void out_text(Vm *vm, const char *p, int n) {
+    QbFile *f = vm->out;
+    char *buf = f ? f->buf : vm->outbuf;
+    int size = f ? QB_FILE_BUF : QB_OUT_BUF;
+    int *len = f ? &f->len : &vm->outlen;
+    int *col = f ? &f->col : &vm->col;
+    int i;
+    for (i = n - 1; i >= 0 && p[i] != '\n'; --i) {}
+    *col = i >= 0 ? n - i - 1 : *col + n;
+    while (n > 0) {
+        if (*len == size) {
+            if (f) { if (!file_flush(vm, f)) return; }
+            else con_flush(vm);
+        }
+        int k = size - *len;
+        if (k > n) k = n;
+        memcpy(buf + *len, p, k);
+        *len += k; p += k; n -= k;
+    }
+}
+
+static void out_newline(Vm *vm) {
+    if (vm->out) out_text(vm, "\r\n", 2);
+    else out_text(vm, "\n", 1);
+}
+
+static void out_spaces(Vm *vm, int n) {
+    static const char sp[] = "                                                                ";
+    while (n > 0) {
+        int k = n < 64 ? n : 64;
+        out_text(vm, sp, k);
+        n -= k;
+    }
+}
+
+static int out_col(Vm *vm) { return vm->out ? vm->out->col : vm->col; }
+
+/* want: 0 an input file, 1 an output file, -1 either */
+static QbFile *file_get(Vm *vm, double num, int want) {
+    int k = to_int(num);
+    QbFile *f = (k >= 1 && k <= QB_FILES) ? vm->files[k] : NULL;
+    if (!f) { vm->msg = "Bad file number"; return NULL; }
+    if (want >= 0 && (f->mode != 0) != want) { vm->msg = "Bad file mode"; return NULL; }
+    return f;
+}
+
+static void file_open(Vm *vm, const QbStr *name, double num, int mode) {
+    int k = to_int(num);
+    if (k < 1 || k > QB_FILES) { vm->msg = "Bad file number"; return; }
+    if (vm->files[k]) { vm->msg = "File already open"; return; }
+    if (!SLEN(name)) { vm->msg = "Bad file name"; return; }
+    HANDLE h = CreateFileA(name->data, mode == 0 ? GENERIC_READ : GENERIC_WRITE,
+                           mode == 0 ? FILE_SHARE_READ | FILE_SHARE_WRITE : FILE_SHARE_READ, NULL,
+                           mode == 0 ? OPEN_EXISTING : mode == 1 ? CREATE_ALWAYS : OPEN_ALWAYS,
+                           FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (h == INVALID_HANDLE_VALUE) { vm->msg = file_error(GetLastError()); return; }
+    if (mode == 2) {
+        LARGE_INTEGER zero;
+        zero.QuadPart = 0;
+        SetFilePointerEx(h, zero, NULL, FILE_END);
+    }
+    QbFile *f = (QbFile*)calloc(1, sizeof(QbFile));
+    char *buf = (char*)malloc(QB_FILE_BUF);
+    if (!f || !buf) { free(f); free(buf); CloseHandle(h); vm->msg = "Out of memory"; return; }
+    f->h = h; f->mode = mode; f->buf = buf;
+    vm->files[k] = f;
+}
+
+static void file_close(Vm *vm, int k) {
+    QbFile *f = (k >= 1 && k <= QB_FILES) ? vm->files[k] : NULL;
+    if (!f) return;
+    if (f->mode != 0) file_flush(vm, f);
+    CloseHandle(f->h);
+    if (vm->out == f) vm->out = NULL;
+    if (vm->in_file == f) vm->in_file = NULL;
+    free(f->buf);
+    free(f->line.buf);
+    free(f);
+    vm->files[k] = NULL;
+}
+
+/* Makes unread bytes available; 0 at end of file */
+static int file_more(QbFile *f) {
+    if (f->pos < f->len) return 1;
+    DWORD got = 0;
+    f->pos = f->len = 0;
+    if (!ReadFile(f->h, f->buf, QB_FILE_BUF, &got, NULL)) return 0;
+    f->len = (int)got;
+    return got > 0;
+}
+
+static int line_reserve(Vm *vm, LineBuf *lb, int need) {
+    if (need < lb->cap) return 1;
+    int cap = lb->cap ? lb->cap : 256;
+    while (cap <= need) cap *= 2;
+    char *nb = (char*)realloc(lb->buf, cap);
+    if (!nb) { vm->msg = "Out of memory"; return 0; }
+    lb->buf = nb; lb->cap = cap;
+    return 1;
+}
+
+/* Reads the next line of an input file into its line buffer */
+static int file_read_line(Vm *vm, QbFile *f) {
+    LineBuf *lb = &f->line;
+    if (!file_more(f)) { vm->msg = "Input past end of file"; return 0; }
+    lb->len = 0;
+    while (file_more(f)) {
+        char *b = f->buf + f->pos;
+        char *nl = (char*)memchr(b, '\n', f->len - f->pos);
+        int n = nl ? (int)(nl - b) : f->len - f->pos;
+        if (!line_reserve(vm, lb, lb->len + n)) return 0;
+        memcpy(lb->buf + lb->len, b, n);
+        lb->len += n;
+        f->pos += n + (nl ? 1 : 0);
+        if (nl) break;
+    }
+    if (lb->len && lb->buf[lb->len - 1] == '\r') lb->len--;
+    lb->buf[lb->len] = 0;
+    lb->pos = 0;
+    lb->valid = 1;
+    return 1;
+}
+
+static int read_console(Vm *vm) {
+    LineBuf *lb = &vm->con;
+    con_flush(vm);
+    if (!line_reserve(vm, lb, 1024)) return 0;
+    lb->buf[0] = 0;
+    if (!vm->host->read_line || !vm->host->read_line(vm->host->ctx, lb->buf, lb->cap)) {
+        vm->msg = "Input past end of file";
+        return 0;
+    }
+    lb->len = (int)strlen(lb->buf);
+    lb->pos = 0;
+    lb->valid = 1;
+    vm->col = 0;
+    return 1;
+}
+
+/* Next comma separated INPUT field, unquoted */
+static int next_field(Vm *vm, const char **out, int *outlen) {
+    LineBuf *lb = vm->in_file ? &vm->in_file->line : &vm->con;
+    if (!lb->valid) {
+        if (!vm->in_file) { *out = ""; *outlen = 0; return 1; }   /* fewer values typed than asked for */
+        if (!file_read_line(vm, vm->in_file)) return 0;
+    }
+    const char *s = lb->buf + lb->pos, *e = lb->buf + lb->len, *start;
+    int n;
+    while (s < e && (*s == ' ' || *s == '\t')) s++;
+    if (s < e && *s == '"') {
+        start = ++s;
+        while (s < e && *s != '"') s++;
+        n = (int)(s - start);
+        while (s < e && *s != ',') s++;
+    } else {
+        start = s;
+        while (s < e && *s != ',') s++;
+        n = (int)(s - start);
+        while (n > 0 && (start[n - 1] == ' ' || start[n - 1] == '\t')) n--;
+    }
+    if (s < e) lb->pos = (int)(s + 1 - lb->buf);
+    else lb->valid = 0;
+    *out = start; *outlen = n;
+    return 1;
+}
+
+/* LINE INPUT: the rest of the current line, or the next one */
+static QbStr *read_whole_line(Vm *vm) {
+    LineBuf *lb = vm->in_file ? &vm->in_file->line : &vm->con;
+    if (!lb->valid && (!vm->in_file || !file_read_line(vm, vm->in_file))) return NULL;
+    lb->valid = 0;
+    return str_from(vm, lb->buf + lb->pos, lb->len - lb->pos);
+}
+
+static double parse_val(const char *s, int len) {
+    int i = 0, n = 0;
+    char buf[64];
+    while (i < len && (s[i] == ' ' || s[i] == '\t')) i++;
+    if (i + 1 < len && s[i] == '&' && (up(s[i + 1]) == 'H' || up(s[i + 1]) == 'O')) {
+        int base = up(s[i + 1]) == 'H' ? 16 : 8;
+        double v = 0;
+        for (i += 2; i < len; ++i) {
+            char d = up(s[i]);
+            int dv = is_digit(d) ? d - '0' : (d >= 'A' && d <= 'F') ? d - 'A' + 10 : 99;
+            if (dv >= base) break;
+            v = v * base + dv;
+        }
+        return v;
+    }
+    if (i < len && (s[i] == '-' || s[i] == '+')) buf[n++] = s[i++];
+    while (i < len && n < 56 && (is_digit(s[i]) || s[i] == '.')) buf[n++] = s[i++];
+    if (i < len && (up(s[i]) == 'E' || up(s[i]) == 'D')) {
+        buf[n++] = 'E'; i++;
+        if (i < len && (s[i] == '-' || s[i] == '+')) buf[n++] = s[i++];
+        while (i < len && n < 62 && is_digit(s[i])) buf[n++] = s[i++];
+    }
+    buf[n] = 0;
+    return strtod(buf, NULL);
+}
+
+/* ---- arrays ---- */
+
+static void arr_free(QbArray *a) {
+    if (!a) return;
+    if (a->is_str) for (int i = 0; i < a->count; ++i) str_release(a->data[i].s);
+    free(a);
+}
+
+/* bounds holds a lower and upper bound per dimension */
+static QbArray *arr_new(Vm *vm, int nd, const Slot *bounds, int is_str) {
+    long long count = 1;
+    int lo[QB_MAX_DIMS], ext[QB_MAX_DIMS];
+    for (int d = 0; d < nd; ++d) {
+        lo[d] = to_int(bounds[2 * d].n);
+        int hi = to_int(bounds[2 * d + 1].n);
+        if (hi < lo[d]) { vm->msg = "Subscript out of range"; return NULL; }
+        ext[d] = hi - lo[d] + 1;
+        count *= ext[d];
+        if (count > 0x4000000) { vm->msg = "Out of memory"; return NULL; }
+    }
+    QbArray *a = (QbArray*)calloc(1, offsetof(QbArray, data) + (size_t)count * sizeof(Slot));
+    if (!a) { vm->msg = "Out of memory"; return NULL; }
+    a->ndims = nd; a->is_str = is_str; a->count = (int)count;
+    memcpy(a->lo, lo, sizeof(int) * nd);
+    memcpy(a->ext, ext, sizeof(int) * nd);
+    return a;
+}
+
+static Slot *arr_elem(Vm *vm, Slot *as, const Slot *idx, int nd, int is_str) {
+    QbArray *a = as->a;
+    if (!a) {
+        /* used before DIM: QBasic gives it the bounds base TO 10 */
+        Slot b[2 * QB_MAX_DIMS];
+        for (int d = 0; d < nd; ++d) { b[2 * d].n = vm->p->base; b[2 * d + 1].n = 10; }
+        if ((a = as->a = arr_new(vm, nd, b, is_str)) == NULL) return NULL;
+    }
+    if (a->ndims != nd) { vm->msg = "Subscript out of range"; return NULL; }
+    int off = 0;
+    for (int d = 0; d < nd; ++d) {
+        unsigned i = (unsigned)(to_int(idx[d].n) - a->lo[d]);
+        if (i >= (unsigned)a->ext[d]) { vm->msg = "Subscript out of range"; return NULL; }
+        off = off * a->ext[d] + (int)i;
+    }
+    return &a->data[off];
+}
+
+/* ---- file manager operations ---- */
+
+static int has_wildcards(const QbStr *s) { return s && strpbrk(s->data, "*?") != NULL; }
+
+/* Splits a wildcard spec into its absolute folder and the files in it that match */
+static int expand_spec(Vm *vm, const char *spec, char *dir, char ***out) {
+    char full[MAX_PATH], mask[MAX_PATH], search[MAX_PATH];
+    char *fname = NULL;
+    DWORD n = GetFullPathNameA(spec, MAX_PATH, full, &fname);
+    *out = NULL;
+    if (!n || n >= MAX_PATH || !fname || !*fname) { vm->msg = "Bad file name"; return -1; }
+    strncpy_s(mask, MAX_PATH, fname, _TRUNCATE);
+    *fname = 0;
+    size_t dl = strlen(full);
+    if (dl > 3 && full[dl - 1] == '\\') full[dl - 1] = 0;
+    strncpy_s(dir, MAX_PATH, full, _TRUNCATE);
+    snprintf(search, sizeof(search), "%s%s%s", dir, dir[strlen(dir) - 1] == '\\' ? "" : "\\", mask);
+
+    char **names = NULL;
+    int count = 0, cap = 0;
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileExA(search, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    do {
+        /* FindFirstFile also matches 8.3 aliases, so the long name is checked again */
+        if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !glob_match(mask, fd.cFileName)) continue;
+        char **nn = (char**)grow(names, &cap, count + 1, sizeof(char*));
+        char *dup = nn ? _strdup(fd.cFileName) : NULL;
+        if (nn) names = nn;
+        if (!dup) { vm->msg = "Out of memory"; break; }
+        names[count++] = dup;
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+    if (vm->msg) {
+        for (int i = 0; i < count; ++i) free(names[i]);
+        free(names);
+        return -1;
+    }
+    *out = names;
+    return count;
+}
+
+/* Runs spec over every file a wildcard pattern matches on the batch engine */
+static void vm_batch(Vm *vm, BatchSpec *spec, const char *pattern) {
+    char **names;
+    int n = expand_spec(vm, pattern, spec->dir, &names);
+    if (n <= 0) {
+        if (n == 0) vm->msg = "File not found";
+        return;
+    }
+    Batch *b = batch_start(spec, (const char *const *)names, n);
+    if (!b) vm->msg = "Out of memory";
+    else {
+        while (!batch_wait(b, 100)) if (vm_interrupted(vm)) batch_cancel(b);
+        const BatchFailure *fl;
+        if (vm->broke) vm->msg = "Break";
+        else if (batch_failures(b, &fl) > 0) vm->msg = file_error(fl[0].error);
+        batch_free(b);
+    }
+    for (int i = 0; i < n; ++i) free(names[i]);
+    free(names);
+}
+
+static void fs_check(Vm *vm, BOOL ok) { if (!ok) vm->msg = file_error(GetLastError()); }
+
+static void fs_copy(Vm *vm, const QbStr *src, const QbStr *dst) {
+    if (!SLEN(src) || !SLEN(dst)) { vm->msg = "Bad file name"; return; }
+    DWORD da = GetFileAttributesA(dst->data);
+    int to_dir = da != INVALID_FILE_ATTRIBUTES && (da & FILE_ATTRIBUTE_DIRECTORY);
+    if (has_wildcards(src)) {
+        BatchSpec spec;
+        ZeroMemory(&spec, sizeof(spec));
+        spec.op = BATCH_COPY;
+        if (!to_dir) { vm->msg = "Path not found"; return; }
+        if (!GetFullPathNameA(dst->data, MAX_PATH, spec.dest, NULL)) { vm->msg = "Bad file name"; return; }
+        vm_batch(vm, &spec, src->data);
+        return;
+    }
+    if (to_dir) {
+        char target[MAX_PATH];
+        const char *base = src->data + strlen(src->data);
+        while (base > src->data && base[-1] != '\\' && base[-1] != '/' && base[-1] != ':') base--;
+        snprintf(target, sizeof(target), "%s\\%s", dst->data, base);
+        fs_check(vm, CopyFileA(src->data, target, FALSE));
+    } else fs_check(vm, CopyFileA(src->data, dst->data, FALSE));
+}
+
+static void fs_attrib(Vm *vm, const QbStr *spec_text, const QbStr *change) {
+    BatchSpec spec;
+    ZeroMemory(&spec, sizeof(spec));
+    spec.op = BATCH_ATTRIB;
+    if (!SLEN(spec_text) || !parse_attrib_change(SDATA(change), &spec.attr_set, &spec.attr_clear)) { vm->msg = "Illegal function call"; return; }
+    if (has_wildcards(spec_text)) { vm_batch(vm, &spec, spec_text->data); return; }
+    DWORD a = GetFileAttributesA(spec_text->data);
+    if (a == INVALID_FILE_ATTRIBUTES) { vm->msg = file_error(GetLastError()); return; }
+    a = (a | spec.attr_set) & ~spec.attr_clear;
+    a &= FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_NOT_CONTENT_INDEXED;
+    fs_check(vm, SetFileAttributesA(spec_text->data, a ? a : FILE_ATTRIBUTE_NORMAL));
+}
+
+static void fs_kill(Vm *vm, const QbStr *spec_text) {
+    if (!SLEN(spec_text)) { vm->msg = "Bad file name"; return; }
+    if (has_wildcards(spec_text)) {
+        BatchSpec spec;
+        ZeroMemory(&spec, sizeof(spec));
+        spec.op = BATCH_DELETE;
+        vm_batch(vm, &spec, spec_text->data);
+    } else fs_check(vm, DeleteFileA(spec_text->data));
+}
+
+/* DIR$(spec) starts an enumeration and DIR$ continues it; "" when no files are left */
+static QbStr *dir_next(Vm *vm, int start, const QbStr *spec) {
+    WIN32_FIND_DATAA fd;
+    if (start) {
+        const char *s = SDATA(spec), *m = s + SLEN(spec);
+        char search[MAX_PATH];
+        if (vm->dir_h != INVALID_HANDLE_VALUE) FindClose(vm->dir_h);
+        while (m > s && m[-1] != '\\' && m[-1] != '/' && m[-1] != ':') m--;
+        strncpy_s(vm->dir_mask, MAX_PATH, *m ? m : "*", _TRUNCATE);
+        snprintf(search, sizeof(search), "%s%s", s, *m ? "" : "*");
+        vm->dir_h = FindFirstFileExA(search, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+        if (vm->dir_h == INVALID_HANDLE_VALUE) return NULL;
+    } else if (vm->dir_h == INVALID_HANDLE_VALUE) {
+        vm->msg = "Illegal function call";
+        return NULL;
+    } else if (!FindNextFileA(vm->dir_h, &fd)) {
+        FindClose(vm->dir_h);
+        vm->dir_h = INVALID_HANDLE_VALUE;
+        return NULL;
+    }
+    for (;;) {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && glob_match(vm->dir_mask, fd.cFileName))
+            return str_from(vm, fd.cFileName, (int)strlen(fd.cFileName));
+        if (!FindNextFileA(vm->dir_h, &fd)) {
+            FindClose(vm->dir_h);
+            vm->dir_h = INVALID_HANDLE_VALUE;
+            return NULL;
+        }
+    }
+}
+
+static double next_rnd(Vm *vm) {
+    unsigned int x = vm->seed;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    vm->seed = x;
+    vm->last_rnd = x / 4294967296.0;
+    return vm->last_rnd;
+}
+
+static unsigned int seed_from(double v) {
+    unsigned int w[2];
+    memcpy(w, &v, sizeof(w));
+    return (w[0] ^ w[1] ^ 0x9E3779B9u) | 1;
+}
+
+static QbStr *str_printf(Vm *vm, const char *fmt, ...) {
+    char buf[64];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return str_from(vm, buf, n);
+}
+
+/* Calls built-in id with argc arguments at a. A function's result replaces a[0]; returns
+   the number of values left at a. Errors are left in vm->msg. */
+static int vm_builtin(Vm *vm, int id, int argc, Slot *a) {
+    QbStr *s = a[0].s, *r = NULL;
+    double x = a[0].n;
+    char buf[MAX_PATH + 8];
+    int n, len;
+    SYSTEMTIME st;
+    switch (id) {
+    case BI_LEN:
+        len = SLEN(s);
+        str_release(s);
+        a[0].n = len;
+        return 1;
+    case BI_LEFT: case BI_RIGHT: case BI_MID: {
+        int start = 0;
+        len = SLEN(s);
+        if (id == BI_MID) {
+            start = to_int(a[1].n) - 1;
+            n = argc == 3 ? to_int(a[2].n) : len;
+            if (start < 0) { vm->msg = "Illegal function call"; return 1; }
+        } else n = to_int(a[1].n);
+        if (n < 0) { vm->msg = "Illegal function call"; return 1; }
+        if (start >= len) n = 0;
+        else if (n > len - start) n = len - start;
+        if (id == BI_RIGHT) start = len - n;
+        if (n == len) return 1;
+        a[0].s = str_from(vm, SDATA(s) + start, n);
+        str_release(s);
+        return 1;
+    }
+    case BI_INSTR: {
+        int start = 1, found = 0;
+        QbStr *h = a[0].s, *t = a[1].s;
+        if (argc == 3) { start = to_int(a[0].n); h = a[1].s; t = a[2].s; }
+        int hl = SLEN(h), tl = SLEN(t);
+        if (start < 1) vm->msg = "Illegal function call";
+        else if (tl == 0) found = start <= hl ? start : 0;
+        else {
+            const char *hp = SDATA(h), *tp = SDATA(t), *q = hp + start - 1, *last = hp + hl - tl;
+            while (q <= last && (q = (const char*)memchr(q, tp[0], last - q + 1)) != NULL) {
+                if (memcmp(q, tp, tl) == 0) { found = (int)(q - hp) + 1; break; }
+                q++;
+            }
+        }
+        str_release(h); str_release(t);
+        a[0].n = found;
+        return 1;
+    }
+    case BI_UCASE: case BI_LCASE:
+        if ((s = str_own(vm, s)) != NULL) {
+            for (int i = 0; i < s->len; ++i) {
+                char ch = s->data[i];
+                if (id == BI_UCASE && ch >= 'a' && ch <= 'z') s->data[i] = (char)(ch - 32);
+                else if (id == BI_LCASE && ch >= 'A' && ch <= 'Z') s->data[i] = (char)(ch + 32);
+            }
+        }
+        a[0].s = s;
+        return 1;
+    case BI_LTRIM: case BI_RTRIM: {
+        int b = 0, e = SLEN(s);
+        if (id == BI_LTRIM) while (b < e && s->data[b] == ' ') b++;
+        else while (e > 0 && s->data[e - 1] == ' ') e--;
+        if (b == 0 && e == SLEN(s)) return 1;
+        a[0].s = str_from(vm, SDATA(s) + b, e - b);
+        str_release(s);
+        return 1;
+    }
+    case BI_STR:
+        buf[0] = ' ';
+        n = fmt_num(x, buf + 1);
+        a[0].s = x < 0 ? str_from(vm, buf + 1, n) : str_from(vm, buf, n + 1);
+        return 1;
+    case BI_VAL:
+        a[0].n = parse_val(SDATA(s), SLEN(s));
+        str_release(s);
+        return 1;
+    case BI_CHR:
+        n = to_int(x);
+        if (n < 0 || n > 255) { vm->msg = "Illegal function call"; return 1; }
+        buf[0] = (char)n;
+        a[0].s = str_from(vm, buf, 1);
+        return 1;
+    case BI_ASC:
+        n = SLEN(s) ? (unsigned char)s->data[0] : -1;
+        str_release(s);
+        if (n < 0) vm->msg = "Illegal function call";
+        a[0].n = n;
+        return 1;
+    case BI_SPACE: case BI_STRING: case BI_STRINGS: {
+        int ch = ' ';
+        n = to_int(x);
+        if (id == BI_STRING) ch = to_int(a[1].n);
+        else if (id == BI_STRINGS) {
+            ch = SLEN(a[1].s) ? (unsigned char)a[1].s->data[0] : -1;
+            str_release(a[1].s);
+        }
+        a[0].s = NULL;
+        if (n < 0 || ch < 0 || ch > 255) vm->msg = "Illegal function call";
+        else if ((r = str_new(vm, n)) != NULL) memset(r->data, ch, n), a[0].s = r;
+        return 1;
+    }
+    case BI_HEX:
+        a[0].s = str_printf(vm, "%X", (unsigned int)to_int(x));
+        return 1;
+    case BI_ABS: a[0].n = fabs(x); return 1;
+    case BI_INT: a[0].n = floor(x); return 1;
+    case BI_FIX: a[0].n = x < 0 ? ceil(x) : floor(x); return 1;
+    case BI_SGN: a[0].n = (x > 0) - (x < 0); return 1;
+    case BI_SQR:
+        if (x < 0) vm->msg = "Illegal function call";
+        else a[0].n = sqrt(x);
+        return 1;
+    case BI_SIN: a[0].n = sin(x); return 1;
+    case BI_COS: a[0].n = cos(x); return 1;
+    case BI_TAN: a[0].n = tan(x); return 1;
+    case BI_ATN: a[0].n = atan(x); return 1;
+    case BI_EXP:
+        a[0].n = exp(x);
+        if (x > 709) vm->msg = "Overflow";
+        return 1;
+    case BI_LOG:
+        if (x <= 0) vm->msg = "Illegal function call";
+        else a[0].n = log(x);
+        return 1;
+    case BI_CINT:
+        if (x < -32768.5 || x >= 32767.5) vm->msg = "Overflow";
+        else a[0].n = round_even(x);
+        return 1;
+    case BI_CLNG:
+        if (x < -2147483648.5 || x >= 2147483647.5) vm->msg = "Overflow";
+        else a[0].n = round_even(x);
+        return 1;
+    case BI_RND:
+        if (argc && x < 0) vm->seed = seed_from(x);
+        a[0].n = (argc && x == 0) ? vm->last_rnd : next_rnd(vm);
+        return 1;
+    case BI_TIMER:
+        GetLocalTime(&st);
+        a[0].n = st.wHour * 3600.0 + st.wMinute * 60.0 + st.wSecond + st.wMilliseconds / 1000.0;
+        return 1;
+    case BI_DATE:
+        GetLocalTime(&st);
+        a[0].s = str_printf(vm, "%02u-%02u-%04u", st.wMonth, st.wDay, st.wYear);
+        return 1;
+    case BI_TIME:
+        GetLocalTime(&st);
+        a[0].s = str_printf(vm, "%02u:%02u:%02u", st.wHour, st.wMinute, st.wSecond);
+        return 1;
+    case BI_ENVIRON: {
+        char *v = (char*)malloc(32768);
+        DWORD got = (v && SLEN(s)) ? GetEnvironmentVariableA(s->data, v, 32768) : 0;
+        a[0].s = got < 32768 ? str_from(vm, v, (int)got) : NULL;
+        free(v);
+        str_release(s);
+        return 1;
+    }
+    case BI_COMMAND:
+        a[0].s = str_from(vm, vm->command, (int)strlen(vm->command));
+        return 1;
+    case BI_EOF: {
+        QbFile *f = file_get(vm, x, 0);
+        a[0].n = (f && !f->line.valid && !file_more(f)) ? -1 : 0;
+        return 1;
+    }
+    case BI_LOF: {
+        QbFile *f = file_get(vm, x, -1);
+        LARGE_INTEGER size;
+        a[0].n = 0;
+        if (f && GetFileSizeEx(f->h, &size)) a[0].n = (double)size.QuadPart + (f->mode ? f->len : 0);
+        return 1;
+    }
+    case BI_FREEFILE:
+        for (n = 1; n <= QB_FILES && vm->files[n]; ++n) {}
+        if (n > QB_FILES) vm->msg = "Too many files";
+        a[0].n = n;
+        return 1;
+    case BI_DIR:
+        a[0].s = dir_next(vm, argc, argc ? s : NULL);
+        if (argc) str_release(s);
+        return 1;
+    case BI_CURDIR:
+        n = (int)GetCurrentDirectoryA(MAX_PATH, buf);
+        a[0].s = (n > 0 && n < MAX_PATH) ? str_from(vm, buf, n) : NULL;
+        return 1;
+    case BI_MATCH: {
+        /* MATCH(name$, pattern$): "/regex/" or a DOS wildcard */
+        QbStr *pat = a[1].s;
+        const char *pp = SDATA(pat);
+        int pl = SLEN(pat), hit;
+        if (pl >= 2 && pp[0] == '/' && pp[pl - 1] == '/') {
+            char *re = (char*)malloc(pl - 1);
+            hit = re && (memcpy(re, pp + 1, pl - 2), re[pl - 2] = 0, regex_match(re, SDATA(s)));
+            free(re);
+        } else hit = glob_match(pp, SDATA(s));
+        str_release(s); str_release(pat);
+        a[0].n = hit ? -1 : 0;
+        return 1;
+    }
+    case BI_FILELEN: {
+        WIN32_FILE_ATTRIBUTE_DATA fa;
+        if (SLEN(s) && GetFileAttributesExA(s->data, GetFileExInfoStandard, &fa))
+            a[0].n = (double)(((unsigned long long)fa.nFileSizeHigh << 32) | fa.nFileSizeLow);
+        else { a[0].n = 0; vm->msg = SLEN(s) ? file_error(GetLastError()) : "Bad file name"; }
+        str_release(s);
+        return 1;
+    }
+    case BI_GETATTR: {
+        DWORD at = SLEN(s) ? GetFileAttributesA(s->data) : INVALID_FILE_ATTRIBUTES;
+        if (at == INVALID_FILE_ATTRIBUTES) vm->msg = SLEN(s) ? file_error(GetLastError()) : "Bad file name";
+        str_release(s);
+        a[0].n = at & 0xFFFF;
+        return 1;
+    }
+
+    case BI_CLS:
+        con_flush(vm);
+        if (vm->host->clear) vm->host->clear(vm->host->ctx);
+        vm->col = 0;
+        return 0;
+    case BI_RANDOMIZE:
+        vm->seed = argc ? seed_from(x) : (GetTickCount() * 2654435761u) | 1;
+        return 0;
+    case BI_SLEEP: {
+        DWORD until = GetTickCount() + (DWORD)(x > 0 ? (x < 86400 ? x : 86400) * 1000 : 0);
+        while ((int)(until - GetTickCount()) > 0 && !vm_interrupted(vm)) Sleep(50);
+        if (vm->broke) vm->msg = "Break";
+        return 0;
+    }
+    case BI_KILL: fs_kill(vm, s); str_release(s); return 0;
+    case BI_NAME:
+        if (!SLEN(s) || !SLEN(a[1].s)) vm->msg = "Bad file name";
+        else fs_check(vm, MoveFileExA(s->data, a[1].s->data, 0));
+        str_release(s); str_release(a[1].s);
+        return 0;
+    case BI_MKDIR: case BI_RMDIR: case BI_CHDIR:
+        if (!SLEN(s)) vm->msg = "Bad file name";
+        else fs_check(vm, id == BI_MKDIR ? CreateDirectoryA(s->data, NULL) : id == BI_RMDIR ? RemoveDirectoryA(s->data) : SetCurrentDirectoryA(s->data));
+        str_release(s);
+        return 0;
+    case BI_FILECOPY: fs_copy(vm, s, a[1].s); str_release(s); str_release(a[1].s); return 0;
+    case BI_ATTRIB: fs_attrib(vm, s, a[1].s); str_release(s); str_release(a[1].s); return 0;
+    }
+    vm->msg = "Illegal function call";
+    return 0;
+}
+
+/* ---- interpreter ---- */
+
+static int line_of(const QbProgram *p, int pc) {
+    int lo = 0, hi = p->nlines - 1, line = 0;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (p->linepc[mid] <= pc) { line = p->lineno[mid]; lo = mid + 1; }
+        else hi = mid - 1;
+    }
+    return line;
+}
+
+/* Releases a returning call's locals; from is 1 for a FUNCTION, whose result moves to the stack */
+static void frame_release(const Proc *pr, Slot *l, int from) {
+    for (int i = from; i < pr->nlocals; ++i) {
+        if (pr->kinds[i] == K_STR) str_release(l[i].s);
+        else if (pr->kinds[i] == K_ARR) arr_free(l[i].a);
+    }
+}
+
+#define FAIL(m)  do { vm->msg = (m); goto fail; } while (0)
+#define CHECK()  do { if (vm->msg) goto fail; } while (0)
+#define POLL()   do { if (--poll == 0) { poll = QB_POLL; if (vm_interrupted(vm)) FAIL("Break"); } } while (0)
+#define TRUTH(x) ((x) ? -1.0 : 0.0)
+
+/* Runs the program; returns -1 at END or the pc of the failing instruction */
+static int vm_exec(Vm *vm) {
+    const int *code = vm->p->code;
+    const double *nums = vm->p->nums;
+    QbStr *const *strs = vm->p->strs;
+    Slot *g = vm->globals, *l = vm->locals, *ltop = vm->locals;
+    Slot *sp = vm->stack - 1;
+    int pc = 0, poll = QB_POLL;
+    char buf[40];
+
+    for (;;) {
+        int op = code[pc++];
+        switch (op) {
+        case OP_END:
+            return -1;
+        case OP_PUSHN: (++sp)->n = nums[code[pc++]]; break;
+        case OP_PUSHS: (++sp)->s = strs[code[pc++]]; STR_RETAIN(sp->s); break;
+        case OP_LDG:   (++sp)->n = g[code[pc++]].n; break;
+        case OP_LDL:   (++sp)->n = l[code[pc++]].n; break;
+        case OP_STG:   g[code[pc++]].n = (sp--)->n; break;
+        case OP_STL:   l[code[pc++]].n = (sp--)->n; break;
+        case OP_LDGS:  (++sp)->s = g[code[pc++]].s; STR_RETAIN(sp->s); break;
+        case OP_LDLS:  (++sp)->s = l[code[pc++]].s; STR_RETAIN(sp->s); break;
+        case OP_STGS: case OP_STLS: {
+            Slot *v = (op == OP_STGS ? g : l) + code[pc++];
+            str_release(v->s);
+            v->s = (sp--)->s;
+            break;
+        }
+        case OP_APPG: case OP_APPL: {
+            Slot *v = (op == OP_APPG ? g : l) + code[pc++];
+            v->s = str_cat(vm, v->s, (sp--)->s);
+            CHECK();
+            break;
+        }
+
+        case OP_ALD: case OP_ALDS: case OP_AST: case OP_ASTS: {
+            int slot = code[pc++], fl = code[pc++], nd = fl >> 2, store = op == OP_AST || op == OP_ASTS;
+            Slot *arr = ((fl & 1) ? l : g) + slot;
+            Slot *e = arr_elem(vm, arr, sp - nd + 1 - store, nd, (fl >> 1) & 1);
+            if (!e) goto fail;
+            if (op == OP_ALD) { sp -= nd - 1; sp->n = e->n; }
+            else if (op == OP_ALDS) { sp -= nd - 1; sp->s = e->s; STR_RETAIN(sp->s); }
+            else if (op == OP_AST) { e->n = sp->n; sp -= nd + 1; }
+            else { str_release(e->s); e->s = sp->s; sp -= nd + 1; }
+            break;
+        }
+        case OP_DIM: {
+            int slot = code[pc++], fl = code[pc++], nd = fl >> 2;
+            Slot *arr = ((fl & 1) ? l : g) + slot;
+            QbArray *a = arr_new(vm, nd, sp - 2 * nd + 1, (fl >> 1) & 1);
+            if (!a) goto fail;
+            sp -= 2 * nd;
+            arr_free(arr->a);
+            arr->a = a;
+            break;
+        }
+        case OP_ERASE: {
+            int slot = code[pc++], fl = code[pc++];
+            Slot *arr = ((fl & 1) ? l : g) + slot;
+            arr_free(arr->a);
+            arr->a = NULL;
+            break;
+        }
+
+        case OP_ADD: sp[-1].n += sp[0].n; sp--; break;
+        case OP_SUB: sp[-1].n -= sp[0].n; sp--; break;
+        case OP_MUL: sp[-1].n *= sp[0].n; sp--; break;
+        case OP_DIV:
+            if (sp[0].n == 0) FAIL("Division by zero");
+            sp[-1].n /= sp[0].n;
+            sp--;
+            break;
+        case OP_IDIV: case OP_MOD: {
+            double a = round_even(sp[-1].n), b = round_even(sp[0].n);
+            if (b == 0) FAIL("Division by zero");
+            sp--;
+            sp->n = op == OP_IDIV ? (a / b < 0 ? ceil(a / b) : floor(a / b)) : fmod(a, b);
+            break;
+        }
+        case OP_POW:
+            if (sp[-1].n == 0 && sp[0].n < 0) FAIL("Division by zero");
+            sp[-1].n = pow(sp[-1].n, sp[0].n);
+            sp--;
+            break;
+        case OP_NEG: sp->n = -sp->n; break;
+        case OP_CINT: sp->n = round_even(sp->n); break;
+        case OP_CAT:
+            sp[-1].s = str_cat(vm, sp[-1].s, sp[0].s);
+            sp--;
+            CHECK();
+            break;
+
+        case OP_EQ: sp[-1].n = TRUTH(sp[-1].n == sp[0].n); sp--; break;
+        case OP_NE: sp[-1].n = TRUTH(sp[-1].n != sp[0].n); sp--; break;
+        case OP_LT: sp[-1].n = TRUTH(sp[-1].n < sp[0].n); sp--; break;
+        case OP_GT: sp[-1].n = TRUTH(sp[-1].n > sp[0].n); sp--; break;
+        case OP_LE: sp[-1].n = TRUTH(sp[-1].n <= sp[0].n); sp--; break;
+        case OP_GE: sp[-1].n = TRUTH(sp[-1].n >= sp[0].n); sp--; break;
+        case OP_SEQ: case OP_SNE: case OP_SLT: case OP_SGT: case OP_SLE: case OP_SGE: {
+            QbStr *a = sp[-1].s, *b = sp[0].s;
+            int r, t;
+            if (op == OP_SEQ || op == OP_SNE) r = SLEN(a) != SLEN(b) || memcmp(SDATA(a), SDATA(b), SLEN(a)) != 0;
+            else r = str_cmp(a, b);
+            switch (op) {
+            case OP_SEQ: t = r == 0; break;
+            case OP_SNE: t = r != 0; break;
+            case OP_SLT: t = r < 0; break;
+            case OP_SGT: t = r > 0; break;
+            case OP_SLE: t = r <= 0; break;
+            default:     t = r >= 0; break;
+            }
+            str_release(a);
+            str_release(b);
+            (--sp)->n = TRUTH(t);
+            break;
+        }
+        case OP_NOT: sp->n = ~to_int(sp->n); break;
+        case OP_AND: sp[-1].n = to_int(sp[-1].n) & to_int(sp[0].n); sp--; break;
+        case OP_OR:  sp[-1].n = to_int(sp[-1].n) | to_int(sp[0].n); sp--; break;
+        case OP_XOR: sp[-1].n = to_int(sp[-1].n) ^ to_int(sp[0].n); sp--; break;
+
+        case OP_JMP:
+            if (code[pc] < pc) POLL();
+            pc = code[pc];
+            break;
+        case OP_JZ: case OP_JNZ:
+            if (((sp--)->n == 0) == (op == OP_JZ)) {
+                if (code[pc] < pc) POLL();
+                pc = code[pc];
+            } else pc++;
+            break;
+        case OP_FORG: case OP_FORL: {
+            const Slot *b = op == OP_FORG ? g : l;
+            double v = b[code[pc]].n, lim = b[code[pc + 1]].n;
+            if (b[code[pc + 2]].n >= 0 ? v > lim : v < lim) pc = code[pc + 3];
+            else pc += 4;
+            break;
+        }
+        case OP_NEXTG: case OP_NEXTL: {
+            Slot *b = op == OP_NEXTG ? g : l;
+            double step = b[code[pc + 2]].n, lim = b[code[pc + 1]].n;
+            double v = b[code[pc]].n += step;
+            POLL();
+            if (step >= 0 ? v <= lim : v >= lim) pc = code[pc + 3];
+            else pc += 4;
+            break;
+        }
+
+        case OP_CALL: {
+            const Proc *pr = &vm->p->procs[code[pc]];
+            int np = pr->nparams;
+            if (vm->nframes == QB_FRAMES || ltop + pr->nlocals > vm->locals + QB_LOCALS || sp > vm->stack + QB_STACK - 256)
+                FAIL("Out of stack space");
+            POLL();
+            memset(ltop, 0, sizeof(Slot) * pr->nlocals);
+            memcpy(ltop + pr->is_func, sp - np + 1, sizeof(Slot) * np);
+            sp -= np;
+            Frame *f = &vm->frames[vm->nframes++];
+            f->ret = pc + 1; f->caller = l; f->base = ltop; f->proc = pr;
+            l = ltop;
+            ltop += pr->nlocals;
+            pc = pr->entry;
+            break;
+        }
+        case OP_RET: {
+            Frame *f = &vm->frames[--vm->nframes];
+            const Proc *pr = f->proc;
+            frame_release(pr, l, pr->is_func);
+            if (pr->is_func) *++sp = l[0];
+            ltop = l;
+            l = f->caller;
+            pc = f->ret;
+            break;
+        }
+        case OP_GOSUB:
+            if (vm->ngosubs == QB_GOSUBS) FAIL("Out of stack space");
+            POLL();
+            vm->gosubs[vm->ngosubs++] = pc + 1;
+            pc = code[pc];
+            break;
+        case OP_RETSUB:
+            if (vm->ngosubs == 0) FAIL("RETURN without GOSUB");
+            pc = vm->gosubs[--vm->ngosubs];
+            break;
+
+        case OP_BI: {
+            int id = code[pc], argc = code[pc + 1];
+            Slot *a = sp - argc + 1;
+            pc += 2;
+            sp = a + vm_builtin(vm, id, argc, a) - 1;
+            CHECK();
+            break;
+        }
+
+        case OP_PRN: {
+            double v = (sp--)->n;
+            buf[0] = ' ';
+            int n = fmt_num(v, buf + 1);
+            buf[n + 1] = ' ';
+            if (v < 0) out_text(vm, buf + 1, n + 1);
+            else out_text(vm, buf, n + 2);
+            CHECK();
+            break;
+        }
+        case OP_PRS:
+            out_text(vm, SDATA(sp->s), SLEN(sp->s));
+            str_release((sp--)->s);
+            CHECK();
+            break;
+        case OP_PRTAB: {
+            int col = out_col(vm);
+            out_spaces(vm, (col / QB_ZONE + 1) * QB_ZONE - col);
+            CHECK();
+            break;
+        }
+        case OP_PRNL: out_newline(vm); CHECK(); break;
+        case OP_PRCOL: {
+            int to = to_int((sp--)->n) - 1;
+            if (to < out_col(vm)) out_newline(vm);
+            out_spaces(vm, to - out_col(vm));
+            CHECK();
+            break;
+        }
+        case OP_PRSPC: out_spaces(vm, to_int((sp--)->n)); CHECK(); break;
+        case OP_WRN: {
+            int n = fmt_num((sp--)->n, buf);
+            out_text(vm, buf, n);
+            CHECK();
+            break;
+        }
+        case OP_WRS:
+            out_text(vm, "\"", 1);
+            out_text(vm, SDATA(sp->s), SLEN(sp->s));
+            out_text(vm, "\"", 1);
+            str_release((sp--)->s);
+            CHECK();
+            break;
+        case OP_WRSEP: out_text(vm, ",", 1); CHECK(); break;
+        case OP_OUT:
+            if ((vm->out = file_get(vm, (sp--)->n, 1)) == NULL) goto fail;
+            break;
+        case OP_OUTCON: vm->out = NULL; break;
+
+        case OP_READ:
+            if (code[pc++]) {
+                if ((vm->in_file = file_get(vm, (sp--)->n, 0)) == NULL) goto fail;
+            } else {
+                vm->in_file = NULL;
+                if (!read_console(vm)) goto fail;
+            }
+            break;
+        case OP_FIELDN: case OP_FIELDS: {
+            const char *f;
+            int n;
+            if (!next_field(vm, &f, &n)) goto fail;
+            if (op == OP_FIELDN) (++sp)->n = parse_val(f, n);
+            else (++sp)->s = str_from(vm, f, n);
+            CHECK();
+            break;
+        }
+        case OP_LINE:
+            (++sp)->s = read_whole_line(vm);
+            CHECK();
+            break;
+        case OP_OPEN:
+            file_open(vm, sp[-1].s, sp[0].n, code[pc++]);
+            str_release(sp[-1].s);
+            sp -= 2;
+            CHECK();
+            break;
+        case OP_CLOSE: {
+            int n = code[pc++];
+            if (n == 0) for (int k = 1; k <= QB_FILES; ++k) file_close(vm, k);
+            for (; n > 0; --n) file_close(vm, to_int((sp--)->n));
+            CHECK();
+            break;
+        }
+        default:
+            FAIL("Internal error");
+        }
+    }
+fail:
+    return pc - 1;
+}
+
+int qb_run(QbProgram *p, const char *command, const QbHost *host, char *err, size_t errlen) {
+    Vm *vm = (Vm*)calloc(1, sizeof(Vm));
+    Slot *globals = (Slot*)calloc(p->nglobals ? p->nglobals : 1, sizeof(Slot));
+    Slot *locals = (Slot*)malloc(sizeof(Slot) * QB_LOCALS);
+    if (!vm || !globals || !locals) {
+        free(vm); free(globals); free(locals);
+        snprintf(err, errlen, "Out of memory");
+        return 1;
+    }
+    vm->p = p;
+    vm->host = host;
+    vm->command = command ? command : "";
+    vm->globals = globals;
+    vm->locals = locals;
+    vm->live.prev = vm->live.next = &vm->live;
+    vm->dir_h = INVALID_HANDLE_VALUE;
+    vm->seed = 0x2545F491u;
+
+    int at = vm_exec(vm);
+
+    for (int k = 1; k <= QB_FILES; ++k) {
+        const char *msg = vm->msg;
+        file_close(vm, k);
+        if (msg) vm->msg = msg;           /* keep the first error */
+    }
+    con_flush(vm);
+    if (vm->dir_h != INVALID_HANDLE_VALUE) FindClose(vm->dir_h);
+    if (vm->msg) snprintf(err, errlen, "%s in line %d", vm->msg, line_of(p, at >= 0 ? at : p->ncode - 1));
+    else if (err && errlen) err[0] = 0;
+    int failed = vm->msg != NULL;
+
+    /* arrays of the module and of calls still active after an error; every string this
+       run made is on the live list and is swept afterwards */
+    for (int i = 0; i < p->nglobals; ++i) if (p->gkinds[i] == K_ARR) free(globals[i].a);
+    for (int f = 0; f < vm->nframes; ++f) {
+        const Proc *pr = vm->frames[f].proc;
+        for (int i = 0; i < pr->nlocals; ++i) if (pr->kinds[i] == K_ARR) free(vm->frames[f].base[i].a);
+    }
+    for (QbStr *s = vm->live.next, *next; s != &vm->live; s = next) {
+        next = s->next;
+        free(s);
+    }
+    free(vm->con.buf);
+    free(globals);
+    free(locals);
+    free(vm);
+    return failed;
+}
@@ -0,0 +1,34 @@
+// qbasic.h - QBasic subset compiler and bytecode interpreter for the "MS-DOS QBasic" item
+#ifndef QBASIC_H
+#define QBASIC_H
+
+#include <windows.h>
+
+typedef struct QbProgram QbProgram;
+
+typedef struct {
+    void *ctx;
+    /* PRINT/WRITE to the screen (CP437 text, '\n' ends a line) */
+    void (*write)(void *ctx, const char *text, int len);
+    /* INPUT/LINE INPUT from the keyboard, without the line break. 0 when input is closed. */
+    int (*read_line)(void *ctx, char *buf, int len);
+    /* Polled while the program runs; nonzero stops it with "Break". May be NULL. */
+    int (*interrupted)(void *ctx);
+    /* CLS. May be NULL. */
+    void (*clear)(void *ctx);
+} QbHost;
+
+/* Compiles source text to bytecode. On a syntax error returns NULL and describes it, with
+   the line number, in err. */
+QbProgram *qb_compile(const char *src, size_t len, char *err, size_t errlen);
+
+/* Reads and compiles a .BAS file. */
+QbProgram *qb_compile_file(const char *path, char *err, size_t errlen);
+
+/* Runs a compiled program; command is what COMMAND$ returns. Returns 0 when the program
+   ended normally, otherwise nonzero with the runtime error and its line in err. */
+int qb_run(QbProgram *p, const char *command, const QbHost *host, char *err, size_t errlen);
+
+void qb_free(QbProgram *p);
+
+#endif
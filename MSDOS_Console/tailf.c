@@ -0,0 +1,200 @@
+// tailf.c - Follows a growing file (tail -f) for the file manager's follow view (Windows, C)
+//
+// The file stays open with full sharing, so the writer can keep appending, truncate it or
+// rename it away. Each update reads from the last offset to the current end and no further
+// back than the ring can hold: the last max_lines lines never span more than
+// max_lines * TAIL_LINE_MAX stored bytes, so anything before that window is skipped with
+// a seek. Rotation is noticed by the path naming a file with another volume serial and
+// file index (the Windows counterpart of an inode change); the old file is read to its end
+// first, then following continues at the start of the new one.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tailf.h"
+
+#define READ_CHUNK (64 * 1024)
+
+struct TailFollow {
+    char path[MAX_PATH];
+    HANDLE file;
+    BY_HANDLE_FILE_INFORMATION id;
+    unsigned long long offset;   /* bytes of the current file already read */
+    HANDLE change;               /* folder change notification, or NULL */
+    int max_lines;
+    char *text;                  /* max_lines slots of TAIL_LINE_MAX bytes; line n in slot n % max_lines */
+    int *len;
+    long long first, next;       /* oldest complete line kept; the line being written */
+    int resync;                  /* after a skip: drop text up to the next line break */
+    char buf[READ_CHUNK];
+};
+
+static HANDLE open_shared(const char *path) {
+    return CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static int same_file(const BY_HANDLE_FILE_INFORMATION *a, const BY_HANDLE_FILE_INFORMATION *b) {
+    return a->dwVolumeSerialNumber == b->dwVolumeSerialNumber &&
+           a->nFileIndexHigh == b->nFileIndexHigh && a->nFileIndexLow == b->nFileIndexLow;
+}
+
+static int *slot_len(TailFollow *t, long long n) { return &t->len[n % t->max_lines]; }
+static char *slot_text(TailFollow *t, long long n) { return t->text + (size_t)(n % t->max_lines) * TAIL_LINE_MAX; }
+
+/* Ends the line being written; the oldest line falls out once the ring is full */
+static void end_line(TailFollow *t) {
+    int *l = slot_len(t, t->next);
+    if (*l > 0 && slot_text(t, t->next)[*l - 1] == '\r') (*l)--;
+    t->next++;
+    *slot_len(t, t->next) = 0;
+    if (t->next - t->first > t->max_lines - 1) t->first = t->next - (t->max_lines - 1);
+}
+
+
+static void feed(TailFollow *t, const char *p, size_t n) {
+    const char *end = p + n;
+    while (p < end) {
+        const char *nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+        size_t seg = (size_t)((nl ? nl : end) - p);
+        if (t->resync) {
+            if (nl) t->resync = 0;
+        } else {
+            int *l = slot_len(t, t->next);
+            size_t room = (size_t)(TAIL_LINE_MAX - *l);
+            if (seg > room) seg = room;
+            memcpy(slot_text(t, t->next) + *l, p, seg);
+            *l += (int)seg;
+            if (nl) end_line(t);
+        }
+        p = nl ? nl + 1 : end;
+    }
+}
+
+/* Reads from the last offset to the current end of the file; returns TAIL_APPENDED and
+   TAIL_SKIPPED flags */
+static int read_appended(TailFollow *t) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(t->file, &size) || (unsigned long long)size.QuadPart <= t->offset) return 0;
+    unsigned long long end = (unsigned long long)size.QuadPart;
+    int ev = 0;
+    unsigned long long window = (unsigned long long)t->max_lines * TAIL_LINE_MAX;
+    if (end - t->offset > window) {
+        /* everything before the window would be pushed out of the ring anyway */
+        t->offset = end - window;
+        *slot_len(t, t->next) = 0;
+        t->first = t->next;
+        t->resync = 1;
+        ev |= TAIL_SKIPPED;
+    }
+    LARGE_INTEGER pos;
+    pos.QuadPart = (LONGLONG)t->offset;
+    if (!SetFilePointerEx(t->file, pos, NULL, FILE_BEGIN)) return ev;
+    while (t->offset < end) {
+        DWORD want = (DWORD)((end - t->offset < READ_CHUNK) ? end - t->offset : READ_CHUNK);
+        DWORD got = 0;
+        if (!ReadFile(t->file, t->buf, want, &got, NULL) || got == 0) break;
+        feed(t, t->buf, got);
+        t->offset += got;
+        ev |= TAIL_APPENDED;
+    }
+    return ev;
+}
+
+/* Where the file was truncated or replaced, a marker line goes into the ring */
+static void mark_break(TailFollow *t, const char *what) {
+    if (*slot_len(t, t->next) > 0) end_line(t);
+    feed(t, what, strlen(what));
+}
+
+TailFollow *tail_open(const char *path, int max_lines, char *err, size_t errlen) {
+    if (max_lines < 2) max_lines = 2;
+    TailFollow *t = (TailFollow*)calloc(1, sizeof(TailFollow));
+    if (t) {
+        t->text = (char*)malloc((size_t)max_lines * TAIL_LINE_MAX);
+        t->len = (int*)calloc((size_t)max_lines, sizeof(int));
+    }
+    if (!t || !t->text || !t->len) {
+        if (t) { free(t->text); free(t->len); free(t); }
+        snprintf(err, errlen, "Out of memory");
+        return NULL;
+    }
+    strncpy_s(t->path, MAX_PATH, path, _TRUNCATE);
+    t->max_lines = max_lines;
+    t->file = open_shared(path);
+    if (t->file == INVALID_HANDLE_VALUE || !GetFileInformationByHandle(t->file, &t->id)) {
+        if (t->file != INVALID_HANDLE_VALUE) CloseHandle(t->file);
+        free(t->text); free(t->len); free(t);
+        snprintf(err, errlen, "Cannot open %s", path);
+        return NULL;
+    }
+
+    /* size changes are reported for the folder, not the file */
+    char dir[MAX_PATH];
+    strncpy_s(dir, MAX_PATH, path, _TRUNCATE);
+    char *slash = strrchr(dir, '\\');
+    if (!slash) strcpy_s(dir, MAX_PATH, ".");
+    else if (slash == dir || slash[-1] == ':') slash[1] = 0;
+    else *slash = 0;
+    t->change = FindFirstChangeNotificationA(dir, FALSE, FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (t->change == INVALID_HANDLE_VALUE) t->change = NULL;
+
+    read_appended(t);
+    return t;
+}
+
+HANDLE tail_handle(const TailFollow *t) {
+    return t->change;
+}
+
+int tail_update(TailFollow *t) {
+    int ev = 0;
+    if (t->change) FindNextChangeNotification(t->change);
+
+    HANDLE h = open_shared(t->path);
+    if (h != INVALID_HANDLE_VALUE) {
+        BY_HANDLE_FILE_INFORMATION fi;
+        if (GetFileInformationByHandle(h, &fi) && !same_file(&fi, &t->id)) {
+            /* rotated: the writer may have added to the old file before moving on */
+            ev |= read_appended(t);
+            mark_break(t, "--- file replaced ---\n");
+            CloseHandle(t->file);
+            t->file = h;
+            t->id = fi;
+            t->offset = 0;
+            t->resync = 0;
+            h = INVALID_HANDLE_VALUE;
+            ev |= TAIL_ROTATED;
+        }
+        if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
+    }
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(t->file, &size) && (unsigned long long)size.QuadPart < t->offset) {
+        mark_break(t, "--- file truncated ---\n");
+        t->offset = 0;
+        t->resync = 0;
+        ev |= TAIL_TRUNCATED;
+    }
+    return ev | read_appended(t);
+}
+
+long long tail_first(const TailFollow *t) { return t->first; }
+long long tail_end(const TailFollow *t) { return t->next; }
+
+const char *tail_line(const TailFollow *t, long long n, int *len) {
+    if (n < t->first || n > t->next) { *len = 0; return ""; }
+    *len = t->len[n % t->max_lines];
+    return t->text + (size_t)(n % t->max_lines) * TAIL_LINE_MAX;
+}
+
+void tail_close(TailFollow *t) {
+    if (!t) return;
+    if (t->change) FindCloseChangeNotification(t->change);
+    CloseHandle(t->file);
+    free(t->text);
+    free(t->len);
+    free(t);
+}
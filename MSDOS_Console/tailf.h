@@ -0,0 +1,44 @@
+// tailf.h - Follows a growing file (tail -f): appended lines land in a fixed ring buffer
+#ifndef TAILF_H
+#define TAILF_H
+
+#include <windows.h>
+
+/* Longer lines keep their first TAIL_LINE_MAX bytes */
+#define TAIL_LINE_MAX 512
+
+typedef struct TailFollow TailFollow;
+
+/* What tail_update found */
+enum {
+    TAIL_APPENDED = 1,           /* new text arrived */
+    TAIL_TRUNCATED = 2,          /* the file got shorter; reading starts over at offset 0 */
+    TAIL_ROTATED = 4,            /* the path names a different file now (log rotation) */
+    TAIL_SKIPPED = 8             /* more arrived than the ring holds; the line being written restarted */
+};
+
+/* Opens path and reads its last lines. The ring holds max_lines lines: the last
+   max_lines-1 complete ones plus the line still being written. NULL and a message in err
+   on failure. */
+TailFollow *tail_open(const char *path, int max_lines, char *err, size_t errlen);
+
+/* Signalled when something changes in the folder holding the file; wait on it together with
+   other handles, then call tail_update. NULL when the folder cannot be watched. */
+HANDLE tail_handle(const TailFollow *t);
+
+/* Rearms the change notification and reads only what was appended since the last call.
+   When more was appended than the ring can hold, the older part is skipped unread, so the
+   cost per call is bounded by the ring size however fast the file grows. A truncation or
+   rotation puts a "--- file truncated ---" or "--- file replaced ---" line into the ring at
+   the point where it happened. Returns TAIL_* flags. */
+int tail_update(TailFollow *t);
+
+/* Complete lines are numbered from 0 in the order they were read; lines tail_first to
+   tail_end-1 are still in the ring. The line being written is number tail_end. */
+long long tail_first(const TailFollow *t);
+long long tail_end(const TailFollow *t);
+const char *tail_line(const TailFollow *t, long long n, int *len);
+
+void tail_close(TailFollow *t);
+
+#endif
@@ -0,0 +1,325 @@
+// vtout.c - VT/ANSI escape sequence output backend for the console renderer (Windows, C)
+//
+// The renderer builds a CHAR_INFO frame as before. Instead of WriteConsoleOutputA this
+// backend compares it with the previous frame and sends only the changed spans as text
+// plus escape sequences, so it works in any VT terminal (Windows Terminal, ConPTY, SSH)
+// and a redraw after a keypress costs a few dozen bytes rather than the whole screen.
+// Colors are set with SGR only when the attribute actually changes, cursor moves use the
+// shortest form, and each frame is assembled in one reusable buffer and written once,
+// wrapped in synchronized output mode when the terminal supports it.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vtout.h"
+
+#ifndef ENABLE_VIRTUAL_TERMINAL_INPUT
+#define ENABLE_VIRTUAL_TERMINAL_INPUT 0x0200
+#endif
+
+#define VT_GAP_FILL    4    /* unchanged cells re-sent rather than a cursor jump */
+#define VT_PROBE_MS    250  /* wait for the DECRQM reply */
+#define VT_NO_ATTR     0xFFFF
+#define VT_BLANK_ATTR  (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE)
+
+struct VtOut {
+    HANDLE out;
+    DWORD old_out_mode;
+    UINT old_cp;
+    int sync;                  /* terminal supports DEC mode 2026 */
+    int suspended;             /* console mode and code page are the caller's again */
+    CHAR_INFO *prev;           /* last frame sent */
+    BYTE *dirty;               /* rows overwritten outside vt_present */
+    int w, h;
+    char *buf;                 /* frame being assembled, reused */
+    size_t len, cap;
+    WORD attr;                 /* current SGR state, VT_NO_ATTR if unknown */
+    int cx, cy;                /* cursor position, -1 if unknown */
+    char glyph[256][4];        /* CP437 -> UTF-8 */
+    BYTE glyph_len[256];
+};
+
+static const WORD cp437_high[128] = {
+    0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+    0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+    0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+    0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+    0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+    0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+    0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+    0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+    0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+    0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+    0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0,
+};
+
+static void build_glyphs(VtOut *vt) {
+    for (int c = 0; c < 256; ++c) {
+        unsigned cp = (c < 32 || c == 127) ? ' ' : (c < 128) ? (unsigned)c : cp437_high[c - 128];
+        char *g = vt->glyph[c];
+        if (cp < 0x80) { g[0] = (char)cp; vt->glyph_len[c] = 1; }
+        else if (cp < 0x800) { g[0] = (char)(0xC0 | (cp >> 6)); g[1] = (char)(0x80 | (cp & 0x3F)); vt->glyph_len[c] = 2; }
+        else { g[0] = (char)(0xE0 | (cp >> 12)); g[1] = (char)(0x80 | ((cp >> 6) & 0x3F)); g[2] = (char)(0x80 | (cp & 0x3F)); vt->glyph_len[c] = 3; }
+    }
+}
+
+static int vt_reserve(VtOut *vt, size_t more) {
+    if (vt->len + more <= vt->cap) return 1;
+    size_t ncap = vt->cap ? vt->cap : 16384;
+    while (ncap < vt->len + more) ncap *= 2;
+    char *nb = (char*)realloc(vt->buf, ncap);
+    if (!nb) return 0;
+    vt->buf = nb; vt->cap = ncap;
+    return 1;
+}
+
+static void vt_put(VtOut *vt, const char *s, size_t n) {
+    if (!vt_reserve(vt, n)) return;
+    memcpy(vt->buf + vt->len, s, n);
+    vt->len += n;
+}
+
+#define VT_LIT(vt, s) vt_put((vt), (s), sizeof(s) - 1)
+
+static void vt_flush(VtOut *vt) {
+    size_t off = 0;
+    while (off < vt->len) {
+        DWORD wrote = 0;
+        if (!WriteFile(vt->out, vt->buf + off, (DWORD)(vt->len - off), &wrote, NULL) || wrote == 0) break;
+        off += wrote;
+    }
+    vt->len = 0;
+}
+
+/* Windows colour bits are BGR, ANSI colour numbers are RGB */
+static int ansi_color(int c) {
+    return ((c & 1) ? 4 : 0) | (c & 2) | ((c & 4) ? 1 : 0);
+}
+
+static void vt_sgr(VtOut *vt, WORD attr) {
+    attr &= 0xFF;
+    if (attr == vt->attr) return;
+    int fg = attr & 0x0F, bg = (attr >> 4) & 0x0F;
+    char seq[32];
+    int n;
+    if (vt->attr == VT_NO_ATTR) {
+        n = snprintf(seq, sizeof(seq), "\x1b[0;%d;%dm", ((fg & 8) ? 90 : 30) + ansi_color(fg), ((bg & 8) ? 100 : 40) + ansi_color(bg));
+    } else {
+        int ofg = vt->attr & 0x0F, obg = (vt->attr >> 4) & 0x0F;
+        if (fg != ofg && bg != obg) n = snprintf(seq, sizeof(seq), "\x1b[%d;%dm", ((fg & 8) ? 90 : 30) + ansi_color(fg), ((bg & 8) ? 100 : 40) + ansi_color(bg));
+        else if (fg != ofg) n = snprintf(seq, sizeof(seq), "\x1b[%dm", ((fg & 8) ? 90 : 30) + ansi_color(fg));
+        else n = snprintf(seq, sizeof(seq), "\x1b[%dm", ((bg & 8) ? 100 : 40) + ansi_color(bg));
+    }
+    vt_put(vt, seq, (size_t)n);
+    vt->attr = attr;
+}
+
+static void vt_move(VtOut *vt, int x, int y) {
+    if (vt->cy == y && vt->cx == x) return;
+    char seq[32];
+    int n;
+    if (vt->cy == y && vt->cx >= 0 && x > vt->cx) n = (x - vt->cx == 1) ? snprintf(seq, sizeof(seq), "\x1b[C") : snprintf(seq, sizeof(seq), "\x1b[%dC", x - vt->cx);
+    else if (x == 0) n = snprintf(seq, sizeof(seq), "\x1b[%dH", y + 1);
+    else n = snprintf(seq, sizeof(seq), "\x1b[%d;%dH", y + 1, x + 1);
+    vt_put(vt, seq, (size_t)n);
+    vt->cx = x; vt->cy = y;
+}
+
+static void vt_cells(VtOut *vt, const CHAR_INFO *cells, int x0, int x1, int y) {
+    vt_move(vt, x0, y);
+    for (int x = x0; x <= x1; ++x) {
+        vt_sgr(vt, cells[x].Attributes);
+        BYTE c = (BYTE)cells[x].Char.AsciiChar;
+        vt_put(vt, vt->glyph[c], vt->glyph_len[c]);
+    }
+    /* after the last column the cursor position is terminal dependent */
+    vt->cx = (x1 + 1 < vt->w) ? x1 + 1 : -1;
+}
+
+static int same_cell(const CHAR_INFO *a, const CHAR_INFO *b) {
+    return a->Char.AsciiChar == b->Char.AsciiChar && (a->Attributes & 0xFF) == (b->Attributes & 0xFF);
+}
+
+/* Ask the terminal whether it knows mode 2026 (DECRQM); the reply arrives as input */
+static int probe_sync(VtOut *vt, HANDLE in) {
+    char env[8];
+    if (GetEnvironmentVariableA("WCDOS_SYNC", env, sizeof(env)) > 0) return env[0] == '1';
+    DWORD in_mode = 0;
+    if (in == INVALID_HANDLE_VALUE || !GetConsoleMode(in, &in_mode)) return 0;
+    if (!SetConsoleMode(in, in_mode | ENABLE_VIRTUAL_TERMINAL_INPUT)) return 0;
+    VT_LIT(vt, "\x1b[?2026$p");
+    vt_flush(vt);
+    char reply[64];
+    int n = 0, done = 0;
+    ULONGLONG deadline = GetTickCount64() + VT_PROBE_MS;
+    while (!done) {
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline || WaitForSingleObject(in, (DWORD)(deadline - now)) != WAIT_OBJECT_0) break;
+        INPUT_RECORD ir;
+        DWORD read = 0;
+        if (!ReadConsoleInput(in, &ir, 1, &read) || read == 0) break;
+        if (ir.EventType != KEY_EVENT || !ir.Event.KeyEvent.bKeyDown) continue;
+        char c = ir.Event.KeyEvent.uChar.AsciiChar;
+        if (c == 0x1b) n = 0;
+        if (n < (int)sizeof(reply) - 1) reply[n++] = c;
+        if (c == 'y') done = 1;
+    }
+    reply[n] = 0;
+    SetConsoleMode(in, in_mode);
+    /* "ESC [ ? 2026 ; Ps $ y" with Ps 1..3 = recognised, 0 = unknown, 4 = permanently reset */
+    int ps = 0;
+    const char *p = strstr(reply, "[?2026;");
+    if (done && p) ps = atoi(p + 7);
+    return ps >= 1 && ps <= 3;
+}
+
+static BOOL vt_mode(HANDLE out, DWORD mode) {
+    return SetConsoleMode(out, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING | DISABLE_NEWLINE_AUTO_RETURN);
+}
+
+VtOut *vt_open(HANDLE out, HANDLE in) {
+    DWORD mode = 0;
+    if (out == INVALID_HANDLE_VALUE || !GetConsoleMode(out, &mode)) return NULL;
+    if (!vt_mode(out, mode)) return NULL;
+    VtOut *vt = (VtOut*)calloc(1, sizeof(VtOut));
+    if (!vt) { SetConsoleMode(out, mode); return NULL; }
+    vt->out = out;
+    vt->old_out_mode = mode;
+    vt->old_cp = GetConsoleOutputCP();
+    SetConsoleOutputCP(CP_UTF8);
+    vt->attr = VT_NO_ATTR;
+    vt->cx = vt->cy = -1;
+    build_glyphs(vt);
+    vt->sync = probe_sync(vt, in);
+    /* alternate screen, cursor hidden, autowrap off so the last column never scrolls */
+    VT_LIT(vt, "\x1b[?1049h\x1b[?25l\x1b[?7l");
+    vt_flush(vt);
+    return vt;
+}
+
+void vt_close(VtOut *vt) {
+    if (!vt) return;
+    if (!vt->suspended) {
+        VT_LIT(vt, "\x1b[0m\x1b[?7h\x1b[?25h\x1b[?1049l");
+        vt_flush(vt);
+    }
+    SetConsoleOutputCP(vt->old_cp);
+    SetConsoleMode(vt->out, vt->old_out_mode);
+    free(vt->prev);
+    free(vt->dirty);
+    free(vt->buf);
+    free(vt);
+}
+
+void vt_present(VtOut *vt, const CHAR_INFO *cells, int w, int h) {
+    int full = (w != vt->w || h != vt->h || !vt->prev);
+    if (full) {
+        CHAR_INFO *np = (CHAR_INFO*)realloc(vt->prev, sizeof(CHAR_INFO) * (size_t)w * h);
+        BYTE *nd = (BYTE*)realloc(vt->dirty, (size_t)h);
+        if (np) vt->prev = np;
+        if (nd) vt->dirty = nd;
+        if (!np || !nd) { free(vt->prev); vt->prev = NULL; vt->w = vt->h = 0; return; }
+        vt->w = w; vt->h = h;
+    }
+    vt->len = 0;
+    if (vt->sync) VT_LIT(vt, "\x1b[?2026h");
+    size_t start = vt->len;
+    if (full) {
+        /* clear to blanks in the default colours (erase uses the current background),
+           then diff against that so blank areas cost nothing */
+        vt->attr = VT_NO_ATTR;
+        vt_sgr(vt, VT_BLANK_ATTR);
+        VT_LIT(vt, "\x1b[2J");
+        vt->cx = vt->cy = -1;
+        for (size_t i = 0; i < (size_t)w * h; ++i) { vt->prev[i].Char.AsciiChar = ' '; vt->prev[i].Attributes = VT_BLANK_ATTR; }
+        memset(vt->dirty, 0, (size_t)h);
+    }
+    for (int y = 0; y < h; ++y) {
+        const CHAR_INFO *row = cells + (size_t)y * w;
+        const CHAR_INFO *old = vt->prev + (size_t)y * w;
+        int force = vt->dirty[y];
+        int x = 0;
+        while (x < w) {
+            if (!force && same_cell(&row[x], &old[x])) { x++; continue; }
+            /* a changed span; short unchanged gaps are cheaper to resend than to skip */
+            int last = x;
+            for (int k = x + 1; k < w && (force || k - last <= VT_GAP_FILL); ++k)
+                if (force || !same_cell(&row[k], &old[k])) last = k;
+            vt_cells(vt, row, x, last, y);
+            x = last + 1;
+        }
+        vt->dirty[y] = 0;
+    }
+    memcpy(vt->prev, cells, sizeof(CHAR_INFO) * (size_t)w * h);
+    if (vt->len == start) { vt->len = 0; return; }
+    if (vt->sync) VT_LIT(vt, "\x1b[?2026l");
+    vt_flush(vt);
+}
+
+void vt_text(VtOut *vt, int x, int y, const char *text, WORD attr) {
+    vt->len = 0;
+    vt_move(vt, x, y);
+    vt_sgr(vt, attr);
+    int n = 0;
+    for (const char *p = text; *p && (vt->w == 0 || x + n < vt->w); ++p, ++n) {
+        BYTE c = (BYTE)*p;
+        vt_put(vt, vt->glyph[c], vt->glyph_len[c]);
+    }
+    vt->cx = (vt->w == 0 || x + n < vt->w) ? x + n : -1;
+    if (y >= 0 && y < vt->h) vt->dirty[y] = 1;
+    vt_flush(vt);
+}
+
+void vt_suspend(VtOut *vt) {
+    vt->len = 0;
+    VT_LIT(vt, "\x1b[0m\x1b[?7h\x1b[?25h\x1b[?1049l");
+    vt_flush(vt);
+    vt->attr = VT_NO_ATTR;
+    vt->cx = vt->cy = -1;
+    /* programs run meanwhile expect bare \n to return the carriage and bytes in the
+       console's own code page */
+    SetConsoleOutputCP(vt->old_cp);
+    SetConsoleMode(vt->out, vt->old_out_mode);
+    vt->suspended = 1;
+}
+
+void vt_resume(VtOut *vt) {
+    if (!vt->suspended) return;
+    vt->suspended = 0;
+    DWORD mode = vt->old_out_mode;
+    GetConsoleMode(vt->out, &mode);     /* a program may have changed it */
+    vt_mode(vt->out, mode);
+    SetConsoleOutputCP(CP_UTF8);
+    vt->len = 0;
+    VT_LIT(vt, "\x1b[?1049h\x1b[?25l\x1b[?7l");
+    vt_flush(vt);
+    /* the screen content is unknown now: the next vt_present repaints everything */
+    free(vt->prev);
+    vt->prev = NULL;
+    vt->w = vt->h = 0;
+}
+
+/* While suspended the console is back in the caller's mode and code page, so text goes
+   through the plain console API like any other program's output */
+void vt_clear(VtOut *vt) {
+    CONSOLE_SCREEN_BUFFER_INFO sbi;
+    COORD home = { 0, 0 };
+    DWORD written;
+    if (!GetConsoleScreenBufferInfo(vt->out, &sbi)) return;
+    DWORD cells = (DWORD)sbi.dwSize.X * sbi.dwSize.Y;
+    FillConsoleOutputCharacterA(vt->out, ' ', cells, home, &written);
+    FillConsoleOutputAttribute(vt->out, sbi.wAttributes, cells, home, &written);
+    SetConsoleCursorPosition(vt->out, home);
+}
+
+void vt_write(VtOut *vt, const char *text, int len) {
+    DWORD written;
+    WriteConsoleA(vt->out, text, (DWORD)len, &written, NULL);
+}
@@ -0,0 +1,40 @@
+// vtout.h - VT/ANSI escape sequence output backend for the console renderer
+#ifndef VTOUT_H
+#define VTOUT_H
+
+#include <windows.h>
+
+typedef struct VtOut VtOut;
+
+/* Switches the console to VT processing with UTF-8 output, enters the alternate screen and
+   probes for synchronized output (DEC mode 2026). Returns NULL if VT output is unavailable.
+   WCDOS_SYNC=0/1 skips the probe and forces synchronized output off or on. */
+VtOut *vt_open(HANDLE out, HANDLE in);
+
+/* Leaves the alternate screen and restores the console modes and code page. */
+void vt_close(VtOut *vt);
+
+/* Writes a frame of CP437 cells. Only cells that changed since the previous frame are sent,
+   attribute changes are coalesced into minimal SGR sequences and the whole frame goes out
+   in one write. A size change repaints everything. */
+void vt_present(VtOut *vt, const CHAR_INFO *cells, int w, int h);
+
+/* Writes text directly at x,y (prompts drawn outside a frame); the row is repainted by the
+   next vt_present. */
+void vt_text(VtOut *vt, int x, int y, const char *text, WORD attr);
+
+/* Hands the terminal to a program that writes plain text: the normal screen with cursor and
+   line wrapping, and the console mode and code page it had before vt_open, so bare '\n'
+   returns the carriage and bytes are read in the console's code page. vt_resume takes it
+   back and makes the next frame a full repaint. */
+void vt_suspend(VtOut *vt);
+void vt_resume(VtOut *vt);
+
+/* Writes text in the console's code page at the cursor while suspended; '\n' starts a new
+   line. */
+void vt_write(VtOut *vt, const char *text, int len);
+
+/* Clears the screen and homes the cursor while suspended (CLS). */
+void vt_clear(VtOut *vt);
+
+#endif